@@ -69,4 +69,9 @@
 /* Instruct lower device to use last 4-bytes of skb data as FCS */
 #define SO_NOFCS		43
 
+#define SO_BUSY_POLL		44
+
+#define SO_ATTACH_BPF		45
+#define SO_DETACH_BPF		SO_DETACH_FILTER
+
 #endif /* __ASM_AVR32_SOCKET_H */
@@ -68,6 +68,11 @@
 /* Instruct lower device to use last 4-bytes of skb data as FCS */
 #define SO_NOFCS		0x4024
 
+#define SO_BUSY_POLL		0x4025
+
+#define SO_ATTACH_BPF		0x4026
+#define SO_DETACH_BPF		SO_DETACH_FILTER
+
 
 /* O_NONBLOCK clashes with the bits used for socket types.  Therefore we
  * have to define SOCK_NONBLOCK to a different value here.
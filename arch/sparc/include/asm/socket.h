@@ -65,6 +65,11 @@
 /* Instruct lower device to use last 4-bytes of skb data as FCS */
 #define SO_NOFCS		0x0027
 
+#define SO_BUSY_POLL		0x0028
+
+#define SO_ATTACH_BPF		0x0029
+#define SO_DETACH_BPF		SO_DETACH_FILTER
+
 
 /* Security levels - as per NRL IPv6 - don't actually do anything */
 #define SO_SECURITY_AUTHENTICATION		0x5001
@@ -0,0 +1,15 @@
+#ifndef _ASM_X86_CONTEXT_TRACKING_H
+#define _ASM_X86_CONTEXT_TRACKING_H
+
+/*
+ * Reschedule on the way back to userspace.  With context tracking the
+ * CPU may already be in the user extended quiescent state here, so go
+ * through schedule_user() which leaves it around the call.
+ */
+#ifdef CONFIG_CONTEXT_TRACKING
+# define SCHEDULE_USER call schedule_user
+#else
+# define SCHEDULE_USER call schedule
+#endif
+
+#endif /* _ASM_X86_CONTEXT_TRACKING_H */
@@ -36,6 +36,8 @@
 #include <linux/aer.h>
 #include <linux/if_vlan.h>
 
+#include <net/busy_poll.h>
+
 #include "ixgbe_type.h"
 #include "ixgbe_common.h"
 #include "ixgbe_dcb.h"
@@ -328,10 +330,127 @@ struct ixgbe_q_vector {
 	struct rcu_head rcu;	/* to avoid race with update stats on free */
 	char name[IFNAMSIZ + 9];
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned int state;
+#define IXGBE_QV_STATE_IDLE        0
+#define IXGBE_QV_STATE_NAPI	   1    /* NAPI owns this QV */
+#define IXGBE_QV_STATE_POLL	   2    /* poll owns this QV */
+#define IXGBE_QV_LOCKED (IXGBE_QV_STATE_NAPI | IXGBE_QV_STATE_POLL)
+#define IXGBE_QV_STATE_NAPI_YIELD  4    /* NAPI yielded this QV */
+#define IXGBE_QV_STATE_POLL_YIELD  8    /* poll yielded this QV */
+#define IXGBE_QV_YIELD (IXGBE_QV_STATE_NAPI_YIELD | IXGBE_QV_STATE_POLL_YIELD)
+#define IXGBE_QV_USER_PEND (IXGBE_QV_STATE_POLL | IXGBE_QV_STATE_POLL_YIELD)
+	spinlock_t lock;
+#endif  /* CONFIG_NET_RX_BUSY_POLL */
+
 	/* for dynamic allocation of rings associated with this q_vector */
 	struct ixgbe_ring ring[0] ____cacheline_internodealigned_in_smp;
 };
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+static inline void ixgbe_qv_init_lock(struct ixgbe_q_vector *q_vector)
+{
+	spin_lock_init(&q_vector->lock);
+	q_vector->state = IXGBE_QV_STATE_IDLE;
+}
+
+/* called from the device poll routine to get ownership of a q_vector */
+static inline bool ixgbe_qv_lock_napi(struct ixgbe_q_vector *q_vector)
+{
+	int rc = true;
+	spin_lock_bh(&q_vector->lock);
+	if (q_vector->state & IXGBE_QV_LOCKED) {
+		WARN_ON(q_vector->state & IXGBE_QV_STATE_NAPI);
+		q_vector->state |= IXGBE_QV_STATE_NAPI_YIELD;
+		rc = false;
+	} else
+		/* we don't care if someone yielded */
+		q_vector->state = IXGBE_QV_STATE_NAPI;
+	spin_unlock_bh(&q_vector->lock);
+	return rc;
+}
+
+/* returns true is someone tried to get the qv while napi had it */
+static inline bool ixgbe_qv_unlock_napi(struct ixgbe_q_vector *q_vector)
+{
+	int rc = false;
+	spin_lock_bh(&q_vector->lock);
+	WARN_ON(q_vector->state & (IXGBE_QV_STATE_POLL |
+			       IXGBE_QV_STATE_NAPI_YIELD));
+
+	if (q_vector->state & IXGBE_QV_STATE_POLL_YIELD)
+		rc = true;
+	q_vector->state = IXGBE_QV_STATE_IDLE;
+	spin_unlock_bh(&q_vector->lock);
+	return rc;
+}
+
+/* called from ixgbe_low_latency_poll() */
+static inline bool ixgbe_qv_lock_poll(struct ixgbe_q_vector *q_vector)
+{
+	int rc = true;
+	spin_lock_bh(&q_vector->lock);
+	if ((q_vector->state & IXGBE_QV_LOCKED)) {
+		q_vector->state |= IXGBE_QV_STATE_POLL_YIELD;
+		rc = false;
+	} else
+		/* preserve yield marks */
+		q_vector->state |= IXGBE_QV_STATE_POLL;
+	spin_unlock_bh(&q_vector->lock);
+	return rc;
+}
+
+/* returns true if someone tried to get the qv while it was locked */
+static inline bool ixgbe_qv_unlock_poll(struct ixgbe_q_vector *q_vector)
+{
+	int rc = false;
+	spin_lock_bh(&q_vector->lock);
+	WARN_ON(q_vector->state & (IXGBE_QV_STATE_NAPI));
+
+	if (q_vector->state & IXGBE_QV_STATE_POLL_YIELD)
+		rc = true;
+	q_vector->state = IXGBE_QV_STATE_IDLE;
+	spin_unlock_bh(&q_vector->lock);
+	return rc;
+}
+
+/* true if a socket is polling, even if it did not get the lock */
+static inline bool ixgbe_qv_busy_polling(struct ixgbe_q_vector *q_vector)
+{
+	WARN_ON(!(q_vector->state & IXGBE_QV_LOCKED));
+	return q_vector->state & IXGBE_QV_USER_PEND;
+}
+#else /* CONFIG_NET_RX_BUSY_POLL */
+static inline void ixgbe_qv_init_lock(struct ixgbe_q_vector *q_vector)
+{
+}
+
+static inline bool ixgbe_qv_lock_napi(struct ixgbe_q_vector *q_vector)
+{
+	return true;
+}
+
+static inline bool ixgbe_qv_unlock_napi(struct ixgbe_q_vector *q_vector)
+{
+	return false;
+}
+
+static inline bool ixgbe_qv_lock_poll(struct ixgbe_q_vector *q_vector)
+{
+	return false;
+}
+
+static inline bool ixgbe_qv_unlock_poll(struct ixgbe_q_vector *q_vector)
+{
+	return false;
+}
+
+static inline bool ixgbe_qv_busy_polling(struct ixgbe_q_vector *q_vector)
+{
+	return false;
+}
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 /*
  * microsecond values for various ITR rates shifted by 2 to fit itr register
  * with the first 3 bits reserved 0
@@ -387,6 +506,45 @@ static inline u16 ixgbe_desc_unused(struct ixgbe_ring *ring)
 /* default to trying for four seconds */
 #define IXGBE_TRY_LINK_TIMEOUT (4 * HZ)
 
+#ifdef CONFIG_RFS_ACCEL
+/*
+ * Accelerated RFS filters are perfect filters with software indices above
+ * anything ethtool can use.  They are created from the Rx path and written
+ * to hardware in batches by ixgbe_rfs_task.
+ */
+#define IXGBE_RFS_SW_IDX_BASE	0x4000
+#define IXGBE_RFS_HASH_BITS	10
+#define IXGBE_RFS_BATCH		64	/* filters written/erased per run */
+#define IXGBE_RFS_EXPIRE_SCAN	512	/* table slots checked per run */
+
+struct ixgbe_rfs_filter {
+	struct hlist_node hash_node;
+	struct list_head pending;	/* on ixgbe_rfs.pending if not in HW */
+	union ixgbe_atr_input filter;
+	u32 flow_id;
+	u16 id;
+	u16 rxq;
+	bool in_hw;
+};
+
+struct ixgbe_rfs {
+	spinlock_t lock;		/* table and pending list vs. Rx path */
+	struct hlist_head *hash;
+	struct ixgbe_rfs_filter **table;	/* indexed by filter id */
+	unsigned long *ids;
+	struct list_head pending;
+	struct work_struct task;
+	unsigned int size;
+	unsigned int count;
+	unsigned int next_id;
+	unsigned int expire_idx;	/* protected by fdir_perfect_lock */
+	unsigned int hw_count;		/* protected by fdir_perfect_lock */
+	u64 added;
+	u64 expired;
+	u64 full;
+};
+
+#endif /* CONFIG_RFS_ACCEL */
 /* board specific private data structure */
 struct ixgbe_adapter {
 	unsigned long active_vlans[BITS_TO_LONGS(VLAN_N_VID)];
@@ -457,6 +615,9 @@ struct ixgbe_adapter {
 
 	/* RX */
 	struct ixgbe_ring *rx_ring[MAX_RX_QUEUES];
+#ifdef CONFIG_BPF_SYSCALL
+	struct bpf_prog __rcu *xdp_prog;	/* run before skb allocation */
+#endif
 	int num_rx_pools;		/* == num_rx_queues in 82598 */
 	int num_rx_queues_per_pool;	/* 1 if 82598, can be many if 82599 */
 	u64 hw_csum_rx_error;
@@ -510,6 +671,9 @@ struct ixgbe_adapter {
 	u32 fdir_pballoc;
 	u32 atr_sample_rate;
 	spinlock_t fdir_perfect_lock;
+#ifdef CONFIG_RFS_ACCEL
+	struct ixgbe_rfs rfs;
+#endif
 
 #ifdef IXGBE_FCOE
 	struct ixgbe_fcoe fcoe;
@@ -654,6 +818,32 @@ extern int ixgbe_fcoe_get_wwn(struct net_device *netdev, u64 *wwn, int type);
 extern int ixgbe_fcoe_get_hbainfo(struct net_device *netdev,
 				  struct netdev_fcoe_hbainfo *info);
 #endif /* IXGBE_FCOE */
+#ifdef CONFIG_RFS_ACCEL
+extern int ixgbe_rfs_init(struct ixgbe_adapter *adapter);
+extern void ixgbe_rfs_exit(struct ixgbe_adapter *adapter);
+extern void ixgbe_rfs_flush(struct ixgbe_adapter *adapter);
+extern void ixgbe_rfs_subtask(struct ixgbe_adapter *adapter);
+extern int ixgbe_rx_flow_steer(struct net_device *netdev,
+			       const struct sk_buff *skb,
+			       u16 rxq_index, u32 flow_id);
+
+static inline bool ixgbe_rfs_in_hw(struct ixgbe_adapter *adapter)
+{
+	return adapter->rfs.hw_count != 0;
+}
+#else
+static inline int ixgbe_rfs_init(struct ixgbe_adapter *adapter)
+{
+	return 0;
+}
+static inline void ixgbe_rfs_exit(struct ixgbe_adapter *adapter) {}
+static inline void ixgbe_rfs_flush(struct ixgbe_adapter *adapter) {}
+static inline void ixgbe_rfs_subtask(struct ixgbe_adapter *adapter) {}
+static inline bool ixgbe_rfs_in_hw(struct ixgbe_adapter *adapter)
+{
+	return false;
+}
+#endif /* CONFIG_RFS_ACCEL */
 
 static inline struct netdev_queue *txring_txq(const struct ixgbe_ring *ring)
 {
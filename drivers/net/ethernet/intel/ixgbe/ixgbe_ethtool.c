@@ -119,6 +119,12 @@ static const struct ixgbe_stats ixgbe_gstrings_stats[] = {
 	{"tx_fcoe_packets", IXGBE_STAT(stats.fcoeptc)},
 	{"tx_fcoe_dwords", IXGBE_STAT(stats.fcoedwtc)},
 #endif /* IXGBE_FCOE */
+#ifdef CONFIG_RFS_ACCEL
+	{"rfs_filters", IXGBE_STAT(rfs.count)},
+	{"rfs_filters_added", IXGBE_STAT(rfs.added)},
+	{"rfs_filters_expired", IXGBE_STAT(rfs.expired)},
+	{"rfs_table_full", IXGBE_STAT(rfs.full)},
+#endif /* CONFIG_RFS_ACCEL */
 };
 
 /* ixgbe allocates num_tx_queues and num_rx_queues symmetrically so
@@ -2578,7 +2584,8 @@ static int ixgbe_add_ethtool_fdir_entry(struct ixgbe_adapter *adapter,
 
 	spin_lock(&adapter->fdir_perfect_lock);
 
-	if (hlist_empty(&adapter->fdir_filter_list)) {
+	if (hlist_empty(&adapter->fdir_filter_list) &&
+	    !ixgbe_rfs_in_hw(adapter)) {
 		/* save mask and program input mask into HW */
 		memcpy(&adapter->fdir_mask, &mask, sizeof(mask));
 		err = ixgbe_fdir_set_input_mask_82599(hw, &mask);
@@ -45,6 +45,8 @@
 #include <linux/if.h>
 #include <linux/if_vlan.h>
 #include <linux/prefetch.h>
+#include <linux/bpf.h>
+#include <linux/cpu_rmap.h>
 #include <scsi/fc/fc_fcoe.h>
 
 #include "ixgbe.h"
@@ -1390,7 +1392,9 @@ static void ixgbe_rx_skb(struct ixgbe_q_vector *q_vector,
 {
 	struct ixgbe_adapter *adapter = q_vector->adapter;
 
-	if (!(adapter->flags & IXGBE_FLAG_IN_NETPOLL))
+	if (ixgbe_qv_busy_polling(q_vector))
+		netif_receive_skb(skb);
+	else if (!(adapter->flags & IXGBE_FLAG_IN_NETPOLL))
 		napi_gro_receive(&q_vector->napi, skb);
 	else
 		netif_rx(skb);
@@ -1612,6 +1616,142 @@ static void ixgbe_add_rx_frag(struct ixgbe_ring *rx_ring,
 	skb->truesize += ixgbe_rx_bufsz(rx_ring);
 }
 
+#ifdef CONFIG_BPF_SYSCALL
+/**
+ * ixgbe_run_xdp - run the XDP program on a received buffer
+ * @adapter: board private structure
+ * @rx_ring: rx descriptor ring the buffer was received on
+ * @rx_desc: descriptor written back by hardware for the buffer
+ * @rx_buffer: buffer holding the frame
+ *
+ * Frames that span several buffers (jumbo frames, RSC) and frames with
+ * errors are not shown to the program and take the normal path.
+ *
+ * Returns XDP_PASS, XDP_TX or XDP_DROP
+ **/
+static u32 ixgbe_run_xdp(struct ixgbe_adapter *adapter,
+			 struct ixgbe_ring *rx_ring,
+			 union ixgbe_adv_rx_desc *rx_desc,
+			 struct ixgbe_rx_buffer *rx_buffer)
+{
+	struct bpf_prog *xdp_prog;
+	struct xdp_buff xdp;
+	unsigned int size;
+	u32 act = XDP_PASS;
+
+	rcu_read_lock();
+	xdp_prog = rcu_dereference(adapter->xdp_prog);
+	if (!xdp_prog)
+		goto out;
+
+	if (!ixgbe_test_staterr(rx_desc, IXGBE_RXD_STAT_EOP) ||
+	    ixgbe_test_staterr(rx_desc, IXGBE_RXDADV_ERR_FRAME_ERR_MASK))
+		goto out;
+
+	size = le16_to_cpu(rx_desc->wb.upper.length);
+	dma_sync_single_range_for_cpu(rx_ring->dev, rx_buffer->dma,
+				      rx_buffer->page_offset, size,
+				      DMA_FROM_DEVICE);
+
+	xdp.data = page_address(rx_buffer->page) + rx_buffer->page_offset;
+	xdp.data_end = xdp.data + size;
+
+	act = bpf_prog_run_xdp(xdp_prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+	case XDP_TX:
+		break;
+	default:
+		/* XDP_ABORTED and unknown actions drop the frame */
+		act = XDP_DROP;
+		break;
+	}
+out:
+	rcu_read_unlock();
+	return act;
+}
+
+/**
+ * ixgbe_xdp_drop - give a buffer dropped by XDP back to the hardware
+ * @rx_ring: rx descriptor ring the buffer was received on
+ * @rx_buffer: buffer holding the dropped frame
+ *
+ * The stack never saw the page, so the same half is placed back on the
+ * ring as is, and next to clean moves past the descriptor.
+ **/
+static void ixgbe_xdp_drop(struct ixgbe_ring *rx_ring,
+			   struct ixgbe_rx_buffer *rx_buffer)
+{
+	struct ixgbe_rx_buffer *new_buff;
+	u16 nta = rx_ring->next_to_alloc;
+	u16 ntc = rx_ring->next_to_clean + 1;
+
+	new_buff = &rx_ring->rx_buffer_info[nta];
+
+	/* update, and store next to alloc */
+	nta++;
+	rx_ring->next_to_alloc = (nta < rx_ring->count) ? nta : 0;
+
+	new_buff->page = rx_buffer->page;
+	new_buff->dma = rx_buffer->dma;
+	new_buff->page_offset = rx_buffer->page_offset;
+
+	/* sync the buffer for use by the device */
+	dma_sync_single_range_for_device(rx_ring->dev, new_buff->dma,
+					 new_buff->page_offset,
+					 ixgbe_rx_bufsz(rx_ring),
+					 DMA_FROM_DEVICE);
+
+	/* clear contents of buffer_info */
+	rx_buffer->dma = 0;
+	rx_buffer->page = NULL;
+
+	/* fetch, update, and store next to clean */
+	ntc = (ntc < rx_ring->count) ? ntc : 0;
+	rx_ring->next_to_clean = ntc;
+
+	prefetch(IXGBE_RX_DESC(rx_ring, ntc));
+}
+
+/**
+ * ixgbe_xdp_xmit - send a frame back out of the port it arrived on
+ * @adapter: board private structure
+ * @rx_ring: rx descriptor ring the frame was received on
+ * @skb: frame as built by the receive path
+ *
+ * The Tx ring paired with the Rx ring is shared with the stack, so the
+ * frame goes through the regular transmit path under the queue lock.
+ **/
+static void ixgbe_xdp_xmit(struct ixgbe_adapter *adapter,
+			   struct ixgbe_ring *rx_ring,
+			   struct sk_buff *skb)
+{
+	struct ixgbe_ring *tx_ring;
+	struct netdev_queue *txq;
+	netdev_tx_t ret = NETDEV_TX_BUSY;
+
+	tx_ring = adapter->tx_ring[rx_ring->queue_index %
+				   adapter->num_tx_queues];
+	txq = netdev_get_tx_queue(rx_ring->netdev, tx_ring->queue_index);
+
+	/* undo the header pull done by eth_type_trans() */
+	skb_push(skb, ETH_HLEN);
+	skb_set_network_header(skb, ETH_HLEN);
+	skb_set_queue_mapping(skb, tx_ring->queue_index);
+	skb->xmit_more = 0;
+
+	__netif_tx_lock(txq, smp_processor_id());
+	if (!netif_xmit_frozen_or_stopped(txq))
+		ret = ixgbe_xmit_frame_ring(skb, adapter, tx_ring);
+	if (ret == NETDEV_TX_OK)
+		txq_trans_update(txq);
+	__netif_tx_unlock(txq);
+
+	if (ret != NETDEV_TX_OK)
+		dev_kfree_skb_any(skb);
+}
+
+#endif /* CONFIG_BPF_SYSCALL */
 /**
  * ixgbe_clean_rx_irq - Clean completed descriptors from Rx ring - bounce buf
  * @q_vector: structure containing interrupt and ring information
@@ -1623,11 +1763,11 @@ static void ixgbe_add_rx_frag(struct ixgbe_ring *rx_ring,
  * expensive overhead for IOMMU access this provides a means of avoiding
  * it by maintaining the mapping of the page to the syste.
  *
- * Returns true if all work is completed without reaching budget
+ * Returns amount of work completed
  **/
-static bool ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
+static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 			       struct ixgbe_ring *rx_ring,
-			       int budget)
+			       const int budget)
 {
 	unsigned int total_rx_bytes = 0, total_rx_packets = 0;
 #ifdef IXGBE_FCOE
@@ -1641,6 +1781,9 @@ static bool ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 		union ixgbe_adv_rx_desc *rx_desc;
 		struct sk_buff *skb;
 		struct page *page;
+#ifdef CONFIG_BPF_SYSCALL
+		u32 xdp_act = XDP_PASS;
+#endif
 		u16 ntc;
 
 		/* return some buffers to hardware, one at a time is too slow */
@@ -1678,6 +1821,22 @@ static bool ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 			prefetch(page_addr + L1_CACHE_BYTES);
 #endif
 
+#ifdef CONFIG_BPF_SYSCALL
+			/* let the XDP program drop the frame before we spend
+			 * an skb on it
+			 */
+			xdp_act = ixgbe_run_xdp(q_vector->adapter, rx_ring,
+						rx_desc, rx_buffer);
+			if (xdp_act == XDP_DROP) {
+				total_rx_bytes +=
+					le16_to_cpu(rx_desc->wb.upper.length);
+				total_rx_packets++;
+				ixgbe_xdp_drop(rx_ring, rx_buffer);
+				cleaned_count++;
+				continue;
+			}
+
+#endif
 			/* allocate a skb to store the frags */
 			skb = netdev_alloc_skb_ip_align(rx_ring->netdev,
 							IXGBE_RX_HDR_SIZE);
@@ -1745,27 +1904,36 @@ static bool ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 
 		/* probably a little skewed due to removing CRC */
 		total_rx_bytes += skb->len;
-		total_rx_packets++;
 
 		/* populate checksum, timestamp, VLAN, and protocol */
 		ixgbe_process_skb_fields(rx_ring, rx_desc, skb);
 
+#ifdef CONFIG_BPF_SYSCALL
+		if (xdp_act == XDP_TX) {
+			ixgbe_xdp_xmit(q_vector->adapter, rx_ring, skb);
+			total_rx_packets++;
+			continue;
+		}
+
+#endif
 #ifdef IXGBE_FCOE
 		/* if ddp, not passing to ULD unless for FCP_RSP or error */
 		if (ixgbe_rx_is_fcoe(rx_ring, rx_desc)) {
 			ddp_bytes = ixgbe_fcoe_ddp(adapter, rx_desc, skb);
 			if (!ddp_bytes) {
 				dev_kfree_skb_any(skb);
+				total_rx_packets++;
 				continue;
 			}
 		}
 
 #endif /* IXGBE_FCOE */
+		skb_mark_napi_id(skb, &q_vector->napi);
 		ixgbe_rx_skb(q_vector, skb);
 
 		/* update budget accounting */
-		budget--;
-	} while (likely(budget));
+		total_rx_packets++;
+	} while (likely(total_rx_packets < budget));
 
 #ifdef IXGBE_FCOE
 	/* include DDPed FCoE data */
@@ -1792,9 +1960,37 @@ static bool ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 	if (cleaned_count)
 		ixgbe_alloc_rx_buffers(rx_ring, cleaned_count);
 
-	return !!budget;
+	return total_rx_packets;
 }
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/* must be called with local_bh_disable()d */
+static int ixgbe_low_latency_recv(struct napi_struct *napi)
+{
+	struct ixgbe_q_vector *q_vector =
+			container_of(napi, struct ixgbe_q_vector, napi);
+	struct ixgbe_adapter *adapter = q_vector->adapter;
+	struct ixgbe_ring  *ring;
+	int found = 0;
+
+	if (test_bit(__IXGBE_DOWN, &adapter->state))
+		return LL_FLUSH_FAILED;
+
+	if (!ixgbe_qv_lock_poll(q_vector))
+		return LL_FLUSH_BUSY;
+
+	ixgbe_for_each_ring(ring, q_vector->rx) {
+		found = ixgbe_clean_rx_irq(q_vector, ring, 4);
+		if (found)
+			break;
+	}
+
+	ixgbe_qv_unlock_poll(q_vector);
+
+	return found;
+}
+#endif	/* CONFIG_NET_RX_BUSY_POLL */
+
 /**
  * ixgbe_configure_msix - Configure MSI-X hardware
  * @adapter: board private structure
@@ -2353,9 +2549,15 @@ int ixgbe_poll(struct napi_struct *napi, int budget)
 	else
 		per_ring_budget = budget;
 
+	/* Exit if we are called by netpoll or busy polling is active */
+	if (!ixgbe_qv_lock_napi(q_vector))
+		return budget;
+
 	ixgbe_for_each_ring(ring, q_vector->rx)
-		clean_complete &= ixgbe_clean_rx_irq(q_vector, ring,
-						     per_ring_budget);
+		clean_complete &= (ixgbe_clean_rx_irq(q_vector, ring,
+				   per_ring_budget) < per_ring_budget);
+
+	ixgbe_qv_unlock_napi(q_vector);
 
 	/* If all work not completed, return budget and keep polling */
 	if (!clean_complete)
@@ -2371,6 +2573,53 @@ int ixgbe_poll(struct napi_struct *napi, int budget)
 	return 0;
 }
 
+/**
+ * ixgbe_init_rx_cpu_rmap - map CPUs to the Rx queues for accelerated RFS
+ * @adapter: board private structure
+ *
+ * The reverse map is built from the IRQ affinity of each Rx queue's
+ * vector, so it is only usable when no vector services several Rx rings.
+ **/
+static void ixgbe_init_rx_cpu_rmap(struct ixgbe_adapter *adapter)
+{
+#ifdef CONFIG_RFS_ACCEL
+	struct net_device *netdev = adapter->netdev;
+	int i;
+
+	if (!adapter->rfs.size)
+		return;
+
+	for (i = 0; i < adapter->num_rx_queues; i++) {
+		if (adapter->rx_ring[i]->q_vector->rx.count != 1)
+			return;
+	}
+
+	netdev->rx_cpu_rmap = alloc_irq_cpu_rmap(adapter->num_rx_queues);
+	if (!netdev->rx_cpu_rmap)
+		return;
+
+	for (i = 0; i < adapter->num_rx_queues; i++) {
+		struct ixgbe_q_vector *q_vector = adapter->rx_ring[i]->q_vector;
+
+		if (irq_cpu_rmap_add(netdev->rx_cpu_rmap,
+				adapter->msix_entries[q_vector->v_idx].vector)) {
+			free_irq_cpu_rmap(netdev->rx_cpu_rmap);
+			netdev->rx_cpu_rmap = NULL;
+			return;
+		}
+	}
+#endif
+}
+
+static void ixgbe_free_rx_cpu_rmap(struct ixgbe_adapter *adapter)
+{
+#ifdef CONFIG_RFS_ACCEL
+	/* must go before free_irq() drops the affinity notifiers */
+	free_irq_cpu_rmap(adapter->netdev->rx_cpu_rmap);
+	adapter->netdev->rx_cpu_rmap = NULL;
+#endif
+}
+
 /**
  * ixgbe_request_msix_irqs - Initialize MSI-X interrupts
  * @adapter: board private structure
@@ -2425,6 +2674,8 @@ static int ixgbe_request_msix_irqs(struct ixgbe_adapter *adapter)
 		goto free_queue_irqs;
 	}
 
+	ixgbe_init_rx_cpu_rmap(adapter);
+
 	return 0;
 
 free_queue_irqs:
@@ -2540,6 +2791,8 @@ static void ixgbe_free_irq(struct ixgbe_adapter *adapter)
 	if (adapter->flags & IXGBE_FLAG_MSIX_ENABLED) {
 		int i, q_vectors;
 
+		ixgbe_free_rx_cpu_rmap(adapter);
+
 		q_vectors = adapter->num_msix_vectors;
 		i = q_vectors - 1;
 		free_irq(adapter->msix_entries[i].vector, adapter);
@@ -3511,6 +3764,7 @@ static void ixgbe_napi_enable_all(struct ixgbe_adapter *adapter)
 
 	for (q_idx = 0; q_idx < q_vectors; q_idx++) {
 		q_vector = adapter->q_vector[q_idx];
+		ixgbe_qv_init_lock(q_vector);
 		napi_enable(&q_vector->napi);
 	}
 }
@@ -3528,6 +3782,8 @@ static void ixgbe_napi_disable_all(struct ixgbe_adapter *adapter)
 	for (q_idx = 0; q_idx < q_vectors; q_idx++) {
 		q_vector = adapter->q_vector[q_idx];
 		napi_disable(&q_vector->napi);
+		while (!ixgbe_qv_lock_napi(q_vector))
+			usleep_range(1000, 20000);
 	}
 }
 
@@ -4262,6 +4518,9 @@ void ixgbe_down(struct ixgbe_adapter *adapter)
 
 	del_timer_sync(&adapter->service_timer);
 
+	/* the Flow Director table is rebuilt on the way back up */
+	ixgbe_rfs_flush(adapter);
+
 	if (adapter->num_vfs) {
 		/* Clear EITR Select mapping */
 		IXGBE_WRITE_REG(&adapter->hw, IXGBE_EITRSEL, 0);
@@ -5689,6 +5948,7 @@ static void ixgbe_service_task(struct work_struct *work)
 	ixgbe_check_overtemp_subtask(adapter);
 	ixgbe_watchdog_subtask(adapter);
 	ixgbe_fdir_reinit_subtask(adapter);
+	ixgbe_rfs_subtask(adapter);
 	ixgbe_check_hang_subtask(adapter);
 
 	ixgbe_service_event_complete(adapter);
@@ -5889,6 +6149,32 @@ static void ixgbe_tx_olinfo_status(union ixgbe_adv_tx_desc *tx_desc,
 #define IXGBE_TXD_CMD (IXGBE_TXD_CMD_EOP | \
 		       IXGBE_TXD_CMD_RS)
 
+static int __ixgbe_maybe_stop_tx(struct ixgbe_ring *tx_ring, u16 size)
+{
+	netif_stop_subqueue(tx_ring->netdev, tx_ring->queue_index);
+	/* Herbert's original patch had:
+	 *  smp_mb__after_netif_stop_queue();
+	 * but since that doesn't exist yet, just open code it. */
+	smp_mb();
+
+	/* We need to check again in a case another CPU has just
+	 * made room available. */
+	if (likely(ixgbe_desc_unused(tx_ring) < size))
+		return -EBUSY;
+
+	/* A reprieve! - use start_queue because it doesn't call schedule */
+	netif_start_subqueue(tx_ring->netdev, tx_ring->queue_index);
+	++tx_ring->tx_stats.restart_queue;
+	return 0;
+}
+
+static inline int ixgbe_maybe_stop_tx(struct ixgbe_ring *tx_ring, u16 size)
+{
+	if (likely(ixgbe_desc_unused(tx_ring) >= size))
+		return 0;
+	return __ixgbe_maybe_stop_tx(tx_ring, size);
+}
+
 static void ixgbe_tx_map(struct ixgbe_ring *tx_ring,
 			 struct ixgbe_tx_buffer *first,
 			 const u8 hdr_len)
@@ -6014,8 +6300,12 @@ static void ixgbe_tx_map(struct ixgbe_ring *tx_ring,
 
 	tx_ring->next_to_use = i;
 
-	/* notify HW of packet */
-	writel(i, tx_ring->tail);
+	ixgbe_maybe_stop_tx(tx_ring, DESC_NEEDED);
+
+	/* notify HW of the packet, or of the whole burst once it is queued */
+	if (!first->skb->xmit_more ||
+	    netif_xmit_stopped(txring_txq(tx_ring)))
+		writel(i, tx_ring->tail);
 
 	return;
 dma_error:
@@ -6033,6 +6323,9 @@ dma_error:
 	}
 
 	tx_ring->next_to_use = i;
+
+	/* do not leave frames queued before this one waiting on a doorbell */
+	writel(i, tx_ring->tail);
 }
 
 static void ixgbe_atr(struct ixgbe_ring *ring,
@@ -6123,32 +6416,6 @@ static void ixgbe_atr(struct ixgbe_ring *ring,
 					      input, common, ring->queue_index);
 }
 
-static int __ixgbe_maybe_stop_tx(struct ixgbe_ring *tx_ring, u16 size)
-{
-	netif_stop_subqueue(tx_ring->netdev, tx_ring->queue_index);
-	/* Herbert's original patch had:
-	 *  smp_mb__after_netif_stop_queue();
-	 * but since that doesn't exist yet, just open code it. */
-	smp_mb();
-
-	/* We need to check again in a case another CPU has just
-	 * made room available. */
-	if (likely(ixgbe_desc_unused(tx_ring) < size))
-		return -EBUSY;
-
-	/* A reprieve! - use start_queue because it doesn't call schedule */
-	netif_start_subqueue(tx_ring->netdev, tx_ring->queue_index);
-	++tx_ring->tx_stats.restart_queue;
-	return 0;
-}
-
-static inline int ixgbe_maybe_stop_tx(struct ixgbe_ring *tx_ring, u16 size)
-{
-	if (likely(ixgbe_desc_unused(tx_ring) >= size))
-		return 0;
-	return __ixgbe_maybe_stop_tx(tx_ring, size);
-}
-
 static u16 ixgbe_select_queue(struct net_device *dev, struct sk_buff *skb)
 {
 	struct ixgbe_adapter *adapter = netdev_priv(dev);
@@ -6290,8 +6557,6 @@ xmit_fcoe:
 #endif /* IXGBE_FCOE */
 	ixgbe_tx_map(tx_ring, first, hdr_len);
 
-	ixgbe_maybe_stop_tx(tx_ring, DESC_NEEDED);
-
 	return NETDEV_TX_OK;
 
 out_drop:
@@ -6690,6 +6955,31 @@ static int ixgbe_set_features(struct net_device *netdev,
 	return 0;
 }
 
+#ifdef CONFIG_BPF_SYSCALL
+static int ixgbe_xdp(struct net_device *netdev, struct netdev_xdp *xdp)
+{
+	struct ixgbe_adapter *adapter = netdev_priv(netdev);
+	struct bpf_prog *old_prog;
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		old_prog = rtnl_dereference(adapter->xdp_prog);
+		rcu_assign_pointer(adapter->xdp_prog, xdp->prog);
+		if (old_prog) {
+			/* wait for Rx polls still running the old program */
+			synchronize_net();
+			bpf_prog_put(old_prog);
+		}
+		return 0;
+	case XDP_QUERY_PROG:
+		xdp->prog_attached = !!rtnl_dereference(adapter->xdp_prog);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+#endif /* CONFIG_BPF_SYSCALL */
 static const struct net_device_ops ixgbe_netdev_ops = {
 	.ndo_open		= ixgbe_open,
 	.ndo_stop		= ixgbe_close,
@@ -6709,6 +6999,9 @@ static const struct net_device_ops ixgbe_netdev_ops = {
 	.ndo_set_vf_spoofchk	= ixgbe_ndo_set_vf_spoofchk,
 	.ndo_get_vf_config	= ixgbe_ndo_get_vf_config,
 	.ndo_get_stats64	= ixgbe_get_stats64,
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	.ndo_busy_poll		= ixgbe_low_latency_recv,
+#endif
 #ifdef CONFIG_IXGBE_DCB
 	.ndo_setup_tc		= ixgbe_setup_tc,
 #endif
@@ -6726,6 +7019,12 @@ static const struct net_device_ops ixgbe_netdev_ops = {
 #endif /* IXGBE_FCOE */
 	.ndo_set_features = ixgbe_set_features,
 	.ndo_fix_features = ixgbe_fix_features,
+#ifdef CONFIG_BPF_SYSCALL
+	.ndo_xdp = ixgbe_xdp,
+#endif
+#ifdef CONFIG_RFS_ACCEL
+	.ndo_rx_flow_steer = ixgbe_rx_flow_steer,
+#endif
 };
 
 static void __devinit ixgbe_probe_vf(struct ixgbe_adapter *adapter,
@@ -6896,6 +7195,9 @@ static int __devinit ixgbe_probe(struct pci_dev *pdev,
 	if (err)
 		goto err_sw_init;
 
+	if (ixgbe_rfs_init(adapter))
+		e_dev_warn("Unable to allocate accelerated RFS filter table\n");
+
 	/* Make it possible the adapter to be woken up via WOL */
 	switch (adapter->hw.mac.type) {
 	case ixgbe_mac_82599EB:
@@ -7166,6 +7468,7 @@ err_register:
 	ixgbe_release_hw_control(adapter);
 	ixgbe_clear_interrupt_scheme(adapter);
 err_sw_init:
+	ixgbe_rfs_exit(adapter);
 	if (adapter->flags & IXGBE_FLAG_SRIOV_ENABLED)
 		ixgbe_disable_sriov(adapter);
 	adapter->flags2 &= ~IXGBE_FLAG2_SEARCH_FOR_SFP;
@@ -7230,6 +7533,14 @@ static void __devexit ixgbe_remove(struct pci_dev *pdev)
 
 	ixgbe_release_hw_control(adapter);
 
+	ixgbe_rfs_exit(adapter);
+
+#ifdef CONFIG_BPF_SYSCALL
+	/* the device is unregistered, no poll can run the program anymore */
+	if (rcu_access_pointer(adapter->xdp_prog))
+		bpf_prog_put(rcu_dereference_protected(adapter->xdp_prog, 1));
+
+#endif
 #ifdef CONFIG_DCB
 	kfree(adapter->ixgbe_ieee_pfc);
 	kfree(adapter->ixgbe_ieee_ets);
@@ -0,0 +1,427 @@
+/*******************************************************************************
+
+  Intel 10 Gigabit PCI Express Linux driver
+  Copyright(c) 1999 - 2012 Intel Corporation.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms and conditions of the GNU General Public License,
+  version 2, as published by the Free Software Foundation.
+
+  This program is distributed in the hope it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along with
+  this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+
+  The full GNU General Public License is included in this distribution in
+  the file called "COPYING".
+
+  Contact Information:
+  e1000-devel Mailing List <e1000-devel@lists.sourceforge.net>
+  Intel Corporation, 5200 N.E. Elam Young Parkway, Hillsboro, OR 97124-6497
+
+*******************************************************************************/
+
+
+#include "ixgbe.h"
+#include <linux/hash.h>
+#include <linux/ip.h>
+#include <linux/in.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+/**
+ * ixgbe_rfs_mask - input mask shared by all accelerated RFS filters
+ * @mask: mask to fill in
+ *
+ * RFS filters match on the full IPv4 4-tuple and the L4 protocol.  The
+ * hardware has a single mask per port, so ethtool n-tuple rules can only
+ * coexist with these filters if they use the same mask.
+ **/
+static void ixgbe_rfs_mask(union ixgbe_atr_input *mask)
+{
+	memset(mask, 0, sizeof(*mask));
+	mask->formatted.flow_type = IXGBE_ATR_L4TYPE_IPV6_MASK |
+				    IXGBE_ATR_L4TYPE_MASK;
+	mask->formatted.src_ip[0] = htonl(0xFFFFFFFF);
+	mask->formatted.dst_ip[0] = htonl(0xFFFFFFFF);
+	mask->formatted.src_port = htons(0xFFFF);
+	mask->formatted.dst_port = htons(0xFFFF);
+}
+
+/**
+ * ixgbe_rfs_parse - build a perfect filter input from a received frame
+ * @skb: frame handed to ndo_rx_flow_steer
+ * @input: filter input, bucket hash included
+ **/
+static int ixgbe_rfs_parse(const struct sk_buff *skb,
+			   union ixgbe_atr_input *input)
+{
+	union ixgbe_atr_input mask;
+	struct iphdr _iph;
+	const struct iphdr *iph;
+	__be16 _ports[2];
+	const __be16 *ports;
+	int nhoff = skb_network_offset(skb);
+
+	if (skb->protocol != htons(ETH_P_IP))
+		return -EPROTONOSUPPORT;
+
+	iph = skb_header_pointer(skb, nhoff, sizeof(_iph), &_iph);
+	if (!iph || iph->ihl < 5 || ip_is_fragment(iph))
+		return -EPROTONOSUPPORT;
+
+	memset(input, 0, sizeof(*input));
+
+	switch (iph->protocol) {
+	case IPPROTO_TCP:
+		input->formatted.flow_type = IXGBE_ATR_FLOW_TYPE_TCPV4;
+		break;
+	case IPPROTO_UDP:
+		input->formatted.flow_type = IXGBE_ATR_FLOW_TYPE_UDPV4;
+		break;
+	default:
+		return -EPROTONOSUPPORT;
+	}
+
+	ports = skb_header_pointer(skb, nhoff + iph->ihl * 4,
+				   sizeof(_ports), _ports);
+	if (!ports)
+		return -EPROTONOSUPPORT;
+
+	input->formatted.src_ip[0] = iph->saddr;
+	input->formatted.dst_ip[0] = iph->daddr;
+	input->formatted.src_port = ports[0];
+	input->formatted.dst_port = ports[1];
+
+	ixgbe_rfs_mask(&mask);
+	ixgbe_atr_compute_perfect_hash_82599(input, &mask);
+
+	return 0;
+}
+
+/**
+ * ixgbe_rx_flow_steer - ndo_rx_flow_steer handler
+ * @netdev: network interface device structure
+ * @skb: frame of the flow to steer
+ * @rxq_index: Rx queue the flow should be delivered to
+ * @flow_id: flow id to hand back to rps_may_expire_flow()
+ *
+ * Called from the Rx softirq, so the filter is only recorded here and
+ * queued for ixgbe_rfs_task to write it to hardware.  Returns the filter
+ * id, or a negative error if the flow cannot be steered.
+ **/
+int ixgbe_rx_flow_steer(struct net_device *netdev, const struct sk_buff *skb,
+			u16 rxq_index, u32 flow_id)
+{
+	struct ixgbe_adapter *adapter = netdev_priv(netdev);
+	struct ixgbe_rfs *rfs = &adapter->rfs;
+	struct ixgbe_rfs_filter *filter;
+	union ixgbe_atr_input input;
+	struct hlist_head *head;
+	struct hlist_node *node;
+	unsigned int id;
+	int err;
+
+	if (!rfs->size || !(adapter->flags & IXGBE_FLAG_FDIR_PERFECT_CAPABLE))
+		return -EOPNOTSUPP;
+
+	err = ixgbe_rfs_parse(skb, &input);
+	if (err)
+		return err;
+
+	head = &rfs->hash[hash_32(skb->rxhash, IXGBE_RFS_HASH_BITS)];
+
+	spin_lock(&rfs->lock);
+
+	/* ixgbe_rfs_flush runs with the adapter already marked down */
+	if (test_bit(__IXGBE_DOWN, &adapter->state)) {
+		err = -ENETDOWN;
+		goto out;
+	}
+
+	hlist_for_each_entry(filter, node, head, hash_node) {
+		if (memcmp(&filter->filter, &input, sizeof(input)))
+			continue;
+
+		/* known flow, only the queue may have changed */
+		filter->flow_id = flow_id;
+		if (filter->rxq != rxq_index) {
+			filter->rxq = rxq_index;
+			if (list_empty(&filter->pending))
+				list_add_tail(&filter->pending, &rfs->pending);
+			schedule_work(&rfs->task);
+		}
+		err = filter->id;
+		goto out;
+	}
+
+	/* the table is shared with the ethtool n-tuple rules */
+	if (rfs->count + adapter->fdir_filter_count >= rfs->size) {
+		rfs->full++;
+		schedule_work(&rfs->task);
+		err = -EBUSY;
+		goto out;
+	}
+
+	filter = kzalloc(sizeof(*filter), GFP_ATOMIC);
+	if (!filter) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	id = find_next_zero_bit(rfs->ids, rfs->size, rfs->next_id);
+	if (id >= rfs->size)
+		id = find_first_zero_bit(rfs->ids, rfs->size);
+	__set_bit(id, rfs->ids);
+	rfs->next_id = id + 1;
+
+	memcpy(&filter->filter, &input, sizeof(input));
+	filter->flow_id = flow_id;
+	filter->id = id;
+	filter->rxq = rxq_index;
+	rfs->table[id] = filter;
+	hlist_add_head(&filter->hash_node, head);
+	list_add_tail(&filter->pending, &rfs->pending);
+	rfs->count++;
+	rfs->added++;
+
+	schedule_work(&rfs->task);
+	err = id;
+out:
+	spin_unlock(&rfs->lock);
+	return err;
+}
+
+/* called with rfs->lock held */
+static void ixgbe_rfs_unlink(struct ixgbe_rfs *rfs,
+			     struct ixgbe_rfs_filter *filter)
+{
+	hlist_del(&filter->hash_node);
+	list_del(&filter->pending);
+	rfs->table[filter->id] = NULL;
+	__clear_bit(filter->id, rfs->ids);
+	rfs->count--;
+}
+
+/**
+ * ixgbe_rfs_program - write queued filters to hardware
+ * @adapter: board private structure
+ *
+ * Called with fdir_perfect_lock held.  Returns true if filters are left
+ * on the pending list.
+ **/
+static bool ixgbe_rfs_program(struct ixgbe_adapter *adapter)
+{
+	struct ixgbe_rfs *rfs = &adapter->rfs;
+	struct ixgbe_hw *hw = &adapter->hw;
+	struct ixgbe_rfs_filter *filter;
+	union ixgbe_atr_input mask;
+	bool usable = true;
+	int budget;
+	u16 rxq;
+
+	ixgbe_rfs_mask(&mask);
+	if (hlist_empty(&adapter->fdir_filter_list) && !rfs->hw_count) {
+		memcpy(&adapter->fdir_mask, &mask, sizeof(mask));
+		if (ixgbe_fdir_set_input_mask_82599(hw, &mask))
+			usable = false;
+	} else if (memcmp(&adapter->fdir_mask, &mask, sizeof(mask))) {
+		/* ethtool rules own the mask, leave RFS to software */
+		usable = false;
+	}
+
+	for (budget = IXGBE_RFS_BATCH; budget; budget--) {
+		spin_lock_bh(&rfs->lock);
+		if (list_empty(&rfs->pending)) {
+			spin_unlock_bh(&rfs->lock);
+			return false;
+		}
+		filter = list_first_entry(&rfs->pending,
+					  struct ixgbe_rfs_filter, pending);
+		list_del_init(&filter->pending);
+		rxq = filter->rxq;
+		spin_unlock_bh(&rfs->lock);
+
+		if (!usable || rxq >= adapter->num_rx_queues)
+			continue;
+
+		/* an existing filter is updated in place with the new queue */
+		ixgbe_fdir_write_perfect_filter_82599(hw, &filter->filter,
+					IXGBE_RFS_SW_IDX_BASE + filter->id,
+					adapter->rx_ring[rxq]->reg_idx);
+		if (!filter->in_hw) {
+			filter->in_hw = true;
+			rfs->hw_count++;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * ixgbe_rfs_expire - remove filters of flows the stack no longer steers
+ * @adapter: board private structure
+ *
+ * Walks the next part of the filter table, so a large table is swept over
+ * several runs.  Called with fdir_perfect_lock held.
+ **/
+static void ixgbe_rfs_expire(struct ixgbe_adapter *adapter)
+{
+	struct ixgbe_rfs *rfs = &adapter->rfs;
+	struct ixgbe_rfs_filter *filter;
+	unsigned int scan = IXGBE_RFS_EXPIRE_SCAN;
+	int budget = IXGBE_RFS_BATCH;
+	unsigned int idx;
+
+	while (scan-- && budget && rfs->count) {
+		idx = rfs->expire_idx;
+		if (++rfs->expire_idx >= rfs->size)
+			rfs->expire_idx = 0;
+
+		spin_lock_bh(&rfs->lock);
+		filter = rfs->table[idx];
+		if (!filter || !list_empty(&filter->pending) ||
+		    !rps_may_expire_flow(adapter->netdev, filter->rxq,
+					 filter->flow_id, filter->id)) {
+			spin_unlock_bh(&rfs->lock);
+			continue;
+		}
+		ixgbe_rfs_unlink(rfs, filter);
+		rfs->expired++;
+		spin_unlock_bh(&rfs->lock);
+
+		if (filter->in_hw) {
+			ixgbe_fdir_erase_perfect_filter_82599(&adapter->hw,
+					&filter->filter,
+					IXGBE_RFS_SW_IDX_BASE + filter->id);
+			rfs->hw_count--;
+			budget--;
+		}
+		kfree(filter);
+	}
+}
+
+static void ixgbe_rfs_task(struct work_struct *work)
+{
+	struct ixgbe_adapter *adapter = container_of(work,
+						     struct ixgbe_adapter,
+						     rfs.task);
+	bool more;
+
+	spin_lock(&adapter->fdir_perfect_lock);
+
+	if (test_bit(__IXGBE_DOWN, &adapter->state) ||
+	    !(adapter->flags & IXGBE_FLAG_FDIR_PERFECT_CAPABLE)) {
+		spin_unlock(&adapter->fdir_perfect_lock);
+		return;
+	}
+
+	more = ixgbe_rfs_program(adapter);
+	ixgbe_rfs_expire(adapter);
+
+	spin_unlock(&adapter->fdir_perfect_lock);
+
+	if (more)
+		schedule_work(&adapter->rfs.task);
+}
+
+/**
+ * ixgbe_rfs_subtask - periodic filter expiry from the service task
+ * @adapter: board private structure
+ **/
+void ixgbe_rfs_subtask(struct ixgbe_adapter *adapter)
+{
+	if (adapter->rfs.count && !test_bit(__IXGBE_DOWN, &adapter->state))
+		schedule_work(&adapter->rfs.task);
+}
+
+/**
+ * ixgbe_rfs_flush - drop all accelerated RFS filters
+ * @adapter: board private structure
+ *
+ * Called once the adapter is marked down.  The Flow Director table is
+ * reinitialized when the adapter comes back up, so the filters are only
+ * released in software.
+ **/
+void ixgbe_rfs_flush(struct ixgbe_adapter *adapter)
+{
+	struct ixgbe_rfs *rfs = &adapter->rfs;
+	unsigned int id;
+
+	if (!rfs->size)
+		return;
+
+	spin_lock(&adapter->fdir_perfect_lock);
+	spin_lock_bh(&rfs->lock);
+
+	for_each_set_bit(id, rfs->ids, rfs->size) {
+		struct ixgbe_rfs_filter *filter = rfs->table[id];
+
+		ixgbe_rfs_unlink(rfs, filter);
+		kfree(filter);
+	}
+	rfs->next_id = 0;
+	rfs->expire_idx = 0;
+	rfs->hw_count = 0;
+
+	spin_unlock_bh(&rfs->lock);
+	spin_unlock(&adapter->fdir_perfect_lock);
+
+	cancel_work_sync(&rfs->task);
+}
+
+/**
+ * ixgbe_rfs_init - allocate the accelerated RFS filter table
+ * @adapter: board private structure
+ *
+ * The table covers every perfect filter the Flow Director can hold with
+ * the configured packet buffer allocation.
+ **/
+int ixgbe_rfs_init(struct ixgbe_adapter *adapter)
+{
+	struct ixgbe_rfs *rfs = &adapter->rfs;
+	unsigned int size, i;
+
+	spin_lock_init(&rfs->lock);
+	INIT_LIST_HEAD(&rfs->pending);
+	INIT_WORK(&rfs->task, ixgbe_rfs_task);
+
+	if (adapter->hw.mac.type == ixgbe_mac_82598EB)
+		return 0;
+
+	size = (1024 << adapter->fdir_pballoc) - 2;
+
+	rfs->hash = kcalloc(1 << IXGBE_RFS_HASH_BITS, sizeof(*rfs->hash),
+			    GFP_KERNEL);
+	rfs->ids = kcalloc(BITS_TO_LONGS(size), sizeof(long), GFP_KERNEL);
+	rfs->table = vzalloc(size * sizeof(*rfs->table));
+	if (!rfs->hash || !rfs->ids || !rfs->table) {
+		ixgbe_rfs_exit(adapter);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < (1 << IXGBE_RFS_HASH_BITS); i++)
+		INIT_HLIST_HEAD(&rfs->hash[i]);
+	rfs->size = size;
+
+	return 0;
+}
+
+void ixgbe_rfs_exit(struct ixgbe_adapter *adapter)
+{
+	struct ixgbe_rfs *rfs = &adapter->rfs;
+
+	ixgbe_rfs_flush(adapter);
+	rfs->size = 0;
+
+	vfree(rfs->table);
+	kfree(rfs->ids);
+	kfree(rfs->hash);
+	rfs->table = NULL;
+	rfs->ids = NULL;
+	rfs->hash = NULL;
+}
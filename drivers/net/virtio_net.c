@@ -617,6 +617,7 @@ static int xmit_skb(struct virtnet_info *vi, struct sk_buff *skb)
 static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct virtnet_info *vi = netdev_priv(dev);
+	bool kick = !skb->xmit_more;
 	int capacity;
 
 	/* Free up any pending old buffers before queueing new ones. */
@@ -640,9 +641,11 @@ static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 		}
 		dev->stats.tx_dropped++;
 		kfree_skb(skb);
+		/* earlier packets of the burst may still wait for a kick */
+		if (kick)
+			virtqueue_kick(vi->svq);
 		return NETDEV_TX_OK;
 	}
-	virtqueue_kick(vi->svq);
 
 	/* Don't wait up for transmitted skbs to be freed. */
 	skb_orphan(skb);
@@ -662,6 +665,10 @@ static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 		}
 	}
 
+	/* the host only looks at the ring once the last packet is queued */
+	if (kick || netif_queue_stopped(dev))
+		virtqueue_kick(vi->svq);
+
 	return NETDEV_TX_OK;
 }
 
@@ -0,0 +1,457 @@
+#ifndef __LINUX_BPF_H__
+#define __LINUX_BPF_H__
+
+/*
+ * Extended BPF: a 64-bit, ten register virtual machine.
+ *
+ * Programs are loaded with the bpf() system call, checked by an in-kernel
+ * verifier and then interpreted or JIT compiled.  Maps are generic
+ * key/value stores that programs and user space share through a file
+ * descriptor.
+ *
+ * The instruction encoding reuses the class, size, mode and op fields of
+ * classic BPF (see <linux/filter.h>), widened to 64-bit operations.
+ */
+
+#include <linux/types.h>
+#include <linux/filter.h>
+
+/* instruction classes */
+#define BPF_ALU64	0x07	/* alu mode in double word width */
+
+/* ld/ldx fields */
+#define BPF_DW		0x18	/* double word */
+#define BPF_XADD	0xc0	/* exclusive add */
+
+/* alu/jmp fields */
+#define BPF_MOD		0x90
+#define BPF_XOR		0xa0
+#define BPF_MOV		0xb0	/* mov reg to reg */
+#define BPF_ARSH	0xc0	/* sign extending arithmetic shift right */
+
+/* change endianness of a register */
+#define BPF_END		0xd0	/* flags for endianness conversion: */
+#define BPF_TO_LE	0x00	/* convert to little-endian */
+#define BPF_TO_BE	0x08	/* convert to big-endian */
+#define BPF_FROM_LE	BPF_TO_LE
+#define BPF_FROM_BE	BPF_TO_BE
+
+#define BPF_JNE		0x50	/* jump != */
+#define BPF_JSGT	0x60	/* SGT is signed '>', GT in x86 */
+#define BPF_JSGE	0x70	/* SGE is signed '>=', GE in x86 */
+#define BPF_CALL	0x80	/* function call */
+#define BPF_EXIT	0x90	/* function return */
+
+/* Register numbers */
+enum {
+	BPF_REG_0 = 0,
+	BPF_REG_1,
+	BPF_REG_2,
+	BPF_REG_3,
+	BPF_REG_4,
+	BPF_REG_5,
+	BPF_REG_6,
+	BPF_REG_7,
+	BPF_REG_8,
+	BPF_REG_9,
+	BPF_REG_10,
+	__MAX_BPF_REG,
+};
+
+/* BPF has 10 general purpose 64-bit registers and stack frame. */
+#define MAX_BPF_REG	__MAX_BPF_REG
+
+/* R0 holds the return value, R1-R5 are helper arguments and are
+ * clobbered by calls, R6-R9 are callee saved and R10 is the read-only
+ * frame pointer.
+ */
+#define BPF_REG_FP	BPF_REG_10
+
+/* BPF program can access up to 512 bytes of stack space. */
+#define MAX_BPF_STACK	512
+
+struct bpf_insn {
+	__u8	code;		/* opcode */
+	__u8	dst_reg:4;	/* dest register */
+	__u8	src_reg:4;	/* source register */
+	__s16	off;		/* signed offset */
+	__s32	imm;		/* signed immediate constant */
+};
+
+/* BPF_LD | BPF_DW | BPF_IMM takes two instructions: the 64-bit constant
+ * is split between the imm fields of both.  When src_reg is
+ * BPF_PSEUDO_MAP_FD the constant is a map file descriptor, which the
+ * verifier replaces with a pointer to the map.
+ */
+#define BPF_PSEUDO_MAP_FD	1
+
+/* BPF syscall commands */
+enum bpf_cmd {
+	/* create a map with given type and attributes
+	 * fd = bpf(BPF_MAP_CREATE, union bpf_attr *, u32 size)
+	 * returns fd or negative error
+	 * map is deleted when fd is closed
+	 */
+	BPF_MAP_CREATE,
+
+	/* lookup key in a given map
+	 * err = bpf(BPF_MAP_LOOKUP_ELEM, union bpf_attr *attr, u32 size)
+	 * Using attr->map_fd, attr->key, attr->value
+	 * returns zero and stores found elem into value
+	 * or negative error
+	 */
+	BPF_MAP_LOOKUP_ELEM,
+
+	/* create or update key/value pair in a given map
+	 * err = bpf(BPF_MAP_UPDATE_ELEM, union bpf_attr *attr, u32 size)
+	 * Using attr->map_fd, attr->key, attr->value, attr->flags
+	 * returns zero or negative error
+	 */
+	BPF_MAP_UPDATE_ELEM,
+
+	/* find and delete elem by key in a given map
+	 * err = bpf(BPF_MAP_DELETE_ELEM, union bpf_attr *attr, u32 size)
+	 * Using attr->map_fd, attr->key
+	 * returns zero or negative error
+	 */
+	BPF_MAP_DELETE_ELEM,
+
+	/* lookup key in a given map and return next key
+	 * err = bpf(BPF_MAP_GET_NEXT_KEY, union bpf_attr *attr, u32 size)
+	 * Using attr->map_fd, attr->key, attr->next_key
+	 * returns zero and stores next key or negative error
+	 */
+	BPF_MAP_GET_NEXT_KEY,
+
+	/* verify and load eBPF program
+	 * prog_fd = bpf(BPF_PROG_LOAD, union bpf_attr *attr, u32 size)
+	 * Using attr->prog_type, attr->insns, attr->insn_cnt, attr->license
+	 * and the optional verifier log attributes
+	 * returns fd or negative error
+	 */
+	BPF_PROG_LOAD,
+};
+
+enum bpf_map_type {
+	BPF_MAP_TYPE_UNSPEC,
+	BPF_MAP_TYPE_HASH,
+	BPF_MAP_TYPE_ARRAY,
+};
+
+/* numbering is shared with the other kernels exposing bpf(), program types
+ * this kernel does not implement are rejected by BPF_PROG_LOAD
+ */
+enum bpf_prog_type {
+	BPF_PROG_TYPE_UNSPEC,
+	BPF_PROG_TYPE_SOCKET_FILTER,
+	BPF_PROG_TYPE_KPROBE,
+	BPF_PROG_TYPE_SCHED_CLS,
+	BPF_PROG_TYPE_SCHED_ACT,
+	BPF_PROG_TYPE_TRACEPOINT,
+	BPF_PROG_TYPE_XDP,
+};
+
+/* flags for BPF_MAP_UPDATE_ELEM command */
+#define BPF_ANY		0 /* create new element or update existing */
+#define BPF_NOEXIST	1 /* create new element if it didn't exist */
+#define BPF_EXIST	2 /* update existing element */
+
+union bpf_attr {
+	struct { /* anonymous struct used by BPF_MAP_CREATE command */
+		__u32	map_type;	/* one of enum bpf_map_type */
+		__u32	key_size;	/* size of key in bytes */
+		__u32	value_size;	/* size of value in bytes */
+		__u32	max_entries;	/* max number of entries in a map */
+	};
+
+	struct { /* anonymous struct used by BPF_MAP_*_ELEM commands */
+		__u32		map_fd;
+		__aligned_u64	key;
+		union {
+			__aligned_u64 value;
+			__aligned_u64 next_key;
+		};
+		__u64		flags;
+	};
+
+	struct { /* anonymous struct used by BPF_PROG_LOAD command */
+		__u32		prog_type;	/* one of enum bpf_prog_type */
+		__u32		insn_cnt;
+		__aligned_u64	insns;
+		__aligned_u64	license;
+		__u32		log_level;	/* verbosity level of verifier */
+		__u32		log_size;	/* size of user buffer */
+		__aligned_u64	log_buf;	/* user supplied buffer */
+		__u32		kern_version;	/* checked when prog_type=kprobe */
+	};
+} __attribute__((aligned(8)));
+
+/* integer value in 'imm' field of BPF_CALL instruction selects which helper
+ * function eBPF program intends to call
+ */
+enum bpf_func_id {
+	BPF_FUNC_unspec,
+
+	/* void *map_lookup_elem(&map, &key)
+	 * Return: Map value or NULL
+	 */
+	BPF_FUNC_map_lookup_elem,
+
+	/* int map_update_elem(&map, &key, &value, flags)
+	 * Return: 0 on success or negative error
+	 */
+	BPF_FUNC_map_update_elem,
+
+	/* int map_delete_elem(&map, &key)
+	 * Return: 0 on success or negative error
+	 */
+	BPF_FUNC_map_delete_elem,
+	__BPF_FUNC_MAX_ID,
+};
+
+/* user accessible mirror of in-kernel sk_buff.
+ * new fields can only be added to the end of this structure
+ */
+struct __sk_buff {
+	__u32 len;
+	__u32 pkt_type;
+	__u32 mark;
+	__u32 queue_mapping;
+	__u32 protocol;
+	__u32 vlan_present;
+	__u32 vlan_tci;
+	__u32 vlan_proto;
+	__u32 priority;
+	__u32 ingress_ifindex;
+	__u32 ifindex;
+	__u32 tc_index;
+	__u32 cb[5];
+	__u32 hash;
+	__u32 tc_classid;
+	__u32 data;
+	__u32 data_end;
+};
+
+/* user accessible context of BPF_PROG_TYPE_XDP programs, which the driver
+ * runs on a received frame before any sk_buff is built for it.
+ * data and data_end are read as packet pointers: the program must check
+ * data + off <= data_end before touching the bytes in between.
+ */
+struct xdp_md {
+	__u32 data;
+	__u32 data_end;
+};
+
+/* return codes of BPF_PROG_TYPE_XDP programs */
+enum xdp_action {
+	XDP_ABORTED = 0,	/* program error, frame is dropped */
+	XDP_DROP,		/* recycle the buffer, frame never reaches the stack */
+	XDP_PASS,		/* continue with normal receive processing */
+	XDP_TX,			/* bounce the frame out of the receiving port */
+};
+
+#ifdef __KERNEL__
+
+#include <linux/atomic.h>
+#include <linux/err.h>
+#include <linux/workqueue.h>
+
+struct bpf_map;
+struct sk_buff;
+
+/* map is generic key/value storage optionally accesible by eBPF programs */
+struct bpf_map_ops {
+	/* funcs callable from userspace (via syscall) */
+	struct bpf_map *(*map_alloc)(union bpf_attr *attr);
+	void (*map_free)(struct bpf_map *);
+	int (*map_get_next_key)(struct bpf_map *map, void *key, void *next_key);
+
+	/* funcs callable from userspace and from eBPF programs */
+	void *(*map_lookup_elem)(struct bpf_map *map, void *key);
+	int (*map_update_elem)(struct bpf_map *map, void *key, void *value,
+			       u64 flags);
+	int (*map_delete_elem)(struct bpf_map *map, void *key);
+};
+
+struct bpf_map {
+	atomic_t		refcnt;
+	enum bpf_map_type	map_type;
+	u32			key_size;
+	u32			value_size;
+	u32			max_entries;
+	const struct bpf_map_ops *ops;
+	struct work_struct	work;
+};
+
+struct bpf_map_type_list {
+	struct list_head	list_node;
+	const struct bpf_map_ops *ops;
+	enum bpf_map_type	type;
+};
+
+/* types of values stored in eBPF registers and of helper arguments */
+enum bpf_arg_type {
+	ARG_DONTCARE = 0,	/* unused argument in helper function */
+
+	/* the following constraints used to prototype
+	 * bpf_map_lookup/update/delete_elem() functions
+	 */
+	ARG_CONST_MAP_PTR,	/* const argument used as pointer to bpf_map */
+	ARG_PTR_TO_MAP_KEY,	/* pointer to stack used as map key */
+	ARG_PTR_TO_MAP_VALUE,	/* pointer to stack used as map value */
+
+	ARG_ANYTHING,		/* any (initialized) argument is ok */
+};
+
+/* types of values stored in eBPF registers, tracked by the verifier */
+enum bpf_reg_type {
+	NOT_INIT = 0,		 /* nothing was written into register */
+	UNKNOWN_VALUE,		 /* reg doesn't contain a valid pointer */
+	PTR_TO_CTX,		 /* reg points to bpf_context */
+	CONST_PTR_TO_MAP,	 /* reg points to struct bpf_map */
+	PTR_TO_MAP_VALUE,	 /* reg points to map element value */
+	PTR_TO_MAP_VALUE_OR_NULL,/* points to map elem value or NULL */
+	FRAME_PTR,		 /* reg == frame_pointer */
+	PTR_TO_STACK,		 /* reg == frame_pointer + imm */
+	CONST_IMM,		 /* constant integer value */
+	PTR_TO_PACKET,		 /* reg == packet start + imm */
+	PTR_TO_PACKET_END,	 /* reg == packet end */
+};
+
+/* type of values returned from helper functions */
+enum bpf_return_type {
+	RET_INTEGER,			/* function returns integer */
+	RET_VOID,			/* function doesn't return anything */
+	RET_PTR_TO_MAP_VALUE_OR_NULL,	/* returns a pointer to map elem value or NULL */
+};
+
+/* eBPF function prototype used by verifier to allow BPF_CALLs from eBPF
+ * programs to in-kernel helper functions and for adjusting imm32 field
+ * in BPF_CALL instructions after verifying
+ */
+struct bpf_func_proto {
+	u64 (*func)(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5);
+	bool gpl_only;		/* only callable from GPL compatible programs */
+	enum bpf_return_type ret_type;
+	enum bpf_arg_type arg1_type;
+	enum bpf_arg_type arg2_type;
+	enum bpf_arg_type arg3_type;
+	enum bpf_arg_type arg4_type;
+	enum bpf_arg_type arg5_type;
+};
+
+/* bpf_context is intentionally undefined structure. Pointer to bpf_context
+ * is the first argument to eBPF programs.
+ * For socket filters: 'struct bpf_context *' == 'struct sk_buff *'
+ */
+struct bpf_context;
+
+enum bpf_access_type {
+	BPF_READ = 1,
+	BPF_WRITE = 2
+};
+
+/* longest sequence a single ctx load may be converted into */
+#define BPF_CTX_MAX_INSNS	8
+
+struct bpf_verifier_ops {
+	/* return eBPF function prototype for verification */
+	const struct bpf_func_proto *(*get_func_proto)(enum bpf_func_id func_id);
+
+	/* return true if 'size' wide access at offset 'off' within bpf_context
+	 * with 'type' (read or write) is allowed.  A read may set *reg_type
+	 * when the loaded value is a pointer the verifier should track.
+	 */
+	bool (*is_valid_access)(int off, int size, enum bpf_access_type type,
+				enum bpf_reg_type *reg_type);
+
+	/* emit into insn_buf the instructions that load the in-kernel
+	 * counterpart of ctx field ctx_off from src_reg into dst_reg, and
+	 * return how many were emitted (at most BPF_CTX_MAX_INSNS)
+	 */
+	u32 (*convert_ctx_access)(int dst_reg, int src_reg, int ctx_off,
+				  struct bpf_insn *insn_buf);
+};
+
+struct bpf_prog_type_list {
+	struct list_head	list_node;
+	const struct bpf_verifier_ops *ops;
+	enum bpf_prog_type	type;
+};
+
+struct bpf_prog {
+	atomic_t		refcnt;
+	u32			len;		/* number of instructions */
+	enum bpf_prog_type	type;
+	bool			jited;
+	bool			may_access_skb;	/* uses LD_ABS or LD_IND */
+	bool			gpl_compatible;	/* license given at load time */
+	const struct bpf_verifier_ops *ops;
+	u32			used_map_cnt;
+	struct bpf_map		**used_maps;
+	struct work_struct	work;
+	unsigned int		(*bpf_func)(const void *ctx,
+					    const struct bpf_insn *insn);
+	struct bpf_insn		insnsi[0];
+};
+
+#define BPF_PROG_RUN(prog, ctx)	(*(prog)->bpf_func)(ctx, (prog)->insnsi)
+
+/* in-kernel context of BPF_PROG_TYPE_XDP programs */
+struct xdp_buff {
+	void *data;
+	void *data_end;
+};
+
+/* caller must hold rcu_read_lock() for the benefit of map helpers */
+static inline u32 bpf_prog_run_xdp(const struct bpf_prog *prog,
+				   struct xdp_buff *xdp)
+{
+	return BPF_PROG_RUN(prog, xdp);
+}
+
+/* verifier limits */
+#define BPF_COMPLEXITY_LIMIT_INSNS	32768
+
+extern u64 __bpf_call_base(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5);
+
+/* function argument constraints and helpers shared by all program types */
+extern const struct bpf_func_proto bpf_map_lookup_elem_proto;
+extern const struct bpf_func_proto bpf_map_update_elem_proto;
+extern const struct bpf_func_proto bpf_map_delete_elem_proto;
+
+#ifdef CONFIG_BPF_SYSCALL
+void bpf_register_map_type(struct bpf_map_type_list *tl);
+void bpf_register_prog_type(struct bpf_prog_type_list *tl);
+
+int bpf_check(struct bpf_prog **prog, union bpf_attr *attr);
+void bpf_prog_select_runtime(struct bpf_prog *prog);
+void bpf_int_jit_compile(struct bpf_prog *prog);
+unsigned int __bpf_prog_run(const void *ctx, const struct bpf_insn *insn);
+s64 bpf_load_skb(const struct sk_buff *skb, int off, unsigned int size);
+
+struct bpf_map *bpf_map_get(u32 ufd);
+struct bpf_prog *bpf_prog_get(u32 ufd);
+struct bpf_prog *bpf_prog_get_type(u32 ufd, enum bpf_prog_type type);
+void bpf_prog_put(struct bpf_prog *prog);
+void bpf_map_put(struct bpf_map *map);
+#else
+static inline struct bpf_prog *bpf_prog_get(u32 ufd)
+{
+	return ERR_PTR(-EOPNOTSUPP);
+}
+
+static inline struct bpf_prog *bpf_prog_get_type(u32 ufd,
+						 enum bpf_prog_type type)
+{
+	return ERR_PTR(-EOPNOTSUPP);
+}
+
+static inline void bpf_prog_put(struct bpf_prog *prog)
+{
+}
+#endif /* CONFIG_BPF_SYSCALL */
+
+#endif /* __KERNEL__ */
+
+#endif /* __LINUX_BPF_H__ */
@@ -0,0 +1,78 @@
+#ifndef _LINUX_CONTEXT_TRACKING_H
+#define _LINUX_CONTEXT_TRACKING_H
+
+#include <linux/sched.h>
+#include <linux/percpu.h>
+#include <asm/ptrace.h>
+
+/*
+ * Context tracking: probes on the kernel/user boundaries of the CPUs
+ * that asked for it (full dynticks CPUs).  While such a CPU executes
+ * user code, RCU considers it in an extended quiescent state and the
+ * time it spends there is charged to the task without help from the
+ * tick.
+ */
+struct context_tracking {
+	/*
+	 * When active is false, the probes are unset to minimize the
+	 * overhead: TIF_NOHZ is cleared and user_enter()/user_exit()
+	 * return without doing anything.
+	 */
+	bool active;
+	enum ctx_state {
+		IN_KERNEL = 0,
+		IN_USER,
+	} state;
+};
+
+#ifdef CONFIG_CONTEXT_TRACKING
+DECLARE_PER_CPU(struct context_tracking, context_tracking);
+
+static inline bool context_tracking_in_user(void)
+{
+	return __this_cpu_read(context_tracking.state) == IN_USER;
+}
+
+static inline bool context_tracking_active(void)
+{
+	return __this_cpu_read(context_tracking.active);
+}
+
+extern void user_enter(void);
+extern void user_exit(void);
+extern void context_tracking_cpu_set(int cpu);
+extern void context_tracking_task_switch(struct task_struct *prev,
+					 struct task_struct *next);
+
+extern void vtime_user_enter(struct task_struct *tsk);
+extern void vtime_user_exit(struct task_struct *tsk);
+extern void vtime_task_switch(struct task_struct *prev,
+			      struct task_struct *next);
+
+/*
+ * Exception handlers may be entered from user mode while the CPU is in
+ * the user extended quiescent state.  Leave it for the duration of the
+ * handler and go back to it if that is where the exception came from.
+ */
+static inline void exception_enter(struct pt_regs *regs)
+{
+	user_exit();
+}
+
+static inline void exception_exit(struct pt_regs *regs)
+{
+	if (user_mode(regs))
+		user_enter();
+}
+#else
+static inline bool context_tracking_in_user(void) { return false; }
+static inline bool context_tracking_active(void) { return false; }
+static inline void user_enter(void) { }
+static inline void user_exit(void) { }
+static inline void context_tracking_task_switch(struct task_struct *prev,
+						struct task_struct *next) { }
+static inline void exception_enter(struct pt_regs *regs) { }
+static inline void exception_exit(struct pt_regs *regs) { }
+#endif /* !CONFIG_CONTEXT_TRACKING */
+
+#endif /* _LINUX_CONTEXT_TRACKING_H */
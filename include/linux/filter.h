@@ -134,6 +134,7 @@ struct sock_fprog {	/* Required for SO_ATTACH_FILTER. */
 
 struct sk_buff;
 struct sock;
+struct bpf_prog;
 
 struct sk_filter
 {
@@ -141,6 +142,7 @@ struct sk_filter
 	unsigned int         	len;	/* Number of filter blocks */
 	unsigned int		(*bpf_func)(const struct sk_buff *skb,
 					    const struct sock_filter *filter);
+	struct bpf_prog		*prog;	/* eBPF program, len is 0 then */
 	struct rcu_head		rcu;
 	struct sock_filter     	insns[0];
 };
@@ -154,13 +156,15 @@ extern int sk_filter(struct sock *sk, struct sk_buff *skb);
 extern unsigned int sk_run_filter(const struct sk_buff *skb,
 				  const struct sock_filter *filter);
 extern int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk);
+extern int sk_attach_bpf(u32 ufd, struct sock *sk);
 extern int sk_detach_filter(struct sock *sk);
 extern int sk_chk_filter(struct sock_filter *filter, unsigned int flen);
+extern void *bpf_internal_load_pointer_neg_helper(const struct sk_buff *skb,
+						  int k, unsigned int size);
 
 #ifdef CONFIG_BPF_JIT
 extern void bpf_jit_compile(struct sk_filter *fp);
 extern void bpf_jit_free(struct sk_filter *fp);
-#define SK_RUN_FILTER(FILTER, SKB) (*FILTER->bpf_func)(SKB, FILTER->insns)
 #else
 static inline void bpf_jit_compile(struct sk_filter *fp)
 {
@@ -168,9 +172,13 @@ static inline void bpf_jit_compile(struct sk_filter *fp)
 static inline void bpf_jit_free(struct sk_filter *fp)
 {
 }
-#define SK_RUN_FILTER(FILTER, SKB) sk_run_filter(SKB, FILTER->insns)
 #endif
 
+/* bpf_func is sk_run_filter() unless the filter was JIT compiled or is
+ * an eBPF program attached with SO_ATTACH_BPF
+ */
+#define SK_RUN_FILTER(FILTER, SKB) (*FILTER->bpf_func)(SKB, FILTER->insns)
+
 enum {
 	BPF_S_RET_K = 1,
 	BPF_S_RET_A,
@@ -428,9 +428,10 @@ static inline u32 inet6_rsk_offset(struct request_sock *rsk)
 	return rsk->rsk_ops->obj_size - sizeof(struct inet6_request_sock);
 }
 
-static inline struct request_sock *inet6_reqsk_alloc(struct request_sock_ops *ops)
+static inline struct request_sock *inet6_reqsk_alloc(struct request_sock_ops *ops,
+						    struct sock *sk_listener)
 {
-	struct request_sock *req = reqsk_alloc(ops);
+	struct request_sock *req = inet_reqsk_alloc(ops, sk_listener);
 
 	if (req != NULL) {
 		inet_rsk(req)->inet6_rsk_offset = inet6_rsk_offset(req);
@@ -440,6 +441,23 @@ static inline struct request_sock *inet6_reqsk_alloc(struct request_sock_ops *op
 	return req;
 }
 
+/* Request socks hashed in the established table have no ipv6_pinfo, their
+ * addresses live in the inet6_request_sock.
+ */
+static inline const struct in6_addr *inet6_ehash_daddr(struct sock *sk)
+{
+	if (sk->sk_state == TCP_NEW_SYN_RECV)
+		return &inet6_rsk(inet_reqsk(sk))->rmt_addr;
+	return &inet6_sk(sk)->daddr;
+}
+
+static inline const struct in6_addr *inet6_ehash_rcv_saddr(struct sock *sk)
+{
+	if (sk->sk_state == TCP_NEW_SYN_RECV)
+		return &inet6_rsk(inet_reqsk(sk))->loc_addr;
+	return &inet6_sk(sk)->rcv_saddr;
+}
+
 static inline struct raw6_sock *raw6_sk(const struct sock *sk)
 {
 	return (struct raw6_sock *)sk;
@@ -525,15 +543,15 @@ static inline struct raw6_sock *raw6_sk(const struct sock *sk)
 
 #define INET6_MATCH(__sk, __net, __hash, __saddr, __daddr, __ports, __dif)\
 	(((__sk)->sk_hash == (__hash)) && sock_net((__sk)) == (__net)	&& \
-	 ((*((__portpair *)&(inet_sk(__sk)->inet_dport))) == (__ports)) && \
+	 ((__sk)->sk_portpair == (__ports))			&& \
 	 ((__sk)->sk_family		== AF_INET6)		&& \
-	 ipv6_addr_equal(&inet6_sk(__sk)->daddr, (__saddr))	&& \
-	 ipv6_addr_equal(&inet6_sk(__sk)->rcv_saddr, (__daddr))	&& \
+	 ipv6_addr_equal(inet6_ehash_daddr(__sk), (__saddr))	&& \
+	 ipv6_addr_equal(inet6_ehash_rcv_saddr(__sk), (__daddr)) && \
 	 (!((__sk)->sk_bound_dev_if) || ((__sk)->sk_bound_dev_if == (__dif))))
 
 #define INET6_TW_MATCH(__sk, __net, __hash, __saddr, __daddr, __ports, __dif) \
 	(((__sk)->sk_hash == (__hash)) && sock_net((__sk)) == (__net)	&& \
-	 (*((__portpair *)&(inet_twsk(__sk)->tw_dport)) == (__ports))	&& \
+	 ((__sk)->sk_portpair == (__ports))				&& \
 	 ((__sk)->sk_family	       == PF_INET6)			&& \
 	 (ipv6_addr_equal(&inet6_twsk(__sk)->tw_v6_daddr, (__saddr)))	&& \
 	 (ipv6_addr_equal(&inet6_twsk(__sk)->tw_v6_rcv_saddr, (__daddr))) && \
@@ -0,0 +1,72 @@
+#ifndef _NFNL_CLASSIFIER_H_
+#define _NFNL_CLASSIFIER_H_
+
+/* Compiled IPv4 packet classifier, configured through nfnetlink.
+ *
+ * A ruleset is an ordered list of rules attached to one of the IPv4
+ * netfilter hooks.  The first matching rule gives the verdict, like in
+ * an iptables chain, and the policy applies when no rule matches.
+ *
+ * Rules are loaded into a staging area with NFNL_MSG_CLS_NEW (several
+ * messages may be used, NLM_F_APPEND adds to the rules already staged)
+ * and atomically replace the active ruleset of the hook on
+ * NFNL_MSG_CLS_COMMIT.
+ */
+
+#define NFCLS_MAX_PORTS		15	/* same as xt_multiport */
+
+enum nfnl_cls_msg_types {
+	NFNL_MSG_CLS_NEW,
+	NFNL_MSG_CLS_COMMIT,
+	NFNL_MSG_CLS_GET,
+	NFNL_MSG_CLS_DEL,
+	NFNL_MSG_CLS_MAX
+};
+
+enum nfcls_attr_type {
+	NFCLS_UNSPEC,
+	NFCLS_HOOK,		/* u32: NF_INET_* hook number */
+	NFCLS_POLICY,		/* u32: NF_ACCEPT or NF_DROP */
+	NFCLS_RULES,		/* nested NFCLS_RULE list */
+	NFCLS_NRULES,		/* u32: number of rules (GET) */
+	NFCLS_NENTRIES,		/* u32: compiled hash entries (GET) */
+	NFCLS_NTABLES,		/* u32: compiled hash tables (GET) */
+	__NFCLS_MAX
+};
+#define NFCLS_MAX (__NFCLS_MAX - 1)
+
+enum nfcls_rules_attr_type {
+	NFCLS_RULES_UNSPEC,
+	NFCLS_RULE,		/* nested nfcls_rule_attr_type */
+	__NFCLS_RULES_MAX
+};
+#define NFCLS_RULES_MAX (__NFCLS_RULES_MAX - 1)
+
+enum nfcls_rule_attr_type {
+	NFCLS_RULE_UNSPEC,
+	NFCLS_RULE_SRC,		/* nested nfcls_range_attr_type, be32 */
+	NFCLS_RULE_DST,		/* nested nfcls_range_attr_type, be32 */
+	NFCLS_RULE_PROTO,	/* u8: layer 4 protocol, 0 matches any */
+	NFCLS_RULE_SPORTS,	/* nested list of NFCLS_PORTS_RANGE */
+	NFCLS_RULE_DPORTS,	/* nested list of NFCLS_PORTS_RANGE */
+	NFCLS_RULE_VERDICT,	/* u32: NF_ACCEPT or NF_DROP */
+	__NFCLS_RULE_MAX
+};
+#define NFCLS_RULE_MAX (__NFCLS_RULE_MAX - 1)
+
+enum nfcls_ports_attr_type {
+	NFCLS_PORTS_UNSPEC,
+	NFCLS_PORTS_RANGE,	/* nested nfcls_range_attr_type, be16 */
+	__NFCLS_PORTS_MAX
+};
+#define NFCLS_PORTS_MAX (__NFCLS_PORTS_MAX - 1)
+
+enum nfcls_range_attr_type {
+	NFCLS_RANGE_UNSPEC,
+	NFCLS_RANGE_FROM,	/* first value, network byte order */
+	NFCLS_RANGE_TO,		/* last value, network byte order */
+	__NFCLS_RANGE_MAX
+};
+#define NFCLS_RANGE_MAX (__NFCLS_RANGE_MAX - 1)
+
+#endif /* _NFNL_CLASSIFIER_H_ */
@@ -190,6 +190,10 @@ extern void rcu_idle_enter(void);
 extern void rcu_idle_exit(void);
 extern void rcu_irq_enter(void);
 extern void rcu_irq_exit(void);
+#ifdef CONFIG_CONTEXT_TRACKING
+extern void rcu_user_enter(void);
+extern void rcu_user_exit(void);
+#endif
 
 /**
  * RCU_NONIDLE - Indicate idle-loop code that needs RCU readers
@@ -49,16 +49,22 @@ extern struct tvec_base boot_tvec_bases;
 #endif
 
 /*
- * Note that all tvec_bases are 2 byte aligned and lower bit of
- * base in timer_list is guaranteed to be zero. Use the LSB to
- * indicate whether the timer is deferrable.
+ * Note that all tvec_bases are 4 byte aligned and the lower two bits
+ * of base in timer_list are guaranteed to be zero. Use them as flags.
  *
  * A deferrable timer will work normally when the system is busy, but
  * will not cause a CPU to come out of idle just to service it; instead,
  * the timer will be serviced when the CPU eventually wakes up with a
  * subsequent non-deferrable timer.
+ *
+ * A pinned timer always expires on the CPU it was queued on.  Other
+ * timers of an idle CPU may be expired by a busy one instead.  The flag
+ * is set by add_timer_on() and mod_timer_pinned() and is kept until the
+ * timer is initialized again.
  */
 #define TBASE_DEFERRABLE_FLAG		(0x1)
+#define TIMER_PINNED			(0x2)
+#define TBASE_FLAG_MASK			(TBASE_DEFERRABLE_FLAG | TIMER_PINNED)
 
 #define TIMER_INITIALIZER(_function, _expires, _data) {		\
 		.entry = { .prev = TIMER_ENTRY_STATIC },	\
@@ -215,7 +221,6 @@ extern int mod_timer_pinned(struct timer_list *timer, unsigned long expires);
 extern void set_timer_slack(struct timer_list *time, int slack_hz);
 
 #define TIMER_NOT_PINNED	0
-#define TIMER_PINNED		1
 /*
  * The jiffies value which is added to now, when there is no timer
  * in the timer wheel:
@@ -229,6 +234,12 @@ extern void set_timer_slack(struct timer_list *time, int slack_hz);
  */
 extern unsigned long get_next_timer_interrupt(unsigned long now);
 
+#if defined(CONFIG_NO_HZ) && defined(CONFIG_SMP)
+extern void timer_clear_idle(void);
+#else
+static inline void timer_clear_idle(void) { }
+#endif
+
 /*
  * Timer-statistics info:
  */
@@ -29,6 +29,8 @@ struct udphdr {
 /* UDP socket options */
 #define UDP_CORK	1	/* Never send partially complete segments */
 #define UDP_ENCAP	100	/* Set the socket to accept encapsulated packets */
+/* 101 to 104 are used by other kernels */
+#define UDP_RCVQ_PERCPU	200	/* Queue received datagrams per cpu */
 
 /* UDP encapsulation types */
 #define UDP_ENCAP_ESPINUDP_NON_IKE	1 /* draft-ietf-ipsec-nat-t-ike-00/01 */
@@ -81,6 +83,11 @@ struct udp_sock {
 	 * For encapsulation sockets.
 	 */
 	int (*encap_rcv)(struct sock *sk, struct sk_buff *skb);
+	/*
+	 * Per cpu receive queues (UDP_RCVQ_PERCPU), spliced into
+	 * sk_receive_queue by the reader.
+	 */
+	struct sk_buff_head __percpu *rcvq;
 };
 
 static inline struct udp_sock *udp_sk(const struct sock *sk)
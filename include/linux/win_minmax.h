@@ -0,0 +1,47 @@
+#ifndef _LINUX_WIN_MINMAX_H
+#define _LINUX_WIN_MINMAX_H
+
+/* Windowed running min/max estimator */
+
+/* For more documentation see lib/win_minmax.c */
+
+#include <linux/types.h>
+
+/* A single measurement and the time it was taken at */
+struct minmax_sample {
+	u32	t;
+	u32	v;
+};
+
+/* Best, 2nd best and 3rd best samples seen in the current window */
+struct minmax {
+	struct minmax_sample s[3];
+};
+
+/**
+ * minmax_get() - Get the current windowed min or max
+ * @m: Estimator
+ */
+static inline u32 minmax_get(const struct minmax *m)
+{
+	return m->s[0].v;
+}
+
+/**
+ * minmax_reset() - Forget all history and start over from one sample
+ * @m: Estimator
+ * @t: Time of the measurement
+ * @meas: Measured value
+ */
+static inline u32 minmax_reset(struct minmax *m, u32 t, u32 meas)
+{
+	struct minmax_sample val = { .t = t, .v = meas };
+
+	m->s[2] = m->s[1] = m->s[0] = val;
+	return m->s[0].v;
+}
+
+extern u32 minmax_running_max(struct minmax *m, u32 win, u32 t, u32 meas);
+extern u32 minmax_running_min(struct minmax *m, u32 win, u32 t, u32 meas);
+
+#endif /* _LINUX_WIN_MINMAX_H */
@@ -337,6 +337,7 @@ static inline void __skb_tunnel_rx(struct sk_buff *skb, struct net_device *dev)
 	if (!skb->l4_rxhash)
 		skb->rxhash = 0;
 	skb_set_queue_mapping(skb, 0);
+	skb->encapsulation = 0;
 	skb_dst_drop(skb);
 	nf_reset(skb);
 }
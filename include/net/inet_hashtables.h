@@ -251,6 +251,9 @@ extern void inet_put_port(struct sock *sk);
 
 void inet_hashinfo_init(struct inet_hashinfo *h);
 
+extern bool inet_ehash_insert(struct sock *sk, struct sock *osk);
+extern bool inet_ehash_nolisten(struct sock *sk, struct sock *osk);
+extern void sock_gen_put(struct sock *sk);
 extern int __inet_hash_nolisten(struct sock *sk, struct inet_timewait_sock *tw);
 extern void inet_hash(struct sock *sk);
 extern void inet_unhash(struct sock *sk);
@@ -270,14 +273,15 @@ static inline struct sock *inet_lookup_listener(struct net *net,
 
 /* Socket demux engine toys. */
 /* What happens here is ugly; there's a pair of adjacent fields in
-   struct inet_sock; __be16 dport followed by __u16 num.  We want to
+   struct sock_common; __be16 dport followed by __u16 num.  We want to
    search by pair, so we combine the keys into a single 32bit value
-   and compare with 32bit value read from &...->dport.  Let's at least
-   make sure that it's not mixed with anything else...
+   and compare with 32bit value read from &...->skc_portpair.  Let's at
+   least make sure that it's not mixed with anything else...
    On 64bit targets we combine comparisons with pair of adjacent __be32
    fields in the same way.
+   Because both pairs live in sock_common, INET_MATCH() is valid for full
+   sockets and for request socks hashed in the established table.
 */
-typedef __u32 __bitwise __portpair;
 #ifdef __BIG_ENDIAN
 #define INET_COMBINED_PORTS(__sport, __dport) \
 	((__force __portpair)(((__force __u32)(__be16)(__sport) << 16) | (__u32)(__dport)))
@@ -302,12 +306,12 @@ typedef __u64 __bitwise __addrpair;
 #define INET_MATCH(__sk, __net, __hash, __cookie, __saddr, __daddr, __ports, __dif)\
 	(((__sk)->sk_hash == (__hash)) && net_eq(sock_net(__sk), (__net)) &&	\
 	 ((*((__addrpair *)&(inet_sk(__sk)->inet_daddr))) == (__cookie))  &&	\
-	 ((*((__portpair *)&(inet_sk(__sk)->inet_dport))) == (__ports))   &&	\
+	 ((__sk)->sk_portpair == (__ports))   &&	\
 	 (!((__sk)->sk_bound_dev_if) || ((__sk)->sk_bound_dev_if == (__dif))))
 #define INET_TW_MATCH(__sk, __net, __hash, __cookie, __saddr, __daddr, __ports, __dif)\
 	(((__sk)->sk_hash == (__hash)) && net_eq(sock_net(__sk), (__net)) &&	\
 	 ((*((__addrpair *)&(inet_twsk(__sk)->tw_daddr))) == (__cookie)) &&	\
-	 ((*((__portpair *)&(inet_twsk(__sk)->tw_dport))) == (__ports)) &&	\
+	 ((__sk)->sk_portpair == (__ports)) &&	\
 	 (!((__sk)->sk_bound_dev_if) || ((__sk)->sk_bound_dev_if == (__dif))))
 #else /* 32-bit arch */
 #define INET_ADDR_COOKIE(__name, __saddr, __daddr)
@@ -315,13 +319,13 @@ typedef __u64 __bitwise __addrpair;
 	(((__sk)->sk_hash == (__hash)) && net_eq(sock_net(__sk), (__net))	&&	\
 	 (inet_sk(__sk)->inet_daddr	== (__saddr))		&&	\
 	 (inet_sk(__sk)->inet_rcv_saddr	== (__daddr))		&&	\
-	 ((*((__portpair *)&(inet_sk(__sk)->inet_dport))) == (__ports))	&&	\
+	 ((__sk)->sk_portpair == (__ports))	&&	\
 	 (!((__sk)->sk_bound_dev_if) || ((__sk)->sk_bound_dev_if == (__dif))))
 #define INET_TW_MATCH(__sk, __net, __hash,__cookie, __saddr, __daddr, __ports, __dif)	\
 	(((__sk)->sk_hash == (__hash)) && net_eq(sock_net(__sk), (__net))	&&	\
 	 (inet_twsk(__sk)->tw_daddr	== (__saddr))		&&	\
 	 (inet_twsk(__sk)->tw_rcv_saddr	== (__daddr))		&&	\
-	 ((*((__portpair *)&(inet_twsk(__sk)->tw_dport))) == (__ports)) &&	\
+	 ((__sk)->sk_portpair == (__ports)) &&	\
 	 (!((__sk)->sk_bound_dev_if) || ((__sk)->sk_bound_dev_if == (__dif))))
 #endif /* 64-bit arch */
 
@@ -40,6 +40,14 @@ struct inet_peer {
 	u32			pmtu_orig;
 	u32			pmtu_learned;
 	struct inetpeer_addr_base redirect_learned;
+	/* TCP Fast Open client cache, see net/ipv4/tcp_fastopen.c */
+	struct {
+		__u16			mss;
+		__s8			cookie_len;
+		__u8			cookie[16];
+		__u16			syn_loss;
+		unsigned long		last_syn_loss;
+	} tcp_fastopen;
 	union {
 		struct list_head	gc_list;
 		struct rcu_head     gc_rcu;
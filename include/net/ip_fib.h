@@ -20,6 +20,8 @@
 #include <linux/seq_file.h>
 #include <net/fib_rules.h>
 
+struct rtable;
+
 struct fib_config {
 	u8			fc_dst_len;
 	u8			fc_tos;
@@ -53,7 +55,8 @@ struct fib_nh {
 	unsigned char		nh_scope;
 #ifdef CONFIG_IP_ROUTE_MULTIPATH
 	int			nh_weight;
-	int			nh_power;
+	int			nh_buckets;	/* hash buckets mapped here */
+	int			nh_target;	/* buckets owed by weight */
 #endif
 #ifdef CONFIG_IP_ROUTE_CLASSID
 	__u32			nh_tclassid;
@@ -62,6 +65,10 @@ struct fib_nh {
 	__be32			nh_gw;
 	__be32			nh_saddr;
 	int			nh_saddr_genid;
+	/* per cpu forwarding or local delivery route through this nexthop */
+	struct rtable __rcu * __percpu *nh_pcpu_rth_input;
+	/* per cpu output route via this nexthop's gateway */
+	struct rtable __rcu * __percpu *nh_pcpu_rth_output;
 };
 
 /*
@@ -87,7 +94,7 @@ struct fib_info {
 #define fib_advmss fib_metrics[RTAX_ADVMSS-1]
 	int			fib_nhs;
 #ifdef CONFIG_IP_ROUTE_MULTIPATH
-	int			fib_power;
+	u16			*fib_mp_buckets; /* hash bucket -> nexthop */
 #endif
 	struct rcu_head		rcu;
 	struct fib_nh		fib_nh[0];
@@ -237,7 +244,10 @@ extern int fib_sync_down_dev(struct net_device *dev, int force);
 extern int fib_sync_down_addr(struct net *net, __be32 local);
 extern void fib_update_nh_saddrs(struct net_device *dev);
 extern int fib_sync_up(struct net_device *dev);
-extern void fib_select_multipath(struct fib_result *res);
+extern int sysctl_fib_multipath_hash_policy;
+extern u32 fib_multipath_hash_skb(const struct sk_buff *skb);
+extern u32 fib_multipath_hash_fl4(const struct flowi4 *fl4);
+extern void fib_select_multipath(struct fib_result *res, u32 hash);
 
 /* Exported by fib_trie.c */
 extern void fib_trie_init(void);
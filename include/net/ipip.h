@@ -49,8 +49,10 @@ struct ip_tunnel_prl_entry {
 	int err;							\
 	int pkt_len = skb->len - skb_transport_offset(skb);		\
 									\
-	skb->ip_summed = CHECKSUM_NONE;					\
-	ip_select_ident(iph, &rt->dst, NULL);				\
+	if (skb->ip_summed != CHECKSUM_PARTIAL)				\
+		skb->ip_summed = CHECKSUM_NONE;				\
+	ip_select_ident_more(iph, &rt->dst, NULL,			\
+			     (skb_shinfo(skb)->gso_segs ?: 1) - 1);	\
 									\
 	err = ip_local_out(skb);					\
 	if (likely(net_xmit_eval(err) == 0)) {				\
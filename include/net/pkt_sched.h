@@ -65,6 +65,8 @@ struct qdisc_watchdog {
 };
 
 extern void qdisc_watchdog_init(struct qdisc_watchdog *wd, struct Qdisc *qdisc);
+extern void qdisc_watchdog_schedule_ns(struct qdisc_watchdog *wd,
+				       u64 expires);
 extern void qdisc_watchdog_schedule(struct qdisc_watchdog *wd,
 				    psched_time_t expires);
 extern void qdisc_watchdog_cancel(struct qdisc_watchdog *wd);
@@ -89,7 +91,7 @@ extern void qdisc_put_stab(struct qdisc_size_table *tab);
 extern void qdisc_warn_nonwc(char *txt, struct Qdisc *qdisc);
 extern int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 			   struct net_device *dev, struct netdev_queue *txq,
-			   spinlock_t *root_lock);
+			   spinlock_t *root_lock, bool validate);
 
 extern void __qdisc_run(struct Qdisc *q);
 
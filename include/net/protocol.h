@@ -41,7 +41,8 @@ struct net_protocol {
 					       netdev_features_t features);
 	struct sk_buff	      **(*gro_receive)(struct sk_buff **head,
 					       struct sk_buff *skb);
-	int			(*gro_complete)(struct sk_buff *skb);
+	int			(*gro_complete)(struct sk_buff *skb,
+						int nhoff);
 	unsigned int		no_policy:1,
 				netns_ok:1;
 };
@@ -60,7 +61,7 @@ struct inet6_protocol {
 				       netdev_features_t features);
 	struct sk_buff **(*gro_receive)(struct sk_buff **head,
 					struct sk_buff *skb);
-	int	(*gro_complete)(struct sk_buff *skb);
+	int	(*gro_complete)(struct sk_buff *skb, int nhoff);
 
 	unsigned int	flags;	/* INET6_PROTO_xxx */
 };
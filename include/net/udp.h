@@ -267,4 +267,26 @@ extern void udp_init(void);
 extern int udp4_ufo_send_check(struct sk_buff *skb);
 extern struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 	netdev_features_t features);
+
+/**
+ *	struct udp_offload - GRO handlers of a UDP encapsulation
+ *	@port: destination UDP port the encapsulation listens on
+ *	@gro_receive: called with the GRO offset past the UDP header
+ *	@gro_complete: called with @nhoff pointing past the UDP header
+ *
+ *	A UDP tunnel registers one of these with udp_add_offload() so that
+ *	packets sent to @port are aggregated on their inner headers.
+ */
+struct udp_offload {
+	__be16			port;
+	struct sk_buff		**(*gro_receive)(struct sk_buff **head,
+						 struct sk_buff *skb);
+	int			(*gro_complete)(struct sk_buff *skb, int nhoff);
+};
+
+extern int udp_add_offload(struct udp_offload *uo);
+extern void udp_del_offload(struct udp_offload *uo);
+extern struct sk_buff **udp4_gro_receive(struct sk_buff **head,
+					 struct sk_buff *skb);
+extern int udp4_gro_complete(struct sk_buff *skb, int nhoff);
 #endif	/* _UDP_H */
@@ -0,0 +1,353 @@
+/*
+ * Extended BPF interpreter
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Programs reaching the interpreter have been accepted by the verifier:
+ * all jumps are forward and in range, registers are initialized before
+ * they are read, memory accesses are within the stack, a map value or the
+ * context, and the last instruction is an exit.  None of this is checked
+ * again here.
+ */
+#include <linux/kernel.h>
+#include <linux/export.h>
+#include <linux/types.h>
+#include <linux/atomic.h>
+#include <linux/math64.h>
+#include <linux/ratelimit.h>
+#include <linux/skbuff.h>
+#include <linux/filter.h>
+#include <linux/bpf.h>
+#include <asm/byteorder.h>
+#include <asm/unaligned.h>
+
+/* Base function for offset calculation. Needs to go into .text section,
+ * therefore keeping it non-static as well; will also be used by JITs
+ * anyway later on, so do not let the compiler omit it.
+ */
+noinline u64 __bpf_call_base(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5)
+{
+	return 0;
+}
+
+/**
+ *	bpf_load_skb - load packet data for BPF_LD | BPF_ABS and BPF_IND
+ *	@skb: buffer to read from
+ *	@off: offset, may be negative to reach the SKF_NET_OFF and SKF_LL_OFF
+ *	      areas like in classic BPF
+ *	@size: 1, 2 or 4 bytes
+ *
+ * Returns the value in host byte order, or a negative value if the access
+ * falls outside the packet, in which case the program returns 0.  Used by
+ * the interpreter and called directly from JIT compiled programs.
+ */
+s64 bpf_load_skb(const struct sk_buff *skb, int off, unsigned int size)
+{
+	u8 buf[4];
+	void *ptr;
+
+	if (off >= 0)
+		ptr = skb_header_pointer(skb, off, size, buf);
+	else
+		ptr = bpf_internal_load_pointer_neg_helper(skb, off, size);
+	if (!ptr)
+		return -EFAULT;
+
+	switch (size) {
+	case 4:
+		return get_unaligned_be32(ptr);
+	case 2:
+		return get_unaligned_be16(ptr);
+	default:
+		return *(u8 *)ptr;
+	}
+}
+
+/**
+ *	__bpf_prog_run - run eBPF program on a given context
+ *	@ctx: is the data we are operating on
+ *	@insn: is the array of eBPF instructions
+ *
+ * Decode and execute eBPF instructions.
+ */
+unsigned int __bpf_prog_run(const void *ctx, const struct bpf_insn *insn)
+{
+	u64 stack[MAX_BPF_STACK / sizeof(u64)];
+	u64 regs[MAX_BPF_REG];
+	u64 tmp;
+	s64 val;
+
+#define DST	regs[insn->dst_reg]
+#define SRC	regs[insn->src_reg]
+#define FP	regs[BPF_REG_FP]
+#define ARG1	regs[BPF_REG_1]
+#define CTX	regs[BPF_REG_6]
+#define IMM	insn->imm
+
+	FP = (u64) (unsigned long) &stack[ARRAY_SIZE(stack)];
+	ARG1 = (u64) (unsigned long) ctx;
+
+	for (;; insn++) {
+		switch (insn->code) {
+#define ALU(OPCODE, OP)						\
+		case BPF_ALU64 | OPCODE | BPF_X:		\
+			DST = DST OP SRC;			\
+			break;					\
+		case BPF_ALU | OPCODE | BPF_X:			\
+			DST = (u32) DST OP (u32) SRC;		\
+			break;					\
+		case BPF_ALU64 | OPCODE | BPF_K:		\
+			DST = DST OP IMM;			\
+			break;					\
+		case BPF_ALU | OPCODE | BPF_K:			\
+			DST = (u32) DST OP (u32) IMM;		\
+			break;
+
+		ALU(BPF_ADD,  +)
+		ALU(BPF_SUB,  -)
+		ALU(BPF_AND,  &)
+		ALU(BPF_OR,   |)
+		ALU(BPF_LSH, <<)
+		ALU(BPF_RSH, >>)
+		ALU(BPF_XOR,  ^)
+		ALU(BPF_MUL,  *)
+#undef ALU
+		case BPF_ALU | BPF_NEG:
+			DST = (u32) -DST;
+			break;
+		case BPF_ALU64 | BPF_NEG:
+			DST = -DST;
+			break;
+		case BPF_ALU | BPF_MOV | BPF_X:
+			DST = (u32) SRC;
+			break;
+		case BPF_ALU | BPF_MOV | BPF_K:
+			DST = (u32) IMM;
+			break;
+		case BPF_ALU64 | BPF_MOV | BPF_X:
+			DST = SRC;
+			break;
+		case BPF_ALU64 | BPF_MOV | BPF_K:
+			DST = IMM;
+			break;
+		case BPF_ALU | BPF_ARSH | BPF_X:
+			DST = (u32) ((s32) DST >> SRC);
+			break;
+		case BPF_ALU | BPF_ARSH | BPF_K:
+			DST = (u32) ((s32) DST >> IMM);
+			break;
+		case BPF_ALU64 | BPF_ARSH | BPF_X:
+			(*(s64 *) &DST) >>= SRC;
+			break;
+		case BPF_ALU64 | BPF_ARSH | BPF_K:
+			(*(s64 *) &DST) >>= IMM;
+			break;
+		case BPF_ALU64 | BPF_MOD | BPF_X:
+			if (unlikely(SRC == 0))
+				return 0;
+			DST = DST - div64_u64(DST, SRC) * SRC;
+			break;
+		case BPF_ALU | BPF_MOD | BPF_X:
+			if (unlikely((u32) SRC == 0))
+				return 0;
+			DST = (u32) DST % (u32) SRC;
+			break;
+		case BPF_ALU64 | BPF_MOD | BPF_K:
+			tmp = (u64) (s64) IMM;
+			DST = DST - div64_u64(DST, tmp) * tmp;
+			break;
+		case BPF_ALU | BPF_MOD | BPF_K:
+			DST = (u32) DST % (u32) IMM;
+			break;
+		case BPF_ALU64 | BPF_DIV | BPF_X:
+			if (unlikely(SRC == 0))
+				return 0;
+			DST = div64_u64(DST, SRC);
+			break;
+		case BPF_ALU | BPF_DIV | BPF_X:
+			if (unlikely((u32) SRC == 0))
+				return 0;
+			DST = (u32) DST / (u32) SRC;
+			break;
+		case BPF_ALU64 | BPF_DIV | BPF_K:
+			DST = div64_u64(DST, (u64) (s64) IMM);
+			break;
+		case BPF_ALU | BPF_DIV | BPF_K:
+			DST = (u32) DST / (u32) IMM;
+			break;
+		case BPF_ALU | BPF_END | BPF_TO_BE:
+			switch (IMM) {
+			case 16:
+				DST = (__force u16) cpu_to_be16(DST);
+				break;
+			case 32:
+				DST = (__force u32) cpu_to_be32(DST);
+				break;
+			case 64:
+				DST = (__force u64) cpu_to_be64(DST);
+				break;
+			}
+			break;
+		case BPF_ALU | BPF_END | BPF_TO_LE:
+			switch (IMM) {
+			case 16:
+				DST = (__force u16) cpu_to_le16(DST);
+				break;
+			case 32:
+				DST = (__force u32) cpu_to_le32(DST);
+				break;
+			case 64:
+				DST = (__force u64) cpu_to_le64(DST);
+				break;
+			}
+			break;
+
+		/* CALL */
+		case BPF_JMP | BPF_CALL:
+			/* Function call scratches BPF_R1-BPF_R5 registers,
+			 * preserves BPF_R6-BPF_R9, and stores return value
+			 * into BPF_R0.
+			 */
+			regs[BPF_REG_0] = (__bpf_call_base + insn->imm)(
+				regs[BPF_REG_1], regs[BPF_REG_2],
+				regs[BPF_REG_3], regs[BPF_REG_4],
+				regs[BPF_REG_5]);
+			break;
+
+		/* JMP */
+#define JMP(OPCODE, COND)					\
+		case BPF_JMP | OPCODE | BPF_X:			\
+			if (DST COND SRC)			\
+				insn += insn->off;		\
+			break;					\
+		case BPF_JMP | OPCODE | BPF_K:			\
+			if (DST COND (u64) (s64) IMM)		\
+				insn += insn->off;		\
+			break;
+
+		JMP(BPF_JEQ, ==)
+		JMP(BPF_JNE, !=)
+		JMP(BPF_JGT, >)
+		JMP(BPF_JGE, >=)
+		JMP(BPF_JSET, &)
+#undef JMP
+		case BPF_JMP | BPF_JA:
+			insn += insn->off;
+			break;
+		case BPF_JMP | BPF_JSGT | BPF_X:
+			if (((s64) DST) > ((s64) SRC))
+				insn += insn->off;
+			break;
+		case BPF_JMP | BPF_JSGT | BPF_K:
+			if (((s64) DST) > ((s64) IMM))
+				insn += insn->off;
+			break;
+		case BPF_JMP | BPF_JSGE | BPF_X:
+			if (((s64) DST) >= ((s64) SRC))
+				insn += insn->off;
+			break;
+		case BPF_JMP | BPF_JSGE | BPF_K:
+			if (((s64) DST) >= ((s64) IMM))
+				insn += insn->off;
+			break;
+		case BPF_JMP | BPF_EXIT:
+			return regs[BPF_REG_0];
+
+		/* STX and ST and LDX */
+#define LDST(SIZEOP, SIZE)						\
+		case BPF_STX | BPF_MEM | SIZEOP:			\
+			*(SIZE *)(unsigned long) (DST + insn->off) = SRC;	\
+			break;						\
+		case BPF_ST | BPF_MEM | SIZEOP:				\
+			*(SIZE *)(unsigned long) (DST + insn->off) = IMM;	\
+			break;						\
+		case BPF_LDX | BPF_MEM | SIZEOP:			\
+			DST = *(SIZE *)(unsigned long) (SRC + insn->off);	\
+			break;
+
+		LDST(BPF_B,   u8)
+		LDST(BPF_H,  u16)
+		LDST(BPF_W,  u32)
+		LDST(BPF_DW, u64)
+#undef LDST
+		case BPF_STX | BPF_XADD | BPF_W: /* lock xadd *(u32 *)(dst_reg + off16) += src_reg */
+			atomic_add((u32) SRC, (atomic_t *)(unsigned long)
+				   (DST + insn->off));
+			break;
+		case BPF_STX | BPF_XADD | BPF_DW: /* lock xadd *(u64 *)(dst_reg + off16) += src_reg */
+			atomic64_add((u64) SRC, (atomic64_t *)(unsigned long)
+				     (DST + insn->off));
+			break;
+		case BPF_LD | BPF_IMM | BPF_DW:
+			DST = (u64) (u32) insn[0].imm | ((u64) (u32) insn[1].imm) << 32;
+			insn++;
+			break;
+
+		/* BPF_LD | BPF_ABS and BPF_LD | BPF_IND implicitly read the
+		 * skb passed in the context register saved in R6, and end
+		 * the program returning 0 if the data is not in the packet.
+		 */
+		case BPF_LD | BPF_ABS | BPF_W:
+		case BPF_LD | BPF_ABS | BPF_H:
+		case BPF_LD | BPF_ABS | BPF_B:
+		case BPF_LD | BPF_IND | BPF_W:
+		case BPF_LD | BPF_IND | BPF_H:
+		case BPF_LD | BPF_IND | BPF_B:
+			tmp = IMM;
+			if (BPF_MODE(insn->code) == BPF_IND)
+				tmp += SRC;
+			switch (BPF_SIZE(insn->code)) {
+			case BPF_W:
+				val = bpf_load_skb((void *) (unsigned long) CTX,
+						   (int) tmp, 4);
+				break;
+			case BPF_H:
+				val = bpf_load_skb((void *) (unsigned long) CTX,
+						   (int) tmp, 2);
+				break;
+			default:
+				val = bpf_load_skb((void *) (unsigned long) CTX,
+						   (int) tmp, 1);
+				break;
+			}
+			if (val < 0)
+				return 0;
+			regs[BPF_REG_0] = val;
+			break;
+		default:
+			/* If we ever reach this, we have a bug somewhere. */
+			WARN_RATELIMIT(1, "unknown opcode %02x\n", insn->code);
+			return 0;
+		}
+	}
+#undef IMM
+#undef CTX
+#undef ARG1
+#undef FP
+#undef SRC
+#undef DST
+}
+EXPORT_SYMBOL_GPL(__bpf_prog_run);
+
+void __weak bpf_int_jit_compile(struct bpf_prog *prog)
+{
+}
+
+/**
+ *	bpf_prog_select_runtime - select execution runtime for BPF program
+ *	@prog: verified BPF program
+ *
+ * Try to JIT the program; if the architecture has no eBPF JIT or it gives
+ * up, the program runs in the interpreter.
+ */
+void bpf_prog_select_runtime(struct bpf_prog *prog)
+{
+	prog->bpf_func = __bpf_prog_run;
+	prog->jited = false;
+
+	bpf_int_jit_compile(prog);
+}
+EXPORT_SYMBOL_GPL(bpf_prog_select_runtime);
@@ -8,6 +8,7 @@
 #include <linux/math64.h>
 #include <asm/uaccess.h>
 #include <linux/kernel_stat.h>
+#include <linux/tick.h>
 #include <trace/events/timer.h>
 
 /*
@@ -764,6 +765,8 @@ static int posix_cpu_timer_set(struct k_itimer *timer, int flags,
 	if (new_expires.sched != 0 &&
 	    cpu_time_before(timer->it_clock, val, new_expires)) {
 		arm_timer(timer);
+		/* Full dynticks CPUs must check the new expiry from their tick */
+		tick_nohz_full_kick_all();
 	}
 
 	spin_unlock(&p->sighand->siglock);
@@ -1274,6 +1277,27 @@ static inline int fastpath_timer_check(struct task_struct *tsk)
 	return 0;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/**
+ * posix_cpu_timers_can_stop_tick - check whether @tsk relies on the tick
+ *
+ * @tsk:	The task (thread) being checked.
+ *
+ * Expired CPU timers are only noticed from the tick: a full dynticks CPU
+ * must keep it while the task or its thread group has one armed.
+ */
+bool posix_cpu_timers_can_stop_tick(struct task_struct *tsk)
+{
+	if (!task_cputime_zero(&tsk->cputime_expires))
+		return false;
+
+	if (tsk->signal->cputimer.running)
+		return false;
+
+	return true;
+}
+#endif
+
 /*
  * This is called from the timer interrupt handler.  The irq handler has
  * already updated our counts.  We need to check if any timers fire now.
@@ -1389,6 +1413,8 @@ void set_process_cpu_timer(struct task_struct *tsk, unsigned int clock_idx,
 			tsk->signal->cputime_expires.virt_exp = *newval;
 		break;
 	}
+
+	tick_nohz_full_kick_all();
 }
 
 static int do_cpu_nanosleep(const clockid_t which_clock, int flags,
@@ -52,6 +52,7 @@
 #include <linux/prefetch.h>
 #include <linux/delay.h>
 #include <linux/stop_machine.h>
+#include <linux/tick.h>
 
 #include "rcutree.h"
 #include <trace/events/rcu.h>
@@ -342,12 +343,15 @@ static int rcu_implicit_offline_qs(struct rcu_data *rdp)
  *
  * If the new value of the ->dynticks_nesting counter now is zero,
  * we really have entered idle, and must do the appropriate accounting.
- * The caller must have disabled interrupts.
+ * The caller must have disabled interrupts.  @user is true when the
+ * extended quiescent state being entered is user mode rather than the
+ * idle loop, in which case the current task need not be the idle task.
  */
-static void rcu_idle_enter_common(struct rcu_dynticks *rdtp, long long oldval)
+static void rcu_idle_enter_common(struct rcu_dynticks *rdtp, long long oldval,
+				  bool user)
 {
 	trace_rcu_dyntick("Start", oldval, 0);
-	if (!is_idle_task(current)) {
+	if (!user && !is_idle_task(current)) {
 		struct task_struct *idle = idle_task(smp_processor_id());
 
 		trace_rcu_dyntick("Error on entry: not idle task", oldval, 0);
@@ -356,7 +360,8 @@ static void rcu_idle_enter_common(struct rcu_dynticks *rdtp, long long oldval)
 			  current->pid, current->comm,
 			  idle->pid, idle->comm); /* must be idle task! */
 	}
-	rcu_prepare_for_idle(smp_processor_id());
+	if (!user)
+		rcu_prepare_for_idle(smp_processor_id());
 	/* CPUs seeing atomic_inc() must see prior RCU read-side crit sects */
 	smp_mb__before_atomic_inc();  /* See above. */
 	atomic_inc(&rdtp->dynticks);
@@ -364,8 +369,8 @@ static void rcu_idle_enter_common(struct rcu_dynticks *rdtp, long long oldval)
 	WARN_ON_ONCE(atomic_read(&rdtp->dynticks) & 0x1);
 
 	/*
-	 * The idle task is not permitted to enter the idle loop while
-	 * in an RCU read-side critical section.
+	 * Neither the idle task nor a task returning to user mode is
+	 * permitted to do so while in an RCU read-side critical section.
 	 */
 	rcu_lockdep_assert(!lock_is_held(&rcu_lock_map),
 			   "Illegal idle entry in RCU read-side critical section.");
@@ -375,19 +380,11 @@ static void rcu_idle_enter_common(struct rcu_dynticks *rdtp, long long oldval)
 			   "Illegal idle entry in RCU-sched read-side critical section.");
 }
 
-/**
- * rcu_idle_enter - inform RCU that current CPU is entering idle
- *
- * Enter idle mode, in other words, -leave- the mode in which RCU
- * read-side critical sections can occur.  (Though RCU read-side
- * critical sections can occur in irq handlers in idle, a possibility
- * handled by irq_enter() and irq_exit().)
- *
- * We crowbar the ->dynticks_nesting field to zero to allow for
- * the possibility of usermode upcalls having messed up our count
- * of interrupt nesting level during the prior busy period.
+/*
+ * Enter an extended quiescent state from process level, either the
+ * idle loop or, with context tracking, user mode.
  */
-void rcu_idle_enter(void)
+static void rcu_eqs_enter(bool user)
 {
 	unsigned long flags;
 	long long oldval;
@@ -401,11 +398,56 @@ void rcu_idle_enter(void)
 		rdtp->dynticks_nesting = 0;
 	else
 		rdtp->dynticks_nesting -= DYNTICK_TASK_NEST_VALUE;
-	rcu_idle_enter_common(rdtp, oldval);
+	rcu_idle_enter_common(rdtp, oldval, user);
 	local_irq_restore(flags);
 }
+
+/**
+ * rcu_idle_enter - inform RCU that current CPU is entering idle
+ *
+ * Enter idle mode, in other words, -leave- the mode in which RCU
+ * read-side critical sections can occur.  (Though RCU read-side
+ * critical sections can occur in irq handlers in idle, a possibility
+ * handled by irq_enter() and irq_exit().)
+ *
+ * We crowbar the ->dynticks_nesting field to zero to allow for
+ * the possibility of usermode upcalls having messed up our count
+ * of interrupt nesting level during the prior busy period.
+ */
+void rcu_idle_enter(void)
+{
+	rcu_eqs_enter(false);
+}
 EXPORT_SYMBOL_GPL(rcu_idle_enter);
 
+#ifdef CONFIG_CONTEXT_TRACKING
+/**
+ * rcu_user_enter - inform RCU that we are resuming userspace.
+ *
+ * Enter RCU idle mode right before resuming userspace.  No use of RCU
+ * is permitted between this call and rcu_user_exit().  This way the
+ * CPU doesn't need to maintain the tick for RCU maintenance purposes
+ * when it runs in userspace.
+ */
+void rcu_user_enter(void)
+{
+	rcu_eqs_enter(true);
+}
+#endif /* CONFIG_CONTEXT_TRACKING */
+
+/*
+ * An irq that leaves the extended quiescent state of a non-idle task
+ * must have interrupted user mode on a context tracking CPU.
+ */
+static inline bool rcu_irq_from_user(void)
+{
+#ifdef CONFIG_CONTEXT_TRACKING
+	return !is_idle_task(current);
+#else
+	return false;
+#endif
+}
+
 /**
  * rcu_irq_exit - inform RCU that current CPU is exiting irq towards idle
  *
@@ -436,7 +478,7 @@ void rcu_irq_exit(void)
 	if (rdtp->dynticks_nesting)
 		trace_rcu_dyntick("--=", oldval, rdtp->dynticks_nesting);
 	else
-		rcu_idle_enter_common(rdtp, oldval);
+		rcu_idle_enter_common(rdtp, oldval, rcu_irq_from_user());
 	local_irq_restore(flags);
 }
 
@@ -445,18 +487,21 @@ void rcu_irq_exit(void)
  *
  * If the new value of the ->dynticks_nesting counter was previously zero,
  * we really have exited idle, and must do the appropriate accounting.
- * The caller must have disabled interrupts.
+ * The caller must have disabled interrupts.  @user has the same meaning
+ * as for rcu_idle_enter_common().
  */
-static void rcu_idle_exit_common(struct rcu_dynticks *rdtp, long long oldval)
+static void rcu_idle_exit_common(struct rcu_dynticks *rdtp, long long oldval,
+				 bool user)
 {
 	smp_mb__before_atomic_inc();  /* Force ordering w/previous sojourn. */
 	atomic_inc(&rdtp->dynticks);
 	/* CPUs seeing atomic_inc() must see later RCU read-side crit sects */
 	smp_mb__after_atomic_inc();  /* See above. */
 	WARN_ON_ONCE(!(atomic_read(&rdtp->dynticks) & 0x1));
-	rcu_cleanup_after_idle(smp_processor_id());
+	if (!user)
+		rcu_cleanup_after_idle(smp_processor_id());
 	trace_rcu_dyntick("End", oldval, rdtp->dynticks_nesting);
-	if (!is_idle_task(current)) {
+	if (!user && !is_idle_task(current)) {
 		struct task_struct *idle = idle_task(smp_processor_id());
 
 		trace_rcu_dyntick("Error on exit: not idle task",
@@ -468,18 +513,10 @@ static void rcu_idle_exit_common(struct rcu_dynticks *rdtp, long long oldval)
 	}
 }
 
-/**
- * rcu_idle_exit - inform RCU that current CPU is leaving idle
- *
- * Exit idle mode, in other words, -enter- the mode in which RCU
- * read-side critical sections can occur.
- *
- * We crowbar the ->dynticks_nesting field to DYNTICK_TASK_NEST to
- * allow for the possibility of usermode upcalls messing up our count
- * of interrupt nesting level during the busy period that is just
- * now starting.
+/*
+ * Exit an extended quiescent state to process level, see rcu_eqs_enter().
  */
-void rcu_idle_exit(void)
+static void rcu_eqs_exit(bool user)
 {
 	unsigned long flags;
 	struct rcu_dynticks *rdtp;
@@ -493,11 +530,40 @@ void rcu_idle_exit(void)
 		rdtp->dynticks_nesting += DYNTICK_TASK_NEST_VALUE;
 	else
 		rdtp->dynticks_nesting = DYNTICK_TASK_EXIT_IDLE;
-	rcu_idle_exit_common(rdtp, oldval);
+	rcu_idle_exit_common(rdtp, oldval, user);
 	local_irq_restore(flags);
 }
+
+/**
+ * rcu_idle_exit - inform RCU that current CPU is leaving idle
+ *
+ * Exit idle mode, in other words, -enter- the mode in which RCU
+ * read-side critical sections can occur.
+ *
+ * We crowbar the ->dynticks_nesting field to DYNTICK_TASK_NEST to
+ * allow for the possibility of usermode upcalls messing up our count
+ * of interrupt nesting level during the busy period that is just
+ * now starting.
+ */
+void rcu_idle_exit(void)
+{
+	rcu_eqs_exit(false);
+}
 EXPORT_SYMBOL_GPL(rcu_idle_exit);
 
+#ifdef CONFIG_CONTEXT_TRACKING
+/**
+ * rcu_user_exit - inform RCU that we are exiting userspace.
+ *
+ * Exit RCU idle mode while entering the kernel because it can
+ * run a RCU read side critical section anytime.
+ */
+void rcu_user_exit(void)
+{
+	rcu_eqs_exit(true);
+}
+#endif /* CONFIG_CONTEXT_TRACKING */
+
 /**
  * rcu_irq_enter - inform RCU that current CPU is entering irq away from idle
  *
@@ -531,7 +597,7 @@ void rcu_irq_enter(void)
 	if (oldval)
 		trace_rcu_dyntick("++=", oldval, rdtp->dynticks_nesting);
 	else
-		rcu_idle_exit_common(rdtp, oldval);
+		rcu_idle_exit_common(rdtp, oldval, rcu_irq_from_user());
 	local_irq_restore(flags);
 }
 
@@ -1801,9 +1867,14 @@ static void invoke_rcu_core(void)
 	raise_softirq(RCU_SOFTIRQ);
 }
 
+/*
+ * Queue a callback on the current CPU.  Unless @offload is false, the
+ * callbacks of a no-CBs CPU are handed over to its offload kthread
+ * instead of being invoked from RCU_SOFTIRQ.
+ */
 static void
 __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
-	   struct rcu_state *rsp, bool lazy)
+	   struct rcu_state *rsp, bool lazy, bool offload)
 {
 	unsigned long flags;
 	struct rcu_data *rdp;
@@ -1824,6 +1895,12 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	local_irq_save(flags);
 	rdp = this_cpu_ptr(rsp->rda);
 
+	/* No-CBs CPUs leave the callback to their kthread. */
+	if (offload && __call_rcu_nocb(rdp, head, lazy)) {
+		local_irq_restore(flags);
+		return;
+	}
+
 	/* Add the callback to our list. */
 	*rdp->nxttail[RCU_NEXT_TAIL] = head;
 	rdp->nxttail[RCU_NEXT_TAIL] = &head->next;
@@ -1837,6 +1914,10 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	else
 		trace_rcu_callback(rsp->name, head, rdp->qlen_lazy, rdp->qlen);
 
+	/* A full dynticks CPU needs its tick back to push the callback. */
+	if (tick_nohz_full_cpu(smp_processor_id()) && tick_nohz_tick_stopped())
+		tick_nohz_full_kick();
+
 	/* If interrupts were disabled, don't dive into RCU core. */
 	if (irqs_disabled_flags(flags)) {
 		local_irq_restore(flags);
@@ -1882,7 +1963,7 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
  */
 void call_rcu_sched(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_sched_state, 0);
+	__call_rcu(head, func, &rcu_sched_state, 0, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu_sched);
 
@@ -1891,7 +1972,7 @@ EXPORT_SYMBOL_GPL(call_rcu_sched);
  */
 void call_rcu_bh(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_bh_state, 0);
+	__call_rcu(head, func, &rcu_bh_state, 0, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
@@ -2194,6 +2275,28 @@ static void rcu_barrier_func(void *type)
 	call_rcu_func(head, rcu_barrier_callback);
 }
 
+/*
+ * The offload kthreads of no-CBs CPUs keep invoking callbacks after
+ * their CPU went offline: queue a barrier callback behind them too.
+ * Called with CPU hotplug excluded.
+ */
+static void rcu_barrier_offline_nocbs(struct rcu_state *rsp)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct rcu_head *head = &per_cpu(rcu_barrier_head, cpu);
+
+		if (cpu_online(cpu) || !rcu_is_nocb_cpu(cpu))
+			continue;
+		debug_rcu_head_queue(head);
+		head->func = rcu_barrier_callback;
+		atomic_inc(&rcu_barrier_cpu_count);
+		if (!__call_rcu_nocb(per_cpu_ptr(rsp->rda, cpu), head, false))
+			atomic_dec(&rcu_barrier_cpu_count);
+	}
+}
+
 /*
  * Orchestrate the specified type of RCU barrier, waiting for all
  * RCU callbacks of the specified type to complete.
@@ -2218,7 +2321,10 @@ static void _rcu_barrier(struct rcu_state *rsp,
 	 * CPU has queued its RCU-barrier callback.
 	 */
 	atomic_set(&rcu_barrier_cpu_count, 1);
+	get_online_cpus();
 	on_each_cpu(rcu_barrier_func, (void *)call_rcu_func, 1);
+	rcu_barrier_offline_nocbs(rsp);
+	put_online_cpus();
 	if (atomic_dec_and_test(&rcu_barrier_cpu_count))
 		complete(&rcu_barrier_completion);
 	wait_for_completion(&rcu_barrier_completion);
@@ -2267,6 +2373,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	WARN_ON_ONCE(atomic_read(&rdp->dynticks->dynticks) != 1);
 	rdp->cpu = cpu;
 	rdp->rsp = rsp;
+	rcu_boot_init_nocb_percpu_data(rdp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
@@ -25,6 +25,7 @@
  */
 
 #include <linux/delay.h>
+#include <linux/bootmem.h>
 
 #define RCU_KTHREAD_PRIO 1
 
@@ -700,7 +701,7 @@ static void rcu_preempt_do_callbacks(void)
  */
 void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state, 0);
+	__call_rcu(head, func, &rcu_preempt_state, 0, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
@@ -714,7 +715,7 @@ EXPORT_SYMBOL_GPL(call_rcu);
 void kfree_call_rcu(struct rcu_head *head,
 		    void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state, 1);
+	__call_rcu(head, func, &rcu_preempt_state, 1, true);
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
@@ -1132,7 +1133,7 @@ static void rcu_preempt_process_callbacks(void)
 void kfree_call_rcu(struct rcu_head *head,
 		    void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_sched_state, 1);
+	__call_rcu(head, func, &rcu_sched_state, 1, true);
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
@@ -2299,3 +2300,266 @@ static void increment_cpu_stall_ticks(void)
 }
 
 #endif /* #else #ifdef CONFIG_RCU_CPU_STALL_INFO */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback processing from the boot-time-specified set of CPUs
+ * specified by rcu_nocb_mask.  For each CPU in the set and each RCU
+ * flavor, there is a kthread created that pulls the callbacks from the
+ * corresponding CPU, waits for a grace period to elapse, and invokes
+ * the callbacks.  The no-CBs CPUs do a wake_up() on their kthread when
+ * they insert a callback into an empty list, unless the rcu_nocb_poll
+ * boot parameter has been specified, in which case each kthread actively
+ * polls its CPU.  (Which isn't so great for energy efficiency, but which
+ * does reduce RCU's overhead on that CPU.)
+ *
+ * The kthreads are not bound to any CPU, so they can be confined to
+ * housekeeping CPUs with sched_setaffinity() or cpusets, leaving the
+ * no-CBs CPUs free of callback invocation jitter.  The no-CBs CPUs
+ * still take part in grace periods.
+ */
+
+static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
+static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
+static bool rcu_nocb_poll;	    /* Offload kthreads are to poll. */
+module_param(rcu_nocb_poll, bool, 0444);
+
+/* Parse the boot-time rcu_nocbs= CPU list from the kernel parameters. */
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+/* Is the specified CPU a no-CBs CPU? */
+static bool rcu_is_nocb_cpu(int cpu)
+{
+	if (have_rcu_nocb_mask)
+		return cpumask_test_cpu(cpu, rcu_nocb_mask);
+	return false;
+}
+
+/*
+ * Enqueue the specified callback onto the specified rcu_data structure's
+ * offload list, and wake up the kthread if the list was empty.  Returns
+ * false if callbacks are not offloaded (yet) for that rcu_data, in which
+ * case the caller must queue the callback the normal way.
+ *
+ * Callers are the CPU owning the rcu_data with irqs disabled, or
+ * rcu_barrier() for offline CPUs: the list is lock-free, with the
+ * kthread as its only consumer.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy)
+{
+	struct rcu_head **old_rhpp;
+	struct task_struct *t = ACCESS_ONCE(rdp->nocb_kthread);
+
+	if (!t)
+		return false;
+
+	/* Enqueue the callback on the nocb list and update counts. */
+	rhp->next = NULL;
+	old_rhpp = xchg(&rdp->nocb_tail, &rhp->next);
+	ACCESS_ONCE(*old_rhpp) = rhp;
+	atomic_long_inc(&rdp->nocb_q_count);
+	if (lazy)
+		atomic_long_inc(&rdp->nocb_q_count_lazy);
+
+	/* If we are the first to enqueue, wake up the kthread. */
+	if (old_rhpp == &rdp->nocb_head && !rcu_nocb_poll)
+		wake_up(&rdp->nocb_wq);
+
+	if (__is_kfree_rcu_offset((unsigned long)rhp->func))
+		trace_rcu_kfree_callback(rdp->rsp->name, rhp,
+					 (unsigned long)rhp->func,
+					 atomic_long_read(&rdp->nocb_q_count_lazy),
+					 atomic_long_read(&rdp->nocb_q_count));
+	else
+		trace_rcu_callback(rdp->rsp->name, rhp,
+				   atomic_long_read(&rdp->nocb_q_count_lazy),
+				   atomic_long_read(&rdp->nocb_q_count));
+	return true;
+}
+
+struct rcu_nocb_gp {
+	struct rcu_head head;
+	struct completion done;
+};
+
+static void rcu_nocb_gp_done(struct rcu_head *head)
+{
+	struct rcu_nocb_gp *gp = container_of(head, struct rcu_nocb_gp, head);
+
+	complete(&gp->done);
+}
+
+/*
+ * Wait for a full grace period of the rcu_data's flavor.  The callback
+ * used for that is queued on whatever CPU this kthread runs, without
+ * offloading: two kthreads waiting for each other's grace-period
+ * callback would otherwise deadlock.
+ */
+static void rcu_nocb_wait_gp(struct rcu_data *rdp)
+{
+	struct rcu_nocb_gp gp;
+
+	init_rcu_head_on_stack(&gp.head);
+	init_completion(&gp.done);
+	__call_rcu(&gp.head, rcu_nocb_gp_done, rdp->rsp, 0, false);
+	wait_for_completion(&gp.done);
+	destroy_rcu_head_on_stack(&gp.head);
+}
+
+/*
+ * Per-rcu_data kthread, but only for no-CBs CPUs.  Each kthread invokes
+ * callbacks queued by the corresponding no-CBs CPU.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	long c, cl;
+	struct rcu_head *list;
+	struct rcu_head *next;
+	struct rcu_head **tail;
+	struct rcu_data *rdp = arg;
+
+	/* Each pass through this loop invokes one batch of callbacks */
+	for (;;) {
+		/* If not polling, wait for next batch of callbacks. */
+		if (!rcu_nocb_poll)
+			wait_event_interruptible(rdp->nocb_wq,
+						 ACCESS_ONCE(rdp->nocb_head));
+		list = ACCESS_ONCE(rdp->nocb_head);
+		if (!list) {
+			schedule_timeout_interruptible(1);
+			flush_signals(current);
+			continue;
+		}
+
+		/*
+		 * Extract queued callbacks, update counts, and wait
+		 * for a grace period to elapse.
+		 */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+		c = atomic_long_xchg(&rdp->nocb_q_count, 0);
+		cl = atomic_long_xchg(&rdp->nocb_q_count_lazy, 0);
+		rcu_nocb_wait_gp(rdp);
+
+		/* Each pass through the following loop invokes a callback. */
+		trace_rcu_batch_start(rdp->rsp->name, cl, c, -1);
+		c = cl = 0;
+		while (list) {
+			next = list->next;
+			/* Wait for enqueuing to complete, if needed. */
+			while (next == NULL && &list->next != tail) {
+				schedule_timeout_interruptible(1);
+				next = list->next;
+			}
+			debug_rcu_head_unqueue(list);
+			local_bh_disable();
+			if (__rcu_reclaim(rdp->rsp->name, list))
+				cl++;
+			c++;
+			local_bh_enable();
+			list = next;
+			cond_resched();
+		}
+		trace_rcu_batch_end(rdp->rsp->name, c, !!list, 0, 0, 1);
+		rdp->n_nocbs_invoked += c;
+	}
+	return 0;
+}
+
+/* Initialize per-rcu_data variables for no-CBs CPUs. */
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_tail = &rdp->nocb_head;
+	init_waitqueue_head(&rdp->nocb_wq);
+}
+
+/* Create a kthread for each RCU flavor for each no-CBs CPU. */
+static void __init rcu_spawn_nocb_kthreads(struct rcu_state *rsp)
+{
+	int cpu;
+	struct rcu_data *rdp;
+	struct task_struct *t;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		t = kthread_run(rcu_nocb_kthread, rdp,
+				"rcuo%c/%d", rsp->name[4], cpu);
+		if (IS_ERR(t)) {
+			pr_err("RCU: failed to spawn no-CBs kthread for CPU %d\n",
+			       cpu);
+			continue;
+		}
+		/* Callbacks may be offloaded from now on. */
+		smp_wmb();
+		ACCESS_ONCE(rdp->nocb_kthread) = t;
+	}
+}
+
+/*
+ * Start offloading.  Full dynticks CPUs are no-CBs CPUs by default:
+ * they would otherwise keep their tick for as long as they have
+ * callbacks queued.  Runs after tick_nohz_init(), which validates the
+ * nohz_full= range.
+ */
+static int __init rcu_init_nocb(void)
+{
+	char buf[64];
+
+#ifdef CONFIG_NO_HZ_FULL
+	if (tick_nohz_full_running) {
+		if (!have_rcu_nocb_mask) {
+			if (!zalloc_cpumask_var(&rcu_nocb_mask, GFP_KERNEL))
+				return -ENOMEM;
+			have_rcu_nocb_mask = true;
+		}
+		cpumask_or(rcu_nocb_mask, rcu_nocb_mask, tick_nohz_full_mask);
+	}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+
+	if (!have_rcu_nocb_mask)
+		return 0;
+	cpumask_and(rcu_nocb_mask, rcu_nocb_mask, cpu_possible_mask);
+	if (cpumask_empty(rcu_nocb_mask))
+		return 0;
+
+	cpulist_scnprintf(buf, sizeof(buf), rcu_nocb_mask);
+	pr_info("\tOffload RCU callbacks from CPUs: %s.\n", buf);
+	if (rcu_nocb_poll)
+		pr_info("\tPoll for callbacks from no-CBs CPUs.\n");
+
+	rcu_spawn_nocb_kthreads(&rcu_sched_state);
+	rcu_spawn_nocb_kthreads(&rcu_bh_state);
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	rcu_spawn_nocb_kthreads(&rcu_preempt_state);
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+	return 0;
+}
+core_initcall(rcu_init_nocb);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool rcu_is_nocb_cpu(int cpu)
+{
+	return false;
+}
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy)
+{
+	return false;
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
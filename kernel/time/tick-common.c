@@ -296,6 +296,20 @@ static void tick_handover_do_timer(int *cpup)
 	if (*cpup == tick_do_timer_cpu) {
 		int cpu = cpumask_first(cpu_online_mask);
 
+#ifdef CONFIG_NO_HZ_FULL
+		/* Keep the timekeeping duty away from full dynticks CPUs */
+		if (tick_nohz_full_running) {
+			int hk;
+
+			for_each_online_cpu(hk) {
+				if (hk != *cpup && !tick_nohz_full_cpu(hk)) {
+					cpu = hk;
+					break;
+				}
+			}
+		}
+#endif
+
 		tick_do_timer_cpu = (cpu < nr_cpu_ids) ? cpu :
 			TICK_DO_TIMER_NONE;
 	}
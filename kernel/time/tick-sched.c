@@ -20,6 +20,11 @@
 #include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/module.h>
+#include <linux/irq_work.h>
+#include <linux/bootmem.h>
+#include <linux/posix-timers.h>
+#include <linux/perf_event.h>
+#include <linux/context_tracking.h>
 
 #include <asm/irq_regs.h>
 
@@ -272,49 +277,14 @@ u64 get_cpu_iowait_time_us(int cpu, u64 *last_update_time)
 }
 EXPORT_SYMBOL_GPL(get_cpu_iowait_time_us);
 
-static void tick_nohz_stop_sched_tick(struct tick_sched *ts)
+static void tick_nohz_stop_sched_tick(struct tick_sched *ts,
+				      ktime_t now, int cpu)
 {
 	unsigned long seq, last_jiffies, next_jiffies, delta_jiffies;
-	ktime_t last_update, expires, now;
+	ktime_t last_update, expires;
 	struct clock_event_device *dev = __get_cpu_var(tick_cpu_device).evtdev;
 	u64 time_delta;
-	int cpu;
-
-	cpu = smp_processor_id();
-	ts = &per_cpu(tick_cpu_sched, cpu);
-
-	now = tick_nohz_start_idle(cpu, ts);
-
-	/*
-	 * If this cpu is offline and it is the one which updates
-	 * jiffies, then give up the assignment and let it be taken by
-	 * the cpu which runs the tick timer next. If we don't drop
-	 * this here the jiffies might be stale and do_timer() never
-	 * invoked.
-	 */
-	if (unlikely(!cpu_online(cpu))) {
-		if (cpu == tick_do_timer_cpu)
-			tick_do_timer_cpu = TICK_DO_TIMER_NONE;
-	}
-
-	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
-		return;
-
-	if (need_resched())
-		return;
-
-	if (unlikely(local_softirq_pending() && cpu_online(cpu))) {
-		static int ratelimit;
-
-		if (ratelimit < 10) {
-			printk(KERN_ERR "NOHZ: local_softirq_pending %02x\n",
-			       (unsigned int) local_softirq_pending());
-			ratelimit++;
-		}
-		return;
-	}
 
-	ts->idle_calls++;
 	/* Read jiffies and the time when jiffies were updated last */
 	do {
 		seq = read_seqbegin(&xtime_lock);
@@ -365,6 +335,16 @@ static void tick_nohz_stop_sched_tick(struct tick_sched *ts)
 			time_delta = KTIME_MAX;
 		}
 
+#ifdef CONFIG_NO_HZ_FULL
+		/*
+		 * A CPU running a task keeps one tick per second, so that
+		 * the scheduler statistics of that task and the runqueue
+		 * clock do not go stale.
+		 */
+		if (!ts->inidle)
+			time_delta = min_t(u64, time_delta, NSEC_PER_SEC);
+#endif
+
 		/*
 		 * calculate the expiry time for the next timer wheel
 		 * timer. delta_jiffies >= NEXT_TIMER_MAX_DELTA signals
@@ -401,7 +381,6 @@ static void tick_nohz_stop_sched_tick(struct tick_sched *ts)
 		 * the scheduler tick in nohz_restart_sched_tick.
 		 */
 		if (!ts->tick_stopped) {
-			select_nohz_load_balancer(1);
 			calc_load_enter_idle();
 
 			ts->idle_tick = hrtimer_get_expires(&ts->sched_timer);
@@ -409,10 +388,12 @@ static void tick_nohz_stop_sched_tick(struct tick_sched *ts)
 			ts->idle_jiffies = last_jiffies;
 		}
 
-		ts->idle_sleeps++;
+		if (ts->inidle) {
+			ts->idle_sleeps++;
 
-		/* Mark expires */
-		ts->idle_expires = expires;
+			/* Mark expires */
+			ts->idle_expires = expires;
+		}
 
 		/*
 		 * If the expiration time == KTIME_MAX, then
@@ -446,6 +427,285 @@ out:
 	ts->sleep_length = ktime_sub(dev->next_event, now);
 }
 
+static void tick_nohz_restart(struct tick_sched *ts, ktime_t now)
+{
+	hrtimer_cancel(&ts->sched_timer);
+	hrtimer_set_expires(&ts->sched_timer, ts->idle_tick);
+
+	while (1) {
+		/* Forward the time to expire in the future */
+		hrtimer_forward(&ts->sched_timer, now, tick_period);
+
+		if (ts->nohz_mode == NOHZ_MODE_HIGHRES) {
+			hrtimer_start_expires(&ts->sched_timer,
+					      HRTIMER_MODE_ABS_PINNED);
+			/* Check, if the timer was already in the past */
+			if (hrtimer_active(&ts->sched_timer))
+				break;
+		} else {
+			if (!tick_program_event(
+				hrtimer_get_expires(&ts->sched_timer), 0))
+				break;
+		}
+		/* Reread time and update jiffies */
+		now = ktime_get();
+		tick_do_update_jiffies64(now);
+	}
+}
+
+static void tick_nohz_restart_sched_tick(struct tick_sched *ts, ktime_t now)
+{
+	/* Update jiffies first */
+	tick_do_update_jiffies64(now);
+
+	calc_load_exit_idle();
+	touch_softlockup_watchdog();
+	/*
+	 * Cancel the scheduled timer and restore the tick
+	 */
+	ts->tick_stopped  = 0;
+	ts->idle_exittime = now;
+
+	tick_nohz_restart(ts, now);
+}
+
+#ifdef CONFIG_NO_HZ_FULL
+bool tick_nohz_full_running;
+cpumask_var_t tick_nohz_full_mask;
+static bool tick_nohz_full_mask_set __initdata;
+
+/*
+ * Everything that relies on the tick of a CPU running a task has to
+ * be quiet before that tick can be stopped.  RCU callbacks and timer
+ * wheel events are checked by tick_nohz_stop_sched_tick() itself.
+ */
+static bool can_stop_full_tick(struct tick_sched *ts)
+{
+	WARN_ON_ONCE(!irqs_disabled());
+
+	if (unlikely(ts->nohz_mode != NOHZ_MODE_HIGHRES))
+		return false;
+
+	if (need_resched() || local_softirq_pending())
+		return false;
+
+	if (!sched_can_stop_tick())
+		return false;
+
+	if (!posix_cpu_timers_can_stop_tick(current))
+		return false;
+
+	if (!perf_event_can_stop_tick())
+		return false;
+
+	return true;
+}
+
+/*
+ * Called on irq exit of a full dynticks CPU that is not idle: stop the
+ * tick if nothing needs it anymore, restart it otherwise.
+ */
+static void tick_nohz_full_stop_tick(struct tick_sched *ts)
+{
+	int cpu = smp_processor_id();
+
+	if (!tick_nohz_full_cpu(cpu) || is_idle_task(current))
+		return;
+
+	if (!can_stop_full_tick(ts)) {
+		if (ts->tick_stopped)
+			tick_nohz_restart_sched_tick(ts, ktime_get());
+		return;
+	}
+
+	tick_nohz_stop_sched_tick(ts, ktime_get(), cpu);
+}
+
+/*
+ * The kick only has to raise an interrupt: the tick is reevaluated
+ * by tick_nohz_irq_exit() on the way out of it.
+ */
+static void nohz_full_kick_work_func(struct irq_work *work)
+{
+}
+
+static DEFINE_PER_CPU(struct irq_work, nohz_full_kick_work) = {
+	.func = nohz_full_kick_work_func,
+};
+
+/**
+ * tick_nohz_full_kick - reevaluate the tick of the current CPU
+ *
+ * Used when something that needs the tick, like a perf event that must
+ * be rotated, has been set up on this full dynticks CPU.
+ */
+void tick_nohz_full_kick(void)
+{
+	if (tick_nohz_full_cpu(smp_processor_id()))
+		irq_work_queue(&__get_cpu_var(nohz_full_kick_work));
+}
+
+/**
+ * tick_nohz_full_kick_cpu - reevaluate the tick of a full dynticks CPU
+ * @cpu: the CPU to kick, must be called with preemption disabled
+ */
+void tick_nohz_full_kick_cpu(int cpu)
+{
+	if (!tick_nohz_full_cpu(cpu))
+		return;
+
+	if (cpu == smp_processor_id())
+		irq_work_queue(&__get_cpu_var(nohz_full_kick_work));
+	else
+		smp_send_reschedule(cpu);
+}
+
+/**
+ * tick_nohz_full_kick_all - reevaluate the tick of all full dynticks CPUs
+ *
+ * Used for state that any CPU may have to look at from its tick, like
+ * the process wide POSIX CPU timers.
+ */
+void tick_nohz_full_kick_all(void)
+{
+	int cpu;
+
+	if (!tick_nohz_full_running)
+		return;
+
+	preempt_disable();
+	for_each_cpu_and(cpu, tick_nohz_full_mask, cpu_online_mask)
+		tick_nohz_full_kick_cpu(cpu);
+	preempt_enable();
+}
+
+bool tick_nohz_tick_stopped(void)
+{
+	return __this_cpu_read(tick_cpu_sched.tick_stopped);
+}
+
+/*
+ * Parse the boot-time list of full dynticks CPUs.
+ */
+static int __init tick_nohz_full_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		pr_warning("NOHZ: Incorrect nohz_full cpumask\n");
+		return 1;
+	}
+	tick_nohz_full_mask_set = true;
+
+	return 1;
+}
+__setup("nohz_full=", tick_nohz_full_setup);
+
+/*
+ * Runs before the secondary CPUs are brought up, so the context
+ * tracking probes are armed before any task runs on them.
+ */
+static int __init tick_nohz_init(void)
+{
+	char buf[64];
+	int cpu;
+
+	if (!tick_nohz_full_mask_set || !tick_nohz_enabled)
+		return 0;
+
+	/* The boot CPU keeps the timekeeping duty */
+	cpu = smp_processor_id();
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		pr_warning("NOHZ: Clearing %d from nohz_full range for timekeeping\n",
+			   cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+
+	if (cpumask_empty(tick_nohz_full_mask))
+		return 0;
+
+	for_each_cpu(cpu, tick_nohz_full_mask)
+		context_tracking_cpu_set(cpu);
+
+	tick_nohz_full_running = true;
+
+	cpulist_scnprintf(buf, sizeof(buf), tick_nohz_full_mask);
+	pr_info("NOHZ: Full dynticks CPUs: %s.\n", buf);
+
+	return 0;
+}
+early_initcall(tick_nohz_init);
+#else
+static inline void tick_nohz_full_stop_tick(struct tick_sched *ts) { }
+#endif /* CONFIG_NO_HZ_FULL */
+
+static bool can_stop_idle_tick(int cpu, struct tick_sched *ts)
+{
+	/*
+	 * If this cpu is offline and it is the one which updates
+	 * jiffies, then give up the assignment and let it be taken by
+	 * the cpu which runs the tick timer next. If we don't drop
+	 * this here the jiffies might be stale and do_timer() never
+	 * invoked.
+	 */
+	if (unlikely(!cpu_online(cpu))) {
+		if (cpu == tick_do_timer_cpu)
+			tick_do_timer_cpu = TICK_DO_TIMER_NONE;
+	}
+
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
+		return false;
+
+	if (need_resched())
+		return false;
+
+	if (unlikely(local_softirq_pending() && cpu_online(cpu))) {
+		static int ratelimit;
+
+		if (ratelimit < 10) {
+			printk(KERN_ERR "NOHZ: local_softirq_pending %02x\n",
+			       (unsigned int) local_softirq_pending());
+			ratelimit++;
+		}
+		return false;
+	}
+
+#ifdef CONFIG_NO_HZ_FULL
+	if (tick_nohz_full_running) {
+		/*
+		 * Keep the timekeeping CPU tick as long as full dynticks
+		 * CPUs rely on it for jiffies and wall time.
+		 */
+		if (tick_do_timer_cpu == cpu)
+			return false;
+		/*
+		 * Boot safety: make sure the timekeeping duty has been
+		 * assigned before entering dyntick-idle mode.
+		 */
+		if (tick_do_timer_cpu == TICK_DO_TIMER_NONE)
+			return false;
+	}
+#endif
+
+	return true;
+}
+
+static void __tick_nohz_idle_enter(struct tick_sched *ts)
+{
+	int cpu = smp_processor_id();
+	ktime_t now;
+
+	now = tick_nohz_start_idle(cpu, ts);
+
+	if (!can_stop_idle_tick(cpu, ts))
+		return;
+
+	ts->idle_calls++;
+	tick_nohz_stop_sched_tick(ts, now, cpu);
+
+	if (ts->tick_stopped)
+		select_nohz_load_balancer(1);
+}
+
 /**
  * tick_nohz_idle_enter - stop the idle tick from the idle task
  *
@@ -481,7 +741,14 @@ void tick_nohz_idle_enter(void)
 	 * update of the idle time accounting in tick_nohz_start_idle().
 	 */
 	ts->inidle = 1;
-	tick_nohz_stop_sched_tick(ts);
+	/*
+	 * A full dynticks CPU may come here with the tick already
+	 * stopped by the task that just went to sleep: idle time
+	 * starts now, not when the tick was stopped.
+	 */
+	if (ts->tick_stopped)
+		ts->idle_jiffies = jiffies;
+	__tick_nohz_idle_enter(ts);
 
 	local_irq_enable();
 }
@@ -493,18 +760,23 @@ void tick_nohz_idle_enter(void)
  * a reschedule, it may still add, modify or delete a timer, enqueue
  * an RCU callback, etc...
  * So we need to re-calculate and reprogram the next tick event.
+ *
+ * On a full dynticks CPU running a task, the interrupt may also have
+ * made the tick necessary again, or unnecessary.
  */
 void tick_nohz_irq_exit(void)
 {
 	unsigned long flags;
 	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
 
-	if (!ts->inidle)
+	if (!ts->inidle) {
+		tick_nohz_full_stop_tick(ts);
 		return;
+	}
 
 	local_irq_save(flags);
 
-	tick_nohz_stop_sched_tick(ts);
+	__tick_nohz_idle_enter(ts);
 
 	local_irq_restore(flags);
 }
@@ -521,32 +793,6 @@ ktime_t tick_nohz_get_sleep_length(void)
 	return ts->sleep_length;
 }
 
-static void tick_nohz_restart(struct tick_sched *ts, ktime_t now)
-{
-	hrtimer_cancel(&ts->sched_timer);
-	hrtimer_set_expires(&ts->sched_timer, ts->idle_tick);
-
-	while (1) {
-		/* Forward the time to expire in the future */
-		hrtimer_forward(&ts->sched_timer, now, tick_period);
-
-		if (ts->nohz_mode == NOHZ_MODE_HIGHRES) {
-			hrtimer_start_expires(&ts->sched_timer,
-					      HRTIMER_MODE_ABS_PINNED);
-			/* Check, if the timer was already in the past */
-			if (hrtimer_active(&ts->sched_timer))
-				break;
-		} else {
-			if (!tick_program_event(
-				hrtimer_get_expires(&ts->sched_timer), 0))
-				break;
-		}
-		/* Reread time and update jiffies */
-		now = ktime_get();
-		tick_do_update_jiffies64(now);
-	}
-}
-
 /**
  * tick_nohz_idle_exit - restart the idle tick from the idle task
  *
@@ -568,6 +814,7 @@ void tick_nohz_idle_exit(void)
 	WARN_ON_ONCE(!ts->inidle);
 
 	ts->inidle = 0;
+	timer_clear_idle();
 
 	if (ts->idle_active || ts->tick_stopped)
 		now = ktime_get();
@@ -598,15 +845,7 @@ void tick_nohz_idle_exit(void)
 		account_idle_ticks(ticks);
 #endif
 
-	calc_load_exit_idle();
-	touch_softlockup_watchdog();
-	/*
-	 * Cancel the scheduled timer and restore the tick
-	 */
-	ts->tick_stopped  = 0;
-	ts->idle_exittime = now;
-
-	tick_nohz_restart(ts, now);
+	tick_nohz_restart_sched_tick(ts, now);
 
 	local_irq_enable();
 }
@@ -636,7 +875,8 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 
 	/* Check, if the jiffies need an update */
@@ -788,7 +1028,8 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 #endif
 
@@ -55,49 +55,103 @@ u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 EXPORT_SYMBOL(jiffies_64);
 
 /*
- * per-CPU timer vector definitions:
+ * The timer wheel has LVL_DEPTH levels of LVL_SIZE buckets each.  Every
+ * level is LVL_CLK_DIV times coarser than the one below it:
+ *
+ * HZ 1000
+ * Level Offset  Granularity            Range (approximate)
+ *  0      0         1 ms                0 ms -         63 ms
+ *  1     64         8 ms               64 ms -        511 ms
+ *  2    128        64 ms              512 ms -       4095 ms (512ms - ~4s)
+ *  3    192       512 ms             4096 ms -      32767 ms (~4s - ~32s)
+ *  4    256      4096 ms (~4s)      32768 ms -     262143 ms (~32s - ~4m)
+ *  5    320     32768 ms (~32s)    262144 ms -    2097151 ms (~4m - ~34m)
+ *  6    384    262144 ms (~4m)    2097152 ms -   16777215 ms (~34m - ~4h)
+ *  7    448   2097152 ms (~34m)  16777216 ms -  134217727 ms (~4h - ~1d)
+ *  8    512  16777216 ms (~4h)  134217728 ms - 1073741822 ms (~1d - ~12d)
+ *
+ * A timer is queued on the level whose range covers its timeout and is
+ * never moved again: there is no cascading.  The expiry time is rounded
+ * up to the granularity of that level, so a timer never fires early but
+ * may fire late by up to 1/8th or so of its timeout.  Networking and
+ * other timeout-style timers are almost always removed or rearmed long
+ * before they would expire, so they never pay for a cascade they did not
+ * need.  Timeouts beyond the capacity of the wheel are clamped to it.
+ *
+ * The pending_map has one bit per bucket, which lets the idle code find
+ * the next expiring bucket without walking the lists.
+ *
+ * Every CPU has three wheels, called bases: one for pinned timers, one
+ * for the other (global) timers and one for deferrable timers.  Keeping
+ * deferrable timers apart means the pending_map of the first two bases is
+ * all the idle code needs to look at.  The global timers of an idle CPU
+ * are handed to the timer migration hierarchy, see below, and are expired
+ * by a busy CPU rather than waking the idle one up.
  */
-#define TVN_BITS (CONFIG_BASE_SMALL ? 4 : 6)
-#define TVR_BITS (CONFIG_BASE_SMALL ? 6 : 8)
-#define TVN_SIZE (1 << TVN_BITS)
-#define TVR_SIZE (1 << TVR_BITS)
-#define TVN_MASK (TVN_SIZE - 1)
-#define TVR_MASK (TVR_SIZE - 1)
-#define MAX_TVAL ((unsigned long)((1ULL << (TVR_BITS + 4*TVN_BITS)) - 1))
-
-struct tvec {
-	struct list_head vec[TVN_SIZE];
-};
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+/* First timeout (in jiffies) that is queued on level n */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+#define LVL_BITS	6
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
+
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+#define WHEEL_SIZE		(LVL_SIZE * LVL_DEPTH)
 
-struct tvec_root {
-	struct list_head vec[TVR_SIZE];
+enum {
+	BASE_LOCAL,
+	BASE_GLOBAL,
+	BASE_DEF,
+	NR_BASES
 };
 
 struct tvec_base {
 	spinlock_t lock;
 	struct timer_list *running_timer;
 	unsigned long timer_jiffies;
-	unsigned long next_timer;
-	struct tvec_root tv1;
-	struct tvec tv2;
-	struct tvec tv3;
-	struct tvec tv4;
-	struct tvec tv5;
+	int cpu;
+	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
+	struct list_head vectors[WHEEL_SIZE];
 } ____cacheline_aligned;
 
 struct tvec_base boot_tvec_bases;
 EXPORT_SYMBOL(boot_tvec_bases);
-static DEFINE_PER_CPU(struct tvec_base *, tvec_bases) = &boot_tvec_bases;
+/* The other bases of the boot CPU */
+static struct tvec_base boot_tvec_global_base, boot_tvec_def_base;
+static DEFINE_PER_CPU(struct tvec_base *, tvec_bases[NR_BASES]) = {
+	[BASE_LOCAL]	= &boot_tvec_bases,
+	[BASE_GLOBAL]	= &boot_tvec_global_base,
+	[BASE_DEF]	= &boot_tvec_def_base,
+};
 
-/* Functions below help us manage 'deferrable' flag */
+/* Functions below help us manage the 'deferrable' and 'pinned' flags */
 static inline unsigned int tbase_get_deferrable(struct tvec_base *base)
 {
 	return ((unsigned int)(unsigned long)base & TBASE_DEFERRABLE_FLAG);
 }
 
+static inline unsigned int tbase_get_pinned(struct tvec_base *base)
+{
+	return ((unsigned int)(unsigned long)base & TIMER_PINNED);
+}
+
 static inline struct tvec_base *tbase_get_base(struct tvec_base *base)
 {
-	return ((struct tvec_base *)((unsigned long)base & ~TBASE_DEFERRABLE_FLAG));
+	return ((struct tvec_base *)((unsigned long)base & ~TBASE_FLAG_MASK));
 }
 
 static inline void timer_set_deferrable(struct timer_list *timer)
@@ -105,11 +159,28 @@ static inline void timer_set_deferrable(struct timer_list *timer)
 	timer->base = TBASE_MAKE_DEFERRED(timer->base);
 }
 
+static inline void timer_set_pinned(struct timer_list *timer)
+{
+	timer->base = (struct tvec_base *)((unsigned long)timer->base |
+					   TIMER_PINNED);
+}
+
 static inline void
 timer_set_base(struct timer_list *timer, struct tvec_base *new_base)
 {
 	timer->base = (struct tvec_base *)((unsigned long)(new_base) |
-				      tbase_get_deferrable(timer->base));
+		((unsigned long)timer->base & TBASE_FLAG_MASK));
+}
+
+/* The base of @cpu that @timer is queued on */
+static inline struct tvec_base *
+get_target_base(struct timer_list *timer, int cpu)
+{
+	if (tbase_get_deferrable(timer->base))
+		return per_cpu(tvec_bases, cpu)[BASE_DEF];
+	if (tbase_get_pinned(timer->base))
+		return per_cpu(tvec_bases, cpu)[BASE_LOCAL];
+	return per_cpu(tvec_bases, cpu)[BASE_GLOBAL];
 }
 
 static unsigned long round_jiffies_common(unsigned long j, int cpu,
@@ -331,47 +402,77 @@ void set_timer_slack(struct timer_list *timer, int slack_hz)
 }
 EXPORT_SYMBOL_GPL(set_timer_slack);
 
-static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+/*
+ * Bucket index of @expires on level @lvl.  The expiry is rounded up to the
+ * level granularity so that the timer never fires before ->expires.
+ */
+static inline unsigned int calc_index(unsigned long expires, unsigned int lvl)
 {
-	unsigned long expires = timer->expires;
-	unsigned long idx = expires - base->timer_jiffies;
-	struct list_head *vec;
-
-	if (idx < TVR_SIZE) {
-		int i = expires & TVR_MASK;
-		vec = base->tv1.vec + i;
-	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
-		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = base->tv2.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec = base->tv3.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv4.vec + i;
-	} else if ((signed long) idx < 0) {
-		/*
-		 * Can happen if you add a timer with expires == jiffies,
-		 * or you set a timer to go off in the past
-		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
-	} else {
-		int i;
-		/* If the timeout is larger than MAX_TVAL (on 64-bit
-		 * architectures or with CONFIG_BASE_SMALL=1) then we
-		 * use the maximum timeout.
-		 */
-		if (idx > MAX_TVAL) {
-			idx = MAX_TVAL;
-			expires = idx + base->timer_jiffies;
-		}
-		i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv5.vec + i;
+	expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+static unsigned int calc_wheel_index(unsigned long expires, unsigned long clk)
+{
+	unsigned long delta = expires - clk;
+	unsigned int lvl;
+
+	/*
+	 * Can happen if you add a timer with expires == jiffies,
+	 * or you set a timer to go off in the past
+	 */
+	if ((long) delta < 0)
+		return clk & LVL_MASK;
+
+	/*
+	 * Force expire obscene large timeouts to expire at the
+	 * capacity limit of the wheel.
+	 */
+	if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+		expires = clk + WHEEL_TIMEOUT_MAX;
+		delta = WHEEL_TIMEOUT_MAX;
 	}
+
+	for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++)
+		if (delta < LVL_START(lvl + 1))
+			break;
+
+	return calc_index(expires, lvl);
+}
+
+#ifdef CONFIG_NO_HZ
+static unsigned long __next_timer_interrupt(struct tvec_base *base);
+
+/*
+ * The base of a CPU which sat in dynticks idle lags behind jiffies.  Timers
+ * are queued relative to base->timer_jiffies, so a stale base would put new
+ * timers on a coarser level than their timeout warrants.  Catch up with
+ * jiffies unless some bucket in between is still waiting to be run.
+ */
+static void forward_timer_base(struct tvec_base *base)
+{
+	unsigned long jnow = jiffies;
+
+	if ((long)(jnow - base->timer_jiffies) < (long)LVL_CLK_DIV)
+		return;
+	if (time_after(__next_timer_interrupt(base), jnow))
+		base->timer_jiffies = jnow;
+}
+#else
+static inline void forward_timer_base(struct tvec_base *base) { }
+#endif
+
+static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+{
+	unsigned int idx;
+
+	forward_timer_base(base);
+	idx = calc_wheel_index(timer->expires, base->timer_jiffies);
 	/*
 	 * Timers are FIFO:
 	 */
-	list_add_tail(&timer->entry, vec);
+	list_add_tail(&timer->entry, base->vectors + idx);
+	__set_bit(idx, base->pending_map);
 }
 
 #ifdef CONFIG_TIMER_STATS
@@ -605,7 +706,7 @@ static void __init_timer(struct timer_list *timer,
 			 struct lock_class_key *key)
 {
 	timer->entry.next = NULL;
-	timer->base = __raw_get_cpu_var(tvec_bases);
+	timer->base = __raw_get_cpu_var(tvec_bases)[BASE_LOCAL];
 	timer->slack = -1;
 #ifdef CONFIG_TIMER_STATS
 	timer->start_site = NULL;
@@ -660,10 +761,20 @@ static inline void detach_timer(struct timer_list *timer,
 				int clear_pending)
 {
 	struct list_head *entry = &timer->entry;
+	struct tvec_base *base = tbase_get_base(timer->base);
 
 	debug_deactivate(timer);
 
 	__list_del(entry->prev, entry->next);
+	/*
+	 * If the timer was the only one on its wheel bucket, both neighbours
+	 * are the bucket head: the bucket is empty now.  Timers being run
+	 * sit on a private list and fail the range check.
+	 */
+	if (entry->prev == entry->next &&
+	    entry->next >= base->vectors &&
+	    entry->next < base->vectors + WHEEL_SIZE)
+		__clear_bit(entry->next - base->vectors, base->pending_map);
 	if (clear_pending)
 		entry->next = NULL;
 	entry->prev = LIST_POISON2;
@@ -675,7 +786,7 @@ static inline void detach_timer(struct timer_list *timer,
  * locked, and the base itself is locked too.
  *
  * So __run_timers/migrate_timers can safely modify all timers which could
- * be found on ->tvX lists.
+ * be found on the wheel buckets.
  *
  * When the timer's base is locked, and the timer removed from list, it is
  * possible to set timer->base = NULL and drop the lock: the timer remains
@@ -716,9 +827,6 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 
 	if (timer_pending(timer)) {
 		detach_timer(timer, 0);
-		if (timer->expires == base->next_timer &&
-		    !tbase_get_deferrable(timer->base))
-			base->next_timer = base->timer_jiffies;
 		ret = 1;
 	} else {
 		if (pending_only)
@@ -727,13 +835,17 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 
 	debug_activate(timer, expires);
 
+	if (pinned)
+		timer_set_pinned(timer);
+
 	cpu = smp_processor_id();
 
 #if defined(CONFIG_NO_HZ) && defined(CONFIG_SMP)
-	if (!pinned && get_sysctl_timer_migration() && idle_cpu(cpu))
+	if (!tbase_get_pinned(timer->base) && get_sysctl_timer_migration() &&
+	    idle_cpu(cpu))
 		cpu = get_nohz_timer_target();
 #endif
-	new_base = per_cpu(tvec_bases, cpu);
+	new_base = get_target_base(timer, cpu);
 
 	if (base != new_base) {
 		/*
@@ -754,11 +866,17 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	}
 
 	timer->expires = expires;
-	if (time_before(timer->expires, base->next_timer) &&
-	    !tbase_get_deferrable(timer->base))
-		base->next_timer = timer->expires;
 	internal_add_timer(base, timer);
 
+#ifdef CONFIG_NO_HZ_FULL
+	/*
+	 * A full dynticks CPU may run with its tick stopped for as long
+	 * as its timer wheel is empty: make it look at the new timer.
+	 */
+	if (!tbase_get_deferrable(timer->base) && tick_nohz_full_cpu(base->cpu))
+		wake_up_nohz_cpu(base->cpu);
+#endif
+
 out_unlock:
 	spin_unlock_irqrestore(&base->lock, flags);
 
@@ -868,10 +986,14 @@ EXPORT_SYMBOL(mod_timer);
  * mod_timer_pinned(timer, expires) is equivalent to:
  *
  *     del_timer(timer); timer->expires = expires; add_timer(timer);
+ *
+ * The timer is marked TIMER_PINNED: it is not expired by another CPU
+ * while this one is idle, and mod_timer() keeps it on the local CPU too.
  */
 int mod_timer_pinned(struct timer_list *timer, unsigned long expires)
 {
-	if (timer->expires == expires && timer_pending(timer))
+	if (timer->expires == expires && timer_pending(timer) &&
+	    tbase_get_pinned(timer->base))
 		return 1;
 
 	return __mod_timer(timer, expires, false, TIMER_PINNED);
@@ -905,30 +1027,29 @@ EXPORT_SYMBOL(add_timer);
  * @cpu: the CPU to start it on
  *
  * This is not very scalable on SMP. Double adds are not possible.
+ * The timer is marked TIMER_PINNED, see mod_timer_pinned().
  */
 void add_timer_on(struct timer_list *timer, int cpu)
 {
-	struct tvec_base *base = per_cpu(tvec_bases, cpu);
+	struct tvec_base *base;
 	unsigned long flags;
 
 	timer_stats_timer_set_start_info(timer);
 	BUG_ON(timer_pending(timer) || !timer->function);
+	timer_set_pinned(timer);
+	base = get_target_base(timer, cpu);
 	spin_lock_irqsave(&base->lock, flags);
 	timer_set_base(timer, base);
 	debug_activate(timer, timer->expires);
-	if (time_before(timer->expires, base->next_timer) &&
-	    !tbase_get_deferrable(timer->base))
-		base->next_timer = timer->expires;
 	internal_add_timer(base, timer);
 	/*
-	 * Check whether the other CPU is idle and needs to be
-	 * triggered to reevaluate the timer wheel when nohz is
-	 * active. We are protected against the other CPU fiddling
+	 * Check whether the other CPU is in dynticks mode and needs
+	 * to be triggered to reevaluate the timer wheel. We are protected against the other CPU fiddling
 	 * with the timer by holding the timer base lock. This also
 	 * makes sure that a CPU on the way to idle can not evaluate
 	 * the timer wheel.
 	 */
-	wake_up_idle_cpu(cpu);
+	wake_up_nohz_cpu(cpu);
 	spin_unlock_irqrestore(&base->lock, flags);
 }
 EXPORT_SYMBOL_GPL(add_timer_on);
@@ -957,9 +1078,6 @@ int del_timer(struct timer_list *timer)
 		base = lock_timer_base(timer, &flags);
 		if (timer_pending(timer)) {
 			detach_timer(timer, 1);
-			if (timer->expires == base->next_timer &&
-			    !tbase_get_deferrable(timer->base))
-				base->next_timer = base->timer_jiffies;
 			ret = 1;
 		}
 		spin_unlock_irqrestore(&base->lock, flags);
@@ -993,9 +1111,6 @@ int try_to_del_timer_sync(struct timer_list *timer)
 	ret = 0;
 	if (timer_pending(timer)) {
 		detach_timer(timer, 1);
-		if (timer->expires == base->next_timer &&
-		    !tbase_get_deferrable(timer->base))
-			base->next_timer = base->timer_jiffies;
 		ret = 1;
 	}
 out:
@@ -1071,26 +1186,6 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
-static int cascade(struct tvec_base *base, struct tvec *tv, int index)
-{
-	/* cascade all the timers from tv up one level */
-	struct timer_list *timer, *tmp;
-	struct list_head tv_list;
-
-	list_replace_init(tv->vec + index, &tv_list);
-
-	/*
-	 * We are removing _all_ timers from the list, so we
-	 * don't have to detach them individually.
-	 */
-	list_for_each_entry_safe(timer, tmp, &tv_list, entry) {
-		BUG_ON(tbase_get_base(timer->base) != base);
-		internal_add_timer(base, timer);
-	}
-
-	return index;
-}
-
 static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 			  unsigned long data)
 {
@@ -1132,133 +1227,580 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 	}
 }
 
-#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+static void expire_timers(struct tvec_base *base, struct list_head *head)
+{
+	struct timer_list *timer;
+
+	while (!list_empty(head)) {
+		void (*fn)(unsigned long);
+		unsigned long data;
+
+		timer = list_first_entry(head, struct timer_list,entry);
+		fn = timer->function;
+		data = timer->data;
+
+		timer_stats_account_timer(timer);
+
+		base->running_timer = timer;
+		detach_timer(timer, 1);
+
+		spin_unlock_irq(&base->lock);
+		call_timer_fn(timer, fn, data);
+		spin_lock_irq(&base->lock);
+	}
+}
+
+/*
+ * Append every bucket that expires at base->timer_jiffies to @head.  A
+ * level is only due when the clock has advanced a full step of that level,
+ * i.e. when the lower bits of the clock are zero.
+ */
+static void __collect_expired_timers(struct tvec_base *base,
+				     struct list_head *head)
+{
+	unsigned long clk = base->timer_jiffies;
+	unsigned int idx;
+	int i;
+
+	for (i = 0; i < LVL_DEPTH; i++) {
+		idx = (clk & LVL_MASK) + i * LVL_SIZE;
+
+		if (__test_and_clear_bit(idx, base->pending_map))
+			list_splice_tail_init(base->vectors + idx, head);
+		/* Is it time to look at the next level? */
+		if (clk & LVL_CLK_MASK)
+			break;
+		/* Shift clock for the next level granularity */
+		clk >>= LVL_CLK_SHIFT;
+	}
+}
+
+#ifdef CONFIG_NO_HZ
+static void collect_expired_timers(struct tvec_base *base,
+				   struct list_head *head)
+{
+	/*
+	 * After a long idle sleep the base lags behind jiffies.  Rather than
+	 * stepping through every jiffy in between, look up the next pending
+	 * bucket and forward the clock to it.
+	 */
+	if ((long)(jiffies - base->timer_jiffies) > 2) {
+		unsigned long next = __next_timer_interrupt(base);
+
+		if (time_after(next, jiffies)) {
+			/* The caller increments the clock */
+			base->timer_jiffies = jiffies - 1;
+			return;
+		}
+		base->timer_jiffies = next;
+	}
+	__collect_expired_timers(base, head);
+}
+#else
+static inline void collect_expired_timers(struct tvec_base *base,
+					  struct list_head *head)
+{
+	__collect_expired_timers(base, head);
+}
+#endif
 
 /**
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
  *
- * This function cascades all vectors and executes all expired timer
- * vectors.
+ * This function collects the expired buckets of all levels up to the
+ * current jiffy and then executes them as one batch.  The clock is
+ * brought up to date before any handler runs, so timers rearmed from
+ * a handler are queued relative to now and not to the jiffy that was
+ * being caught up on.
+ *
+ * The global base of an idle CPU may be run by another CPU.  Only one
+ * CPU runs a base at a time, so that ->running_timer stays meaningful;
+ * whoever is running it already catches up with jiffies.
  */
 static inline void __run_timers(struct tvec_base *base)
 {
-	struct timer_list *timer;
-
 	spin_lock_irq(&base->lock);
+	if (base->running_timer) {
+		spin_unlock_irq(&base->lock);
+		return;
+	}
 	while (time_after_eq(jiffies, base->timer_jiffies)) {
-		struct list_head work_list;
-		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
+		LIST_HEAD(work_list);
 
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
-		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, &work_list);
-		while (!list_empty(head)) {
-			void (*fn)(unsigned long);
-			unsigned long data;
-
-			timer = list_first_entry(head, struct timer_list,entry);
-			fn = timer->function;
-			data = timer->data;
-
-			timer_stats_account_timer(timer);
-
-			base->running_timer = timer;
-			detach_timer(timer, 1);
+		do {
+			collect_expired_timers(base, &work_list);
+			++base->timer_jiffies;
+		} while (time_after_eq(jiffies, base->timer_jiffies));
 
-			spin_unlock_irq(&base->lock);
-			call_timer_fn(timer, fn, data);
-			spin_lock_irq(&base->lock);
-		}
+		expire_timers(base, &work_list);
 	}
 	base->running_timer = NULL;
 	spin_unlock_irq(&base->lock);
 }
 
 #ifdef CONFIG_NO_HZ
+/*
+ * Distance from @clk to the next pending bucket of the level starting at
+ * @offset, or -1 if there is none.
+ */
+static int next_pending_bucket(struct tvec_base *base, unsigned int offset,
+			       unsigned int clk)
+{
+	unsigned int pos, start = offset + clk;
+	unsigned int end = offset + LVL_SIZE;
+
+	pos = find_next_bit(base->pending_map, end, start);
+	if (pos < end)
+		return pos - start;
+
+	pos = find_next_bit(base->pending_map, start, offset);
+	return pos < start ? pos + LVL_SIZE - start : -1;
+}
+
 /*
  * Find out when the next timer event is due to happen. This
  * is used on S/390 to stop all activity when a CPU is idle.
  * This function needs to be called with interrupts disabled.
+ *
+ * The result is the expiry time of the next pending bucket, which is
+ * when the timers in it will actually run.
  */
 static unsigned long __next_timer_interrupt(struct tvec_base *base)
 {
-	unsigned long timer_jiffies = base->timer_jiffies;
-	unsigned long expires = timer_jiffies + NEXT_TIMER_MAX_DELTA;
-	int index, slot, array, found = 0;
-	struct timer_list *nte;
-	struct tvec *varray[4];
+	unsigned long clk, next, adj;
+	unsigned int lvl, offset = 0;
 
-	/* Look for timer events in tv1. */
-	index = slot = timer_jiffies & TVR_MASK;
-	do {
-		list_for_each_entry(nte, base->tv1.vec + slot, entry) {
-			if (tbase_get_deferrable(nte->base))
-				continue;
-
-			found = 1;
-			expires = nte->expires;
-			/* Look at the cascade bucket(s)? */
-			if (!index || slot < index)
-				goto cascade;
-			return expires;
+	next = base->timer_jiffies + NEXT_TIMER_MAX_DELTA;
+	clk = base->timer_jiffies;
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++, offset += LVL_SIZE) {
+		int pos = next_pending_bucket(base, offset, clk & LVL_MASK);
+
+		if (pos >= 0) {
+			unsigned long tmp = clk + (unsigned long) pos;
+
+			tmp <<= LVL_SHIFT(lvl);
+			if (time_before(tmp, next))
+				next = tmp;
 		}
-		slot = (slot + 1) & TVR_MASK;
-	} while (slot != index);
+		/*
+		 * Clock for the next level.  If the lower bits of this
+		 * level's clock are zero, the next level is looked at from
+		 * the same position.  Otherwise its current bucket has been
+		 * run already and the next one to expire is one further.
+		 */
+		adj = clk & LVL_CLK_MASK ? 1 : 0;
+		clk >>= LVL_CLK_SHIFT;
+		clk += adj;
+	}
+	return next;
+}
+
+/*
+ * Next expiry of @base in *@next.  Returns false if @base is empty.
+ */
+static bool next_base_expiry(struct tvec_base *base, unsigned long *next)
+{
+	bool pending;
+
+	spin_lock(&base->lock);
+	pending = !bitmap_empty(base->pending_map, WHEEL_SIZE);
+	if (pending)
+		*next = __next_timer_interrupt(base);
+	spin_unlock(&base->lock);
+	return pending;
+}
 
-cascade:
-	/* Calculate the next cascade event */
-	if (index)
-		timer_jiffies += TVR_SIZE - index;
-	timer_jiffies >>= TVR_BITS;
+#ifdef CONFIG_SMP
+/*
+ * Timer migration hierarchy
+ *
+ * CPUs are grouped TMIGR_CHILDREN at a time, those groups again
+ * TMIGR_CHILDREN at a time and so on, up to a single top group.  Every
+ * group knows which of its children still have a busy CPU below them
+ * (->active) and the next global timer of each of the idle ones.
+ *
+ * A CPU going idle records the expiry of its next global timer in its
+ * group.  If a sibling is still busy, that sibling expires the timer when
+ * it is due and the idle CPU does not wake up for it.  Otherwise the
+ * group's earliest event moves up one level, and so on.  Only when every
+ * CPU is idle does the one that went idle last wake up for the earliest
+ * global timer in the system.
+ *
+ * Of the busy children of a group, the first one (the migrator) checks the
+ * idle ones from its timer softirq.  nohz_full CPUs stay out of the
+ * hierarchy: they never count as busy, so they are never the migrator and
+ * their tick is not needed for other CPUs' timers, and they expire their
+ * own global timers themselves.  Changes are made bottom-up with the
+ * lock of a group held while the lock of its parent is taken, so a group's
+ * event is never overwritten by an older one.
+ */
+#define TMIGR_CHILDREN		8
+#define TMIGR_MAX_LEVELS	6
+
+struct tmigr_group {
+	spinlock_t		lock;
+	struct tmigr_group	*parent;
+	unsigned int		level;
+	unsigned int		parent_idx;	/* our slot in the parent */
+	unsigned int		first;		/* first child: cpu or group */
+	unsigned int		num_children;
+	u8			active;		/* children with a busy CPU */
+	u8			pending;	/* idle children with a timer */
+	unsigned long		next;		/* earliest event, if any */
+	unsigned long		child_next[TMIGR_CHILDREN];
+};
 
-	/* Check tv2-tv5. */
-	varray[0] = &base->tv2;
-	varray[1] = &base->tv3;
-	varray[2] = &base->tv4;
-	varray[3] = &base->tv5;
+struct tmigr_cpu {
+	struct tmigr_group	*group;
+	unsigned int		idx;		/* slot in ->group */
+	bool			idle;
+};
 
-	for (array = 0; array < 4; array++) {
-		struct tvec *varp = varray[array];
+static struct tmigr_group *tmigr_level[TMIGR_MAX_LEVELS];
+static unsigned int tmigr_levels;
+static bool tmigr_enabled __read_mostly;
+static DEFINE_PER_CPU(struct tmigr_cpu, tmigr_cpu);
 
-		index = slot = timer_jiffies & TVN_MASK;
-		do {
-			list_for_each_entry(nte, varp->vec + slot, entry) {
-				if (tbase_get_deferrable(nte->base))
-					continue;
+/* Only housekeeping CPUs take part in the hierarchy */
+static inline bool tmigr_cpu_available(int cpu)
+{
+	return !tick_nohz_full_cpu(cpu);
+}
+
+/*
+ * Recompute the earliest event of the idle children of @group, with its
+ * lock held.  Returns false if none of them has a timer.
+ */
+static bool tmigr_group_next(struct tmigr_group *group)
+{
+	unsigned int idle = group->pending & ~group->active;
+	bool found = false;
+	unsigned int i;
+
+	for (i = 0; i < group->num_children; i++) {
+		if (!(idle & (1U << i)))
+			continue;
+		if (!found || time_before(group->child_next[i], group->next))
+			group->next = group->child_next[i];
+		found = true;
+	}
+	return found;
+}
 
-				found = 1;
-				if (time_before(nte->expires, expires))
-					expires = nte->expires;
+/*
+ * Carry a change to the children of @group, whose lock is held, up the
+ * hierarchy and drop the lock.  Stops at the first group whose state in
+ * its parent does not change.  Returns true if every CPU is idle and
+ * there is a global timer, whose expiry is then stored in *@next.
+ */
+static bool tmigr_update(struct tmigr_group *group, unsigned long *next)
+{
+	struct tmigr_group *parent;
+	bool pending, done;
+	u8 bit;
+
+	for (;;) {
+		pending = tmigr_group_next(group);
+		parent = group->parent;
+		if (!parent)
+			break;
+
+		bit = 1U << group->parent_idx;
+		spin_lock_nested(&parent->lock, parent->level);
+		if (!group->active) {
+			parent->active &= ~bit;
+			if (pending) {
+				parent->pending |= bit;
+				parent->child_next[group->parent_idx] = group->next;
+			} else {
+				parent->pending &= ~bit;
 			}
-			/*
-			 * Do we still search for the first timer or are
-			 * we looking up the cascade buckets ?
-			 */
-			if (found) {
-				/* Look at the cascade bucket(s)? */
-				if (!index || slot < index)
-					break;
-				return expires;
+			/* a busy CPU below the parent takes care of us */
+			done = parent->active;
+		} else {
+			done = parent->active & bit;
+			if (!done) {
+				/* only the parent's parent is left to tell */
+				done = parent->active;
+				parent->active |= bit;
+				parent->pending &= ~bit;
 			}
-			slot = (slot + 1) & TVN_MASK;
-		} while (slot != index);
+		}
+		spin_unlock(&group->lock);
+		group = parent;
+		if (done) {
+			tmigr_group_next(group);
+			spin_unlock(&group->lock);
+			return false;
+		}
+	}
+
+	pending = pending && !group->active;
+	if (pending)
+		*next = group->next;
+	spin_unlock(&group->lock);
+	return pending;
+}
+
+/*
+ * @cpu is busy again and expires its own global timers.
+ */
+static void tmigr_cpu_activate(int cpu)
+{
+	struct tmigr_cpu *tmc = &per_cpu(tmigr_cpu, cpu);
+	struct tmigr_group *group = tmc->group;
+	unsigned long flags, next;
+
+	if (!tmigr_enabled || !tmc->idle || !tmigr_cpu_available(cpu))
+		return;
+
+	local_irq_save(flags);
+	spin_lock_nested(&group->lock, 0);
+	tmc->idle = false;
+	group->active |= 1U << tmc->idx;
+	group->pending &= ~(1U << tmc->idx);
+	tmigr_update(group, &next);
+	local_irq_restore(flags);
+}
+
+/*
+ * @cpu is idle, the earliest of its global timers (if @pending) expires at
+ * @next.  Returns true if @cpu has to wake up for a global timer, of any
+ * CPU, at *@wakeup because every CPU is idle.
+ */
+static bool tmigr_cpu_deactivate(int cpu, bool pending, unsigned long next,
+				 unsigned long *wakeup)
+{
+	struct tmigr_cpu *tmc = &per_cpu(tmigr_cpu, cpu);
+	struct tmigr_group *group = tmc->group;
+	unsigned long flags;
+	bool ret;
+
+	local_irq_save(flags);
+	spin_lock_nested(&group->lock, 0);
+	tmc->idle = true;
+	group->active &= ~(1U << tmc->idx);
+	if (pending) {
+		group->pending |= 1U << tmc->idx;
+		group->child_next[tmc->idx] = next;
+	} else {
+		group->pending &= ~(1U << tmc->idx);
+	}
+	ret = tmigr_update(group, wakeup);
+	local_irq_restore(flags);
+	return ret;
+}
+
+/*
+ * Whether the child of @group in slot @idx, on the path of the running
+ * @cpu, is the migrator of @group.  A group without busy CPUs is looked
+ * after by any housekeeping CPU that happens to be awake below it.
+ */
+static bool tmigr_is_migrator(int cpu, struct tmigr_group *group,
+			      unsigned int idx)
+{
+	u8 active = ACCESS_ONCE(group->active);
+
+	if (!tmigr_cpu_available(cpu))
+		return false;
+	return !active || __ffs(active) == idx;
+}
+
+static void tmigr_handle_group(struct tmigr_group *group);
+
+/*
+ * Run the expired global timers of the idle @cpu, then record its next
+ * one in slot @idx of @group.
+ */
+static void tmigr_expire_cpu(struct tmigr_group *group, unsigned int idx,
+			     int cpu)
+{
+	struct tvec_base *base = per_cpu(tvec_bases, cpu)[BASE_GLOBAL];
+	unsigned long next, flags;
+	bool pending;
+
+	if (time_after_eq(jiffies, base->timer_jiffies))
+		__run_timers(base);
 
-		if (index)
-			timer_jiffies += TVN_SIZE - index;
-		timer_jiffies >>= TVN_BITS;
+	local_irq_save(flags);
+	pending = next_base_expiry(base, &next);
+	spin_lock_nested(&group->lock, group->level);
+	if (group->active & (1U << idx)) {
+		/* it woke up meanwhile */
+		spin_unlock(&group->lock);
+	} else {
+		if (pending) {
+			group->pending |= 1U << idx;
+			group->child_next[idx] = next;
+		} else {
+			group->pending &= ~(1U << idx);
+		}
+		tmigr_update(group, &next);
+	}
+	local_irq_restore(flags);
+}
+
+/*
+ * Expire the due timers of the idle children of @group.
+ */
+static void tmigr_handle_group(struct tmigr_group *group)
+{
+	unsigned long flags, now = jiffies;
+	unsigned int i, expired = 0;
+
+	spin_lock_irqsave_nested(&group->lock, flags, group->level);
+	for (i = 0; i < group->num_children; i++) {
+		unsigned int bit = 1U << i;
+
+		if ((group->pending & ~group->active & bit) &&
+		    time_after_eq(now, group->child_next[i]))
+			expired |= bit;
+	}
+	spin_unlock_irqrestore(&group->lock, flags);
+
+	for (i = 0; i < group->num_children; i++) {
+		if (!(expired & (1U << i)))
+			continue;
+		if (!group->level)
+			tmigr_expire_cpu(group, i, group->first + i);
+		else
+			tmigr_handle_group(&tmigr_level[group->level - 1]
+						       [group->first + i]);
 	}
-	return expires;
 }
 
+/*
+ * Called from the timer softirq: expire the due global timers of idle
+ * CPUs in the groups this CPU is the migrator of.
+ */
+static void tmigr_handle_remote(int cpu)
+{
+	struct tmigr_cpu *tmc = &per_cpu(tmigr_cpu, cpu);
+	struct tmigr_group *group = tmc->group;
+	unsigned int idx = tmc->idx;
+
+	if (!tmigr_enabled)
+		return;
+
+	for (; group; idx = group->parent_idx, group = group->parent) {
+		u8 idle;
+
+		if (!tmigr_is_migrator(cpu, group, idx))
+			break;
+		idle = ACCESS_ONCE(group->pending) & ~ACCESS_ONCE(group->active);
+		if (idle && time_after_eq(jiffies, ACCESS_ONCE(group->next)))
+			tmigr_handle_group(group);
+	}
+}
+
+/*
+ * Earliest global timer of an idle CPU that the busy @cpu is the
+ * migrator for, so that a busy CPU with its tick stopped wakes up for it.
+ */
+static bool tmigr_next_remote(int cpu, unsigned long *next)
+{
+	struct tmigr_cpu *tmc = &per_cpu(tmigr_cpu, cpu);
+	struct tmigr_group *group = tmc->group;
+	unsigned int idx = tmc->idx;
+	bool found = false;
+
+	if (!tmigr_enabled)
+		return false;
+
+	for (; group; idx = group->parent_idx, group = group->parent) {
+		if (!tmigr_is_migrator(cpu, group, idx))
+			break;
+		spin_lock_nested(&group->lock, group->level);
+		if (tmigr_group_next(group) &&
+		    (!found || time_before(group->next, *next))) {
+			*next = group->next;
+			found = true;
+		}
+		spin_unlock(&group->lock);
+	}
+	return found;
+}
+
+static int __init tmigr_init(void)
+{
+	unsigned int lvl, i, n = nr_cpu_ids;
+	int cpu;
+
+	do {
+		unsigned int nr = DIV_ROUND_UP(n, TMIGR_CHILDREN);
+
+		if (tmigr_levels == TMIGR_MAX_LEVELS)
+			goto err;
+		tmigr_level[tmigr_levels] = kcalloc(nr,
+						    sizeof(struct tmigr_group),
+						    GFP_KERNEL);
+		if (!tmigr_level[tmigr_levels])
+			goto err;
+		for (i = 0; i < nr; i++) {
+			struct tmigr_group *group = &tmigr_level[tmigr_levels][i];
+
+			spin_lock_init(&group->lock);
+			group->level = tmigr_levels;
+			group->first = i * TMIGR_CHILDREN;
+			group->num_children = min_t(unsigned int,
+						    n - group->first,
+						    TMIGR_CHILDREN);
+			group->parent_idx = i % TMIGR_CHILDREN;
+		}
+		if (tmigr_levels) {
+			for (i = 0; i < n; i++)
+				tmigr_level[tmigr_levels - 1][i].parent =
+					&tmigr_level[tmigr_levels][i / TMIGR_CHILDREN];
+		}
+		tmigr_levels++;
+		n = nr;
+	} while (n > 1);
+
+	/* every CPU starts out busy, offline ones are idle */
+	for_each_possible_cpu(cpu) {
+		struct tmigr_cpu *tmc = &per_cpu(tmigr_cpu, cpu);
+
+		tmc->group = &tmigr_level[0][cpu / TMIGR_CHILDREN];
+		tmc->idx = cpu % TMIGR_CHILDREN;
+		tmc->idle = true;
+	}
+	tmigr_enabled = true;
+	for_each_online_cpu(cpu)
+		tmigr_cpu_activate(cpu);
+	return 0;
+
+err:
+	for (lvl = 0; lvl < tmigr_levels; lvl++)
+		kfree(tmigr_level[lvl]);
+	pr_warn("timer: no memory for the timer migration hierarchy\n");
+	return 0;
+}
+early_initcall(tmigr_init);
+
+/*
+ * The CPU leaves idle: expire its own global timers again.
+ */
+void timer_clear_idle(void)
+{
+	tmigr_cpu_activate(smp_processor_id());
+}
+
+#ifdef CONFIG_HOTPLUG_CPU
+/*
+ * A CPU going offline has its timers taken over by another one, it is
+ * idle for the hierarchy from now on.
+ */
+static void tmigr_cpu_offline(int cpu)
+{
+	unsigned long next;
+
+	if (tmigr_enabled)
+		tmigr_cpu_deactivate(cpu, false, 0, &next);
+}
+#endif
+#endif /* CONFIG_SMP */
+
 /*
  * Check, if the next hrtimer event is before the next timer wheel
  * event:
@@ -1309,20 +1851,44 @@ static unsigned long cmp_next_hrtimer_event(unsigned long now,
  */
 unsigned long get_next_timer_interrupt(unsigned long now)
 {
-	struct tvec_base *base = __this_cpu_read(tvec_bases);
-	unsigned long expires;
+	struct tvec_base **bases = __get_cpu_var(tvec_bases);
+	unsigned long expires = now + NEXT_TIMER_MAX_DELTA;
+	int cpu = smp_processor_id();
+	unsigned long next;
+	bool global;
 
 	/*
 	 * Pretend that there is no timer pending if the cpu is offline.
 	 * Possible pending timers will be migrated later to an active cpu.
 	 */
-	if (cpu_is_offline(smp_processor_id()))
-		return now + NEXT_TIMER_MAX_DELTA;
-	spin_lock(&base->lock);
-	if (time_before_eq(base->next_timer, base->timer_jiffies))
-		base->next_timer = __next_timer_interrupt(base);
-	expires = base->next_timer;
-	spin_unlock(&base->lock);
+	if (cpu_is_offline(cpu))
+		return expires;
+
+	/* deferrable timers do not count */
+	if (next_base_expiry(bases[BASE_LOCAL], &next))
+		expires = next;
+	global = next_base_expiry(bases[BASE_GLOBAL], &next);
+
+#ifdef CONFIG_SMP
+	/* a nohz_full CPU keeps its global timers */
+	if (tmigr_enabled && tmigr_cpu_available(cpu)) {
+		if (get_sysctl_timer_migration() && idle_cpu(cpu)) {
+			/* Leave them to a busy CPU, if there is one */
+			global = tmigr_cpu_deactivate(cpu, global, next, &next);
+		} else {
+			unsigned long remote;
+
+			tmigr_cpu_activate(cpu);
+			if (tmigr_next_remote(cpu, &remote) &&
+			    (!global || time_before(remote, next))) {
+				next = remote;
+				global = true;
+			}
+		}
+	}
+#endif
+	if (global && time_before(next, expires))
+		expires = next;
 
 	if (time_before_eq(expires, now))
 		return now;
@@ -1331,6 +1897,12 @@ unsigned long get_next_timer_interrupt(unsigned long now)
 }
 #endif
 
+#if !defined(CONFIG_NO_HZ) || !defined(CONFIG_SMP)
+static inline void tmigr_cpu_activate(int cpu) { }
+static inline void tmigr_cpu_offline(int cpu) { }
+static inline void tmigr_handle_remote(int cpu) { }
+#endif
+
 /*
  * Called from the timer interrupt handler to charge one tick to the current
  * process.  user_tick is 1 if the tick is user time, 0 for system.
@@ -1358,12 +1930,16 @@ void update_process_times(int user_tick)
  */
 static void run_timer_softirq(struct softirq_action *h)
 {
-	struct tvec_base *base = __this_cpu_read(tvec_bases);
+	struct tvec_base **bases = __get_cpu_var(tvec_bases);
+	int i;
 
 	hrtimer_run_pending();
 
-	if (time_after_eq(jiffies, base->timer_jiffies))
-		__run_timers(base);
+	for (i = 0; i < NR_BASES; i++)
+		if (time_after_eq(jiffies, bases[i]->timer_jiffies))
+			__run_timers(bases[i]);
+
+	tmigr_handle_remote(smp_processor_id());
 }
 
 /*
@@ -1646,7 +2222,7 @@ SYSCALL_DEFINE1(sysinfo, struct sysinfo __user *, info)
 
 static int __cpuinit init_timers_cpu(int cpu)
 {
-	int j;
+	int i, j;
 	struct tvec_base *base;
 	static char __cpuinitdata tvec_base_done[NR_CPUS];
 
@@ -1657,19 +2233,23 @@ static int __cpuinit init_timers_cpu(int cpu)
 			/*
 			 * The APs use this path later in boot
 			 */
-			base = kmalloc_node(sizeof(*base),
-						GFP_KERNEL | __GFP_ZERO,
-						cpu_to_node(cpu));
-			if (!base)
-				return -ENOMEM;
-
-			/* Make sure that tvec_base is 2 byte aligned */
-			if (tbase_get_deferrable(base)) {
-				WARN_ON(1);
-				kfree(base);
-				return -ENOMEM;
+			for (i = 0; i < NR_BASES; i++) {
+				base = kmalloc_node(sizeof(*base),
+						    GFP_KERNEL | __GFP_ZERO,
+						    cpu_to_node(cpu));
+				/* Make sure that tvec_base is 4 byte aligned */
+				if (base && tbase_get_base(base) != base) {
+					WARN_ON(1);
+					kfree(base);
+					base = NULL;
+				}
+				if (!base) {
+					while (i--)
+						kfree(per_cpu(tvec_bases, cpu)[i]);
+					return -ENOMEM;
+				}
+				per_cpu(tvec_bases, cpu)[i] = base;
 			}
-			per_cpu(tvec_bases, cpu) = base;
 		} else {
 			/*
 			 * This is for the boot CPU - we use compile-time
@@ -1678,26 +2258,22 @@ static int __cpuinit init_timers_cpu(int cpu)
 			 * initialised either.
 			 */
 			boot_done = 1;
-			base = &boot_tvec_bases;
 		}
 		tvec_base_done[cpu] = 1;
-	} else {
-		base = per_cpu(tvec_bases, cpu);
 	}
 
-	spin_lock_init(&base->lock);
+	for (i = 0; i < NR_BASES; i++) {
+		base = per_cpu(tvec_bases, cpu)[i];
 
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
-	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
+		spin_lock_init(&base->lock);
 
-	base->timer_jiffies = jiffies;
-	base->next_timer = base->timer_jiffies;
+		for (j = 0; j < WHEEL_SIZE; j++)
+			INIT_LIST_HEAD(base->vectors + j);
+		bitmap_zero(base->pending_map, WHEEL_SIZE);
+
+		base->cpu = cpu;
+		base->timer_jiffies = jiffies;
+	}
 	return 0;
 }
 
@@ -1710,9 +2286,6 @@ static void migrate_timer_list(struct tvec_base *new_base, struct list_head *hea
 		timer = list_first_entry(head, struct timer_list, entry);
 		detach_timer(timer, 0);
 		timer_set_base(timer, new_base);
-		if (time_before(timer->expires, new_base->next_timer) &&
-		    !tbase_get_deferrable(timer->base))
-			new_base->next_timer = timer->expires;
 		internal_add_timer(new_base, timer);
 	}
 }
@@ -1721,32 +2294,28 @@ static void __cpuinit migrate_timers(int cpu)
 {
 	struct tvec_base *old_base;
 	struct tvec_base *new_base;
-	int i;
+	int b, i;
 
 	BUG_ON(cpu_online(cpu));
-	old_base = per_cpu(tvec_bases, cpu);
-	new_base = get_cpu_var(tvec_bases);
-	/*
-	 * The caller is globally serialized and nobody else
-	 * takes two locks at once, deadlock is not possible.
-	 */
-	spin_lock_irq(&new_base->lock);
-	spin_lock_nested(&old_base->lock, SINGLE_DEPTH_NESTING);
-
-	BUG_ON(old_base->running_timer);
-
-	for (i = 0; i < TVR_SIZE; i++)
-		migrate_timer_list(new_base, old_base->tv1.vec + i);
-	for (i = 0; i < TVN_SIZE; i++) {
-		migrate_timer_list(new_base, old_base->tv2.vec + i);
-		migrate_timer_list(new_base, old_base->tv3.vec + i);
-		migrate_timer_list(new_base, old_base->tv4.vec + i);
-		migrate_timer_list(new_base, old_base->tv5.vec + i);
-	}
+	for (b = 0; b < NR_BASES; b++) {
+		old_base = per_cpu(tvec_bases, cpu)[b];
+		new_base = get_cpu_var(tvec_bases)[b];
+		/*
+		 * The caller is globally serialized and nobody else
+		 * takes two locks at once, deadlock is not possible.
+		 */
+		spin_lock_irq(&new_base->lock);
+		spin_lock_nested(&old_base->lock, SINGLE_DEPTH_NESTING);
+
+		BUG_ON(old_base->running_timer);
 
-	spin_unlock(&old_base->lock);
-	spin_unlock_irq(&new_base->lock);
-	put_cpu_var(tvec_bases);
+		for (i = 0; i < WHEEL_SIZE; i++)
+			migrate_timer_list(new_base, old_base->vectors + i);
+
+		spin_unlock(&old_base->lock);
+		spin_unlock_irq(&new_base->lock);
+		put_cpu_var(tvec_bases);
+	}
 }
 #endif /* CONFIG_HOTPLUG_CPU */
 
@@ -1763,7 +2332,15 @@ static int __cpuinit timer_cpu_notify(struct notifier_block *self,
 		if (err < 0)
 			return notifier_from_errno(err);
 		break;
+	case CPU_ONLINE:
+	case CPU_ONLINE_FROZEN:
+		tmigr_cpu_activate(cpu);
+		break;
 #ifdef CONFIG_HOTPLUG_CPU
+	case CPU_DYING:
+	case CPU_DYING_FROZEN:
+		tmigr_cpu_offline(cpu);
+		break;
 	case CPU_DEAD:
 	case CPU_DEAD_FROZEN:
 		migrate_timers(cpu);
@@ -17,8 +17,8 @@
  * This is the generic async execution mechanism.  Work items as are
  * executed in process context.  The worker pool is shared and
  * automatically managed.  There is one worker pool for each CPU and
- * one extra for works which are better served by workers which are
- * not bound to any specific CPU.
+ * one extra for each NUMA node for works which are better served by
+ * workers which are not bound to any specific CPU.
  *
  * Please read Documentation/workqueue.txt for details.
  */
@@ -41,6 +41,7 @@
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
 #include <linux/idr.h>
+#include <linux/device.h>
 
 #include "workqueue_sched.h"
 
@@ -112,6 +113,8 @@ enum {
  * F: wq->flush_mutex protected.
  *
  * W: workqueue_lock protected.
+ *
+ * A: wq_attrs_mutex protected.
  */
 
 struct global_cwq;
@@ -137,6 +140,7 @@ struct worker {
 	unsigned int		flags;		/* X: flags */
 	int			id;		/* I: worker id */
 	struct work_struct	rebind_work;	/* L: rebind worker to cpu */
+	unsigned int		attrs_seq;	/* unbound gcwq attrs applied */
 };
 
 /*
@@ -169,6 +173,24 @@ struct global_cwq {
 	struct worker		*first_idle;	/* L: first idle worker */
 } ____cacheline_aligned_in_smp;
 
+/*
+ * Unbound gcwqs are per NUMA node so that works queued on unbound
+ * workqueues are executed close to where they were issued.  Their
+ * workers aren't bound to a cpu but are confined to @cpumask, which
+ * defaults to the cpus of @node, and run at @nice.  Both can be
+ * changed through sysfs.  Workers pick up the new attributes the next
+ * time they wake up by comparing their @attrs_seq with ours.
+ */
+struct unbound_gcwq {
+	struct global_cwq	gcwq;		/* must be the first member */
+	int			node;		/* I: the associated node */
+	int			nice;		/* A: nice of the workers */
+	cpumask_var_t		cpumask;	/* A: allowed cpus, empty for
+						   the cpus of @node */
+	unsigned int		attrs_seq;	/* A: bumped on any change */
+	struct device		dev;		/* I: sysfs representation */
+};
+
 /*
  * The per-CPU workqueue.  The lower WORK_STRUCT_FLAG_BITS of
  * work_struct->data are used for flags and thus cwqs need to be
@@ -224,7 +246,7 @@ struct workqueue_struct {
 	unsigned int		flags;		/* W: WQ_* flags */
 	union {
 		struct cpu_workqueue_struct __percpu	*pcpu;
-		struct cpu_workqueue_struct		*single;
+		struct cpu_workqueue_struct		**nodes;
 		unsigned long				v;
 	} cpu_wq;				/* I: cwq's */
 	struct list_head	list;		/* W: list of all workqueues */
@@ -279,7 +301,9 @@ static inline int __next_gcwq_cpu(int cpu, const struct cpumask *mask,
 		}
 		if (sw & 2)
 			return WORK_CPU_UNBOUND;
-	}
+	} else if (cpu >= WORK_CPU_UNBOUND &&
+		   cpu + 1 < WORK_CPU_UNBOUND + nr_node_ids)
+		return cpu + 1;
 	return WORK_CPU_NONE;
 }
 
@@ -292,15 +316,15 @@ static inline int __next_wq_cpu(int cpu, const struct cpumask *mask,
 /*
  * CPU iterators
  *
- * An extra gcwq is defined for an invalid cpu number
- * (WORK_CPU_UNBOUND) to host workqueues which are not bound to any
- * specific CPU.  The following iterators are similar to
- * for_each_*_cpu() iterators but also considers the unbound gcwq.
+ * An extra gcwq is defined for each NUMA node with the invalid cpu
+ * number WORK_CPU_UNBOUND + node to host workqueues which are not
+ * bound to any specific CPU.  The following iterators are similar to
+ * for_each_*_cpu() iterators but also considers the unbound gcwqs.
  *
- * for_each_gcwq_cpu()		: possible CPUs + WORK_CPU_UNBOUND
- * for_each_online_gcwq_cpu()	: online CPUs + WORK_CPU_UNBOUND
+ * for_each_gcwq_cpu()		: possible CPUs + unbound gcwqs
+ * for_each_online_gcwq_cpu()	: online CPUs + unbound gcwqs
  * for_each_cwq_cpu()		: possible CPUs for bound workqueues,
- *				  WORK_CPU_UNBOUND for unbound workqueues
+ *				  unbound gcwqs for unbound workqueues
  */
 #define for_each_gcwq_cpu(cpu)						\
 	for ((cpu) = __next_gcwq_cpu(-1, cpu_possible_mask, 3);		\
@@ -447,26 +471,29 @@ static DEFINE_PER_CPU(struct global_cwq, global_cwq);
 static DEFINE_PER_CPU_SHARED_ALIGNED(atomic_t, gcwq_nr_running);
 
 /*
- * Global cpu workqueue and nr_running counter for unbound gcwq.  The
- * gcwq is always online, has GCWQ_DISASSOCIATED set, and all its
- * workers have WORKER_UNBOUND set.
+ * Per-node global cpu workqueues and the nr_running counter they
+ * share.  Unbound gcwqs are always online, have GCWQ_DISASSOCIATED
+ * set, and all their workers have WORKER_UNBOUND set.
  */
-static struct global_cwq unbound_global_cwq;
+static struct unbound_gcwq **unbound_global_cwq;	/* indexed by node */
 static atomic_t unbound_gcwq_nr_running = ATOMIC_INIT(0);	/* always 0 */
 
+/* Serializes changes to the attributes of unbound gcwqs. */
+static DEFINE_MUTEX(wq_attrs_mutex);
+
 static int worker_thread(void *__worker);
 
 static struct global_cwq *get_gcwq(unsigned int cpu)
 {
-	if (cpu != WORK_CPU_UNBOUND)
+	if (cpu < WORK_CPU_UNBOUND)
 		return &per_cpu(global_cwq, cpu);
 	else
-		return &unbound_global_cwq;
+		return &unbound_global_cwq[cpu - WORK_CPU_UNBOUND]->gcwq;
 }
 
 static atomic_t *get_gcwq_nr_running(unsigned int cpu)
 {
-	if (cpu != WORK_CPU_UNBOUND)
+	if (cpu < WORK_CPU_UNBOUND)
 		return &per_cpu(gcwq_nr_running, cpu);
 	else
 		return &unbound_gcwq_nr_running;
@@ -478,11 +505,53 @@ static struct cpu_workqueue_struct *get_cwq(unsigned int cpu,
 	if (!(wq->flags & WQ_UNBOUND)) {
 		if (likely(cpu < nr_cpu_ids))
 			return per_cpu_ptr(wq->cpu_wq.pcpu, cpu);
-	} else if (likely(cpu == WORK_CPU_UNBOUND))
-		return wq->cpu_wq.single;
+	} else if (likely(cpu >= WORK_CPU_UNBOUND &&
+			  cpu < WORK_CPU_UNBOUND + nr_node_ids))
+		return wq->cpu_wq.nodes[cpu - WORK_CPU_UNBOUND];
 	return NULL;
 }
 
+static bool gcwq_is_unbound(struct global_cwq *gcwq)
+{
+	return gcwq->cpu >= WORK_CPU_UNBOUND;
+}
+
+static struct unbound_gcwq *to_unbound_gcwq(struct global_cwq *gcwq)
+{
+	return container_of(gcwq, struct unbound_gcwq, gcwq);
+}
+
+/* node to allocate @node's unbound memory on, it may have none */
+static int wq_mem_node(int node)
+{
+	return node_state(node, N_HIGH_MEMORY) ? node : NUMA_NO_NODE;
+}
+
+/**
+ * unbound_gcwq_cpu - determine the unbound gcwq to queue on
+ * @wq: the unbound workqueue
+ * @cpu: cpu the work is being queued from or for
+ *
+ * Works are served by the unbound gcwq of @cpu's node, or of the local
+ * node if @cpu isn't a valid cpu number.  Ordered workqueues always
+ * use the first node's gcwq so that their works stay in order.
+ *
+ * RETURNS:
+ * The gcwq ID of the selected unbound gcwq.
+ */
+static unsigned int unbound_gcwq_cpu(struct workqueue_struct *wq,
+				     unsigned int cpu)
+{
+	int node = 0;
+
+	if (!(wq->flags & __WQ_ORDERED)) {
+		node = cpu < nr_cpu_ids ? cpu_to_node(cpu) : numa_node_id();
+		if (unlikely(node < 0 || node >= nr_node_ids))
+			node = 0;
+	}
+	return WORK_CPU_UNBOUND + node;
+}
+
 static unsigned int work_color_to_flags(int color)
 {
 	return color << WORK_STRUCT_COLOR_SHIFT;
@@ -561,7 +630,8 @@ static struct global_cwq *get_work_gcwq(struct work_struct *work)
 	if (cpu == WORK_CPU_NONE)
 		return NULL;
 
-	BUG_ON(cpu >= nr_cpu_ids && cpu != WORK_CPU_UNBOUND);
+	BUG_ON(cpu >= nr_cpu_ids && (cpu < WORK_CPU_UNBOUND ||
+				     cpu >= WORK_CPU_UNBOUND + nr_node_ids));
 	return get_gcwq(cpu);
 }
 
@@ -979,7 +1049,7 @@ static bool is_chained_work(struct workqueue_struct *wq)
 static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 			 struct work_struct *work)
 {
-	struct global_cwq *gcwq;
+	struct global_cwq *gcwq, *last_gcwq;
 	struct cpu_workqueue_struct *cwq;
 	struct list_head *worklist;
 	unsigned int work_flags;
@@ -994,39 +1064,36 @@ static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 
 	/* determine gcwq to use */
 	if (!(wq->flags & WQ_UNBOUND)) {
-		struct global_cwq *last_gcwq;
-
 		if (unlikely(cpu == WORK_CPU_UNBOUND))
 			cpu = raw_smp_processor_id();
-
-		/*
-		 * It's multi cpu.  If @wq is non-reentrant and @work
-		 * was previously on a different cpu, it might still
-		 * be running there, in which case the work needs to
-		 * be queued on that cpu to guarantee non-reentrance.
-		 */
 		gcwq = get_gcwq(cpu);
-		if (wq->flags & WQ_NON_REENTRANT &&
-		    (last_gcwq = get_work_gcwq(work)) && last_gcwq != gcwq) {
-			struct worker *worker;
+	} else
+		gcwq = get_gcwq(unbound_gcwq_cpu(wq, cpu));
 
-			spin_lock_irqsave(&last_gcwq->lock, flags);
+	/*
+	 * It's multi gcwq.  If @wq is non-reentrant and @work was
+	 * previously on a different gcwq, it might still be running
+	 * there, in which case the work needs to be queued on that gcwq
+	 * to guarantee non-reentrance.  Unbound workqueues are always
+	 * non-reentrant as they used to be served by a single gcwq.
+	 */
+	if (wq->flags & (WQ_NON_REENTRANT | WQ_UNBOUND) &&
+	    (last_gcwq = get_work_gcwq(work)) && last_gcwq != gcwq) {
+		struct worker *worker;
 
-			worker = find_worker_executing_work(last_gcwq, work);
+		spin_lock_irqsave(&last_gcwq->lock, flags);
 
-			if (worker && worker->current_cwq->wq == wq)
-				gcwq = last_gcwq;
-			else {
-				/* meh... not running there, queue here */
-				spin_unlock_irqrestore(&last_gcwq->lock, flags);
-				spin_lock_irqsave(&gcwq->lock, flags);
-			}
-		} else
+		worker = find_worker_executing_work(last_gcwq, work);
+
+		if (worker && worker->current_cwq->wq == wq)
+			gcwq = last_gcwq;
+		else {
+			/* meh... not running there, queue here */
+			spin_unlock_irqrestore(&last_gcwq->lock, flags);
 			spin_lock_irqsave(&gcwq->lock, flags);
-	} else {
-		gcwq = get_gcwq(WORK_CPU_UNBOUND);
+		}
+	} else
 		spin_lock_irqsave(&gcwq->lock, flags);
-	}
 
 	/* gcwq determined, get cwq and queue */
 	cwq = get_cwq(gcwq->cpu, wq);
@@ -1154,12 +1221,18 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 		if (!(wq->flags & WQ_UNBOUND)) {
 			struct global_cwq *gcwq = get_work_gcwq(work);
 
-			if (gcwq && gcwq->cpu != WORK_CPU_UNBOUND)
+			if (gcwq && !gcwq_is_unbound(gcwq))
 				lcpu = gcwq->cpu;
 			else
 				lcpu = raw_smp_processor_id();
-		} else
-			lcpu = WORK_CPU_UNBOUND;
+		} else {
+			struct global_cwq *gcwq = get_work_gcwq(work);
+
+			if (gcwq && gcwq_is_unbound(gcwq))
+				lcpu = gcwq->cpu;
+			else
+				lcpu = WORK_CPU_UNBOUND;
+		}
 
 		set_work_cwq(work, get_cwq(lcpu, wq), 0);
 
@@ -1354,7 +1427,7 @@ static struct worker *alloc_worker(void)
  */
 static struct worker *create_worker(struct global_cwq *gcwq, bool bind)
 {
-	bool on_unbound_cpu = gcwq->cpu == WORK_CPU_UNBOUND;
+	bool on_unbound_cpu = gcwq_is_unbound(gcwq);
 	struct worker *worker = NULL;
 	int id = -1;
 
@@ -1379,9 +1452,13 @@ static struct worker *create_worker(struct global_cwq *gcwq, bool bind)
 						      worker,
 						      cpu_to_node(gcwq->cpu),
 						      "kworker/%u:%d", gcwq->cpu, id);
-	else
-		worker->task = kthread_create(worker_thread, worker,
-					      "kworker/u:%d", id);
+	else {
+		int node = to_unbound_gcwq(gcwq)->node;
+
+		worker->task = kthread_create_on_node(worker_thread, worker,
+						      wq_mem_node(node),
+						      "kworker/u%d:%d", node, id);
+	}
 	if (IS_ERR(worker->task))
 		goto fail;
 
@@ -1498,8 +1575,8 @@ static bool send_mayday(struct work_struct *work)
 
 	/* mayday mayday mayday */
 	cpu = cwq->gcwq->cpu;
-	/* WORK_CPU_UNBOUND can't be set in cpumask, use cpu 0 instead */
-	if (cpu == WORK_CPU_UNBOUND)
+	/* unbound gcwqs can't be set in cpumask, use cpu 0 instead */
+	if (cpu >= WORK_CPU_UNBOUND)
 		cpu = 0;
 	if (!mayday_test_and_set_cpu(cpu, wq->mayday_mask))
 		wake_up_process(wq->rescuer->task);
@@ -1923,6 +2000,40 @@ static void process_scheduled_works(struct worker *worker)
 	}
 }
 
+/**
+ * worker_update_attrs - apply unbound gcwq attributes to a worker
+ * @worker: self
+ *
+ * Apply the nice level and cpumask of @worker's unbound gcwq if they
+ * changed since @worker last looked.  If none of the allowed cpus is
+ * active, @worker is allowed to run anywhere until that changes.
+ *
+ * CONTEXT:
+ * Might sleep.  Called without any lock.
+ */
+static void worker_update_attrs(struct worker *worker)
+{
+	struct unbound_gcwq *ugcwq = to_unbound_gcwq(worker->gcwq);
+	const struct cpumask *cpumask;
+
+	if (likely(worker->attrs_seq == ACCESS_ONCE(ugcwq->attrs_seq)))
+		return;
+
+	mutex_lock(&wq_attrs_mutex);
+
+	cpumask = ugcwq->cpumask;
+	if (cpumask_empty(cpumask))
+		cpumask = cpumask_of_node(ugcwq->node);
+	if (!cpumask_intersects(cpumask, cpu_active_mask))
+		cpumask = cpu_possible_mask;
+
+	set_user_nice(current, ugcwq->nice);
+	set_cpus_allowed_ptr(current, cpumask);
+	worker->attrs_seq = ugcwq->attrs_seq;
+
+	mutex_unlock(&wq_attrs_mutex);
+}
+
 /**
  * worker_thread - the worker thread function
  * @__worker: self
@@ -1941,6 +2052,9 @@ static int worker_thread(void *__worker)
 	/* tell the scheduler that this is a workqueue worker */
 	worker->task->flags |= PF_WQ_WORKER;
 woke_up:
+	if (gcwq_is_unbound(gcwq))
+		worker_update_attrs(worker);
+
 	spin_lock_irq(&gcwq->lock);
 
 	/* DIE can be set only while we're idle, checking here is enough */
@@ -2009,6 +2123,50 @@ sleep:
 	goto woke_up;
 }
 
+/**
+ * rescue_cwq - process works of a cwq on behalf of its gcwq
+ * @rescuer: the rescuer of @cwq's workqueue
+ * @cwq: cwq asking for help
+ *
+ * Move @rescuer to @cwq's gcwq and process all works issued via @cwq's
+ * workqueue which are pending there.
+ *
+ * CONTEXT:
+ * Might sleep.  Called without any lock.
+ */
+static void rescue_cwq(struct worker *rescuer,
+		       struct cpu_workqueue_struct *cwq)
+{
+	struct global_cwq *gcwq = cwq->gcwq;
+	struct list_head *scheduled = &rescuer->scheduled;
+	struct work_struct *work, *n;
+
+	/* migrate to the target cpu if possible */
+	rescuer->gcwq = gcwq;
+	worker_maybe_bind_and_lock(rescuer);
+
+	/*
+	 * Slurp in all works issued via this workqueue and
+	 * process'em.
+	 */
+	BUG_ON(!list_empty(&rescuer->scheduled));
+	list_for_each_entry_safe(work, n, &gcwq->worklist, entry)
+		if (get_work_cwq(work) == cwq)
+			move_linked_works(work, scheduled, &n);
+
+	process_scheduled_works(rescuer);
+
+	/*
+	 * Leave this gcwq.  If keep_working() is %true, notify a
+	 * regular worker; otherwise, we end up with 0 concurrency
+	 * and stalling the execution.
+	 */
+	if (keep_working(gcwq))
+		wake_up_worker(gcwq);
+
+	spin_unlock_irq(&gcwq->lock);
+}
+
 /**
  * rescuer_thread - the rescuer thread function
  * @__wq: the associated workqueue
@@ -2032,9 +2190,8 @@ static int rescuer_thread(void *__wq)
 {
 	struct workqueue_struct *wq = __wq;
 	struct worker *rescuer = wq->rescuer;
-	struct list_head *scheduled = &rescuer->scheduled;
 	bool is_unbound = wq->flags & WQ_UNBOUND;
-	unsigned int cpu;
+	unsigned int cpu, tcpu;
 
 	set_user_nice(current, RESCUER_NICE_LEVEL);
 repeat:
@@ -2047,41 +2204,18 @@ repeat:
 
 	/*
 	 * See whether any cpu is asking for help.  Unbounded
-	 * workqueues use cpu 0 in mayday_mask for CPU_UNBOUND.
+	 * workqueues use cpu 0 in mayday_mask for all their per-node
+	 * gcwqs, so visit each of them.
 	 */
 	for_each_mayday_cpu(cpu, wq->mayday_mask) {
-		unsigned int tcpu = is_unbound ? WORK_CPU_UNBOUND : cpu;
-		struct cpu_workqueue_struct *cwq = get_cwq(tcpu, wq);
-		struct global_cwq *gcwq = cwq->gcwq;
-		struct work_struct *work, *n;
-
 		__set_current_state(TASK_RUNNING);
 		mayday_clear_cpu(cpu, wq->mayday_mask);
 
-		/* migrate to the target cpu if possible */
-		rescuer->gcwq = gcwq;
-		worker_maybe_bind_and_lock(rescuer);
-
-		/*
-		 * Slurp in all works issued via this workqueue and
-		 * process'em.
-		 */
-		BUG_ON(!list_empty(&rescuer->scheduled));
-		list_for_each_entry_safe(work, n, &gcwq->worklist, entry)
-			if (get_work_cwq(work) == cwq)
-				move_linked_works(work, scheduled, &n);
-
-		process_scheduled_works(rescuer);
-
-		/*
-		 * Leave this gcwq.  If keep_working() is %true, notify a
-		 * regular worker; otherwise, we end up with 0 concurrency
-		 * and stalling the execution.
-		 */
-		if (keep_working(gcwq))
-			wake_up_worker(gcwq);
-
-		spin_unlock_irq(&gcwq->lock);
+		if (!is_unbound)
+			rescue_cwq(rescuer, get_cwq(cpu, wq));
+		else
+			for_each_cwq_cpu(tcpu, wq)
+				rescue_cwq(rescuer, get_cwq(tcpu, wq));
 	}
 
 	schedule();
@@ -2904,9 +3038,23 @@ static int alloc_cwqs(struct workqueue_struct *wq)
 	const size_t align = max_t(size_t, 1 << WORK_STRUCT_FLAG_BITS,
 				   __alignof__(unsigned long long));
 
-	if (!(wq->flags & WQ_UNBOUND))
+	int node;
+
+	if (!(wq->flags & WQ_UNBOUND)) {
 		wq->cpu_wq.pcpu = __alloc_percpu(size, align);
-	else {
+
+		/* just in case, make sure it's actually aligned */
+		BUG_ON(!IS_ALIGNED(wq->cpu_wq.v, align));
+		return wq->cpu_wq.v ? 0 : -ENOMEM;
+	}
+
+	wq->cpu_wq.nodes = kcalloc(nr_node_ids, sizeof(wq->cpu_wq.nodes[0]),
+				   GFP_KERNEL);
+	if (!wq->cpu_wq.nodes)
+		return -ENOMEM;
+
+	for (node = 0; node < nr_node_ids; node++) {
+		struct cpu_workqueue_struct *cwq;
 		void *ptr;
 
 		/*
@@ -2914,26 +3062,38 @@ static int alloc_cwqs(struct workqueue_struct *wq)
 		 * pointer at the end pointing back to the originally
 		 * allocated pointer which will be used for free.
 		 */
-		ptr = kzalloc(size + align + sizeof(void *), GFP_KERNEL);
-		if (ptr) {
-			wq->cpu_wq.single = PTR_ALIGN(ptr, align);
-			*(void **)(wq->cpu_wq.single + 1) = ptr;
-		}
-	}
+		ptr = kzalloc_node(size + align + sizeof(void *), GFP_KERNEL,
+				   wq_mem_node(node));
+		if (!ptr)
+			return -ENOMEM;
 
-	/* just in case, make sure it's actually aligned */
-	BUG_ON(!IS_ALIGNED(wq->cpu_wq.v, align));
-	return wq->cpu_wq.v ? 0 : -ENOMEM;
+		cwq = PTR_ALIGN(ptr, align);
+		*(void **)(cwq + 1) = ptr;
+		wq->cpu_wq.nodes[node] = cwq;
+
+		/* just in case, make sure it's actually aligned */
+		BUG_ON(!IS_ALIGNED((unsigned long)cwq, align));
+	}
+	return 0;
 }
 
 static void free_cwqs(struct workqueue_struct *wq)
 {
-	if (!(wq->flags & WQ_UNBOUND))
+	int node;
+
+	if (!(wq->flags & WQ_UNBOUND)) {
 		free_percpu(wq->cpu_wq.pcpu);
-	else if (wq->cpu_wq.single) {
-		/* the pointer to free is stored right after the cwq */
-		kfree(*(void **)(wq->cpu_wq.single + 1));
+		return;
 	}
+
+	if (!wq->cpu_wq.nodes)
+		return;
+
+	/* the pointer to free is stored right after the cwq */
+	for (node = 0; node < nr_node_ids; node++)
+		if (wq->cpu_wq.nodes[node])
+			kfree(*(void **)(wq->cpu_wq.nodes[node] + 1));
+	kfree(wq->cpu_wq.nodes);
 }
 
 static int wq_clamp_max_active(int max_active, unsigned int flags,
@@ -2987,6 +3147,13 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	if (flags & WQ_UNBOUND)
 		flags |= WQ_HIGHPRI;
 
+	/*
+	 * Unbound workqueues with @max_active of 1 have always been
+	 * ordered.  Keep them on a single unbound gcwq.
+	 */
+	if (flags & WQ_UNBOUND && max_active == 1)
+		flags |= __WQ_ORDERED;
+
 	max_active = max_active ?: WQ_DFL_ACTIVE;
 	max_active = wq_clamp_max_active(max_active, flags, wq->name);
 
@@ -3146,16 +3313,22 @@ EXPORT_SYMBOL_GPL(workqueue_set_max_active);
  * @cpu: CPU in question
  * @wq: target workqueue
  *
- * Test whether @wq's cpu workqueue for @cpu is congested.  There is
- * no synchronization around this function and the test result is
- * unreliable and only useful as advisory hints or for debugging.
+ * Test whether @wq's cpu workqueue for @cpu is congested.  For an
+ * unbound @wq, the workqueue of @cpu's node is tested, or the local
+ * node's if @cpu is WORK_CPU_UNBOUND.  There is no synchronization
+ * around this function and the test result is unreliable and only
+ * useful as advisory hints or for debugging.
  *
  * RETURNS:
  * %true if congested, %false otherwise.
  */
 bool workqueue_congested(unsigned int cpu, struct workqueue_struct *wq)
 {
-	struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	struct cpu_workqueue_struct *cwq;
+
+	if (wq->flags & WQ_UNBOUND)
+		cpu = unbound_gcwq_cpu(wq, cpu);
+	cwq = get_cwq(cpu, wq);
 
 	return !list_empty(&cwq->delayed_works);
 }
@@ -3166,13 +3339,16 @@ EXPORT_SYMBOL_GPL(workqueue_congested);
  * @work: the work of interest
  *
  * RETURNS:
- * CPU number if @work was ever queued.  WORK_CPU_NONE otherwise.
+ * CPU number if @work was ever queued, WORK_CPU_UNBOUND if it was
+ * queued on an unbound gcwq.  WORK_CPU_NONE otherwise.
  */
 unsigned int work_cpu(struct work_struct *work)
 {
 	struct global_cwq *gcwq = get_work_gcwq(work);
 
-	return gcwq ? gcwq->cpu : WORK_CPU_NONE;
+	if (!gcwq)
+		return WORK_CPU_NONE;
+	return gcwq_is_unbound(gcwq) ? WORK_CPU_UNBOUND : gcwq->cpu;
 }
 EXPORT_SYMBOL_GPL(work_cpu);
 
@@ -3589,6 +3765,21 @@ static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 	return notifier_from_errno(0);
 }
 
+/*
+ * The cpus of a node and the set of active cpus change as cpus come
+ * online.  Make unbound workers reevaluate their affinity the next
+ * time they wake up.
+ */
+static void __devinit refresh_unbound_attrs(void)
+{
+	int node;
+
+	mutex_lock(&wq_attrs_mutex);
+	for (node = 0; node < nr_node_ids; node++)
+		unbound_global_cwq[node]->attrs_seq++;
+	mutex_unlock(&wq_attrs_mutex);
+}
+
 /*
  * Workqueues should be brought up before normal priority CPU notifiers.
  * This will be registered high priority CPU notifier.
@@ -3598,10 +3789,12 @@ static int __devinit workqueue_cpu_up_callback(struct notifier_block *nfb,
 					       void *hcpu)
 {
 	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_ONLINE:
+		refresh_unbound_attrs();
+		/* fall through */
 	case CPU_UP_PREPARE:
 	case CPU_UP_CANCELED:
 	case CPU_DOWN_FAILED:
-	case CPU_ONLINE:
 		return workqueue_cpu_callback(nfb, action, hcpu);
 	}
 	return NOTIFY_OK;
@@ -3803,14 +3996,188 @@ out_unlock:
 }
 #endif /* CONFIG_FREEZER */
 
+/*
+ * The attributes of unbound gcwqs are exported as
+ * /sys/devices/system/workqueue/unbound_nodeN/{nice,cpumask}.
+ */
+static struct bus_type wq_subsys = {
+	.name		= "workqueue",
+	.dev_name	= "unbound_node",
+};
+
+static struct unbound_gcwq *dev_to_unbound_gcwq(struct device *dev)
+{
+	return container_of(dev, struct unbound_gcwq, dev);
+}
+
+/*
+ * Bump the attrs sequence and kick idle workers so that they pick up
+ * the new attributes right away.  Busy ones will once they're done.
+ */
+static void unbound_attrs_changed(struct unbound_gcwq *ugcwq)
+{
+	struct global_cwq *gcwq = &ugcwq->gcwq;
+	struct worker *worker;
+
+	lockdep_assert_held(&wq_attrs_mutex);
+
+	ugcwq->attrs_seq++;
+
+	spin_lock_irq(&gcwq->lock);
+	list_for_each_entry(worker, &gcwq->idle_list, entry)
+		wake_up_process(worker->task);
+	spin_unlock_irq(&gcwq->lock);
+}
+
+static ssize_t show_nice(struct device *dev, struct device_attribute *attr,
+			 char *buf)
+{
+	struct unbound_gcwq *ugcwq = dev_to_unbound_gcwq(dev);
+	int nice;
+
+	mutex_lock(&wq_attrs_mutex);
+	nice = ugcwq->nice;
+	mutex_unlock(&wq_attrs_mutex);
+
+	return sprintf(buf, "%d\n", nice);
+}
+
+static ssize_t store_nice(struct device *dev, struct device_attribute *attr,
+			  const char *buf, size_t count)
+{
+	struct unbound_gcwq *ugcwq = dev_to_unbound_gcwq(dev);
+	int nice, ret;
+
+	ret = kstrtoint(buf, 0, &nice);
+	if (ret)
+		return ret;
+	if (nice < -20 || nice > 19)
+		return -EINVAL;
+
+	mutex_lock(&wq_attrs_mutex);
+	ugcwq->nice = nice;
+	unbound_attrs_changed(ugcwq);
+	mutex_unlock(&wq_attrs_mutex);
+
+	return count;
+}
+
+static ssize_t show_cpumask(struct device *dev, struct device_attribute *attr,
+			    char *buf)
+{
+	struct unbound_gcwq *ugcwq = dev_to_unbound_gcwq(dev);
+	const struct cpumask *cpumask;
+	int len;
+
+	mutex_lock(&wq_attrs_mutex);
+	cpumask = ugcwq->cpumask;
+	if (cpumask_empty(cpumask))
+		cpumask = cpumask_of_node(ugcwq->node);
+	len = cpumask_scnprintf(buf, PAGE_SIZE - 2, cpumask);
+	mutex_unlock(&wq_attrs_mutex);
+
+	len += sprintf(buf + len, "\n");
+	return len;
+}
+
+static ssize_t store_cpumask(struct device *dev, struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	struct unbound_gcwq *ugcwq = dev_to_unbound_gcwq(dev);
+	cpumask_var_t cpumask;
+	int ret;
+
+	if (!alloc_cpumask_var(&cpumask, GFP_KERNEL))
+		return -ENOMEM;
+
+	ret = bitmap_parse(buf, count, cpumask_bits(cpumask), nr_cpumask_bits);
+	if (ret)
+		goto out_free;
+
+	/* an empty mask restores the default, the cpus of the node */
+	cpumask_and(cpumask, cpumask, cpu_possible_mask);
+	if (!cpumask_empty(cpumask) &&
+	    !cpumask_intersects(cpumask, cpu_online_mask)) {
+		ret = -EINVAL;
+		goto out_free;
+	}
+
+	mutex_lock(&wq_attrs_mutex);
+	cpumask_copy(ugcwq->cpumask, cpumask);
+	unbound_attrs_changed(ugcwq);
+	mutex_unlock(&wq_attrs_mutex);
+	ret = count;
+out_free:
+	free_cpumask_var(cpumask);
+	return ret;
+}
+
+static DEVICE_ATTR(nice, 0644, show_nice, store_nice);
+static DEVICE_ATTR(cpumask, 0644, show_cpumask, store_cpumask);
+
+static struct attribute *unbound_gcwq_attrs[] = {
+	&dev_attr_nice.attr,
+	&dev_attr_cpumask.attr,
+	NULL
+};
+
+static struct attribute_group unbound_gcwq_attr_group = {
+	.attrs = unbound_gcwq_attrs,
+};
+
+static const struct attribute_group *unbound_gcwq_attr_groups[] = {
+	&unbound_gcwq_attr_group,
+	NULL
+};
+
+static int __init wq_sysfs_init(void)
+{
+	int node, ret;
+
+	ret = subsys_system_register(&wq_subsys, NULL);
+	if (ret)
+		return ret;
+
+	for (node = 0; node < nr_node_ids; node++) {
+		struct device *dev = &unbound_global_cwq[node]->dev;
+
+		dev->id = node;
+		dev->bus = &wq_subsys;
+		dev->groups = unbound_gcwq_attr_groups;
+		ret = device_register(dev);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+core_initcall(wq_sysfs_init);
+
 static int __init init_workqueues(void)
 {
 	unsigned int cpu;
-	int i;
+	int i, node;
 
 	cpu_notifier(workqueue_cpu_up_callback, CPU_PRI_WORKQUEUE_UP);
 	cpu_notifier(workqueue_cpu_down_callback, CPU_PRI_WORKQUEUE_DOWN);
 
+	/* allocate unbound gcwqs, one per node */
+	unbound_global_cwq = kcalloc(nr_node_ids, sizeof(unbound_global_cwq[0]),
+				     GFP_KERNEL);
+	BUG_ON(!unbound_global_cwq);
+
+	for (node = 0; node < nr_node_ids; node++) {
+		struct unbound_gcwq *ugcwq;
+
+		ugcwq = kzalloc_node(sizeof(*ugcwq), GFP_KERNEL,
+				     wq_mem_node(node));
+		BUG_ON(!ugcwq);
+		BUG_ON(!zalloc_cpumask_var(&ugcwq->cpumask, GFP_KERNEL));
+		ugcwq->node = node;
+		/* new workers start at 0 and apply the attrs on wakeup */
+		ugcwq->attrs_seq = 1;
+		unbound_global_cwq[node] = ugcwq;
+	}
+
 	/* initialize gcwqs */
 	for_each_gcwq_cpu(cpu) {
 		struct global_cwq *gcwq = get_gcwq(cpu);
@@ -3842,7 +4209,7 @@ static int __init init_workqueues(void)
 		struct global_cwq *gcwq = get_gcwq(cpu);
 		struct worker *worker;
 
-		if (cpu != WORK_CPU_UNBOUND)
+		if (!gcwq_is_unbound(gcwq))
 			gcwq->flags &= ~GCWQ_DISASSOCIATED;
 		worker = create_worker(gcwq, true);
 		BUG_ON(!worker);
@@ -0,0 +1,663 @@
+/*
+ * Testsuite for the eBPF interpreter and JIT
+ *
+ * Runs a table of small eBPF programs on a fixed skb, first in the
+ * interpreter and then, when the architecture JIT accepts them, as JIT
+ * compiled code, and checks that both give the expected return value.
+ * Set net.core.bpf_jit_enable to 1 before loading the module to test the
+ * JIT as well.
+ *
+ * The programs do not go through the verifier, so they must be valid on
+ * their own: no helper calls, no context field loads and no maps.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/skbuff.h>
+#include <linux/vmalloc.h>
+#include <linux/filter.h>
+#include <linux/bpf.h>
+#include <asm/byteorder.h>
+
+#define BPF_ALU64_REG(OP, DST, SRC)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU64 | BPF_OP(OP) | BPF_X,	\
+		.dst_reg = DST, .src_reg = SRC })
+
+#define BPF_ALU32_REG(OP, DST, SRC)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU | BPF_OP(OP) | BPF_X,		\
+		.dst_reg = DST, .src_reg = SRC })
+
+#define BPF_ALU64_IMM(OP, DST, IMM)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU64 | BPF_OP(OP) | BPF_K,	\
+		.dst_reg = DST, .imm = IMM })
+
+#define BPF_ALU32_IMM(OP, DST, IMM)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU | BPF_OP(OP) | BPF_K,		\
+		.dst_reg = DST, .imm = IMM })
+
+#define BPF_ENDIAN(TYPE, DST, LEN)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU | BPF_END | BPF_SRC(TYPE),	\
+		.dst_reg = DST, .imm = LEN })
+
+#define BPF_MOV64_REG(DST, SRC)					\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU64 | BPF_MOV | BPF_X,		\
+		.dst_reg = DST, .src_reg = SRC })
+
+#define BPF_MOV64_IMM(DST, IMM)					\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU64 | BPF_MOV | BPF_K,		\
+		.dst_reg = DST, .imm = IMM })
+
+#define BPF_MOV32_IMM(DST, IMM)					\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU | BPF_MOV | BPF_K,		\
+		.dst_reg = DST, .imm = IMM })
+
+#define BPF_LD_IMM64(DST, IMM)					\
+	((struct bpf_insn) {					\
+		.code  = BPF_LD | BPF_DW | BPF_IMM,		\
+		.dst_reg = DST, .imm = (u32) (IMM) }),		\
+	((struct bpf_insn) { .imm = ((u64) (IMM)) >> 32 })
+
+#define BPF_LD_ABS(SIZE, IMM)					\
+	((struct bpf_insn) {					\
+		.code  = BPF_LD | BPF_SIZE(SIZE) | BPF_ABS,	\
+		.imm = IMM })
+
+#define BPF_LD_IND(SIZE, SRC, IMM)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_LD | BPF_SIZE(SIZE) | BPF_IND,	\
+		.src_reg = SRC, .imm = IMM })
+
+#define BPF_LDX_MEM(SIZE, DST, SRC, OFF)			\
+	((struct bpf_insn) {					\
+		.code  = BPF_LDX | BPF_SIZE(SIZE) | BPF_MEM,	\
+		.dst_reg = DST, .src_reg = SRC, .off = OFF })
+
+#define BPF_STX_MEM(SIZE, DST, SRC, OFF)			\
+	((struct bpf_insn) {					\
+		.code  = BPF_STX | BPF_SIZE(SIZE) | BPF_MEM,	\
+		.dst_reg = DST, .src_reg = SRC, .off = OFF })
+
+#define BPF_STX_XADD(SIZE, DST, SRC, OFF)			\
+	((struct bpf_insn) {					\
+		.code  = BPF_STX | BPF_SIZE(SIZE) | BPF_XADD,	\
+		.dst_reg = DST, .src_reg = SRC, .off = OFF })
+
+#define BPF_ST_MEM(SIZE, DST, OFF, IMM)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_ST | BPF_SIZE(SIZE) | BPF_MEM,	\
+		.dst_reg = DST, .off = OFF, .imm = IMM })
+
+#define BPF_JMP_REG(OP, DST, SRC, OFF)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_JMP | BPF_OP(OP) | BPF_X,		\
+		.dst_reg = DST, .src_reg = SRC, .off = OFF })
+
+#define BPF_JMP_IMM(OP, DST, IMM, OFF)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_JMP | BPF_OP(OP) | BPF_K,		\
+		.dst_reg = DST, .off = OFF, .imm = IMM })
+
+#define BPF_EXIT_INSN()						\
+	((struct bpf_insn) { .code = BPF_JMP | BPF_EXIT })
+
+#define R0	BPF_REG_0
+#define R1	BPF_REG_1
+#define R2	BPF_REG_2
+#define R6	BPF_REG_6
+#define R7	BPF_REG_7
+#define R10	BPF_REG_10
+
+#define MAX_INSNS	16
+#define SKB_LEN		64	/* data byte i holds the value i */
+#define SKB_NET_HDR	14
+
+struct bpf_test {
+	const char *descr;
+	struct bpf_insn insns[MAX_INSNS];
+	u32 result;
+};
+
+static struct bpf_test tests[] __initdata = {
+	/* ALU */
+	{
+		"ALU64_ADD_X",
+		{
+			BPF_MOV64_IMM(R0, 1),
+			BPF_MOV64_IMM(R1, 2),
+			BPF_ALU64_REG(BPF_ADD, R0, R1),
+			BPF_EXIT_INSN(),
+		},
+		3
+	},
+	{
+		"ALU64_ADD_K carries into the upper half",
+		{
+			BPF_LD_IMM64(R0, 0xffffffffULL),
+			BPF_ALU64_IMM(BPF_ADD, R0, 1),
+			BPF_ALU64_IMM(BPF_RSH, R0, 32),
+			BPF_EXIT_INSN(),
+		},
+		1
+	},
+	{
+		"ALU_ADD_K wraps around",
+		{
+			BPF_MOV64_IMM(R0, -1),
+			BPF_ALU32_IMM(BPF_ADD, R0, 2),
+			BPF_EXIT_INSN(),
+		},
+		1
+	},
+	{
+		"ALU_ADD_X clears the upper half",
+		{
+			BPF_MOV64_IMM(R0, -1),
+			BPF_MOV64_IMM(R1, 0),
+			BPF_ALU32_REG(BPF_ADD, R0, R1),
+			BPF_ALU64_IMM(BPF_RSH, R0, 32),
+			BPF_EXIT_INSN(),
+		},
+		0
+	},
+	{
+		"ALU64_SUB_X",
+		{
+			BPF_MOV64_IMM(R0, 3),
+			BPF_MOV64_IMM(R1, 5),
+			BPF_ALU64_REG(BPF_SUB, R0, R1),
+			BPF_EXIT_INSN(),
+		},
+		-2
+	},
+	{
+		"ALU64_MUL_K",
+		{
+			BPF_MOV64_IMM(R0, 0x10000),
+			BPF_ALU64_IMM(BPF_MUL, R0, 0x10000),
+			BPF_ALU64_IMM(BPF_RSH, R0, 32),
+			BPF_EXIT_INSN(),
+		},
+		1
+	},
+	{
+		"ALU_MUL_X",
+		{
+			BPF_MOV64_IMM(R0, 0x10000),
+			BPF_MOV64_IMM(R1, 0x10001),
+			BPF_ALU32_REG(BPF_MUL, R0, R1),
+			BPF_EXIT_INSN(),
+		},
+		0x10000
+	},
+	{
+		"ALU64_DIV_X",
+		{
+			BPF_MOV64_IMM(R0, -1),
+			BPF_MOV64_IMM(R1, 2),
+			BPF_ALU64_REG(BPF_DIV, R0, R1),
+			BPF_ALU64_IMM(BPF_RSH, R0, 32),
+			BPF_EXIT_INSN(),
+		},
+		0x7fffffff
+	},
+	{
+		"ALU_DIV_K",
+		{
+			BPF_MOV64_IMM(R0, -1),
+			BPF_ALU32_IMM(BPF_DIV, R0, 2),
+			BPF_EXIT_INSN(),
+		},
+		0x7fffffff
+	},
+	{
+		"ALU64_MOD_K",
+		{
+			BPF_MOV64_IMM(R0, 100),
+			BPF_ALU64_IMM(BPF_MOD, R0, 7),
+			BPF_EXIT_INSN(),
+		},
+		2
+	},
+	{
+		"ALU_MOD_X",
+		{
+			BPF_MOV64_IMM(R0, -1),
+			BPF_MOV64_IMM(R1, 10),
+			BPF_ALU32_REG(BPF_MOD, R0, R1),
+			BPF_EXIT_INSN(),
+		},
+		5
+	},
+	{
+		"ALU64_DIV_X by zero returns 0",
+		{
+			BPF_MOV64_IMM(R0, 1),
+			BPF_MOV64_IMM(R1, 0),
+			BPF_ALU64_REG(BPF_DIV, R0, R1),
+			BPF_MOV64_IMM(R0, 1),
+			BPF_EXIT_INSN(),
+		},
+		0
+	},
+	{
+		"ALU_MOD_X by zero in the lower half returns 0",
+		{
+			BPF_MOV64_IMM(R0, 1),
+			BPF_LD_IMM64(R1, 0x100000000ULL),
+			BPF_ALU32_REG(BPF_MOD, R0, R1),
+			BPF_MOV64_IMM(R0, 1),
+			BPF_EXIT_INSN(),
+		},
+		0
+	},
+	{
+		"ALU64_LSH_X",
+		{
+			BPF_MOV64_IMM(R0, 1),
+			BPF_MOV64_IMM(R1, 40),
+			BPF_ALU64_REG(BPF_LSH, R0, R1),
+			BPF_ALU64_IMM(BPF_RSH, R0, 32),
+			BPF_EXIT_INSN(),
+		},
+		0x100
+	},
+	{
+		"ALU_RSH_K",
+		{
+			BPF_MOV32_IMM(R0, 0x80000000),
+			BPF_ALU32_IMM(BPF_RSH, R0, 31),
+			BPF_EXIT_INSN(),
+		},
+		1
+	},
+	{
+		"ALU64_ARSH_K",
+		{
+			BPF_MOV64_IMM(R0, -16),
+			BPF_ALU64_IMM(BPF_ARSH, R0, 2),
+			BPF_EXIT_INSN(),
+		},
+		-4
+	},
+	{
+		"ALU64_NEG",
+		{
+			BPF_MOV64_IMM(R0, 5),
+			BPF_ALU64_IMM(BPF_NEG, R0, 0),
+			BPF_EXIT_INSN(),
+		},
+		-5
+	},
+	{
+		"ALU64_OR_K, AND_K, XOR_K",
+		{
+			BPF_MOV64_IMM(R0, 0xf0),
+			BPF_ALU64_IMM(BPF_OR, R0, 0x0f),
+			BPF_ALU64_IMM(BPF_AND, R0, 0x3c),
+			BPF_ALU64_IMM(BPF_XOR, R0, 0x01),
+			BPF_EXIT_INSN(),
+		},
+		0x3d
+	},
+	{
+		"ALU_END_TO_BE 16",
+		{
+			BPF_MOV32_IMM(R0, 0x12345678),
+			BPF_ENDIAN(BPF_TO_BE, R0, 16),
+			BPF_EXIT_INSN(),
+		},
+		__constant_cpu_to_be16(0x5678)
+	},
+	{
+		"ALU_END_TO_BE 32",
+		{
+			BPF_MOV32_IMM(R0, 0x12345678),
+			BPF_ENDIAN(BPF_TO_BE, R0, 32),
+			BPF_EXIT_INSN(),
+		},
+		__constant_cpu_to_be32(0x12345678)
+	},
+	{
+		"ALU_END_TO_LE 16",
+		{
+			BPF_MOV32_IMM(R0, 0x12345678),
+			BPF_ENDIAN(BPF_TO_LE, R0, 16),
+			BPF_EXIT_INSN(),
+		},
+		__constant_cpu_to_le16(0x5678)
+	},
+	{
+		"LD_IMM64",
+		{
+			BPF_LD_IMM64(R0, 0x123456789abcdef0ULL),
+			BPF_ALU64_IMM(BPF_RSH, R0, 32),
+			BPF_EXIT_INSN(),
+		},
+		0x12345678
+	},
+
+	/* jumps */
+	{
+		"JMP_JGT_X is unsigned",
+		{
+			BPF_MOV64_IMM(R1, -1),
+			BPF_MOV64_IMM(R2, 1),
+			BPF_MOV64_IMM(R0, 1),
+			BPF_JMP_REG(BPF_JGT, R1, R2, 1),
+			BPF_MOV64_IMM(R0, 2),
+			BPF_EXIT_INSN(),
+		},
+		1
+	},
+	{
+		"JMP_JSGT_X is signed",
+		{
+			BPF_MOV64_IMM(R1, -1),
+			BPF_MOV64_IMM(R2, 1),
+			BPF_MOV64_IMM(R0, 1),
+			BPF_JMP_REG(BPF_JSGT, R1, R2, 1),
+			BPF_MOV64_IMM(R0, 2),
+			BPF_EXIT_INSN(),
+		},
+		2
+	},
+	{
+		"JMP_JSGE_K",
+		{
+			BPF_MOV64_IMM(R1, -1),
+			BPF_MOV64_IMM(R0, 1),
+			BPF_JMP_IMM(BPF_JSGE, R1, -1, 1),
+			BPF_MOV64_IMM(R0, 2),
+			BPF_EXIT_INSN(),
+		},
+		1
+	},
+	{
+		"JMP_JGE_K sign extends the immediate",
+		{
+			BPF_LD_IMM64(R1, 0x100000000ULL),
+			BPF_MOV64_IMM(R0, 1),
+			BPF_JMP_IMM(BPF_JGE, R1, -1, 1),
+			BPF_MOV64_IMM(R0, 2),
+			BPF_EXIT_INSN(),
+		},
+		2
+	},
+	{
+		"JMP_JSET_K",
+		{
+			BPF_MOV64_IMM(R1, 6),
+			BPF_MOV64_IMM(R0, 1),
+			BPF_JMP_IMM(BPF_JSET, R1, 2, 1),
+			BPF_MOV64_IMM(R0, 2),
+			BPF_EXIT_INSN(),
+		},
+		1
+	},
+	{
+		"JMP_JNE_X, JEQ_K",
+		{
+			BPF_MOV64_IMM(R1, 3),
+			BPF_MOV64_IMM(R2, 3),
+			BPF_MOV64_IMM(R0, 1),
+			BPF_JMP_REG(BPF_JNE, R1, R2, 2),
+			BPF_JMP_IMM(BPF_JEQ, R1, 3, 1),
+			BPF_MOV64_IMM(R0, 2),
+			BPF_EXIT_INSN(),
+		},
+		1
+	},
+
+	/* stack */
+	{
+		"STX_MEM_W, LDX_MEM_W",
+		{
+			BPF_MOV64_IMM(R1, 0x11223344),
+			BPF_STX_MEM(BPF_W, R10, R1, -4),
+			BPF_LDX_MEM(BPF_W, R0, R10, -4),
+			BPF_EXIT_INSN(),
+		},
+		0x11223344
+	},
+	{
+		"STX_MEM_B, LDX_MEM_B",
+		{
+			BPF_ST_MEM(BPF_DW, R10, -8, 0),
+			BPF_MOV64_IMM(R1, 0x11223344),
+			BPF_STX_MEM(BPF_B, R10, R1, -1),
+			BPF_LDX_MEM(BPF_B, R0, R10, -1),
+			BPF_EXIT_INSN(),
+		},
+		0x44
+	},
+	{
+		"ST_MEM_DW sign extends the immediate",
+		{
+			BPF_ST_MEM(BPF_DW, R10, -8, -1),
+			BPF_LDX_MEM(BPF_DW, R0, R10, -8),
+			BPF_ALU64_IMM(BPF_RSH, R0, 32),
+			BPF_EXIT_INSN(),
+		},
+		0xffffffff
+	},
+	{
+		"STX_XADD_DW",
+		{
+			BPF_ST_MEM(BPF_DW, R10, -8, 1),
+			BPF_MOV64_IMM(R1, 2),
+			BPF_STX_XADD(BPF_DW, R10, R1, -8),
+			BPF_LDX_MEM(BPF_DW, R0, R10, -8),
+			BPF_EXIT_INSN(),
+		},
+		3
+	},
+	{
+		"STX_XADD_W",
+		{
+			BPF_ST_MEM(BPF_W, R10, -4, 0x7fffffff),
+			BPF_MOV64_IMM(R1, 1),
+			BPF_STX_XADD(BPF_W, R10, R1, -4),
+			BPF_LDX_MEM(BPF_W, R0, R10, -4),
+			BPF_EXIT_INSN(),
+		},
+		0x80000000
+	},
+
+	/* packet loads */
+	{
+		"LD_ABS_W",
+		{
+			BPF_MOV64_REG(R6, R1),
+			BPF_LD_ABS(BPF_W, 0),
+			BPF_EXIT_INSN(),
+		},
+		0x00010203
+	},
+	{
+		"LD_ABS_H",
+		{
+			BPF_MOV64_REG(R6, R1),
+			BPF_LD_ABS(BPF_H, 2),
+			BPF_EXIT_INSN(),
+		},
+		0x0203
+	},
+	{
+		"LD_ABS_B",
+		{
+			BPF_MOV64_REG(R6, R1),
+			BPF_LD_ABS(BPF_B, 5),
+			BPF_EXIT_INSN(),
+		},
+		5
+	},
+	{
+		"LD_IND_H",
+		{
+			BPF_MOV64_REG(R6, R1),
+			BPF_MOV64_IMM(R7, 4),
+			BPF_LD_IND(BPF_H, R7, 2),
+			BPF_EXIT_INSN(),
+		},
+		0x0607
+	},
+	{
+		"LD_ABS_B from SKF_NET_OFF",
+		{
+			BPF_MOV64_REG(R6, R1),
+			BPF_LD_ABS(BPF_B, SKF_NET_OFF + 1),
+			BPF_EXIT_INSN(),
+		},
+		SKB_NET_HDR + 1
+	},
+	{
+		"LD_ABS_W past the end returns 0",
+		{
+			BPF_MOV64_REG(R6, R1),
+			BPF_LD_ABS(BPF_W, SKB_LEN - 2),
+			BPF_MOV64_IMM(R0, 1),
+			BPF_EXIT_INSN(),
+		},
+		0
+	},
+	{
+		"LD_IND_B with a negative offset returns 0",
+		{
+			BPF_MOV64_REG(R6, R1),
+			BPF_MOV64_IMM(R7, -8),
+			BPF_LD_IND(BPF_B, R7, 0),
+			BPF_MOV64_IMM(R0, 1),
+			BPF_EXIT_INSN(),
+		},
+		0
+	},
+	{
+		"LD_ABS keeps R6-R9",
+		{
+			BPF_MOV64_REG(R6, R1),
+			BPF_MOV64_IMM(R7, 7),
+			BPF_LD_ABS(BPF_B, 0),
+			BPF_ALU64_REG(BPF_ADD, R0, R7),
+			BPF_EXIT_INSN(),
+		},
+		7
+	},
+};
+
+static struct sk_buff *__init populate_skb(void)
+{
+	struct sk_buff *skb;
+	u8 *data;
+	int i;
+
+	skb = alloc_skb(SKB_LEN, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+	data = skb_put(skb, SKB_LEN);
+	for (i = 0; i < SKB_LEN; i++)
+		data[i] = i;
+	skb_reset_mac_header(skb);
+	skb_set_network_header(skb, SKB_NET_HDR);
+	return skb;
+}
+
+/* number of instructions up to the last non-zero one */
+static int __init prog_len(const struct bpf_insn *insns)
+{
+	int len;
+
+	for (len = MAX_INSNS; len > 0; len--)
+		if (insns[len - 1].code || insns[len - 1].imm)
+			break;
+	return len;
+}
+
+/* returns 1 if the JIT ran the program too, 0 if only the interpreter did */
+static int __init run_one(const struct bpf_test *test, struct sk_buff *skb)
+{
+	struct bpf_prog *prog;
+	int len = prog_len(test->insns);
+	u32 ret;
+	int err = 0;
+
+	prog = vzalloc(sizeof(*prog) + len * sizeof(struct bpf_insn));
+	if (!prog)
+		return -ENOMEM;
+	atomic_set(&prog->refcnt, 1);
+	prog->len = len;
+	prog->type = BPF_PROG_TYPE_SOCKET_FILTER;
+	memcpy(prog->insnsi, test->insns, len * sizeof(struct bpf_insn));
+
+	ret = __bpf_prog_run(skb, prog->insnsi);
+	if (ret != test->result) {
+		pr_err("%s: interpreter returned %#x, expected %#x\n",
+		       test->descr, ret, test->result);
+		err = -EINVAL;
+	}
+
+	bpf_prog_select_runtime(prog);
+	if (prog->jited) {
+		ret = BPF_PROG_RUN(prog, skb);
+		if (ret != test->result) {
+			pr_err("%s: JIT returned %#x, expected %#x\n",
+			       test->descr, ret, test->result);
+			err = -EINVAL;
+		}
+	}
+
+	if (!err)
+		err = prog->jited;
+	bpf_prog_put(prog);
+	return err;
+}
+
+static int __init test_bpf_init(void)
+{
+	struct sk_buff *skb;
+	int i, ret, err_cnt = 0, jit_cnt = 0;
+
+	skb = populate_skb();
+	if (!skb)
+		return -ENOMEM;
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		ret = run_one(&tests[i], skb);
+		if (ret < 0)
+			err_cnt++;
+		else
+			jit_cnt += ret;
+	}
+	kfree_skb(skb);
+
+	if (err_cnt) {
+		pr_err("%d of %zu tests failed\n", err_cnt, ARRAY_SIZE(tests));
+		return -EINVAL;
+	}
+	pr_info("all %zu tests passed, %d of them JIT compiled\n",
+		ARRAY_SIZE(tests), jit_cnt);
+	return 0;
+}
+
+static void __exit test_bpf_exit(void)
+{
+}
+
+module_init(test_bpf_init);
+module_exit(test_bpf_exit);
+MODULE_LICENSE("GPL");
@@ -0,0 +1,117 @@
+/*
+ * lib/win_minmax.c
+ *
+ * This source code is licensed under the GNU General Public License,
+ * Version 2.  See the file COPYING for more details.
+ */
+
+#include <linux/compiler.h>
+#include <linux/export.h>
+#include <linux/win_minmax.h>
+
+/**
+ * DOC: Windowed min/max estimator
+ *
+ * Tracks the minimum or maximum of a series of measurements over a sliding
+ * time window, using the algorithm of Kathleen Nichols: instead of keeping
+ * every sample of the window, only the best, 2nd best and 3rd best samples
+ * are kept, each of them taken later than the previous one and each one
+ * being the best of what was measured after it.  When the best sample ages
+ * out of the window the 2nd best takes its place, and so on.  This needs
+ * constant space and time, and the estimate is never off by more than the
+ * values seen in the last quarter or half of the window.
+ *
+ * Time and value units are up to the caller; the window is expressed in the
+ * same unit as the time.  The same code serves min and max trackers, the
+ * caller only decides which of the two running functions to feed.
+ */
+
+/* As time advances, update the 1st, 2nd, and 3rd choices. */
+static u32 minmax_subwin_update(struct minmax *m, u32 win,
+				const struct minmax_sample *val)
+{
+	u32 dt = val->t - m->s[0].t;
+
+	if (unlikely(dt > win)) {
+		/*
+		 * Passed entire window without a new val so make 2nd
+		 * choice the new val & 3rd choice the new 2nd choice.
+		 * We may have to iterate this since our 2nd choice
+		 * may also be outside the window (we checked on entry
+		 * that the third choice was in the window).
+		 */
+		m->s[0] = m->s[1];
+		m->s[1] = m->s[2];
+		m->s[2] = *val;
+		if (unlikely(val->t - m->s[0].t > win)) {
+			m->s[0] = m->s[1];
+			m->s[1] = m->s[2];
+			m->s[2] = *val;
+		}
+	} else if (unlikely(m->s[1].t == m->s[0].t) && dt > win / 4) {
+		/*
+		 * We've passed a quarter of the window without a new val
+		 * so take a 2nd choice from the 2nd quarter of the window.
+		 */
+		m->s[2] = m->s[1] = *val;
+	} else if (unlikely(m->s[2].t == m->s[1].t) && dt > win / 2) {
+		/*
+		 * We've passed half the window without finding a new val
+		 * so take a 3rd choice from the last half of the window
+		 */
+		m->s[2] = *val;
+	}
+	return m->s[0].v;
+}
+
+/**
+ * minmax_running_max() - Feed a measurement to a windowed max estimator
+ * @m: Estimator
+ * @win: Length of the window
+ * @t: Time of the measurement
+ * @meas: Measured value
+ *
+ * Returns the max over the last @win time units.
+ */
+u32 minmax_running_max(struct minmax *m, u32 win, u32 t, u32 meas)
+{
+	struct minmax_sample val = { .t = t, .v = meas };
+
+	if (unlikely(val.v >= m->s[0].v) ||	  /* found new max? */
+	    unlikely(val.t - m->s[2].t > win))	  /* nothing left in window? */
+		return minmax_reset(m, t, meas);  /* forget earlier samples */
+
+	if (unlikely(val.v >= m->s[1].v))
+		m->s[2] = m->s[1] = val;
+	else if (unlikely(val.v >= m->s[2].v))
+		m->s[2] = val;
+
+	return minmax_subwin_update(m, win, &val);
+}
+EXPORT_SYMBOL(minmax_running_max);
+
+/**
+ * minmax_running_min() - Feed a measurement to a windowed min estimator
+ * @m: Estimator
+ * @win: Length of the window
+ * @t: Time of the measurement
+ * @meas: Measured value
+ *
+ * Returns the min over the last @win time units.
+ */
+u32 minmax_running_min(struct minmax *m, u32 win, u32 t, u32 meas)
+{
+	struct minmax_sample val = { .t = t, .v = meas };
+
+	if (unlikely(val.v <= m->s[0].v) ||	  /* found new min? */
+	    unlikely(val.t - m->s[2].t > win))	  /* nothing left in window? */
+		return minmax_reset(m, t, meas);  /* forget earlier samples */
+
+	if (unlikely(val.v <= m->s[1].v))
+		m->s[2] = m->s[1] = val;
+	else if (unlikely(val.v <= m->s[2].v))
+		m->s[2] = val;
+
+	return minmax_subwin_update(m, win, &val);
+}
+EXPORT_SYMBOL(minmax_running_min);
@@ -135,6 +135,8 @@
 #include <linux/net_tstamp.h>
 #include <linux/static_key.h>
 #include <net/flow_keys.h>
+#include <net/busy_poll.h>
+#include <linux/bpf.h>
 
 #include "net-sysfs.h"
 
@@ -1945,47 +1947,56 @@ out:
 }
 EXPORT_SYMBOL(skb_checksum_help);
 
-/**
- *	skb_gso_segment - Perform segmentation on skb.
- *	@skb: buffer to segment
- *	@features: features for the output path (see dev->features)
- *
- *	This function segments the given skb and returns a list of segments.
- *
- *	It may return NULL if the skb requires no segmentation.  This is
- *	only possible when GSO is used for verifying header integrity.
- */
-struct sk_buff *skb_gso_segment(struct sk_buff *skb,
-	netdev_features_t features)
+static __be16 skb_network_protocol(struct sk_buff *skb)
 {
-	struct sk_buff *segs = ERR_PTR(-EPROTONOSUPPORT);
-	struct packet_type *ptype;
 	__be16 type = skb->protocol;
 	int vlan_depth = ETH_HLEN;
-	int err;
+
+	/* Tunnel gso handlers can set protocol to ethernet. */
+	if (type == htons(ETH_P_TEB)) {
+		struct ethhdr *eth;
+
+		if (unlikely(!pskb_may_pull(skb, sizeof(struct ethhdr))))
+			return 0;
+
+		eth = (struct ethhdr *)skb_mac_header(skb);
+		type = eth->h_proto;
+	}
 
 	while (type == htons(ETH_P_8021Q)) {
 		struct vlan_hdr *vh;
 
 		if (unlikely(!pskb_may_pull(skb, vlan_depth + VLAN_HLEN)))
-			return ERR_PTR(-EINVAL);
+			return 0;
 
 		vh = (struct vlan_hdr *)(skb->data + vlan_depth);
 		type = vh->h_vlan_encapsulated_proto;
 		vlan_depth += VLAN_HLEN;
 	}
 
-	skb_reset_mac_header(skb);
-	skb->mac_len = skb->network_header - skb->mac_header;
-	__skb_pull(skb, skb->mac_len);
+	return type;
+}
 
-	if (unlikely(skb->ip_summed != CHECKSUM_PARTIAL)) {
-		skb_warn_bad_offload(skb);
+/**
+ *	skb_mac_gso_segment - mac layer segmentation handler.
+ *	@skb: buffer to segment
+ *	@features: features for the output path (see dev->features)
+ *
+ *	Segments an skb whose mac header and mac_len are already set up.
+ *	Tunnel gso handlers use this to segment the inner packet.
+ */
+struct sk_buff *skb_mac_gso_segment(struct sk_buff *skb,
+	netdev_features_t features)
+{
+	struct sk_buff *segs = ERR_PTR(-EPROTONOSUPPORT);
+	struct packet_type *ptype;
+	__be16 type = skb_network_protocol(skb);
+	int err;
 
-		if (skb_header_cloned(skb) &&
-		    (err = pskb_expand_head(skb, 0, 0, GFP_ATOMIC)))
-			return ERR_PTR(err);
-	}
+	if (unlikely(!type))
+		return ERR_PTR(-EINVAL);
+
+	__skb_pull(skb, skb->mac_len);
 
 	rcu_read_lock();
 	list_for_each_entry_rcu(ptype,
@@ -2009,6 +2020,37 @@ struct sk_buff *skb_gso_segment(struct sk_buff *skb,
 
 	return segs;
 }
+EXPORT_SYMBOL(skb_mac_gso_segment);
+
+/**
+ *	skb_gso_segment - Perform segmentation on skb.
+ *	@skb: buffer to segment
+ *	@features: features for the output path (see dev->features)
+ *
+ *	This function segments the given skb and returns a list of segments.
+ *
+ *	It may return NULL if the skb requires no segmentation.  This is
+ *	only possible when GSO is used for verifying header integrity.
+ */
+struct sk_buff *skb_gso_segment(struct sk_buff *skb,
+	netdev_features_t features)
+{
+	int err;
+
+	if (unlikely(skb->ip_summed != CHECKSUM_PARTIAL)) {
+		skb_warn_bad_offload(skb);
+
+		if (skb_header_cloned(skb) &&
+		    (err = pskb_expand_head(skb, 0, 0, GFP_ATOMIC)))
+			return ERR_PTR(err);
+	}
+
+	SKB_GSO_CB(skb)->mac_offset = skb_headroom(skb);
+	skb_reset_mac_header(skb);
+	skb->mac_len = skb->network_header - skb->mac_header;
+
+	return skb_mac_gso_segment(skb, features);
+}
 EXPORT_SYMBOL(skb_gso_segment);
 
 /* Take action when hardware reception checksum errors are detected. */
@@ -2140,6 +2182,13 @@ netdev_features_t netif_skb_features(struct sk_buff *skb)
 	if (skb_shinfo(skb)->gso_segs > skb->dev->gso_max_segs)
 		features &= ~NETIF_F_GSO_MASK;
 
+	/* Encapsulated packets only get the offloads the device can apply
+	 * to the inner headers.
+	 */
+	if (skb->encapsulation)
+		features &= skb->dev->hw_enc_features |
+			    ~(NETIF_F_ALL_CSUM | NETIF_F_GSO_MASK);
+
 	if (protocol == htons(ETH_P_8021Q)) {
 		struct vlan_ethhdr *veh = (struct vlan_ethhdr *)skb->data;
 		protocol = veh->h_vlan_encapsulated_proto;
@@ -2176,69 +2225,123 @@ static inline int skb_needs_linearize(struct sk_buff *skb,
 				!(features & NETIF_F_SG)));
 }
 
-int dev_hard_start_xmit(struct sk_buff *skb, struct net_device *dev,
-			struct netdev_queue *txq)
+/*
+ * Hand one packet to the driver.  @more tells it that the caller has
+ * further packets for @txq queued behind this one; the segments of a GSO
+ * packet are always sent with the hint set on all but the last one.
+ */
+static struct sk_buff *validate_xmit_skb(struct sk_buff *skb,
+					 struct net_device *dev)
 {
-	const struct net_device_ops *ops = dev->netdev_ops;
-	int rc = NETDEV_TX_OK;
-	unsigned int skb_len;
+	netdev_features_t features;
 
-	if (likely(!skb->next)) {
-		netdev_features_t features;
+	/*
+	 * If device doesn't need skb->dst, release it right now while
+	 * its hot in this cpu cache
+	 */
+	if (dev->priv_flags & IFF_XMIT_DST_RELEASE)
+		skb_dst_drop(skb);
 
-		/*
-		 * If device doesn't need skb->dst, release it right now while
-		 * its hot in this cpu cache
-		 */
-		if (dev->priv_flags & IFF_XMIT_DST_RELEASE)
-			skb_dst_drop(skb);
+	if (!list_empty(&ptype_all))
+		dev_queue_xmit_nit(skb, dev);
 
-		if (!list_empty(&ptype_all))
-			dev_queue_xmit_nit(skb, dev);
+	features = netif_skb_features(skb);
 
-		features = netif_skb_features(skb);
+	if (vlan_tx_tag_present(skb) &&
+	    !(features & NETIF_F_HW_VLAN_TX)) {
+		skb = __vlan_put_tag(skb, vlan_tx_tag_get(skb));
+		if (unlikely(!skb))
+			return NULL;
 
-		if (vlan_tx_tag_present(skb) &&
-		    !(features & NETIF_F_HW_VLAN_TX)) {
-			skb = __vlan_put_tag(skb, vlan_tx_tag_get(skb));
-			if (unlikely(!skb))
-				goto out;
+		skb->vlan_tci = 0;
+	}
 
-			skb->vlan_tci = 0;
-		}
+	if (netif_needs_gso(skb, features)) {
+		if (unlikely(dev_gso_segment(skb, features)))
+			goto out_kfree_skb;
+	} else {
+		if (skb_needs_linearize(skb, features) &&
+		    __skb_linearize(skb))
+			goto out_kfree_skb;
 
-		if (netif_needs_gso(skb, features)) {
-			if (unlikely(dev_gso_segment(skb, features)))
-				goto out_kfree_skb;
-			if (skb->next)
-				goto gso;
-		} else {
-			if (skb_needs_linearize(skb, features) &&
-			    __skb_linearize(skb))
+		/* If packet is not checksummed and device does not
+		 * support checksumming for this protocol, complete
+		 * checksumming here.
+		 */
+		if (skb->ip_summed == CHECKSUM_PARTIAL) {
+			skb_set_transport_header(skb,
+				skb_checksum_start_offset(skb));
+			if (!(features & NETIF_F_ALL_CSUM) &&
+			     skb_checksum_help(skb))
 				goto out_kfree_skb;
+		}
+	}
 
-			/* If packet is not checksummed and device does not
-			 * support checksumming for this protocol, complete
-			 * checksumming here.
-			 */
-			if (skb->ip_summed == CHECKSUM_PARTIAL) {
-				skb_set_transport_header(skb,
-					skb_checksum_start_offset(skb));
-				if (!(features & NETIF_F_ALL_CSUM) &&
-				     skb_checksum_help(skb))
-					goto out_kfree_skb;
-			}
+	return skb;
+
+out_kfree_skb:
+	kfree_skb(skb);
+	return NULL;
+}
+
+/**
+ *	validate_xmit_skb_list - prepare a batch of packets for the driver
+ *	@skb: first packet of a batch linked through skb->next
+ *	@dev: device the batch is sent on
+ *
+ *	Does everything dev_hard_start_xmit() cannot fail on: VLAN tag
+ *	insertion, GSO segmentation, linearization and checksumming.  Packets
+ *	that fail are freed and unlinked, so a caller running this before it
+ *	takes the tx lock knows that the last packet it hands to the driver
+ *	really is the last one.  A GSO packet ends the batch and keeps its
+ *	segments on skb->next.  Returns the new head, or NULL if every packet
+ *	was dropped.
+ */
+struct sk_buff *validate_xmit_skb_list(struct sk_buff *skb,
+				       struct net_device *dev)
+{
+	struct sk_buff *head = NULL, *tail = NULL;
+
+	while (skb) {
+		struct sk_buff *next = skb->next;
+
+		skb->next = NULL;
+		skb = validate_xmit_skb(skb, dev);
+		if (skb) {
+			if (tail)
+				tail->next = skb;
+			else
+				head = skb;
+			tail = skb;
+			if (skb->next)
+				break;	/* GSO segments, last of the batch */
 		}
+		skb = next;
+	}
+	return head;
+}
+EXPORT_SYMBOL_GPL(validate_xmit_skb_list);
+
+/*
+ * Hands a packet prepared by validate_xmit_skb_list() to the driver, one
+ * segment at a time if it was split for GSO.  Called with the tx lock held;
+ * nothing in here drops the packet before the driver has seen it.
+ */
+int dev_hard_start_xmit(struct sk_buff *skb, struct net_device *dev,
+			struct netdev_queue *txq, bool more)
+{
+	int rc = NETDEV_TX_OK;
+	unsigned int skb_len;
 
+	if (likely(!skb->next)) {
 		skb_len = skb->len;
-		rc = ops->ndo_start_xmit(skb, dev);
+		rc = netdev_start_xmit(skb, dev, more);
 		trace_net_dev_xmit(skb, rc, dev, skb_len);
 		if (rc == NETDEV_TX_OK)
 			txq_trans_update(txq);
 		return rc;
 	}
 
-gso:
 	do {
 		struct sk_buff *nskb = skb->next;
 
@@ -2253,7 +2356,7 @@ gso:
 			skb_dst_drop(nskb);
 
 		skb_len = nskb->len;
-		rc = ops->ndo_start_xmit(nskb, dev);
+		rc = netdev_start_xmit(nskb, dev, more || skb->next);
 		trace_net_dev_xmit(nskb, rc, dev, skb_len);
 		if (unlikely(rc != NETDEV_TX_OK)) {
 			if (rc & ~NETDEV_TX_MASK)
@@ -2270,9 +2373,7 @@ gso:
 out_kfree_gso_skb:
 	if (likely(skb->next == NULL))
 		skb->destructor = DEV_GSO_CB(skb)->destructor;
-out_kfree_skb:
 	kfree_skb(skb);
-out:
 	return rc;
 }
 
@@ -2436,7 +2537,7 @@ static inline int __dev_xmit_skb(struct sk_buff *skb, struct Qdisc *q,
 
 		qdisc_bstats_update(q, skb);
 
-		if (sch_direct_xmit(skb, q, dev, txq, root_lock)) {
+		if (sch_direct_xmit(skb, q, dev, txq, root_lock, true)) {
 			if (unlikely(contended)) {
 				spin_unlock(&q->busylock);
 				contended = false;
@@ -2549,11 +2650,15 @@ int dev_queue_xmit(struct sk_buff *skb)
 			if (__this_cpu_read(xmit_recursion) > RECURSION_LIMIT)
 				goto recursion_alert;
 
+			skb = validate_xmit_skb_list(skb, dev);
+			if (!skb)
+				goto out;
+
 			HARD_TX_LOCK(dev, txq, cpu);
 
 			if (!netif_xmit_stopped(txq)) {
 				__this_cpu_inc(xmit_recursion);
-				rc = dev_hard_start_xmit(skb, dev, txq);
+				rc = dev_hard_start_xmit(skb, dev, txq, false);
 				__this_cpu_dec(xmit_recursion);
 				if (dev_xmit_complete(rc)) {
 					HARD_TX_UNLOCK(dev, txq);
@@ -3365,7 +3470,8 @@ static int napi_gro_complete(struct sk_buff *skb)
 		if (ptype->type != type || ptype->dev || !ptype->gro_complete)
 			continue;
 
-		err = ptype->gro_complete(skb);
+		err = ptype->gro_complete(skb, skb_mac_header(skb) +
+						skb->mac_len - skb->data);
 		break;
 	}
 	rcu_read_unlock();
@@ -3380,6 +3486,37 @@ out:
 	return netif_receive_skb(skb);
 }
 
+/* Tunnel gro_receive/gro_complete handlers use these to hand the inner
+ * packet to the handler of its protocol.  Called under rcu_read_lock().
+ */
+struct packet_type *gro_find_receive_by_type(__be16 type)
+{
+	struct list_head *head = &ptype_base[ntohs(type) & PTYPE_HASH_MASK];
+	struct packet_type *ptype;
+
+	list_for_each_entry_rcu(ptype, head, list) {
+		if (ptype->type != type || ptype->dev || !ptype->gro_receive)
+			continue;
+		return ptype;
+	}
+	return NULL;
+}
+EXPORT_SYMBOL(gro_find_receive_by_type);
+
+struct packet_type *gro_find_complete_by_type(__be16 type)
+{
+	struct list_head *head = &ptype_base[ntohs(type) & PTYPE_HASH_MASK];
+	struct packet_type *ptype;
+
+	list_for_each_entry_rcu(ptype, head, list) {
+		if (ptype->type != type || ptype->dev || !ptype->gro_complete)
+			continue;
+		return ptype;
+	}
+	return NULL;
+}
+EXPORT_SYMBOL(gro_find_complete_by_type);
+
 inline void napi_gro_flush(struct napi_struct *napi)
 {
 	struct sk_buff *skb, *next;
@@ -3422,6 +3559,8 @@ enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 		NAPI_GRO_CB(skb)->same_flow = 0;
 		NAPI_GRO_CB(skb)->flush = 0;
 		NAPI_GRO_CB(skb)->free = 0;
+		NAPI_GRO_CB(skb)->udp_mark = 0;
+		NAPI_GRO_CB(skb)->csum = skb->csum;
 
 		pp = ptype->gro_receive(&napi->gro_list, skb);
 		break;
@@ -3551,6 +3690,7 @@ EXPORT_SYMBOL(skb_gro_reset_offset);
 
 gro_result_t napi_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 {
+	skb_mark_napi_id(skb, napi);
 	skb_gro_reset_offset(skb);
 
 	return napi_skb_finish(__napi_gro_receive(napi, skb), skb);
@@ -3618,6 +3758,7 @@ struct sk_buff *napi_frags_skb(struct napi_struct *napi)
 
 	napi->skb = NULL;
 
+	skb_mark_napi_id(skb, napi);
 	skb_reset_mac_header(skb);
 	skb_gro_reset_offset(skb);
 
@@ -3812,6 +3953,9 @@ void netif_napi_del(struct napi_struct *napi)
 
 	list_del_init(&napi->dev_list);
 	napi_free_frags(napi);
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	napi_hash_del(napi);
+#endif
 
 	for (skb = napi->gro_list; skb; skb = next) {
 		next = skb->next;
@@ -3824,6 +3968,125 @@ void netif_napi_del(struct napi_struct *napi)
 }
 EXPORT_SYMBOL(netif_napi_del);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+#define NAPI_HASH_BITS	8
+
+static DEFINE_SPINLOCK(napi_hash_lock);
+static unsigned int napi_gen_id;
+static struct hlist_head napi_hash[1 << NAPI_HASH_BITS];
+
+static inline struct hlist_head *napi_hash_bucket(unsigned int napi_id)
+{
+	return &napi_hash[hash_32(napi_id, NAPI_HASH_BITS)];
+}
+
+/* must be called under rcu_read_lock(), as we dont take a reference */
+struct napi_struct *napi_by_id(unsigned int napi_id)
+{
+	struct napi_struct *napi;
+	struct hlist_node *node;
+
+	hlist_for_each_entry_rcu(napi, node, napi_hash_bucket(napi_id),
+				 napi_hash_node)
+		if (napi->napi_id == napi_id)
+			return napi;
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(napi_by_id);
+
+void napi_hash_add(struct napi_struct *napi)
+{
+	if (!test_and_set_bit(NAPI_STATE_HASHED, &napi->state)) {
+
+		spin_lock(&napi_hash_lock);
+
+		/* 0 is not a valid id, we also skip an id that is taken
+		 * we expect both events to be extremely rare
+		 */
+		napi->napi_id = 0;
+		while (!napi->napi_id) {
+			napi->napi_id = ++napi_gen_id;
+			if (napi_by_id(napi->napi_id))
+				napi->napi_id = 0;
+		}
+
+		hlist_add_head_rcu(&napi->napi_hash_node,
+				   napi_hash_bucket(napi->napi_id));
+
+		spin_unlock(&napi_hash_lock);
+	}
+}
+EXPORT_SYMBOL_GPL(napi_hash_add);
+
+/* Warning : caller is responsible to make sure rcu grace period
+ * is respected before freeing memory containing @napi
+ */
+void napi_hash_del(struct napi_struct *napi)
+{
+	spin_lock(&napi_hash_lock);
+
+	if (test_and_clear_bit(NAPI_STATE_HASHED, &napi->state))
+		hlist_del_rcu(&napi->napi_hash_node);
+
+	spin_unlock(&napi_hash_lock);
+}
+EXPORT_SYMBOL_GPL(napi_hash_del);
+
+/**
+ *	napi_busy_loop - poll a NAPI context from process context
+ *	@napi_id: id of the NAPI context to poll
+ *	@end_time: busy_loop_us_clock() deadline, 0 to poll exactly once
+ *	@loop_end: returns true once the caller has what it waits for
+ *	@loop_end_arg: argument passed to @loop_end
+ *
+ * Repeatedly calls the driver's ndo_busy_poll() for @napi_id until
+ * @loop_end is satisfied, @end_time passes or we need to reschedule.
+ * Returns the number of packets the driver processed.
+ */
+int napi_busy_loop(unsigned int napi_id, unsigned long end_time,
+		   bool (*loop_end)(void *), void *loop_end_arg)
+{
+	const struct net_device_ops *ops;
+	struct napi_struct *napi;
+	int rc, work = 0;
+
+	/*
+	 * rcu read lock for napi hash
+	 * bh so we don't race with net_rx_action
+	 */
+	rcu_read_lock_bh();
+
+	napi = napi_by_id(napi_id);
+	if (!napi)
+		goto out;
+
+	ops = napi->dev->netdev_ops;
+	if (!ops->ndo_busy_poll)
+		goto out;
+
+	do {
+		rc = ops->ndo_busy_poll(napi);
+
+		if (rc == LL_FLUSH_FAILED)
+			break; /* permanent failure */
+
+		if (rc > 0) {
+			work += rc;
+			/* local bh are disabled so it is ok to use _BH */
+			NET_ADD_STATS_BH(dev_net(napi->dev),
+					 LINUX_MIB_BUSYPOLLRXPACKETS, rc);
+		}
+
+	} while (end_time && !loop_end(loop_end_arg) &&
+		 !need_resched() && !busy_loop_timeout(end_time));
+out:
+	rcu_read_unlock_bh();
+	return work;
+}
+EXPORT_SYMBOL(napi_busy_loop);
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 static void net_rx_action(struct softirq_action *h)
 {
 	struct softnet_data *sd = &__get_cpu_var(softnet_data);
@@ -4760,6 +5023,45 @@ int dev_set_mtu(struct net_device *dev, int new_mtu)
 }
 EXPORT_SYMBOL(dev_set_mtu);
 
+/**
+ *	dev_change_xdp_fd - set or clear the early receive program of a device
+ *	@dev: device
+ *	@fd: descriptor of a BPF_PROG_TYPE_XDP program, or -1 to detach
+ *
+ *	Hand the program to the driver through ndo_xdp.  The driver owns
+ *	the reference from then on and drops the one of the program it
+ *	replaces.  Called under rtnl_lock.
+ */
+int dev_change_xdp_fd(struct net_device *dev, int fd)
+{
+	const struct net_device_ops *ops = dev->netdev_ops;
+	struct bpf_prog *prog = NULL;
+	struct netdev_xdp xdp;
+	int err;
+
+	ASSERT_RTNL();
+
+	if (!ops->ndo_xdp)
+		return -EOPNOTSUPP;
+
+	if (fd >= 0) {
+		prog = bpf_prog_get_type(fd, BPF_PROG_TYPE_XDP);
+		if (IS_ERR(prog))
+			return PTR_ERR(prog);
+	}
+
+	memset(&xdp, 0, sizeof(xdp));
+	xdp.command = XDP_SETUP_PROG;
+	xdp.prog = prog;
+
+	err = ops->ndo_xdp(dev, &xdp);
+	if (err < 0 && prog)
+		bpf_prog_put(prog);
+
+	return err;
+}
+EXPORT_SYMBOL(dev_change_xdp_fd);
+
 /**
  *	dev_set_group - Change group this device belongs to
  *	@dev: device
@@ -25,17 +25,20 @@
 #include <linux/inet.h>
 #include <linux/netdevice.h>
 #include <linux/if_packet.h>
+#include <linux/if_vlan.h>
 #include <linux/gfp.h>
 #include <net/ip.h>
 #include <net/protocol.h>
 #include <net/netlink.h>
 #include <linux/skbuff.h>
 #include <net/sock.h>
+#include <net/sch_generic.h>
 #include <linux/errno.h>
 #include <linux/timer.h>
 #include <asm/uaccess.h>
 #include <asm/unaligned.h>
 #include <linux/filter.h>
+#include <linux/bpf.h>
 #include <linux/reciprocal_div.h>
 #include <linux/ratelimit.h>
 
@@ -584,11 +587,26 @@ void sk_filter_release_rcu(struct rcu_head *rcu)
 {
 	struct sk_filter *fp = container_of(rcu, struct sk_filter, rcu);
 
-	bpf_jit_free(fp);
+	if (fp->prog)
+		bpf_prog_put(fp->prog);
+	else
+		bpf_jit_free(fp);
 	kfree(fp);
 }
 EXPORT_SYMBOL(sk_filter_release_rcu);
 
+static void sk_install_filter(struct sock *sk, struct sk_filter *fp)
+{
+	struct sk_filter *old_fp;
+
+	old_fp = rcu_dereference_protected(sk->sk_filter,
+					   sock_owned_by_user(sk));
+	rcu_assign_pointer(sk->sk_filter, fp);
+
+	if (old_fp)
+		sk_filter_uncharge(sk, old_fp);
+}
+
 /**
  *	sk_attach_filter - attach a socket filter
  *	@fprog: the filter program
@@ -601,7 +619,7 @@ EXPORT_SYMBOL(sk_filter_release_rcu);
  */
 int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 {
-	struct sk_filter *fp, *old_fp;
+	struct sk_filter *fp;
 	unsigned int fsize = sizeof(struct sock_filter) * fprog->len;
 	int err;
 
@@ -620,6 +638,7 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 	atomic_set(&fp->refcnt, 1);
 	fp->len = fprog->len;
 	fp->bpf_func = sk_run_filter;
+	fp->prog = NULL;
 
 	err = sk_chk_filter(fp->insns, fp->len);
 	if (err) {
@@ -629,16 +648,60 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 
 	bpf_jit_compile(fp);
 
-	old_fp = rcu_dereference_protected(sk->sk_filter,
-					   sock_owned_by_user(sk));
-	rcu_assign_pointer(sk->sk_filter, fp);
-
-	if (old_fp)
-		sk_filter_uncharge(sk, old_fp);
+	sk_install_filter(sk, fp);
 	return 0;
 }
 EXPORT_SYMBOL_GPL(sk_attach_filter);
 
+/* eBPF programs hang off a filter without classic instructions; the
+ * instruction pointer handed in by SK_RUN_FILTER() leads back to it.
+ */
+static unsigned int sk_run_bpf(const struct sk_buff *skb,
+			       const struct sock_filter *insns)
+{
+	const struct sk_filter *fp = container_of(insns, struct sk_filter,
+						  insns[0]);
+
+	return BPF_PROG_RUN(fp->prog, skb);
+}
+
+/**
+ *	sk_attach_bpf - attach an eBPF socket filter
+ *	@ufd: file descriptor of a BPF_PROG_TYPE_SOCKET_FILTER program
+ *	@sk: the socket to use
+ *
+ * The program was verified when it was loaded with the bpf() syscall, so
+ * it is only checked to be of the right type.  Returns zero on success.
+ */
+int sk_attach_bpf(u32 ufd, struct sock *sk)
+{
+	struct sk_filter *fp;
+	struct bpf_prog *prog;
+
+	prog = bpf_prog_get(ufd);
+	if (IS_ERR(prog))
+		return PTR_ERR(prog);
+
+	if (prog->type != BPF_PROG_TYPE_SOCKET_FILTER) {
+		bpf_prog_put(prog);
+		return -EINVAL;
+	}
+
+	fp = sock_kmalloc(sk, sizeof(*fp), GFP_KERNEL);
+	if (!fp) {
+		bpf_prog_put(prog);
+		return -ENOMEM;
+	}
+
+	atomic_set(&fp->refcnt, 1);
+	fp->len = 0;
+	fp->bpf_func = sk_run_bpf;
+	fp->prog = prog;
+
+	sk_install_filter(sk, fp);
+	return 0;
+}
+
 int sk_detach_filter(struct sock *sk)
 {
 	int ret = -ENOENT;
@@ -654,3 +717,272 @@ int sk_detach_filter(struct sock *sk)
 	return ret;
 }
 EXPORT_SYMBOL_GPL(sk_detach_filter);
+
+#ifdef CONFIG_BPF_SYSCALL
+static const struct bpf_func_proto *
+sk_filter_func_proto(enum bpf_func_id func_id)
+{
+	switch (func_id) {
+	case BPF_FUNC_map_lookup_elem:
+		return &bpf_map_lookup_elem_proto;
+	case BPF_FUNC_map_update_elem:
+		return &bpf_map_update_elem_proto;
+	case BPF_FUNC_map_delete_elem:
+		return &bpf_map_delete_elem_proto;
+	default:
+		return NULL;
+	}
+}
+
+#define BPF_LDX_MEM(SIZE, DST, SRC, OFF)				\
+	((struct bpf_insn) {						\
+		.code  = BPF_LDX | BPF_SIZE(SIZE) | BPF_MEM,		\
+		.dst_reg = DST,						\
+		.src_reg = SRC,						\
+		.off   = OFF,						\
+		.imm   = 0 })
+
+#define BPF_ALU32_IMM(OP, DST, IMM)					\
+	((struct bpf_insn) {						\
+		.code  = BPF_ALU | BPF_OP(OP) | BPF_K,			\
+		.dst_reg = DST,						\
+		.src_reg = 0,						\
+		.off   = 0,						\
+		.imm   = IMM })
+
+#define BPF_MOV32_IMM(DST, IMM)		BPF_ALU32_IMM(BPF_MOV, DST, IMM)
+
+#define BPF_JMP_IMM(OP, DST, IMM, OFF)					\
+	((struct bpf_insn) {						\
+		.code  = BPF_JMP | BPF_OP(OP) | BPF_K,			\
+		.dst_reg = DST,						\
+		.src_reg = 0,						\
+		.off   = OFF,						\
+		.imm   = IMM })
+
+#define BPF_PTR_SIZE	(sizeof(void *) == 8 ? BPF_DW : BPF_W)
+
+/* pkt_type lives in a bitfield, __pkt_type_offset marks its byte */
+#ifdef __BIG_ENDIAN_BITFIELD
+#define PKT_TYPE_MAX	(7 << 5)
+#else
+#define PKT_TYPE_MAX	7
+#endif
+#define PKT_TYPE_OFFSET	offsetof(struct sk_buff, __pkt_type_offset)
+
+/* struct __sk_buff is read only and all of its fields are 32 bits wide.
+ * tc_classid and the direct packet pointers data/data_end have no
+ * counterpart in this kernel and cannot be read.
+ */
+static bool sk_filter_is_valid_access(int off, int size,
+				      enum bpf_access_type type,
+				      enum bpf_reg_type *reg_type)
+{
+	if (type != BPF_READ)
+		return false;
+
+	if (off < 0 || off >= sizeof(struct __sk_buff))
+		return false;
+
+	if (size != sizeof(__u32) || off % size != 0)
+		return false;
+
+	switch (off) {
+	case offsetof(struct __sk_buff, tc_classid):
+	case offsetof(struct __sk_buff, data):
+	case offsetof(struct __sk_buff, data_end):
+		return false;
+	}
+
+	return true;
+}
+
+/* turn a load from struct __sk_buff into loads from struct sk_buff */
+static u32 sk_filter_convert_ctx_access(int dst_reg, int src_reg, int ctx_off,
+					struct bpf_insn *insn_buf)
+{
+	struct bpf_insn *insn = insn_buf;
+
+	switch (ctx_off) {
+	case offsetof(struct __sk_buff, len):
+		BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, len) != 4);
+		*insn++ = BPF_LDX_MEM(BPF_W, dst_reg, src_reg,
+				      offsetof(struct sk_buff, len));
+		break;
+
+	case offsetof(struct __sk_buff, pkt_type):
+		*insn++ = BPF_LDX_MEM(BPF_B, dst_reg, src_reg, PKT_TYPE_OFFSET);
+		*insn++ = BPF_ALU32_IMM(BPF_AND, dst_reg, PKT_TYPE_MAX);
+#ifdef __BIG_ENDIAN_BITFIELD
+		*insn++ = BPF_ALU32_IMM(BPF_RSH, dst_reg, 5);
+#endif
+		break;
+
+	case offsetof(struct __sk_buff, mark):
+		BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, mark) != 4);
+		*insn++ = BPF_LDX_MEM(BPF_W, dst_reg, src_reg,
+				      offsetof(struct sk_buff, mark));
+		break;
+
+	case offsetof(struct __sk_buff, queue_mapping):
+		BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, queue_mapping) != 2);
+		*insn++ = BPF_LDX_MEM(BPF_H, dst_reg, src_reg,
+				      offsetof(struct sk_buff, queue_mapping));
+		break;
+
+	case offsetof(struct __sk_buff, protocol):
+		BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, protocol) != 2);
+		*insn++ = BPF_LDX_MEM(BPF_H, dst_reg, src_reg,
+				      offsetof(struct sk_buff, protocol));
+		break;
+
+	case offsetof(struct __sk_buff, vlan_present):
+	case offsetof(struct __sk_buff, vlan_tci):
+		BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, vlan_tci) != 2);
+		BUILD_BUG_ON(VLAN_TAG_PRESENT != 0x1000);
+		*insn++ = BPF_LDX_MEM(BPF_H, dst_reg, src_reg,
+				      offsetof(struct sk_buff, vlan_tci));
+		if (ctx_off == offsetof(struct __sk_buff, vlan_tci)) {
+			*insn++ = BPF_ALU32_IMM(BPF_AND, dst_reg,
+						~VLAN_TAG_PRESENT);
+		} else {
+			*insn++ = BPF_ALU32_IMM(BPF_RSH, dst_reg, 12);
+			*insn++ = BPF_ALU32_IMM(BPF_AND, dst_reg, 1);
+		}
+		break;
+
+	case offsetof(struct __sk_buff, vlan_proto):
+		/* only 802.1Q tags are offloaded into skb->vlan_tci */
+		*insn++ = BPF_MOV32_IMM(dst_reg, htons(ETH_P_8021Q));
+		break;
+
+	case offsetof(struct __sk_buff, priority):
+		BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, priority) != 4);
+		*insn++ = BPF_LDX_MEM(BPF_W, dst_reg, src_reg,
+				      offsetof(struct sk_buff, priority));
+		break;
+
+	case offsetof(struct __sk_buff, ingress_ifindex):
+		BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, skb_iif) != 4);
+		*insn++ = BPF_LDX_MEM(BPF_W, dst_reg, src_reg,
+				      offsetof(struct sk_buff, skb_iif));
+		break;
+
+	case offsetof(struct __sk_buff, ifindex):
+		BUILD_BUG_ON(FIELD_SIZEOF(struct net_device, ifindex) != 4);
+		*insn++ = BPF_LDX_MEM(BPF_PTR_SIZE, dst_reg, src_reg,
+				      offsetof(struct sk_buff, dev));
+		*insn++ = BPF_JMP_IMM(BPF_JEQ, dst_reg, 0, 1);
+		*insn++ = BPF_LDX_MEM(BPF_W, dst_reg, dst_reg,
+				      offsetof(struct net_device, ifindex));
+		break;
+
+	case offsetof(struct __sk_buff, tc_index):
+#ifdef CONFIG_NET_SCHED
+		BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, tc_index) != 2);
+		*insn++ = BPF_LDX_MEM(BPF_H, dst_reg, src_reg,
+				      offsetof(struct sk_buff, tc_index));
+#else
+		*insn++ = BPF_MOV32_IMM(dst_reg, 0);
+#endif
+		break;
+
+	case offsetof(struct __sk_buff, cb[0]) ...
+	     offsetof(struct __sk_buff, cb[4]):
+		BUILD_BUG_ON(FIELD_SIZEOF(struct qdisc_skb_cb, data) <
+			     FIELD_SIZEOF(struct __sk_buff, cb));
+		*insn++ = BPF_LDX_MEM(BPF_W, dst_reg, src_reg,
+				      offsetof(struct sk_buff, cb) +
+				      offsetof(struct qdisc_skb_cb, data) +
+				      ctx_off - offsetof(struct __sk_buff, cb[0]));
+		break;
+
+	case offsetof(struct __sk_buff, hash):
+		BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, rxhash) != 4);
+		*insn++ = BPF_LDX_MEM(BPF_W, dst_reg, src_reg,
+				      offsetof(struct sk_buff, rxhash));
+		break;
+	}
+
+	return insn - insn_buf;
+}
+
+static const struct bpf_verifier_ops sk_filter_ops = {
+	.get_func_proto = sk_filter_func_proto,
+	.is_valid_access = sk_filter_is_valid_access,
+	.convert_ctx_access = sk_filter_convert_ctx_access,
+};
+
+static struct bpf_prog_type_list sk_filter_type __read_mostly = {
+	.ops = &sk_filter_ops,
+	.type = BPF_PROG_TYPE_SOCKET_FILTER,
+};
+
+static struct bpf_prog_type_list sched_cls_type __read_mostly = {
+	.ops = &sk_filter_ops,
+	.type = BPF_PROG_TYPE_SCHED_CLS,
+};
+
+/* struct xdp_md is read only, its fields are the packet pointers */
+static bool xdp_is_valid_access(int off, int size, enum bpf_access_type type,
+				enum bpf_reg_type *reg_type)
+{
+	if (type != BPF_READ)
+		return false;
+
+	if (size != sizeof(__u32))
+		return false;
+
+	switch (off) {
+	case offsetof(struct xdp_md, data):
+		*reg_type = PTR_TO_PACKET;
+		return true;
+	case offsetof(struct xdp_md, data_end):
+		*reg_type = PTR_TO_PACKET_END;
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* the fields of struct xdp_md are full pointers in struct xdp_buff */
+static u32 xdp_convert_ctx_access(int dst_reg, int src_reg, int ctx_off,
+				  struct bpf_insn *insn_buf)
+{
+	struct bpf_insn *insn = insn_buf;
+
+	switch (ctx_off) {
+	case offsetof(struct xdp_md, data):
+		*insn++ = BPF_LDX_MEM(BPF_DW, dst_reg, src_reg,
+				      offsetof(struct xdp_buff, data));
+		break;
+
+	case offsetof(struct xdp_md, data_end):
+		*insn++ = BPF_LDX_MEM(BPF_DW, dst_reg, src_reg,
+				      offsetof(struct xdp_buff, data_end));
+		break;
+	}
+
+	return insn - insn_buf;
+}
+
+static const struct bpf_verifier_ops xdp_ops = {
+	.get_func_proto = sk_filter_func_proto,
+	.is_valid_access = xdp_is_valid_access,
+	.convert_ctx_access = xdp_convert_ctx_access,
+};
+
+static struct bpf_prog_type_list xdp_type __read_mostly = {
+	.ops = &xdp_ops,
+	.type = BPF_PROG_TYPE_XDP,
+};
+
+static int __init register_sk_filter_ops(void)
+{
+	bpf_register_prog_type(&sk_filter_type);
+	bpf_register_prog_type(&sched_cls_type);
+	bpf_register_prog_type(&xdp_type);
+	return 0;
+}
+late_initcall(register_sk_filter_ops);
+#endif /* CONFIG_BPF_SYSCALL */
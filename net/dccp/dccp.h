@@ -269,6 +269,7 @@ extern int  dccp_reqsk_init(struct request_sock *rq, struct dccp_sock const *dp,
 			    struct sk_buff const *skb);
 
 extern int dccp_v4_conn_request(struct sock *sk, struct sk_buff *skb);
+extern void dccp_req_err(struct sock *sk, u64 seq);
 
 extern struct sock *dccp_create_openreq_child(struct sock *sk,
 					      const struct request_sock *req,
@@ -279,10 +280,11 @@ extern int dccp_v4_do_rcv(struct sock *sk, struct sk_buff *skb);
 extern struct sock *dccp_v4_request_recv_sock(struct sock *sk,
 					      struct sk_buff *skb,
 					      struct request_sock *req,
-					      struct dst_entry *dst);
+					      struct dst_entry *dst,
+					      struct request_sock *req_unhash,
+					      bool *own_req);
 extern struct sock *dccp_check_req(struct sock *sk, struct sk_buff *skb,
-				   struct request_sock *req,
-				   struct request_sock **prev);
+				   struct request_sock *req);
 
 extern int dccp_child_process(struct sock *parent, struct sock *child,
 			      struct sk_buff *skb);
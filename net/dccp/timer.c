@@ -161,15 +161,6 @@ out:
 	sock_put(sk);
 }
 
-/*
- *	Timer for listening sockets
- */
-static void dccp_response_timer(struct sock *sk)
-{
-	inet_csk_reqsk_queue_prune(sk, TCP_SYNQ_INTERVAL, DCCP_TIMEOUT_INIT,
-				   DCCP_RTO_MAX);
-}
-
 static void dccp_keepalive_timer(unsigned long data)
 {
 	struct sock *sk = (struct sock *)data;
@@ -182,10 +173,9 @@ static void dccp_keepalive_timer(unsigned long data)
 		goto out;
 	}
 
-	if (sk->sk_state == DCCP_LISTEN) {
-		dccp_response_timer(sk);
-		goto out;
-	}
+	/* Pending requests have their own timers, see reqsk_timer_handler() */
+	if (sk->sk_state == DCCP_LISTEN)
+		DCCP_WARN("keepalive timer on a LISTEN socket\n");
 out:
 	bh_unlock_sock(sk);
 	sock_put(sk);
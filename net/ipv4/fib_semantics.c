@@ -32,6 +32,9 @@
 #include <linux/skbuff.h>
 #include <linux/init.h>
 #include <linux/slab.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/random.h>
 
 #include <net/arp.h>
 #include <net/ip.h>
@@ -42,6 +45,7 @@
 #include <net/ip_fib.h>
 #include <net/netlink.h>
 #include <net/nexthop.h>
+#include <net/flow_keys.h>
 
 #include "fib_lookup.h"
 
@@ -57,7 +61,9 @@ static struct hlist_head fib_info_devhash[DEVINDEX_HASHSIZE];
 
 #ifdef CONFIG_IP_ROUTE_MULTIPATH
 
-static DEFINE_SPINLOCK(fib_multipath_lock);
+/* 0: hash on addresses only, 1: also on protocol and ports */
+int sysctl_fib_multipath_hash_policy __read_mostly;
+static u32 fib_multipath_secret __read_mostly;
 
 #define for_nexthops(fi) {						\
 	int nhsel; const struct fib_nh *nh;				\
@@ -88,6 +94,75 @@ static DEFINE_SPINLOCK(fib_multipath_lock);
 
 #define endfor_nexthops(fi) }
 
+#ifdef CONFIG_IP_ROUTE_MULTIPATH
+/*
+ * Multipath routes map a flow hash onto a table of buckets, each owned
+ * by one nexthop, nexthops owning buckets in proportion to their weight.
+ * When nexthops die or come back only the buckets that must change owner
+ * are moved, so flows through the other nexthops keep their path.
+ */
+static inline unsigned int fib_mp_nbuckets(int nhs)
+{
+	return max_t(unsigned int, 256, roundup_pow_of_two(nhs * 16));
+}
+
+/* Caller must hold RTNL */
+static void fib_rebalance(struct fib_info *fi)
+{
+	unsigned int nbuckets = fib_mp_nbuckets(fi->fib_nhs);
+	int total = 0, left, to = 0;
+	unsigned int b;
+
+	if (fi->fib_nhs < 2)
+		return;
+
+	for_nexthops(fi) {
+		if (!(nh->nh_flags & RTNH_F_DEAD))
+			total += nh->nh_weight;
+	} endfor_nexthops(fi);
+	if (!total)
+		return;
+
+	left = nbuckets;
+	change_nexthops(fi) {
+		nexthop_nh->nh_target = 0;
+		if (!(nexthop_nh->nh_flags & RTNH_F_DEAD))
+			nexthop_nh->nh_target = nbuckets * nexthop_nh->nh_weight /
+						total;
+		left -= nexthop_nh->nh_target;
+	} endfor_nexthops(fi);
+
+	/* Hand out the rounding leftovers to live nexthops already above
+	 * their share first, so that fewer buckets change owner.
+	 */
+	change_nexthops(fi) {
+		if (left && !(nexthop_nh->nh_flags & RTNH_F_DEAD) &&
+		    nexthop_nh->nh_buckets > nexthop_nh->nh_target) {
+			nexthop_nh->nh_target++;
+			left--;
+		}
+	} endfor_nexthops(fi);
+	change_nexthops(fi) {
+		if (left && !(nexthop_nh->nh_flags & RTNH_F_DEAD)) {
+			nexthop_nh->nh_target++;
+			left--;
+		}
+	} endfor_nexthops(fi);
+
+	for (b = 0; b < nbuckets; b++) {
+		struct fib_nh *from = &fi->fib_nh[fi->fib_mp_buckets[b]];
+
+		if (from->nh_buckets <= from->nh_target)
+			continue;
+		while (fi->fib_nh[to].nh_buckets >= fi->fib_nh[to].nh_target)
+			to++;
+		from->nh_buckets--;
+		fi->fib_nh[to].nh_buckets++;
+		ACCESS_ONCE(fi->fib_mp_buckets[b]) = to;
+	}
+}
+#endif
+
 
 const struct fib_prop fib_props[RTN_MAX + 1] = {
 	[RTN_UNSPEC] = {
@@ -140,6 +215,54 @@ const struct fib_prop fib_props[RTN_MAX + 1] = {
 	},
 };
 
+static void rt_fibinfo_free_cpus(struct rtable __rcu * __percpu *rtp)
+{
+	int cpu;
+
+	if (!rtp)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct rtable *rt;
+
+		rt = rcu_dereference_protected(*per_cpu_ptr(rtp, cpu), 1);
+		if (rt)
+			dst_free(&rt->dst);
+	}
+	free_percpu(rtp);
+}
+
+static void rt_fibinfo_flush_cpus(struct rtable __rcu * __percpu *rtp)
+{
+	int cpu;
+
+	if (!rtp)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct rtable **p;
+		struct rtable *rt;
+
+		p = (struct rtable __force **)per_cpu_ptr(rtp, cpu);
+		rt = xchg(p, NULL);
+		if (rt)
+			call_rcu_bh(&rt->dst.rcu_head, dst_rcu_free);
+	}
+}
+
+/* Empty the per cpu route caches of a fib_info that left the tree.
+ * Lookups may still race with us; they recheck fib_dead after
+ * installing a route, see rt_nh_cache_insert().
+ */
+static void fib_flush_nh_cache(struct fib_info *fi)
+{
+	smp_mb();
+	change_nexthops(fi) {
+		rt_fibinfo_flush_cpus(nexthop_nh->nh_pcpu_rth_input);
+		rt_fibinfo_flush_cpus(nexthop_nh->nh_pcpu_rth_output);
+	} endfor_nexthops(fi);
+}
+
 /* Release a nexthop info record */
 static void free_fib_info_rcu(struct rcu_head *head)
 {
@@ -148,6 +271,8 @@ static void free_fib_info_rcu(struct rcu_head *head)
 	change_nexthops(fi) {
 		if (nexthop_nh->nh_dev)
 			dev_put(nexthop_nh->nh_dev);
+		rt_fibinfo_free_cpus(nexthop_nh->nh_pcpu_rth_input);
+		rt_fibinfo_free_cpus(nexthop_nh->nh_pcpu_rth_output);
 	} endfor_nexthops(fi);
 
 	release_net(fi->fib_net);
@@ -179,6 +304,7 @@ void fib_release_info(struct fib_info *fi)
 			hlist_del(&nexthop_nh->nh_hash);
 		} endfor_nexthops(fi)
 		fi->fib_dead = 1;
+		fib_flush_nh_cache(fi);
 		fib_info_put(fi);
 	}
 	spin_unlock_bh(&fib_info_lock);
@@ -709,6 +835,7 @@ struct fib_info *fib_create_info(struct fib_config *cfg)
 	struct fib_info *fi = NULL;
 	struct fib_info *ofi;
 	int nhs = 1;
+	size_t size;
 	struct net *net = cfg->fc_nlinfo.nl_net;
 
 	if (cfg->fc_type > RTN_MAX)
@@ -748,7 +875,12 @@ struct fib_info *fib_create_info(struct fib_config *cfg)
 			goto failure;
 	}
 
-	fi = kzalloc(sizeof(*fi)+nhs*sizeof(struct fib_nh), GFP_KERNEL);
+	size = sizeof(*fi) + nhs * sizeof(struct fib_nh);
+#ifdef CONFIG_IP_ROUTE_MULTIPATH
+	if (nhs > 1)
+		size += fib_mp_nbuckets(nhs) * sizeof(u16);
+#endif
+	fi = kzalloc(size, GFP_KERNEL);
 	if (fi == NULL)
 		goto failure;
 	if (cfg->fc_mx) {
@@ -769,6 +901,12 @@ struct fib_info *fib_create_info(struct fib_config *cfg)
 	fi->fib_nhs = nhs;
 	change_nexthops(fi) {
 		nexthop_nh->nh_parent = fi;
+		nexthop_nh->nh_pcpu_rth_input = alloc_percpu(struct rtable __rcu *);
+		if (!nexthop_nh->nh_pcpu_rth_input)
+			goto failure;
+		nexthop_nh->nh_pcpu_rth_output = alloc_percpu(struct rtable __rcu *);
+		if (!nexthop_nh->nh_pcpu_rth_output)
+			goto failure;
 	} endfor_nexthops(fi)
 
 	if (cfg->fc_mx) {
@@ -867,6 +1005,17 @@ struct fib_info *fib_create_info(struct fib_config *cfg)
 	} endfor_nexthops(fi)
 
 link_it:
+#ifdef CONFIG_IP_ROUTE_MULTIPATH
+	if (nhs > 1) {
+		if (unlikely(!fib_multipath_secret))
+			get_random_bytes(&fib_multipath_secret,
+					 sizeof(fib_multipath_secret));
+		/* all buckets start out on the first nexthop */
+		fi->fib_mp_buckets = (u16 *)&fi->fib_nh[nhs];
+		fi->fib_nh[0].nh_buckets = fib_mp_nbuckets(nhs);
+		fib_rebalance(fi);
+	}
+#endif
 	ofi = fib_find_info(fi);
 	if (ofi) {
 		fi->fib_dead = 1;
@@ -1054,12 +1203,6 @@ int fib_sync_down_dev(struct net_device *dev, int force)
 			else if (nexthop_nh->nh_dev == dev &&
 				 nexthop_nh->nh_scope != scope) {
 				nexthop_nh->nh_flags |= RTNH_F_DEAD;
-#ifdef CONFIG_IP_ROUTE_MULTIPATH
-				spin_lock_bh(&fib_multipath_lock);
-				fi->fib_power -= nexthop_nh->nh_power;
-				nexthop_nh->nh_power = 0;
-				spin_unlock_bh(&fib_multipath_lock);
-#endif
 				dead++;
 			}
 #ifdef CONFIG_IP_ROUTE_MULTIPATH
@@ -1073,6 +1216,10 @@ int fib_sync_down_dev(struct net_device *dev, int force)
 			fi->fib_flags |= RTNH_F_DEAD;
 			ret++;
 		}
+#ifdef CONFIG_IP_ROUTE_MULTIPATH
+		else if (dead)
+			fib_rebalance(fi);
+#endif
 	}
 
 	return ret;
@@ -1179,14 +1326,12 @@ int fib_sync_up(struct net_device *dev)
 			    !__in_dev_get_rtnl(dev))
 				continue;
 			alive++;
-			spin_lock_bh(&fib_multipath_lock);
-			nexthop_nh->nh_power = 0;
 			nexthop_nh->nh_flags &= ~RTNH_F_DEAD;
-			spin_unlock_bh(&fib_multipath_lock);
 		} endfor_nexthops(fi)
 
 		if (alive > 0) {
 			fi->fib_flags &= ~RTNH_F_DEAD;
+			fib_rebalance(fi);
 			ret++;
 		}
 	}
@@ -1194,56 +1339,78 @@ int fib_sync_up(struct net_device *dev)
 	return ret;
 }
 
+static inline u32 fib_multipath_hash(__be32 saddr, __be32 daddr,
+				     __be32 ports, u8 proto)
+{
+	return jhash_3words((__force u32)saddr, (__force u32)daddr,
+			    (__force u32)ports, fib_multipath_secret ^ proto);
+}
+
+/* Flow hash of a packet being forwarded, from the flow dissector */
+u32 fib_multipath_hash_skb(const struct sk_buff *skb)
+{
+	struct flow_keys keys;
+
+	if (!skb_flow_dissect(skb, &keys))
+		return 0;
+
+	if (!sysctl_fib_multipath_hash_policy)
+		return fib_multipath_hash(keys.src, keys.dst, 0, 0);
+	return fib_multipath_hash(keys.src, keys.dst, keys.ports,
+				  keys.ip_proto);
+}
+
 /*
- * The algorithm is suboptimal, but it provides really
- * fair weighted route distribution.
+ * Hash of locally generated traffic, from the flow key.  Ports are taken
+ * only for the protocols the flow dissector reads them from, and the SPI
+ * of ESP and AH in packet byte order, so that a flow hashes as it would
+ * if it were forwarded.  The source address must already be chosen.
  */
-void fib_select_multipath(struct fib_result *res)
+u32 fib_multipath_hash_fl4(const struct flowi4 *fl4)
 {
-	struct fib_info *fi = res->fi;
-	int w;
-
-	spin_lock_bh(&fib_multipath_lock);
-	if (fi->fib_power <= 0) {
-		int power = 0;
-		change_nexthops(fi) {
-			if (!(nexthop_nh->nh_flags & RTNH_F_DEAD)) {
-				power += nexthop_nh->nh_weight;
-				nexthop_nh->nh_power = nexthop_nh->nh_weight;
-			}
-		} endfor_nexthops(fi);
-		fi->fib_power = power;
-		if (power <= 0) {
-			spin_unlock_bh(&fib_multipath_lock);
-			/* Race condition: route has just become dead. */
-			res->nh_sel = 0;
-			return;
-		}
+	union {
+		__be32 ports;
+		__be16 port16[2];
+	} u;
+
+	if (!sysctl_fib_multipath_hash_policy)
+		return fib_multipath_hash(fl4->saddr, fl4->daddr, 0, 0);
+
+	if (fl4->flowi4_proto == IPPROTO_ESP ||
+	    fl4->flowi4_proto == IPPROTO_AH) {
+		u.ports = fl4->fl4_ipsec_spi;
+	} else if (proto_ports_offset(fl4->flowi4_proto) >= 0) {
+		u.port16[0] = fl4->fl4_sport;
+		u.port16[1] = fl4->fl4_dport;
+	} else {
+		u.ports = 0;
 	}
+	return fib_multipath_hash(fl4->saddr, fl4->daddr, u.ports,
+				  fl4->flowi4_proto);
+}
 
+/*
+ * Pick the nexthop owning the flow's hash bucket.  No locking: the bucket
+ * table is only rewritten entry by entry under RTNL.
+ */
+void fib_select_multipath(struct fib_result *res, u32 hash)
+{
+	struct fib_info *fi = res->fi;
+	unsigned int b = hash & (fib_mp_nbuckets(fi->fib_nhs) - 1);
+	int sel = ACCESS_ONCE(fi->fib_mp_buckets[b]);
 
-	/* w should be random number [0..fi->fib_power-1],
-	 * it is pretty bad approximation.
-	 */
-
-	w = jiffies % fi->fib_power;
+	if (likely(!(fi->fib_nh[sel].nh_flags & RTNH_F_DEAD))) {
+		res->nh_sel = sel;
+		return;
+	}
 
-	change_nexthops(fi) {
-		if (!(nexthop_nh->nh_flags & RTNH_F_DEAD) &&
-		    nexthop_nh->nh_power) {
-			w -= nexthop_nh->nh_power;
-			if (w <= 0) {
-				nexthop_nh->nh_power--;
-				fi->fib_power--;
-				res->nh_sel = nhsel;
-				spin_unlock_bh(&fib_multipath_lock);
-				return;
-			}
+	/* Race condition: nexthop has just died, not yet rebalanced. */
+	res->nh_sel = 0;
+	for_nexthops(fi) {
+		if (!(nh->nh_flags & RTNH_F_DEAD)) {
+			res->nh_sel = nhsel;
+			break;
 		}
 	} endfor_nexthops(fi);
-
-	/* Race condition: route has just become dead. */
-	res->nh_sel = 0;
-	spin_unlock_bh(&fib_multipath_lock);
 }
 #endif
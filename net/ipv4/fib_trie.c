@@ -101,13 +101,6 @@ struct rt_trie_node {
 	t_key key;
 };
 
-struct leaf {
-	unsigned long parent;
-	t_key key;
-	struct hlist_head list;
-	struct rcu_head rcu;
-};
-
 struct leaf_info {
 	struct hlist_node hlist;
 	int plen;
@@ -116,6 +109,20 @@ struct leaf_info {
 	struct rcu_head rcu;
 };
 
+/*
+ * Most leaves carry a single prefix length, so the leaf_info for the
+ * prefix that created the leaf is embedded in it.  Everything
+ * check_leaf() touches for such a leaf then sits in its first cache
+ * line; the leaf cache is cache line aligned to keep it that way.
+ */
+struct leaf {
+	unsigned long parent;
+	t_key key;
+	struct hlist_head list;
+	struct leaf_info li;
+	struct rcu_head rcu;
+};
+
 struct tnode {
 	unsigned long parent;
 	t_key key;
@@ -371,9 +378,11 @@ static inline void free_leaf(struct leaf *l)
 	call_rcu_bh(&l->rcu, __leaf_free_rcu);
 }
 
-static inline void free_leaf_info(struct leaf_info *leaf)
+static inline void free_leaf_info(struct leaf *l, struct leaf_info *li)
 {
-	kfree_rcu(leaf, rcu);
+	/* the embedded one goes away with its leaf */
+	if (li != &l->li)
+		kfree_rcu(li, rcu);
 }
 
 static struct tnode *tnode_alloc(size_t size)
@@ -447,14 +456,18 @@ static struct leaf *leaf_new(void)
 	return l;
 }
 
+static void leaf_info_init(struct leaf_info *li, int plen)
+{
+	li->plen = plen;
+	li->mask_plen = ntohl(inet_make_mask(plen));
+	INIT_LIST_HEAD(&li->falh);
+}
+
 static struct leaf_info *leaf_info_new(int plen)
 {
 	struct leaf_info *li = kmalloc(sizeof(struct leaf_info),  GFP_KERNEL);
-	if (li) {
-		li->plen = plen;
-		li->mask_plen = ntohl(inet_make_mask(plen));
-		INIT_LIST_HEAD(&li->falh);
-	}
+	if (li)
+		leaf_info_init(li, plen);
 	return li;
 }
 
@@ -1109,12 +1122,8 @@ static struct list_head *fib_insert_node(struct trie *t, u32 key, int plen)
 		return NULL;
 
 	l->key = key;
-	li = leaf_info_new(plen);
-
-	if (!li) {
-		free_leaf(l);
-		return NULL;
-	}
+	li = &l->li;
+	leaf_info_init(li, plen);
 
 	fa_head = &li->falh;
 	insert_leaf_info(&l->list, li);
@@ -1147,7 +1156,6 @@ static struct list_head *fib_insert_node(struct trie *t, u32 key, int plen)
 		}
 
 		if (!tn) {
-			free_leaf_info(li);
 			free_leaf(l);
 			return NULL;
 		}
@@ -1703,7 +1711,7 @@ int fib_table_delete(struct fib_table *tb, struct fib_config *cfg)
 
 	if (list_empty(fa_head)) {
 		hlist_del_rcu(&li->hlist);
-		free_leaf_info(li);
+		free_leaf_info(l, li);
 	}
 
 	if (hlist_empty(&l->list))
@@ -1747,7 +1755,7 @@ static int trie_flush_leaf(struct leaf *l)
 
 		if (list_empty(&li->falh)) {
 			hlist_del_rcu(&li->hlist);
-			free_leaf_info(li);
+			free_leaf_info(l, li);
 		}
 	}
 	return found;
@@ -1973,9 +1981,9 @@ void __init fib_trie_init(void)
 					  0, SLAB_PANIC, NULL);
 
 	trie_leaf_kmem = kmem_cache_create("ip_fib_trie",
-					   max(sizeof(struct leaf),
-					       sizeof(struct leaf_info)),
-					   0, SLAB_PANIC, NULL);
+					   sizeof(struct leaf), 0,
+					   SLAB_HWCACHE_ALIGN | SLAB_PANIC,
+					   NULL);
 }
 
 
@@ -2136,7 +2144,8 @@ static void trie_show_stats(struct seq_file *seq, struct trie_stat *stat)
 	bytes = sizeof(struct leaf) * stat->leaves;
 
 	seq_printf(seq, "\tPrefixes:       %u\n", stat->prefixes);
-	bytes += sizeof(struct leaf_info) * stat->prefixes;
+	/* the first leaf_info of a leaf is embedded in it */
+	bytes += sizeof(struct leaf_info) * (stat->prefixes - stat->leaves);
 
 	seq_printf(seq, "\tInternal nodes: %u\n\t", stat->tnodes);
 	bytes += sizeof(struct tnode) * stat->tnodes;
@@ -243,7 +243,7 @@ begin:
 				goto begintw;
 			if (unlikely(!INET_MATCH(sk, net, hash, acookie,
 				saddr, daddr, ports, dif))) {
-				sock_put(sk);
+				sock_gen_put(sk);
 				goto begin;
 			}
 			goto out;
@@ -268,7 +268,7 @@ begintw:
 			}
 			if (unlikely(!INET_TW_MATCH(sk, net, hash, acookie,
 				 saddr, daddr, ports, dif))) {
-				sock_put(sk);
+				sock_gen_put(sk);
 				goto begintw;
 			}
 			goto out;
@@ -400,6 +400,69 @@ int __inet_hash_nolisten(struct sock *sk, struct inet_timewait_sock *tw)
 }
 EXPORT_SYMBOL_GPL(__inet_hash_nolisten);
 
+/* Insert a socket or a request sock into the established hash table,
+ * replacing @osk (a request sock) if given.  sk->sk_hash must be set.
+ * Returns false if @osk was already unhashed: another CPU owns it, and
+ * @sk was not inserted.
+ */
+bool inet_ehash_insert(struct sock *sk, struct sock *osk)
+{
+	struct inet_hashinfo *hashinfo = sk->sk_prot->h.hashinfo;
+	struct hlist_nulls_head *list;
+	spinlock_t *lock;
+	bool ret = true;
+
+	WARN_ON(!sk_unhashed(sk));
+
+	list = &inet_ehash_bucket(hashinfo, sk->sk_hash)->chain;
+	lock = inet_ehash_lockp(hashinfo, sk->sk_hash);
+
+	spin_lock(lock);
+	if (osk) {
+		WARN_ON(sk->sk_hash != osk->sk_hash);
+		ret = sk_nulls_del_node_init_rcu(osk);
+	}
+	if (ret)
+		__sk_nulls_add_node_rcu(sk, list);
+	spin_unlock(lock);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(inet_ehash_insert);
+
+/* Hash a child socket created from request sock @osk.  If the request was
+ * taken by another CPU meanwhile, the child is destroyed and false is
+ * returned; the caller still has to release its own reference.
+ */
+bool inet_ehash_nolisten(struct sock *sk, struct sock *osk)
+{
+	bool ok = inet_ehash_insert(sk, osk);
+
+	if (ok) {
+		sock_prot_inuse_add(sock_net(sk), sk->sk_prot, 1);
+	} else {
+		percpu_counter_inc(sk->sk_prot->orphan_count);
+		sk->sk_state = TCP_CLOSE;
+		sock_set_flag(sk, SOCK_DEAD);
+		inet_csk_destroy_sock(sk);
+	}
+	return ok;
+}
+EXPORT_SYMBOL_GPL(inet_ehash_nolisten);
+
+/* Release a reference obtained from an established table lookup, which may
+ * return full sockets, TIME_WAIT sockets or request socks.
+ */
+void sock_gen_put(struct sock *sk)
+{
+	if (sk->sk_state == TCP_TIME_WAIT)
+		inet_twsk_put(inet_twsk(sk));
+	else if (sk->sk_state == TCP_NEW_SYN_RECV)
+		reqsk_put(inet_reqsk(sk));
+	else
+		sock_put(sk);
+}
+EXPORT_SYMBOL_GPL(sock_gen_put);
+
 static void __inet_hash(struct sock *sk)
 {
 	struct inet_hashinfo *hashinfo = sk->sk_prot->h.hashinfo;
@@ -129,6 +129,11 @@ static int ipgre_tunnel_bind_dev(struct net_device *dev);
 
 #define HASH_SIZE  16
 
+#define GRE_FEATURES (NETIF_F_SG |		\
+		      NETIF_F_FRAGLIST |	\
+		      NETIF_F_HIGHDMA |		\
+		      NETIF_F_HW_CSUM)
+
 static int ipgre_net_id __read_mostly;
 struct ipgre_net {
 	struct ip_tunnel __rcu *tunnels[4][HASH_SIZE];
@@ -675,6 +680,8 @@ static int ipgre_rcv(struct sk_buff *skb)
 		tstats->rx_packets++;
 		tstats->rx_bytes += skb->len;
 
+		/* A GRO packet is now a plain packet of the inner protocol */
+		skb_shinfo(skb)->gso_type &= ~SKB_GSO_GRE;
 		__skb_tunnel_rx(skb, tunnel->dev);
 
 		skb_reset_network_header(skb);
@@ -805,7 +812,7 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 		df |= (old_iph->frag_off&htons(IP_DF));
 
 		if ((old_iph->frag_off&htons(IP_DF)) &&
-		    mtu < ntohs(old_iph->tot_len)) {
+		    mtu < ntohs(old_iph->tot_len) && !skb_is_gso(skb)) {
 			icmp_send(skb, ICMP_DEST_UNREACH, ICMP_FRAG_NEEDED, htonl(mtu));
 			ip_rt_put(rt);
 			goto tx_error;
@@ -824,7 +831,8 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 			}
 		}
 
-		if (mtu >= IPV6_MIN_MTU && mtu < skb->len - tunnel->hlen + gre_hlen) {
+		if (mtu >= IPV6_MIN_MTU && mtu < skb->len - tunnel->hlen + gre_hlen &&
+		    !skb_is_gso(skb)) {
 			icmpv6_send(skb, ICMPV6_PKT_TOOBIG, 0, mtu);
 			ip_rt_put(rt);
 			goto tx_error;
@@ -862,6 +870,34 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 		old_iph = ip_hdr(skb);
 	}
 
+	if (skb_is_gso(skb)) {
+		/* gso_type lives in the shared info, keep clones intact */
+		if (skb_cloned(skb) &&
+		    pskb_expand_head(skb, 0, 0, GFP_ATOMIC)) {
+			ip_rt_put(rt);
+			dev->stats.tx_dropped++;
+			dev_kfree_skb(skb);
+			return NETDEV_TX_OK;
+		}
+		skb_shinfo(skb)->gso_type |= SKB_GSO_GRE;
+	} else if (skb->ip_summed == CHECKSUM_PARTIAL &&
+		   tunnel->parms.o_flags&GRE_CSUM) {
+		/* The GRE checksum covers the payload, finish it first */
+		if (skb_checksum_help(skb)) {
+			ip_rt_put(rt);
+			dev->stats.tx_dropped++;
+			dev_kfree_skb(skb);
+			return NETDEV_TX_OK;
+		}
+	}
+	old_iph = ip_hdr(skb);
+
+	/* Remember where the payload starts, for segmentation and checksum
+	 * offload of the encapsulated packet.
+	 */
+	skb_reset_inner_headers(skb);
+	skb->encapsulation = 1;
+
 	skb_reset_transport_header(skb);
 	skb_push(skb, gre_hlen);
 	skb_reset_network_header(skb);
@@ -911,7 +947,8 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 			*ptr = tunnel->parms.o_key;
 			ptr--;
 		}
-		if (tunnel->parms.o_flags&GRE_CSUM) {
+		/* For GSO packets the checksum is set per segment */
+		if (tunnel->parms.o_flags&GRE_CSUM && !skb_is_gso(skb)) {
 			*ptr = 0;
 			*(__sum16*)ptr = ip_compute_csum((void*)(iph+1), skb->len - sizeof(struct iphdr));
 		}
@@ -1277,6 +1314,25 @@ static void ipgre_tunnel_setup(struct net_device *dev)
 	dev->priv_flags		&= ~IFF_XMIT_DST_RELEASE;
 }
 
+/* Let the stack hand us checksum offloaded and GSO packets; they are
+ * resolved after encapsulation, by the lower device if it can or by
+ * gre_gso_segment() otherwise.  Sequence numbers have to be assigned per
+ * packet on the wire, and devices with header_ops build the outer header
+ * before we get to see the packet, so those keep the plain feature set.
+ */
+static void ipgre_tunnel_set_features(struct net_device *dev)
+{
+	struct ip_tunnel *tunnel = netdev_priv(dev);
+
+	if (tunnel->parms.o_flags & GRE_SEQ)
+		return;
+	if (dev->header_ops && dev->type == ARPHRD_IPGRE)
+		return;
+
+	dev->features		|= GRE_FEATURES | NETIF_F_GSO_SOFTWARE;
+	dev->hw_features	|= GRE_FEATURES | NETIF_F_GSO_SOFTWARE;
+}
+
 static int ipgre_tunnel_init(struct net_device *dev)
 {
 	struct ip_tunnel *tunnel;
@@ -1303,6 +1359,8 @@ static int ipgre_tunnel_init(struct net_device *dev)
 	} else
 		dev->header_ops = &ipgre_header_ops;
 
+	ipgre_tunnel_set_features(dev);
+
 	dev->tstats = alloc_percpu(struct pcpu_tstats);
 	if (!dev->tstats)
 		return -ENOMEM;
@@ -1492,6 +1550,7 @@ static int ipgre_tap_init(struct net_device *dev)
 	strcpy(tunnel->parms.name, dev->name);
 
 	ipgre_tunnel_bind_dev(dev);
+	ipgre_tunnel_set_features(dev);
 
 	dev->tstats = alloc_percpu(struct pcpu_tstats);
 	if (!dev->tstats)
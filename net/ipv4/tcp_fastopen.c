@@ -0,0 +1,174 @@
+/*
+ * TCP Fast Open: cookie generation for the server side and the per
+ * destination cookie cache for the client side.
+ *
+ * A client that wants to send data in its SYN first obtains a cookie from
+ * the server by sending an empty Fast Open option.  The cookie is the
+ * client IP address encrypted with a secret key of the server, so the
+ * server can validate it later without keeping any per client state.
+ * Cookies learned by the client are kept in the inet_peer of the
+ * destination, together with the MSS announced by the server.
+ */
+
+#include <linux/err.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/random.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
+#include <linux/spinlock.h>
+#include <net/inetpeer.h>
+#include <net/tcp.h>
+
+int sysctl_tcp_fastopen __read_mostly = TFO_CLIENT_ENABLE;
+
+struct tcp_fastopen_context __rcu *tcp_fastopen_ctx;
+
+static DEFINE_SPINLOCK(tcp_fastopen_ctx_lock);
+
+static void tcp_fastopen_ctx_free(struct rcu_head *head)
+{
+	struct tcp_fastopen_context *ctx =
+	    container_of(head, struct tcp_fastopen_context, rcu);
+	crypto_free_cipher(ctx->tfm);
+	kfree(ctx);
+}
+
+int tcp_fastopen_reset_cipher(void *key, unsigned int len)
+{
+	int err;
+	struct tcp_fastopen_context *ctx, *octx;
+
+	ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+	ctx->tfm = crypto_alloc_cipher("aes", 0, 0);
+
+	if (IS_ERR(ctx->tfm)) {
+		err = PTR_ERR(ctx->tfm);
+error:		kfree(ctx);
+		pr_err("TCP: TFO aes cipher alloc error: %d\n", err);
+		return err;
+	}
+	err = crypto_cipher_setkey(ctx->tfm, key, len);
+	if (err) {
+		pr_err("TCP: TFO cipher key error: %d\n", err);
+		crypto_free_cipher(ctx->tfm);
+		goto error;
+	}
+	memcpy(ctx->key, key, len);
+
+	spin_lock(&tcp_fastopen_ctx_lock);
+
+	octx = rcu_dereference_protected(tcp_fastopen_ctx,
+				lockdep_is_held(&tcp_fastopen_ctx_lock));
+	rcu_assign_pointer(tcp_fastopen_ctx, ctx);
+	spin_unlock(&tcp_fastopen_ctx_lock);
+
+	if (octx)
+		call_rcu(&octx->rcu, tcp_fastopen_ctx_free);
+	return err;
+}
+
+/* Computes the fastopen cookie for the peer.
+ * The peer address is a 128 bits long (pad with zeros for IPv4).
+ *
+ * The caller must check foc->len to determine if a valid cookie
+ * has been generated successfully.
+ */
+void tcp_fastopen_cookie_gen(__be32 addr, struct tcp_fastopen_cookie *foc)
+{
+	__be32 peer_addr[4] = { addr, 0, 0, 0 };
+	struct tcp_fastopen_context *ctx;
+
+	rcu_read_lock();
+	ctx = rcu_dereference(tcp_fastopen_ctx);
+	if (ctx) {
+		crypto_cipher_encrypt_one(ctx->tfm,
+					  foc->val,
+					  (__u8 *)peer_addr);
+		foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+	}
+	rcu_read_unlock();
+}
+
+/* The client side cache lives in the inet_peer of the destination. A
+ * single seqlock is enough: updates only happen when a SYN-ACK answers
+ * a Fast Open SYN, and readers simply retry.
+ */
+static DEFINE_SEQLOCK(fastopen_seqlock);
+
+void tcp_fastopen_cache_get(struct sock *sk, u16 *mss,
+			    struct tcp_fastopen_cookie *cookie,
+			    int *syn_loss, unsigned long *last_syn_loss)
+{
+	const struct inet_connection_sock *icsk = inet_csk(sk);
+	struct inet_peer *peer;
+	bool release_it;
+
+	peer = icsk->icsk_af_ops->get_peer(sk, &release_it);
+	if (peer) {
+		unsigned int seq;
+
+		do {
+			seq = read_seqbegin(&fastopen_seqlock);
+			if (peer->tcp_fastopen.mss)
+				*mss = peer->tcp_fastopen.mss;
+			cookie->len = peer->tcp_fastopen.cookie_len;
+			memcpy(cookie->val, peer->tcp_fastopen.cookie,
+			       cookie->len);
+			*syn_loss = peer->tcp_fastopen.syn_loss;
+			*last_syn_loss = *syn_loss ?
+					 peer->tcp_fastopen.last_syn_loss : 0;
+		} while (read_seqretry(&fastopen_seqlock, seq));
+		if (release_it)
+			inet_putpeer(peer);
+	} else {
+		cookie->len = 0;
+		*syn_loss = 0;
+		*last_syn_loss = 0;
+	}
+}
+
+void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+			    struct tcp_fastopen_cookie *cookie, bool syn_lost)
+{
+	const struct inet_connection_sock *icsk = inet_csk(sk);
+	struct inet_peer *peer;
+	bool release_it;
+
+	BUILD_BUG_ON(sizeof(peer->tcp_fastopen.cookie) <
+		     TCP_FASTOPEN_COOKIE_MAX);
+
+	peer = icsk->icsk_af_ops->get_peer(sk, &release_it);
+	if (!peer)
+		return;
+
+	write_seqlock_bh(&fastopen_seqlock);
+	peer->tcp_fastopen.mss = mss;
+	if (cookie->len > 0) {
+		peer->tcp_fastopen.cookie_len = cookie->len;
+		memcpy(peer->tcp_fastopen.cookie, cookie->val, cookie->len);
+	}
+	if (syn_lost) {
+		++peer->tcp_fastopen.syn_loss;
+		peer->tcp_fastopen.last_syn_loss = jiffies;
+	} else
+		peer->tcp_fastopen.syn_loss = 0;
+	write_sequnlock_bh(&fastopen_seqlock);
+
+	if (release_it)
+		inet_putpeer(peer);
+}
+
+static int __init tcp_fastopen_init(void)
+{
+	__u8 key[TCP_FASTOPEN_KEY_LENGTH];
+
+	get_random_bytes(key, sizeof(key));
+	tcp_fastopen_reset_cipher(key, sizeof(key));
+	return 0;
+}
+
+late_initcall(tcp_fastopen_init);
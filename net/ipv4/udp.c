@@ -107,6 +107,7 @@
 #include <net/checksum.h>
 #include <net/xfrm.h>
 #include <trace/events/udp.h>
+#include <net/busy_poll.h>
 #include "udp_impl.h"
 
 struct udp_table udp_table __read_mostly;
@@ -1082,6 +1083,179 @@ out:
 }
 
 
+/*
+ *	Per cpu receive queues (UDP_RCVQ_PERCPU).
+ *
+ *	The softirq side appends datagrams to a queue owned by the current
+ *	cpu, taking neither the socket lock nor sk_receive_queue.lock, and
+ *	only wakes the reader when that queue goes from empty to non-empty.
+ *	Datagrams are charged to sk_rmem_alloc only, bounded by sk_rcvbuf;
+ *	the forward allocation scheme is bypassed so that the reader can
+ *	free them without the socket lock.
+ *
+ *	Whenever sk_receive_queue runs dry the reader splices all per cpu
+ *	queues into it in one pass, so recvmsg()/recvmmsg() then consume
+ *	a whole batch under the usual receive queue lock.
+ */
+static void udp_rcvq_rfree(struct sk_buff *skb)
+{
+	atomic_sub(skb->truesize, &skb->sk->sk_rmem_alloc);
+}
+
+static bool udp_rcvq_pending(const struct sock *sk)
+{
+	struct sk_buff_head __percpu *rcvq = udp_sk(sk)->rcvq;
+	int cpu;
+
+	if (!rcvq)
+		return false;
+
+	for_each_possible_cpu(cpu)
+		if (!skb_queue_empty(per_cpu_ptr(rcvq, cpu)))
+			return true;
+	return false;
+}
+
+static void udp_rcvq_splice(struct sock *sk)
+{
+	struct sk_buff_head __percpu *rcvq = udp_sk(sk)->rcvq;
+	struct sk_buff_head batch;
+	unsigned long flags;
+	int cpu;
+
+	if (!rcvq || !skb_queue_empty(&sk->sk_receive_queue))
+		return;
+
+	__skb_queue_head_init(&batch);
+	for_each_possible_cpu(cpu) {
+		struct sk_buff_head *q = per_cpu_ptr(rcvq, cpu);
+
+		if (skb_queue_empty(q))
+			continue;
+		spin_lock_bh(&q->lock);
+		skb_queue_splice_tail_init(q, &batch);
+		spin_unlock_bh(&q->lock);
+	}
+
+	if (skb_queue_empty(&batch))
+		return;
+
+	spin_lock_irqsave(&sk->sk_receive_queue.lock, flags);
+	skb_queue_splice_tail(&batch, &sk->sk_receive_queue);
+	spin_unlock_irqrestore(&sk->sk_receive_queue.lock, flags);
+}
+
+/*
+ * Same as wait_for_packet() in net/core/datagram.c, but also
+ * considers the per cpu queues.
+ */
+static int udp_rcvq_wait(struct sock *sk, int *err, long *timeo_p)
+{
+	int error;
+	DEFINE_WAIT(wait);
+
+	prepare_to_wait_exclusive(sk_sleep(sk), &wait, TASK_INTERRUPTIBLE);
+
+	error = sock_error(sk);
+	if (error)
+		goto out_err;
+
+	if (!skb_queue_empty(&sk->sk_receive_queue) || udp_rcvq_pending(sk))
+		goto out;
+
+	if (sk->sk_shutdown & RCV_SHUTDOWN)
+		goto out_noerr;
+
+	if (signal_pending(current))
+		goto interrupted;
+
+	error = 0;
+	*timeo_p = schedule_timeout(*timeo_p);
+out:
+	finish_wait(sk_sleep(sk), &wait);
+	return error;
+interrupted:
+	error = sock_intr_errno(*timeo_p);
+out_err:
+	*err = error;
+	goto out;
+out_noerr:
+	*err = 0;
+	error = 1;
+	goto out;
+}
+
+static struct sk_buff *udp_recv_datagram(struct sock *sk, unsigned int flags,
+					 int *peeked, int *off, int *err)
+{
+	struct sk_buff *skb;
+	long timeo;
+
+	if (!udp_sk(sk)->rcvq)
+		return __skb_recv_datagram(sk, flags, peeked, off, err);
+
+	timeo = sock_rcvtimeo(sk, flags & MSG_DONTWAIT);
+	do {
+		udp_rcvq_splice(sk);
+		skb = __skb_recv_datagram(sk, flags | MSG_DONTWAIT,
+					  peeked, off, err);
+		if (skb || *err != -EAGAIN || !timeo)
+			return skb;
+	} while (!udp_rcvq_wait(sk, err, &timeo));
+
+	return NULL;
+}
+
+static void udp_rcvq_purge(struct sock *sk)
+{
+	struct sk_buff_head __percpu *rcvq = udp_sk(sk)->rcvq;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		skb_queue_purge(per_cpu_ptr(rcvq, cpu));
+}
+
+/*
+ * The per cpu queues can only be torn down once the last reference is
+ * gone, as lookups in softirq may still append to them until then.
+ */
+static void udp_rcvq_destruct(struct sock *sk)
+{
+	struct udp_sock *up = udp_sk(sk);
+
+	udp_rcvq_purge(sk);
+	free_percpu(up->rcvq);
+	up->rcvq = NULL;
+	inet_sock_destruct(sk);
+}
+
+static int udp_rcvq_enable(struct sock *sk)
+{
+	struct udp_sock *up = udp_sk(sk);
+	struct sk_buff_head __percpu *rcvq;
+	int cpu, err = 0;
+
+	lock_sock(sk);
+	if (up->rcvq)
+		goto out;
+
+	err = -ENOMEM;
+	rcvq = alloc_percpu(struct sk_buff_head);
+	if (!rcvq)
+		goto out;
+	for_each_possible_cpu(cpu)
+		skb_queue_head_init(per_cpu_ptr(rcvq, cpu));
+
+	sk->sk_destruct = udp_rcvq_destruct;
+	/* queues must be initialised before softirq can see them */
+	smp_wmb();
+	up->rcvq = rcvq;
+	err = 0;
+out:
+	release_sock(sk);
+	return err;
+}
+
 /**
  *	first_packet_length	- return length of first packet in receive queue
  *	@sk: socket
@@ -1097,6 +1271,7 @@ static unsigned int first_packet_length(struct sock *sk)
 
 	__skb_queue_head_init(&list_kill);
 
+	udp_rcvq_splice(sk);
 	spin_lock_bh(&rcvq->lock);
 	while ((skb = skb_peek(rcvq)) != NULL &&
 		udp_lib_checksum_complete(skb)) {
@@ -1183,8 +1358,8 @@ int udp_recvmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 		return ip_recv_error(sk, msg, len);
 
 try_again:
-	skb = __skb_recv_datagram(sk, flags | (noblock ? MSG_DONTWAIT : 0),
-				  &peeked, &off, &err);
+	skb = udp_recv_datagram(sk, flags | (noblock ? MSG_DONTWAIT : 0),
+				&peeked, &off, &err);
 	if (!skb)
 		goto out;
 
@@ -1242,7 +1417,11 @@ try_again:
 		err = ulen;
 
 out_free:
-	skb_free_datagram_locked(sk, skb);
+	/* per cpu queued datagrams carry no forward allocation */
+	if (skb->destructor == udp_rcvq_rfree)
+		consume_skb(skb);
+	else
+		skb_free_datagram_locked(sk, skb);
 out:
 	return err;
 
@@ -1360,6 +1539,7 @@ static int __udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 
 	if (inet_sk(sk)->inet_daddr)
 		sock_rps_save_rxhash(sk, skb);
+	sk_mark_napi_id(sk, skb);
 
 	rc = sock_queue_rcv_skb(sk, skb);
 	if (rc < 0) {
@@ -1379,6 +1559,57 @@ static int __udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 
 }
 
+static int udp_rcvq_enqueue(struct sock *sk, struct sk_buff *skb,
+			     struct sk_buff_head __percpu *rcvq)
+{
+	struct sk_buff_head *q;
+	bool was_empty;
+	int skb_len;
+	int rc;
+
+	if (inet_sk(sk)->inet_daddr)
+		sock_rps_save_rxhash(sk, skb);
+	sk_mark_napi_id(sk, skb);
+
+	rc = -ENOMEM;
+	if (atomic_read(&sk->sk_rmem_alloc) >= sk->sk_rcvbuf)
+		goto drop;
+
+	rc = sk_filter(sk, skb);
+	if (rc)
+		goto drop;
+
+	skb->dev = NULL;
+	skb->sk = sk;
+	skb->destructor = udp_rcvq_rfree;
+	atomic_add(skb->truesize, &sk->sk_rmem_alloc);
+
+	skb_len = skb->len;
+	skb_dst_force(skb);
+
+	q = this_cpu_ptr(rcvq);
+	spin_lock(&q->lock);
+	skb->dropcount = atomic_read(&sk->sk_drops);
+	was_empty = skb_queue_empty(q);
+	__skb_queue_tail(q, skb);
+	spin_unlock(&q->lock);
+
+	/* A reader only sleeps after finding every queue empty. */
+	if (was_empty && !sock_flag(sk, SOCK_DEAD))
+		sk->sk_data_ready(sk, skb_len);
+	return 0;
+
+drop:
+	if (rc == -ENOMEM)
+		UDP_INC_STATS_BH(sock_net(sk), UDP_MIB_RCVBUFERRORS,
+				 IS_UDPLITE(sk));
+	UDP_INC_STATS_BH(sock_net(sk), UDP_MIB_INERRORS, IS_UDPLITE(sk));
+	atomic_inc(&sk->sk_drops);
+	kfree_skb(skb);
+	trace_udp_fail_queue_rcv_skb(rc, sk);
+	return -1;
+}
+
 /* returns:
  *  -1: error
  *   0: success
@@ -1390,6 +1621,7 @@ static int __udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 int udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 {
 	struct udp_sock *up = udp_sk(sk);
+	struct sk_buff_head __percpu *rcvq;
 	int rc;
 	int is_udplite = IS_UDPLITE(sk);
 
@@ -1476,6 +1708,13 @@ int udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 	rc = 0;
 
 	ipv4_pktinfo_prepare(skb);
+
+	rcvq = ACCESS_ONCE(up->rcvq);
+	if (rcvq) {
+		smp_read_barrier_depends();
+		return udp_rcvq_enqueue(sk, skb, rcvq);
+	}
+
 	bh_lock_sock(sk);
 	if (!sock_owned_by_user(sk))
 		rc = __udp_queue_rcv_skb(sk, skb);
@@ -1767,6 +2006,16 @@ int udp_lib_setsockopt(struct sock *sk, int level, int optname,
 		}
 		break;
 
+	case UDP_RCVQ_PERCPU:
+		/* the IPv6 and UDP-Lite receive paths are not converted */
+		if (is_udplite || sk->sk_family != AF_INET)
+			return -ENOPROTOOPT;
+		if (val)
+			err = udp_rcvq_enable(sk);
+		else if (up->rcvq)
+			err = -EINVAL;
+		break;
+
 	/*
 	 * 	UDP-Lite's partial checksum coverage (RFC 3828).
 	 */
@@ -1849,6 +2098,10 @@ int udp_lib_getsockopt(struct sock *sk, int level, int optname,
 		val = up->encap_type;
 		break;
 
+	case UDP_RCVQ_PERCPU:
+		val = up->rcvq != NULL;
+		break;
+
 	/* The following two cannot be changed on UDP sockets, the return is
 	 * always 0 (which corresponds to the full checksum coverage of UDP). */
 	case UDPLITE_SEND_CSCOV:
@@ -1903,8 +2156,15 @@ int compat_udp_getsockopt(struct sock *sk, int level, int optname,
  */
 unsigned int udp_poll(struct file *file, struct socket *sock, poll_table *wait)
 {
-	unsigned int mask = datagram_poll(file, sock, wait);
 	struct sock *sk = sock->sk;
+	unsigned int mask;
+
+	udp_rcvq_splice(sk);
+	mask = datagram_poll(file, sock, wait);
+
+	/* Datagrams queued per cpu after the splice above */
+	if (!(mask & POLLRDNORM) && udp_rcvq_pending(sk))
+		mask |= POLLIN | POLLRDNORM;
 
 	/* Check for false positives due to checksum errors */
 	if ((mask & POLLRDNORM) && !(file->f_flags & O_NONBLOCK) &&
@@ -2232,6 +2492,10 @@ int udp4_ufo_send_check(struct sk_buff *skb)
 	if (!pskb_may_pull(skb, sizeof(*uh)))
 		return -EINVAL;
 
+	/* The tunnel filled in the outer header checksum already. */
+	if (skb->encapsulation)
+		return 0;
+
 	iph = ip_hdr(skb);
 	uh = udp_hdr(skb);
 
@@ -2243,6 +2507,71 @@ int udp4_ufo_send_check(struct sk_buff *skb)
 	return 0;
 }
 
+/* Segment a UDP encapsulated GSO packet: the inner packet, which starts
+ * with an Ethernet header, is segmented as usual and every segment then
+ * gets a copy of the outer headers with the UDP length (and checksum, if
+ * the tunnel uses one) fixed up.
+ */
+static struct sk_buff *skb_udp_tunnel_segment(struct sk_buff *skb,
+	netdev_features_t features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	int mac_len = skb->mac_len;
+	int tnl_hlen = skb_inner_mac_header(skb) - skb_transport_header(skb);
+	__be16 protocol = skb->protocol;
+	netdev_features_t enc_features;
+	int outer_hlen;
+
+	if (unlikely(!pskb_may_pull(skb, tnl_hlen)))
+		goto out;
+
+	skb->encapsulation = 0;
+	__skb_pull(skb, tnl_hlen);
+	skb_reset_mac_header(skb);
+	skb_set_network_header(skb, skb_inner_network_offset(skb));
+	skb->mac_len = skb_inner_network_offset(skb);
+	skb->protocol = htons(ETH_P_TEB);
+
+	/* segment inner packet. */
+	enc_features = skb->dev->hw_enc_features & features;
+	segs = skb_mac_gso_segment(skb, enc_features);
+	if (!segs || IS_ERR(segs))
+		goto out;
+
+	outer_hlen = skb_tnl_header_len(skb);
+	skb = segs;
+	do {
+		struct udphdr *uh;
+		int udp_offset = outer_hlen - tnl_hlen;
+
+		skb->mac_len = mac_len;
+
+		skb_push(skb, outer_hlen);
+		skb_reset_mac_header(skb);
+		skb_set_network_header(skb, mac_len);
+		skb_set_transport_header(skb, udp_offset);
+		uh = udp_hdr(skb);
+		uh->len = htons(skb->len - udp_offset);
+
+		/* csum segment if tunnel sets skb with csum. */
+		if (unlikely(uh->check)) {
+			struct iphdr *iph = ip_hdr(skb);
+
+			uh->check = ~csum_tcpudp_magic(iph->saddr, iph->daddr,
+						       skb->len - udp_offset,
+						       IPPROTO_UDP, 0);
+			uh->check = csum_fold(skb_checksum(skb, udp_offset,
+							   skb->len - udp_offset, 0));
+			if (uh->check == 0)
+				uh->check = CSUM_MANGLED_0;
+		}
+		skb->ip_summed = CHECKSUM_NONE;
+		skb->protocol = protocol;
+	} while ((skb = skb->next));
+out:
+	return segs;
+}
+
 struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 	netdev_features_t features)
 {
@@ -2259,8 +2588,9 @@ struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 		/* Packet is from an untrusted source, reset gso_segs. */
 		int type = skb_shinfo(skb)->gso_type;
 
-		if (unlikely(type & ~(SKB_GSO_UDP | SKB_GSO_DODGY) ||
-			     !(type & (SKB_GSO_UDP))))
+		if (unlikely(type & ~(SKB_GSO_UDP | SKB_GSO_DODGY |
+				      SKB_GSO_UDP_TUNNEL) ||
+			     !(type & (SKB_GSO_UDP | SKB_GSO_UDP_TUNNEL))))
 			goto out;
 
 		skb_shinfo(skb)->gso_segs = DIV_ROUND_UP(skb->len, mss);
@@ -2269,6 +2599,12 @@ struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 		goto out;
 	}
 
+	if (skb->encapsulation &&
+	    skb_shinfo(skb)->gso_type & SKB_GSO_UDP_TUNNEL) {
+		segs = skb_udp_tunnel_segment(skb, features);
+		goto out;
+	}
+
 	/* Do software UFO. Complete and fill in the UDP checksum as HW cannot
 	 * do checksum of UDP packets sent as multiple IP fragments.
 	 */
@@ -2286,3 +2622,171 @@ out:
 	return segs;
 }
 
+/* UDP encapsulations that want their traffic aggregated register a
+ * struct udp_offload keyed by destination port.  The list is short and
+ * walked under RCU from the GRO path.
+ */
+struct udp_offload_priv {
+	struct udp_offload	*offload;
+	struct rcu_head		rcu;
+	struct udp_offload_priv __rcu *next;
+};
+
+static struct udp_offload_priv __rcu *udp_offload_base __read_mostly;
+static DEFINE_SPINLOCK(udp_offload_lock);
+
+#define udp_deref_protected(X) \
+	rcu_dereference_protected(X, lockdep_is_held(&udp_offload_lock))
+
+int udp_add_offload(struct udp_offload *uo)
+{
+	struct udp_offload_priv *new_offload;
+
+	new_offload = kzalloc(sizeof(*new_offload), GFP_ATOMIC);
+	if (!new_offload)
+		return -ENOMEM;
+
+	new_offload->offload = uo;
+
+	spin_lock(&udp_offload_lock);
+	RCU_INIT_POINTER(new_offload->next, udp_deref_protected(udp_offload_base));
+	rcu_assign_pointer(udp_offload_base, new_offload);
+	spin_unlock(&udp_offload_lock);
+
+	return 0;
+}
+EXPORT_SYMBOL(udp_add_offload);
+
+static void udp_offload_free_routine(struct rcu_head *head)
+{
+	struct udp_offload_priv *ou_priv;
+
+	ou_priv = container_of(head, struct udp_offload_priv, rcu);
+	kfree(ou_priv);
+}
+
+void udp_del_offload(struct udp_offload *uo)
+{
+	struct udp_offload_priv __rcu **head = &udp_offload_base;
+	struct udp_offload_priv *uo_priv;
+
+	spin_lock(&udp_offload_lock);
+
+	uo_priv = udp_deref_protected(*head);
+	for (; uo_priv != NULL; uo_priv = udp_deref_protected(*head)) {
+		if (uo_priv->offload == uo) {
+			rcu_assign_pointer(*head,
+					   udp_deref_protected(uo_priv->next));
+			goto unlock;
+		}
+		head = &uo_priv->next;
+	}
+	pr_warn("udp_del_offload: didn't find offload for port %d\n",
+		ntohs(uo->port));
+unlock:
+	spin_unlock(&udp_offload_lock);
+	if (uo_priv != NULL)
+		call_rcu(&uo_priv->rcu, udp_offload_free_routine);
+}
+EXPORT_SYMBOL(udp_del_offload);
+
+struct sk_buff **udp4_gro_receive(struct sk_buff **head, struct sk_buff *skb)
+{
+	struct udp_offload_priv *uo_priv;
+	const struct iphdr *iph;
+	struct sk_buff *p, **pp = NULL;
+	struct udphdr *uh, *uh2;
+	unsigned int hlen, off;
+	int flush = 1;
+
+	/* Only one level of UDP encapsulation is aggregated, and only when
+	 * the device gave us a checksum of the whole packet so that the
+	 * outer and inner checksums can both be verified.
+	 */
+	if (NAPI_GRO_CB(skb)->udp_mark ||
+	    skb->ip_summed != CHECKSUM_COMPLETE)
+		goto out;
+
+	/* mark that this skb passed once through the udp gro layer */
+	NAPI_GRO_CB(skb)->udp_mark = 1;
+
+	off  = skb_gro_offset(skb);
+	hlen = off + sizeof(*uh);
+	uh   = skb_gro_header_fast(skb, off);
+	if (skb_gro_header_hard(skb, hlen)) {
+		uh = skb_gro_header_slow(skb, hlen, off);
+		if (unlikely(!uh))
+			goto out;
+	}
+
+	rcu_read_lock();
+	uo_priv = rcu_dereference(udp_offload_base);
+	for (; uo_priv != NULL; uo_priv = rcu_dereference(uo_priv->next)) {
+		if (uo_priv->offload->port == uh->dest &&
+		    uo_priv->offload->gro_receive)
+			goto unflush;
+	}
+	goto out_unlock;
+
+unflush:
+	iph = skb_gro_network_header(skb);
+	if (uh->check &&
+	    csum_tcpudp_magic(iph->saddr, iph->daddr, skb_gro_len(skb),
+			      IPPROTO_UDP, NAPI_GRO_CB(skb)->csum))
+		goto out_unlock;
+
+	flush = 0;
+
+	for (p = *head; p; p = p->next) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		uh2 = (struct udphdr *)(p->data + off);
+		if ((*(u32 *)&uh->source != *(u32 *)&uh2->source)) {
+			NAPI_GRO_CB(p)->same_flow = 0;
+			continue;
+		}
+	}
+
+	/* pull encapsulating udp header */
+	skb_gro_pull(skb, sizeof(struct udphdr));
+	skb_gro_postpull_rcsum(skb, uh, sizeof(struct udphdr));
+	pp = uo_priv->offload->gro_receive(head, skb);
+
+out_unlock:
+	rcu_read_unlock();
+out:
+	NAPI_GRO_CB(skb)->flush |= flush;
+	return pp;
+}
+
+int udp4_gro_complete(struct sk_buff *skb, int nhoff)
+{
+	struct udp_offload_priv *uo_priv;
+	__be16 newlen = htons(skb->len - nhoff);
+	struct udphdr *uh = (struct udphdr *)(skb->data + nhoff);
+	int err = -ENOSYS;
+
+	uh->len = newlen;
+
+	rcu_read_lock();
+
+	uo_priv = rcu_dereference(udp_offload_base);
+	for (; uo_priv != NULL; uo_priv = rcu_dereference(uo_priv->next)) {
+		if (uo_priv->offload->port == uh->dest &&
+		    uo_priv->offload->gro_complete)
+			break;
+	}
+
+	if (uo_priv != NULL) {
+		skb->encapsulation = 1;
+		skb_shinfo(skb)->gso_type = SKB_GSO_UDP_TUNNEL;
+		skb_set_inner_mac_header(skb, nhoff + sizeof(struct udphdr));
+		err = uo_priv->offload->gro_complete(skb,
+					nhoff + sizeof(struct udphdr));
+	}
+
+	rcu_read_unlock();
+	return err;
+}
+
@@ -92,7 +92,7 @@ begin:
 			if (unlikely(!atomic_inc_not_zero(&sk->sk_refcnt)))
 				goto begintw;
 			if (!INET6_MATCH(sk, net, hash, saddr, daddr, ports, dif)) {
-				sock_put(sk);
+				sock_gen_put(sk);
 				goto begin;
 			}
 		goto out;
@@ -110,7 +110,7 @@ begintw:
 				goto out;
 			}
 			if (!INET6_TW_MATCH(sk, net, hash, saddr, daddr, ports, dif)) {
-				sock_put(sk);
+				sock_gen_put(sk);
 				goto begintw;
 			}
 			goto out;
@@ -111,6 +111,11 @@ struct ipv6_txoptions *ipv6_update_options(struct sock *sk,
 			icsk->icsk_sync_mss(sk, icsk->icsk_pmtu_cookie);
 		}
 		opt = xchg(&inet6_sk(sk)->opt, opt);
+		/* A listener answers SYNs without its socket lock, from
+		 * RCU protected paths: let them drop the old options.
+		 */
+		if (sk->sk_state == TCP_LISTEN)
+			synchronize_net();
 	} else {
 		spin_lock(&sk->sk_dst_lock);
 		opt = xchg(&inet6_sk(sk)->opt, opt);
@@ -36,9 +36,11 @@ void
 nf_tproxy_assign_sock(struct sk_buff *skb, struct sock *sk)
 {
 	/* assigning tw sockets complicates things; most
-	 * skb->sk->X checks would have to test sk->sk_state first */
-	if (sk->sk_state == TCP_TIME_WAIT) {
-		inet_twsk_put(inet_twsk(sk));
+	 * skb->sk->X checks would have to test sk->sk_state first.
+	 * Request socks are found again by the normal TCP lookup. */
+	if (sk->sk_state == TCP_TIME_WAIT ||
+	    sk->sk_state == TCP_NEW_SYN_RECV) {
+		sock_gen_put(sk);
 		return;
 	}
 
@@ -0,0 +1,1185 @@
+/*
+ * Compiled IPv4 packet classifier configured through nfnetlink.
+ *
+ * ip_tables walks a chain rule by rule, so the per packet cost grows
+ * with the size of the ruleset.  This module accepts rules that match
+ * on source and destination address ranges, the layer 4 protocol and
+ * lists of port ranges (what xt_iprange, xt_tcpudp and xt_multiport
+ * express) and compiles them into a small number of hash tables, one
+ * per combination of prefix lengths ("tuple space search"):
+ *
+ *  - every range is split into the aligned prefixes that cover it, and
+ *    every combination of prefixes of a rule becomes one hash entry
+ *    carrying the position of the rule in the ruleset;
+ *  - entries with the same masks share a hash table, an entry that is
+ *    shadowed by an identical one of an earlier rule is dropped;
+ *  - tables are sorted by the earliest rule they hold, so a lookup can
+ *    stop as soon as no remaining table can beat the best match found.
+ *
+ * The lookup cost depends on the number of distinct prefix shapes in
+ * the ruleset instead of the number of rules, which stays small for
+ * real firewalls.
+ *
+ * A new ruleset is built in process context from the rules staged by
+ * NFNL_MSG_CLS_NEW and published with RCU on NFNL_MSG_CLS_COMMIT, so
+ * packets see either the old or the new classifier, never a partial one.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/skbuff.h>
+#include <linux/netlink.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/types.h>
+#include <linux/errno.h>
+#include <linux/ip.h>
+#include <linux/in.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/random.h>
+#include <linux/rcupdate.h>
+#include <linux/sort.h>
+#include <net/ip.h>
+#include <net/netlink.h>
+#include <net/sock.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+
+#include <linux/netfilter.h>
+#include <linux/netfilter_ipv4.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_classifier.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("nfcls: compiled IPv4 packet classifier");
+
+/* Limits on what a single ruleset may expand to. */
+#define NFCLS_RULES_LIMIT	(1 << 18)
+#define NFCLS_EXPAND_LIMIT	4096	/* hash entries per rule */
+#define NFCLS_ENTRIES_LIMIT	(1 << 22)
+
+struct nfcls_range {
+	u32			from;	/* host byte order */
+	u32			to;
+};
+
+struct nfcls_port_range {
+	u16			from;	/* host byte order */
+	u16			to;
+};
+
+struct nfcls_rule {
+	struct nfcls_range	src;
+	struct nfcls_range	dst;
+	u32			verdict;
+	u8			proto;
+	u8			nsports;
+	u8			ndports;
+	struct nfcls_port_range	sports[NFCLS_MAX_PORTS];
+	struct nfcls_port_range	dports[NFCLS_MAX_PORTS];
+};
+
+struct nfcls_rules {
+	struct nfcls_rule	*rule;
+	unsigned int		count;
+	unsigned int		size;
+};
+
+union nfcls_key {
+	struct {
+		__be32		saddr;
+		__be32		daddr;
+		__be16		sport;
+		__be16		dport;
+		u8		proto;
+		u8		pad[3];
+	};
+	u32			w[4];
+};
+
+struct nfcls_entry {
+	struct hlist_node	node;
+	union nfcls_key		key;	/* already masked */
+	u32			prio;	/* position of the rule */
+	u32			verdict;
+};
+
+struct nfcls_table {
+	union nfcls_key		mask;
+	u32			prio;	/* earliest rule in this table */
+	bool			ports;	/* needs the layer 4 ports */
+	unsigned int		count;
+	unsigned int		hmask;
+	struct hlist_head	*hash;
+};
+
+struct nfcls_set {
+	u32			policy;
+	u32			seed;
+	unsigned int		ntables;
+	struct nfcls_table	*tables;
+	unsigned int		nentries;
+	struct nfcls_entry	*entries;
+	struct hlist_head	*buckets;
+	struct nfcls_rules	rules;
+};
+
+struct nfcls_net {
+	struct nfcls_set __rcu	*sets[NF_INET_NUMHOOKS];
+	struct nfcls_rules	staged[NF_INET_NUMHOOKS];
+};
+
+static int nfcls_net_id __read_mostly;
+
+static inline struct nfcls_net *nfcls_pernet(struct net *net)
+{
+	return net_generic(net, nfcls_net_id);
+}
+
+static void *nfcls_alloc(size_t size)
+{
+	void *p;
+
+	if (size <= (PAGE_SIZE << PAGE_ALLOC_COSTLY_ORDER)) {
+		p = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+		if (p != NULL)
+			return p;
+	}
+	return vzalloc(size);
+}
+
+static void nfcls_free(void *p)
+{
+	if (is_vmalloc_addr(p))
+		vfree(p);
+	else
+		kfree(p);
+}
+
+static void nfcls_rules_free(struct nfcls_rules *rules)
+{
+	nfcls_free(rules->rule);
+	rules->rule = NULL;
+	rules->count = 0;
+	rules->size = 0;
+}
+
+/* Must not be visible to packets anymore: vfree() can't run from RCU
+ * callbacks, so callers wait for a grace period instead.
+ */
+static void nfcls_set_free(struct nfcls_set *set)
+{
+	nfcls_free(set->buckets);
+	nfcls_free(set->entries);
+	kfree(set->tables);
+	nfcls_rules_free(&set->rules);
+	kfree(set);
+}
+
+/*
+ * Compilation
+ */
+
+struct nfcls_prefix {
+	u32			val;
+	u32			mask;
+};
+
+#define NFCLS_ADDR_PREFIXES	64
+#define NFCLS_PORT_PREFIXES	(NFCLS_MAX_PORTS * 32)
+
+struct nfcls_expansion {
+	unsigned int		nsrc, ndst, nsport, ndport;
+	struct nfcls_prefix	src[NFCLS_ADDR_PREFIXES];
+	struct nfcls_prefix	dst[NFCLS_ADDR_PREFIXES];
+	struct nfcls_prefix	sport[NFCLS_PORT_PREFIXES];
+	struct nfcls_prefix	dport[NFCLS_PORT_PREFIXES];
+};
+
+/* Cover [from, to] with the smallest set of aligned prefixes. */
+static int nfcls_split_range(u32 from, u32 to, unsigned int bits,
+			     struct nfcls_prefix *pfx, int n, int max)
+{
+	u64 lo = from, hi = to, size;
+
+	while (lo <= hi) {
+		size = 1;
+		while (size < (1ULL << bits) &&
+		       !(lo & (size * 2 - 1)) && lo + size * 2 - 1 <= hi)
+			size *= 2;
+
+		if (n >= max)
+			return -E2BIG;
+		pfx[n].val = lo;
+		pfx[n].mask = ((1ULL << bits) - 1) & ~(size - 1);
+		n++;
+		lo += size;
+	}
+	return n;
+}
+
+static int nfcls_split_ports(const struct nfcls_port_range *range,
+			     unsigned int nranges, struct nfcls_prefix *pfx)
+{
+	unsigned int i;
+	int n = 0;
+
+	/* no port list matches any port */
+	if (nranges == 0) {
+		pfx[0].val = 0;
+		pfx[0].mask = 0;
+		return 1;
+	}
+	for (i = 0; i < nranges; i++) {
+		n = nfcls_split_range(range[i].from, range[i].to, 16,
+				      pfx, n, NFCLS_PORT_PREFIXES);
+		if (n < 0)
+			break;
+	}
+	return n;
+}
+
+static int nfcls_expand(const struct nfcls_rule *rule,
+			struct nfcls_expansion *exp)
+{
+	unsigned long total;
+	int n;
+
+	n = nfcls_split_range(rule->src.from, rule->src.to, 32,
+			      exp->src, 0, NFCLS_ADDR_PREFIXES);
+	if (n < 0)
+		return n;
+	exp->nsrc = n;
+	n = nfcls_split_range(rule->dst.from, rule->dst.to, 32,
+			      exp->dst, 0, NFCLS_ADDR_PREFIXES);
+	if (n < 0)
+		return n;
+	exp->ndst = n;
+	n = nfcls_split_ports(rule->sports, rule->nsports, exp->sport);
+	if (n < 0)
+		return n;
+	exp->nsport = n;
+	n = nfcls_split_ports(rule->dports, rule->ndports, exp->dport);
+	if (n < 0)
+		return n;
+	exp->ndport = n;
+
+	total = (unsigned long)exp->nsrc * exp->ndst *
+		exp->nsport * exp->ndport;
+	if (total > NFCLS_EXPAND_LIMIT)
+		return -E2BIG;
+	return total;
+}
+
+static inline bool nfcls_key_equal(const union nfcls_key *a,
+				   const union nfcls_key *b)
+{
+	return ((a->w[0] ^ b->w[0]) | (a->w[1] ^ b->w[1]) |
+		(a->w[2] ^ b->w[2]) | (a->w[3] ^ b->w[3])) == 0;
+}
+
+static inline void nfcls_key_mask(union nfcls_key *dst,
+				  const union nfcls_key *key,
+				  const union nfcls_key *mask)
+{
+	dst->w[0] = key->w[0] & mask->w[0];
+	dst->w[1] = key->w[1] & mask->w[1];
+	dst->w[2] = key->w[2] & mask->w[2];
+	dst->w[3] = key->w[3] & mask->w[3];
+}
+
+static inline u32 nfcls_hash(const union nfcls_key *key, u32 seed)
+{
+	return jhash2(key->w, ARRAY_SIZE(key->w), seed);
+}
+
+struct nfcls_builder {
+	struct nfcls_set	*set;
+	unsigned int		tsize;		/* allocated tables */
+	bool			insert;		/* second pass */
+};
+
+static int nfcls_find_table(struct nfcls_builder *b,
+			    const union nfcls_key *mask)
+{
+	struct nfcls_set *set = b->set;
+	struct nfcls_table *t;
+	unsigned int i;
+
+	for (i = 0; i < set->ntables; i++) {
+		if (nfcls_key_equal(&set->tables[i].mask, mask))
+			return i;
+	}
+	if (b->insert)
+		return -ENOENT;
+
+	if (set->ntables == b->tsize) {
+		unsigned int size = b->tsize ? b->tsize * 2 : 16;
+
+		t = krealloc(set->tables, size * sizeof(*t), GFP_KERNEL);
+		if (t == NULL)
+			return -ENOMEM;
+		set->tables = t;
+		b->tsize = size;
+	}
+	t = &set->tables[set->ntables];
+	memset(t, 0, sizeof(*t));
+	t->mask = *mask;
+	t->prio = UINT_MAX;
+	t->ports = mask->sport || mask->dport;
+	return set->ntables++;
+}
+
+/* First pass sizes the tables, the second one fills them. */
+static int nfcls_add_entry(struct nfcls_builder *b,
+			   const union nfcls_key *key,
+			   const union nfcls_key *mask,
+			   u32 prio, u32 verdict)
+{
+	struct nfcls_set *set = b->set;
+	struct nfcls_table *t;
+	struct nfcls_entry *e;
+	struct hlist_head *head;
+	struct hlist_node *n;
+	int i;
+
+	i = nfcls_find_table(b, mask);
+	if (i < 0)
+		return i;
+	t = &set->tables[i];
+
+	if (!b->insert) {
+		t->count++;
+		if (prio < t->prio)
+			t->prio = prio;
+		return 0;
+	}
+
+	head = &t->hash[nfcls_hash(key, set->seed) & t->hmask];
+	hlist_for_each_entry(e, n, head, node) {
+		/* rules are added in order, the earlier one wins */
+		if (nfcls_key_equal(&e->key, key))
+			return 0;
+	}
+	e = &set->entries[set->nentries++];
+	e->key = *key;
+	e->prio = prio;
+	e->verdict = verdict;
+	hlist_add_head(&e->node, head);
+	return 0;
+}
+
+static int nfcls_add_rule(struct nfcls_builder *b,
+			  const struct nfcls_rule *rule, u32 prio,
+			  const struct nfcls_expansion *exp)
+{
+	union nfcls_key key, mask;
+	unsigned int s, d, sp, dp;
+	int err;
+
+	memset(&key, 0, sizeof(key));
+	memset(&mask, 0, sizeof(mask));
+	key.proto = rule->proto;
+	mask.proto = rule->proto ? 0xff : 0;
+
+	for (s = 0; s < exp->nsrc; s++) {
+		key.saddr = htonl(exp->src[s].val);
+		mask.saddr = htonl(exp->src[s].mask);
+		for (d = 0; d < exp->ndst; d++) {
+			key.daddr = htonl(exp->dst[d].val);
+			mask.daddr = htonl(exp->dst[d].mask);
+			for (sp = 0; sp < exp->nsport; sp++) {
+				key.sport = htons(exp->sport[sp].val);
+				mask.sport = htons(exp->sport[sp].mask);
+				for (dp = 0; dp < exp->ndport; dp++) {
+					key.dport = htons(exp->dport[dp].val);
+					mask.dport = htons(exp->dport[dp].mask);
+					err = nfcls_add_entry(b, &key, &mask,
+							      prio,
+							      rule->verdict);
+					if (err < 0)
+						return err;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+static int nfcls_table_cmp(const void *a, const void *b)
+{
+	const struct nfcls_table *ta = a, *tb = b;
+
+	if (ta->prio != tb->prio)
+		return ta->prio < tb->prio ? -1 : 1;
+	return 0;
+}
+
+static struct nfcls_set *nfcls_compile(const struct nfcls_rules *rules,
+				       u32 policy)
+{
+	struct nfcls_builder b = { };
+	struct nfcls_expansion *exp;
+	struct nfcls_set *set;
+	unsigned long total = 0, nbuckets = 0;
+	unsigned int i, size;
+	int err = -ENOMEM;
+
+	exp = kmalloc(sizeof(*exp), GFP_KERNEL);
+	if (exp == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	set = kzalloc(sizeof(*set), GFP_KERNEL);
+	if (set == NULL)
+		goto err;
+	set->policy = policy;
+	get_random_bytes(&set->seed, sizeof(set->seed));
+	b.set = set;
+
+	for (i = 0; i < rules->count; i++) {
+		err = nfcls_expand(&rules->rule[i], exp);
+		if (err < 0)
+			goto err;
+		total += err;
+		if (total > NFCLS_ENTRIES_LIMIT) {
+			err = -E2BIG;
+			goto err;
+		}
+		err = nfcls_add_rule(&b, &rules->rule[i], i, exp);
+		if (err < 0)
+			goto err;
+	}
+
+	for (i = 0; i < set->ntables; i++)
+		nbuckets += roundup_pow_of_two(set->tables[i].count);
+
+	err = -ENOMEM;
+	if (total) {
+		set->entries = nfcls_alloc(total * sizeof(*set->entries));
+		set->buckets = nfcls_alloc(nbuckets * sizeof(*set->buckets));
+		if (set->entries == NULL || set->buckets == NULL)
+			goto err;
+	}
+
+	nbuckets = 0;
+	for (i = 0; i < set->ntables; i++) {
+		struct nfcls_table *t = &set->tables[i];
+
+		size = roundup_pow_of_two(t->count);
+		t->hash = &set->buckets[nbuckets];
+		t->hmask = size - 1;
+		nbuckets += size;
+	}
+
+	b.insert = true;
+	for (i = 0; i < rules->count; i++) {
+		nfcls_expand(&rules->rule[i], exp);
+		err = nfcls_add_rule(&b, &rules->rule[i], i, exp);
+		if (err < 0)
+			goto err;
+	}
+
+	/* the hash heads move along with their table */
+	sort(set->tables, set->ntables, sizeof(*set->tables),
+	     nfcls_table_cmp, NULL);
+
+	kfree(exp);
+	return set;
+err:
+	if (set != NULL)
+		nfcls_set_free(set);
+	kfree(exp);
+	return ERR_PTR(err);
+}
+
+/*
+ * Packet path
+ */
+
+static unsigned int nfcls_classify(const struct nfcls_set *set,
+				   const union nfcls_key *pkt, bool ports)
+{
+	const struct nfcls_table *t;
+	const struct nfcls_entry *e;
+	const struct hlist_node *n;
+	union nfcls_key key;
+	u32 best = UINT_MAX;
+	unsigned int verdict = set->policy;
+	unsigned int i;
+
+	for (i = 0; i < set->ntables; i++) {
+		t = &set->tables[i];
+		/* tables are sorted, nothing later can win anymore */
+		if (t->prio >= best)
+			break;
+		if (t->ports && !ports)
+			continue;
+
+		nfcls_key_mask(&key, pkt, &t->mask);
+		hlist_for_each_entry(e, n,
+				     &t->hash[nfcls_hash(&key, set->seed) &
+					      t->hmask], node) {
+			if (nfcls_key_equal(&e->key, &key)) {
+				if (e->prio < best) {
+					best = e->prio;
+					verdict = e->verdict;
+				}
+				break;
+			}
+		}
+	}
+	return verdict;
+}
+
+static inline bool nfcls_proto_has_ports(u8 proto)
+{
+	switch (proto) {
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+	case IPPROTO_UDPLITE:
+	case IPPROTO_SCTP:
+	case IPPROTO_DCCP:
+		return true;
+	}
+	return false;
+}
+
+static unsigned int
+nfcls_hook(unsigned int hooknum, struct sk_buff *skb,
+	   const struct net_device *in, const struct net_device *out,
+	   int (*okfn)(struct sk_buff *))
+{
+	const struct nfcls_set *set;
+	const struct iphdr *iph;
+	union nfcls_key key;
+	bool ports = false;
+
+	/* root is playing with raw sockets. */
+	if (skb->len < sizeof(struct iphdr) ||
+	    ip_hdrlen(skb) < sizeof(struct iphdr))
+		return NF_ACCEPT;
+
+	/* rcu_read_lock()ed by nf_hook_slow */
+	set = rcu_dereference(nfcls_pernet(dev_net(in ? in : out))->sets[hooknum]);
+	if (set == NULL)
+		return NF_ACCEPT;
+
+	iph = ip_hdr(skb);
+	memset(&key, 0, sizeof(key));
+	key.saddr = iph->saddr;
+	key.daddr = iph->daddr;
+	key.proto = iph->protocol;
+
+	/* Like xt_tcpudp, rules with ports never match fragments. */
+	if (!(iph->frag_off & htons(IP_OFFSET)) &&
+	    nfcls_proto_has_ports(iph->protocol)) {
+		const __be16 *pptr;
+		__be16 _ports[2];
+
+		pptr = skb_header_pointer(skb, ip_hdrlen(skb),
+					  sizeof(_ports), _ports);
+		if (pptr != NULL) {
+			key.sport = pptr[0];
+			key.dport = pptr[1];
+			ports = true;
+		}
+	}
+
+	return nfcls_classify(set, &key, ports);
+}
+
+static struct nf_hook_ops nfcls_ops[] __read_mostly = {
+	{
+		.hook		= nfcls_hook,
+		.owner		= THIS_MODULE,
+		.pf		= NFPROTO_IPV4,
+		.hooknum	= NF_INET_PRE_ROUTING,
+		.priority	= NF_IP_PRI_FILTER,
+	},
+	{
+		.hook		= nfcls_hook,
+		.owner		= THIS_MODULE,
+		.pf		= NFPROTO_IPV4,
+		.hooknum	= NF_INET_LOCAL_IN,
+		.priority	= NF_IP_PRI_FILTER,
+	},
+	{
+		.hook		= nfcls_hook,
+		.owner		= THIS_MODULE,
+		.pf		= NFPROTO_IPV4,
+		.hooknum	= NF_INET_FORWARD,
+		.priority	= NF_IP_PRI_FILTER,
+	},
+	{
+		.hook		= nfcls_hook,
+		.owner		= THIS_MODULE,
+		.pf		= NFPROTO_IPV4,
+		.hooknum	= NF_INET_LOCAL_OUT,
+		.priority	= NF_IP_PRI_FILTER,
+	},
+	{
+		.hook		= nfcls_hook,
+		.owner		= THIS_MODULE,
+		.pf		= NFPROTO_IPV4,
+		.hooknum	= NF_INET_POST_ROUTING,
+		.priority	= NF_IP_PRI_FILTER,
+	},
+};
+
+/*
+ * Netlink interface, serialized by the nfnetlink mutex.
+ */
+
+static const struct nla_policy nfcls_rule_policy[NFCLS_RULE_MAX+1] = {
+	[NFCLS_RULE_SRC]	= { .type = NLA_NESTED },
+	[NFCLS_RULE_DST]	= { .type = NLA_NESTED },
+	[NFCLS_RULE_PROTO]	= { .type = NLA_U8 },
+	[NFCLS_RULE_SPORTS]	= { .type = NLA_NESTED },
+	[NFCLS_RULE_DPORTS]	= { .type = NLA_NESTED },
+	[NFCLS_RULE_VERDICT]	= { .type = NLA_U32 },
+};
+
+static const struct nla_policy nfcls_addr_policy[NFCLS_RANGE_MAX+1] = {
+	[NFCLS_RANGE_FROM]	= { .type = NLA_U32 },
+	[NFCLS_RANGE_TO]	= { .type = NLA_U32 },
+};
+
+static const struct nla_policy nfcls_port_policy[NFCLS_RANGE_MAX+1] = {
+	[NFCLS_RANGE_FROM]	= { .type = NLA_U16 },
+	[NFCLS_RANGE_TO]	= { .type = NLA_U16 },
+};
+
+static int nfcls_parse_verdict(const struct nlattr *attr, u32 *verdict)
+{
+	u32 v = ntohl(nla_get_be32(attr));
+
+	if (v != NF_ACCEPT && v != NF_DROP)
+		return -EINVAL;
+	*verdict = v;
+	return 0;
+}
+
+static int nfcls_parse_hook(const struct nlattr * const tb[])
+{
+	u32 hook;
+
+	if (!tb[NFCLS_HOOK])
+		return -EINVAL;
+	hook = ntohl(nla_get_be32(tb[NFCLS_HOOK]));
+	if (hook >= NF_INET_NUMHOOKS)
+		return -EINVAL;
+	return hook;
+}
+
+static int nfcls_parse_addr(const struct nlattr *attr,
+			    struct nfcls_range *range)
+{
+	struct nlattr *tb[NFCLS_RANGE_MAX+1];
+	int err;
+
+	err = nla_parse_nested(tb, NFCLS_RANGE_MAX, attr, nfcls_addr_policy);
+	if (err < 0)
+		return err;
+	if (!tb[NFCLS_RANGE_FROM] || !tb[NFCLS_RANGE_TO])
+		return -EINVAL;
+
+	range->from = ntohl(nla_get_be32(tb[NFCLS_RANGE_FROM]));
+	range->to = ntohl(nla_get_be32(tb[NFCLS_RANGE_TO]));
+	if (range->from > range->to)
+		return -EINVAL;
+	return 0;
+}
+
+static int nfcls_parse_ports(const struct nlattr *attr,
+			     struct nfcls_port_range *range, u8 *count)
+{
+	struct nlattr *tb[NFCLS_RANGE_MAX+1];
+	const struct nlattr *nla;
+	int rem, err;
+
+	*count = 0;
+	nla_for_each_nested(nla, attr, rem) {
+		if (nla_type(nla) != NFCLS_PORTS_RANGE)
+			return -EINVAL;
+		if (*count >= NFCLS_MAX_PORTS)
+			return -E2BIG;
+
+		err = nla_parse_nested(tb, NFCLS_RANGE_MAX, nla,
+				       nfcls_port_policy);
+		if (err < 0)
+			return err;
+		if (!tb[NFCLS_RANGE_FROM] || !tb[NFCLS_RANGE_TO])
+			return -EINVAL;
+
+		range[*count].from = ntohs(nla_get_be16(tb[NFCLS_RANGE_FROM]));
+		range[*count].to = ntohs(nla_get_be16(tb[NFCLS_RANGE_TO]));
+		if (range[*count].from > range[*count].to)
+			return -EINVAL;
+		(*count)++;
+	}
+	return 0;
+}
+
+static int nfcls_parse_rule(const struct nlattr *attr, struct nfcls_rule *rule)
+{
+	struct nlattr *tb[NFCLS_RULE_MAX+1];
+	int err;
+
+	err = nla_parse_nested(tb, NFCLS_RULE_MAX, attr, nfcls_rule_policy);
+	if (err < 0)
+		return err;
+	if (!tb[NFCLS_RULE_VERDICT])
+		return -EINVAL;
+
+	memset(rule, 0, sizeof(*rule));
+	rule->src.to = UINT_MAX;
+	rule->dst.to = UINT_MAX;
+
+	err = nfcls_parse_verdict(tb[NFCLS_RULE_VERDICT], &rule->verdict);
+	if (err < 0)
+		return err;
+	if (tb[NFCLS_RULE_SRC]) {
+		err = nfcls_parse_addr(tb[NFCLS_RULE_SRC], &rule->src);
+		if (err < 0)
+			return err;
+	}
+	if (tb[NFCLS_RULE_DST]) {
+		err = nfcls_parse_addr(tb[NFCLS_RULE_DST], &rule->dst);
+		if (err < 0)
+			return err;
+	}
+	if (tb[NFCLS_RULE_PROTO])
+		rule->proto = nla_get_u8(tb[NFCLS_RULE_PROTO]);
+	if (tb[NFCLS_RULE_SPORTS]) {
+		err = nfcls_parse_ports(tb[NFCLS_RULE_SPORTS], rule->sports,
+					&rule->nsports);
+		if (err < 0)
+			return err;
+	}
+	if (tb[NFCLS_RULE_DPORTS]) {
+		err = nfcls_parse_ports(tb[NFCLS_RULE_DPORTS], rule->dports,
+					&rule->ndports);
+		if (err < 0)
+			return err;
+	}
+
+	/* ports only make sense for protocols that have them */
+	if ((rule->nsports || rule->ndports) &&
+	    !nfcls_proto_has_ports(rule->proto))
+		return -EINVAL;
+	return 0;
+}
+
+static int nfcls_rules_grow(struct nfcls_rules *rules)
+{
+	struct nfcls_rule *rule;
+	unsigned int size;
+
+	if (rules->size >= NFCLS_RULES_LIMIT)
+		return -E2BIG;
+
+	size = rules->size ? rules->size * 2 : 64;
+	rule = nfcls_alloc(size * sizeof(*rule));
+	if (rule == NULL)
+		return -ENOMEM;
+	if (rules->count)
+		memcpy(rule, rules->rule, rules->count * sizeof(*rule));
+	nfcls_free(rules->rule);
+	rules->rule = rule;
+	rules->size = size;
+	return 0;
+}
+
+static int
+nfcls_new(struct sock *nfnl, struct sk_buff *skb,
+	  const struct nlmsghdr *nlh, const struct nlattr * const tb[])
+{
+	struct nfcls_net *cn = nfcls_pernet(sock_net(nfnl));
+	struct nfcls_rules *staged;
+	const struct nlattr *attr;
+	unsigned int count;
+	int hook, rem, err;
+
+	hook = nfcls_parse_hook(tb);
+	if (hook < 0)
+		return hook;
+	staged = &cn->staged[hook];
+
+	if (!(nlh->nlmsg_flags & NLM_F_APPEND))
+		staged->count = 0;
+	if (!tb[NFCLS_RULES])
+		return 0;
+
+	count = staged->count;
+	nla_for_each_nested(attr, tb[NFCLS_RULES], rem) {
+		err = -EINVAL;
+		if (nla_type(attr) != NFCLS_RULE)
+			goto err;
+		if (staged->count == staged->size) {
+			err = nfcls_rules_grow(staged);
+			if (err < 0)
+				goto err;
+		}
+		err = nfcls_parse_rule(attr, &staged->rule[staged->count]);
+		if (err < 0)
+			goto err;
+		staged->count++;
+	}
+	return 0;
+err:
+	/* don't leave half of this message staged */
+	staged->count = count;
+	return err;
+}
+
+static int
+nfcls_commit(struct sock *nfnl, struct sk_buff *skb,
+	     const struct nlmsghdr *nlh, const struct nlattr * const tb[])
+{
+	struct nfcls_net *cn = nfcls_pernet(sock_net(nfnl));
+	struct nfcls_set *set, *old;
+	u32 policy = NF_ACCEPT;
+	int hook, err;
+
+	hook = nfcls_parse_hook(tb);
+	if (hook < 0)
+		return hook;
+	if (tb[NFCLS_POLICY]) {
+		err = nfcls_parse_verdict(tb[NFCLS_POLICY], &policy);
+		if (err < 0)
+			return err;
+	}
+
+	set = nfcls_compile(&cn->staged[hook], policy);
+	if (IS_ERR(set))
+		return PTR_ERR(set);
+
+	/* the compiled set keeps the rules for dumping */
+	set->rules = cn->staged[hook];
+	memset(&cn->staged[hook], 0, sizeof(cn->staged[hook]));
+
+	old = rcu_dereference_protected(cn->sets[hook], 1);
+	rcu_assign_pointer(cn->sets[hook], set);
+	if (old != NULL) {
+		synchronize_rcu();
+		nfcls_set_free(old);
+	}
+	return 0;
+}
+
+static int nfcls_fill_range(struct sk_buff *skb, int type,
+			    u32 from, u32 to, bool port)
+{
+	struct nlattr *nest;
+
+	nest = nla_nest_start(skb, type);
+	if (nest == NULL)
+		goto nla_put_failure;
+	if (port) {
+		NLA_PUT_BE16(skb, NFCLS_RANGE_FROM, htons(from));
+		NLA_PUT_BE16(skb, NFCLS_RANGE_TO, htons(to));
+	} else {
+		NLA_PUT_BE32(skb, NFCLS_RANGE_FROM, htonl(from));
+		NLA_PUT_BE32(skb, NFCLS_RANGE_TO, htonl(to));
+	}
+	nla_nest_end(skb, nest);
+	return 0;
+
+nla_put_failure:
+	return -1;
+}
+
+static int nfcls_fill_ports(struct sk_buff *skb, int type,
+			    const struct nfcls_port_range *range,
+			    unsigned int count)
+{
+	struct nlattr *nest;
+	unsigned int i;
+
+	nest = nla_nest_start(skb, type);
+	if (nest == NULL)
+		return -1;
+	for (i = 0; i < count; i++) {
+		if (nfcls_fill_range(skb, NFCLS_PORTS_RANGE, range[i].from,
+				     range[i].to, true) < 0)
+			return -1;
+	}
+	nla_nest_end(skb, nest);
+	return 0;
+}
+
+static int nfcls_fill_rule(struct sk_buff *skb, const struct nfcls_rule *rule)
+{
+	struct nlattr *nest;
+
+	nest = nla_nest_start(skb, NFCLS_RULE);
+	if (nest == NULL)
+		goto nla_put_failure;
+
+	NLA_PUT_BE32(skb, NFCLS_RULE_VERDICT, htonl(rule->verdict));
+	if ((rule->src.from != 0 || rule->src.to != UINT_MAX) &&
+	    nfcls_fill_range(skb, NFCLS_RULE_SRC, rule->src.from,
+			     rule->src.to, false) < 0)
+		goto nla_put_failure;
+	if ((rule->dst.from != 0 || rule->dst.to != UINT_MAX) &&
+	    nfcls_fill_range(skb, NFCLS_RULE_DST, rule->dst.from,
+			     rule->dst.to, false) < 0)
+		goto nla_put_failure;
+	if (rule->proto)
+		NLA_PUT_U8(skb, NFCLS_RULE_PROTO, rule->proto);
+	if (rule->nsports &&
+	    nfcls_fill_ports(skb, NFCLS_RULE_SPORTS, rule->sports,
+			     rule->nsports) < 0)
+		goto nla_put_failure;
+	if (rule->ndports &&
+	    nfcls_fill_ports(skb, NFCLS_RULE_DPORTS, rule->dports,
+			     rule->ndports) < 0)
+		goto nla_put_failure;
+
+	nla_nest_end(skb, nest);
+	return 0;
+
+nla_put_failure:
+	if (nest != NULL)
+		nla_nest_cancel(skb, nest);
+	return -1;
+}
+
+/* Fill in the ruleset of a hook starting at rule *pos.  Rules that don't
+ * fit are left for the next message, *pos tells where to resume.
+ */
+static int
+nfcls_fill_info(struct sk_buff *skb, u32 pid, u32 seq, int event,
+		unsigned int hook, const struct nfcls_set *set,
+		unsigned int *pos)
+{
+	struct nlmsghdr *nlh;
+	struct nfgenmsg *nfmsg;
+	struct nlattr *nest;
+	unsigned int flags = pos ? NLM_F_MULTI : 0;
+
+	event |= NFNL_SUBSYS_CLASSIFIER << 8;
+	nlh = nlmsg_put(skb, pid, seq, event, sizeof(*nfmsg), flags);
+	if (nlh == NULL)
+		goto nlmsg_failure;
+
+	nfmsg = nlmsg_data(nlh);
+	nfmsg->nfgen_family = AF_INET;
+	nfmsg->version = NFNETLINK_V0;
+	nfmsg->res_id = 0;
+
+	NLA_PUT_BE32(skb, NFCLS_HOOK, htonl(hook));
+	NLA_PUT_BE32(skb, NFCLS_POLICY, htonl(set->policy));
+	NLA_PUT_BE32(skb, NFCLS_NRULES, htonl(set->rules.count));
+	NLA_PUT_BE32(skb, NFCLS_NENTRIES, htonl(set->nentries));
+	NLA_PUT_BE32(skb, NFCLS_NTABLES, htonl(set->ntables));
+
+	if (pos != NULL) {
+		nest = nla_nest_start(skb, NFCLS_RULES);
+		if (nest == NULL)
+			goto nla_put_failure;
+		for (; *pos < set->rules.count; (*pos)++) {
+			if (nfcls_fill_rule(skb, &set->rules.rule[*pos]) < 0)
+				break;
+		}
+		nla_nest_end(skb, nest);
+	}
+
+	nlmsg_end(skb, nlh);
+	return skb->len;
+
+nlmsg_failure:
+nla_put_failure:
+	nlmsg_cancel(skb, nlh);
+	return -1;
+}
+
+/* cb->args[0] is the hook, cb->args[1] the next rule to dump. */
+static int
+nfcls_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct nfcls_net *cn = nfcls_pernet(sock_net(skb->sk));
+	const struct nfcls_set *set;
+	unsigned int pos;
+
+	rcu_read_lock();
+	for (; cb->args[0] < NF_INET_NUMHOOKS; cb->args[0]++) {
+		set = rcu_dereference(cn->sets[cb->args[0]]);
+		if (set == NULL)
+			continue;
+
+		pos = cb->args[1];
+		if (nfcls_fill_info(skb, NETLINK_CB(cb->skb).pid,
+				    cb->nlh->nlmsg_seq, NFNL_MSG_CLS_NEW,
+				    cb->args[0], set, &pos) < 0)
+			break;
+		cb->args[1] = pos;
+		/* message full, resume with the remaining rules */
+		if (pos < set->rules.count)
+			break;
+		cb->args[1] = 0;
+	}
+	rcu_read_unlock();
+	return skb->len;
+}
+
+static int
+nfcls_get(struct sock *nfnl, struct sk_buff *skb,
+	  const struct nlmsghdr *nlh, const struct nlattr * const tb[])
+{
+	struct nfcls_net *cn = nfcls_pernet(sock_net(nfnl));
+	const struct nfcls_set *set;
+	struct sk_buff *skb2;
+	int hook, ret;
+
+	if (nlh->nlmsg_flags & NLM_F_DUMP) {
+		struct netlink_dump_control c = {
+			.dump = nfcls_dump,
+		};
+		return netlink_dump_start(nfnl, skb, nlh, &c);
+	}
+
+	hook = nfcls_parse_hook(tb);
+	if (hook < 0)
+		return hook;
+	set = rcu_dereference_protected(cn->sets[hook], 1);
+	if (set == NULL)
+		return -ENOENT;
+
+	skb2 = nlmsg_new(NLMSG_DEFAULT_SIZE, GFP_KERNEL);
+	if (skb2 == NULL)
+		return -ENOMEM;
+
+	/* summary only, the rules are available through a dump */
+	ret = nfcls_fill_info(skb2, NETLINK_CB(skb).pid, nlh->nlmsg_seq,
+			      NFNL_MSG_CLS_NEW, hook, set, NULL);
+	if (ret <= 0) {
+		kfree_skb(skb2);
+		return -ENOMEM;
+	}
+	ret = netlink_unicast(nfnl, skb2, NETLINK_CB(skb).pid, MSG_DONTWAIT);
+	if (ret > 0)
+		ret = 0;
+
+	/* this avoids a loop in nfnetlink. */
+	return ret == -EAGAIN ? -ENOBUFS : ret;
+}
+
+static int
+nfcls_del(struct sock *nfnl, struct sk_buff *skb,
+	  const struct nlmsghdr *nlh, const struct nlattr * const tb[])
+{
+	struct nfcls_net *cn = nfcls_pernet(sock_net(nfnl));
+	struct nfcls_set *old;
+	int hook;
+
+	hook = nfcls_parse_hook(tb);
+	if (hook < 0)
+		return hook;
+
+	nfcls_rules_free(&cn->staged[hook]);
+	old = rcu_dereference_protected(cn->sets[hook], 1);
+	if (old == NULL)
+		return -ENOENT;
+
+	RCU_INIT_POINTER(cn->sets[hook], NULL);
+	synchronize_rcu();
+	nfcls_set_free(old);
+	return 0;
+}
+
+static const struct nla_policy nfcls_policy[NFCLS_MAX+1] = {
+	[NFCLS_HOOK]		= { .type = NLA_U32 },
+	[NFCLS_POLICY]		= { .type = NLA_U32 },
+	[NFCLS_RULES]		= { .type = NLA_NESTED },
+};
+
+static const struct nfnl_callback nfcls_cb[NFNL_MSG_CLS_MAX] = {
+	[NFNL_MSG_CLS_NEW]	= { .call = nfcls_new,
+				    .attr_count = NFCLS_MAX,
+				    .policy = nfcls_policy },
+	[NFNL_MSG_CLS_COMMIT]	= { .call = nfcls_commit,
+				    .attr_count = NFCLS_MAX,
+				    .policy = nfcls_policy },
+	[NFNL_MSG_CLS_GET]	= { .call = nfcls_get,
+				    .attr_count = NFCLS_MAX,
+				    .policy = nfcls_policy },
+	[NFNL_MSG_CLS_DEL]	= { .call = nfcls_del,
+				    .attr_count = NFCLS_MAX,
+				    .policy = nfcls_policy },
+};
+
+static const struct nfnetlink_subsystem nfcls_subsys = {
+	.name				= "classifier",
+	.subsys_id			= NFNL_SUBSYS_CLASSIFIER,
+	.cb_count			= NFNL_MSG_CLS_MAX,
+	.cb				= nfcls_cb,
+};
+
+MODULE_ALIAS_NFNL_SUBSYS(NFNL_SUBSYS_CLASSIFIER);
+
+static void __net_exit nfcls_net_exit(struct net *net)
+{
+	struct nfcls_net *cn = nfcls_pernet(net);
+	struct nfcls_set *old[NF_INET_NUMHOOKS];
+	int hook;
+
+	for (hook = 0; hook < NF_INET_NUMHOOKS; hook++) {
+		old[hook] = rcu_dereference_protected(cn->sets[hook], 1);
+		RCU_INIT_POINTER(cn->sets[hook], NULL);
+		nfcls_rules_free(&cn->staged[hook]);
+	}
+	synchronize_rcu();
+	for (hook = 0; hook < NF_INET_NUMHOOKS; hook++) {
+		if (old[hook] != NULL)
+			nfcls_set_free(old[hook]);
+	}
+}
+
+static struct pernet_operations nfcls_net_ops = {
+	.exit	= nfcls_net_exit,
+	.id	= &nfcls_net_id,
+	.size	= sizeof(struct nfcls_net),
+};
+
+static int __init nfcls_init(void)
+{
+	int ret;
+
+	ret = register_pernet_subsys(&nfcls_net_ops);
+	if (ret < 0)
+		goto err_pernet;
+
+	ret = nf_register_hooks(nfcls_ops, ARRAY_SIZE(nfcls_ops));
+	if (ret < 0)
+		goto err_hooks;
+
+	ret = nfnetlink_subsys_register(&nfcls_subsys);
+	if (ret < 0) {
+		pr_err("nfcls_init: cannot register with nfnetlink.\n");
+		goto err_subsys;
+	}
+	return 0;
+
+err_subsys:
+	nf_unregister_hooks(nfcls_ops, ARRAY_SIZE(nfcls_ops));
+err_hooks:
+	unregister_pernet_subsys(&nfcls_net_ops);
+err_pernet:
+	return ret;
+}
+
+static void __exit nfcls_exit(void)
+{
+	nfnetlink_subsys_unregister(&nfcls_subsys);
+	nf_unregister_hooks(nfcls_ops, ARRAY_SIZE(nfcls_ops));
+	unregister_pernet_subsys(&nfcls_net_ops);
+}
+
+module_init(nfcls_init);
+module_exit(nfcls_exit);
@@ -243,6 +243,8 @@ struct packet_ring_buffer {
 
 struct packet_sock;
 static int tpacket_snd(struct packet_sock *po, struct msghdr *msg);
+static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
+		       struct packet_type *pt, struct net_device *orig_dev);
 
 static void *packet_previous_frame(struct packet_sock *po,
 		struct packet_ring_buffer *rb,
@@ -307,6 +309,7 @@ struct packet_fanout {
 	u16			id;
 	u8			type;
 	u8			defrag;
+	u8			rollover;
 	atomic_t		rr_cur;
 	struct list_head	list;
 	struct sock		*arr[PACKET_FANOUT_MAX];
@@ -404,6 +407,7 @@ static void __packet_set_status(struct packet_sock *po, void *frame, int status)
 	union {
 		struct tpacket_hdr *h1;
 		struct tpacket2_hdr *h2;
+		struct tpacket3_hdr *h3;
 		void *raw;
 	} h;
 
@@ -418,6 +422,10 @@ static void __packet_set_status(struct packet_sock *po, void *frame, int status)
 		flush_dcache_page(pgv_to_page(&h.h2->tp_status));
 		break;
 	case TPACKET_V3:
+		/* only Tx rings are made of single frames in V3 */
+		h.h3->tp_status = status;
+		flush_dcache_page(pgv_to_page(&h.h3->tp_status));
+		break;
 	default:
 		WARN(1, "TPACKET version not supported.\n");
 		BUG();
@@ -431,6 +439,7 @@ static int __packet_get_status(struct packet_sock *po, void *frame)
 	union {
 		struct tpacket_hdr *h1;
 		struct tpacket2_hdr *h2;
+		struct tpacket3_hdr *h3;
 		void *raw;
 	} h;
 
@@ -445,6 +454,8 @@ static int __packet_get_status(struct packet_sock *po, void *frame)
 		flush_dcache_page(pgv_to_page(&h.h2->tp_status));
 		return h.h2->tp_status;
 	case TPACKET_V3:
+		flush_dcache_page(pgv_to_page(&h.h3->tp_status));
+		return h.h3->tp_status;
 	default:
 		WARN(1, "TPACKET version not supported.\n");
 		BUG();
@@ -1185,16 +1196,14 @@ static int fanout_rr_next(struct packet_fanout *f, unsigned int num)
 	return x;
 }
 
-static struct sock *fanout_demux_hash(struct packet_fanout *f, struct sk_buff *skb, unsigned int num)
+static unsigned int fanout_demux_hash(struct packet_fanout *f, struct sk_buff *skb, unsigned int num)
 {
-	u32 idx, hash = skb->rxhash;
-
-	idx = ((u64)hash * num) >> 32;
+	u32 hash = skb->rxhash;
 
-	return f->arr[idx];
+	return ((u64)hash * num) >> 32;
 }
 
-static struct sock *fanout_demux_lb(struct packet_fanout *f, struct sk_buff *skb, unsigned int num)
+static unsigned int fanout_demux_lb(struct packet_fanout *f, struct sk_buff *skb, unsigned int num)
 {
 	int cur, old;
 
@@ -1202,14 +1211,55 @@ static struct sock *fanout_demux_lb(struct packet_fanout *f, struct sk_buff *skb
 	while ((old = atomic_cmpxchg(&f->rr_cur, cur,
 				     fanout_rr_next(f, num))) != cur)
 		cur = old;
-	return f->arr[cur];
+	return cur;
 }
 
-static struct sock *fanout_demux_cpu(struct packet_fanout *f, struct sk_buff *skb, unsigned int num)
+static unsigned int fanout_demux_cpu(struct packet_fanout *f, struct sk_buff *skb, unsigned int num)
 {
 	unsigned int cpu = smp_processor_id();
 
-	return f->arr[cpu % num];
+	return cpu % num;
+}
+
+/* would the socket queue this packet rather than drop it? */
+static bool packet_rcv_has_room(struct packet_sock *po, struct sk_buff *skb)
+{
+	struct sock *sk = &po->sk;
+	bool has_room;
+
+	if (po->prot_hook.func != tpacket_rcv)
+		return (atomic_read(&sk->sk_rmem_alloc) + skb->truesize)
+			<= sk->sk_rcvbuf;
+
+	spin_lock(&sk->sk_receive_queue.lock);
+	if (po->tp_version == TPACKET_V3)
+		has_room = !prb_queue_frozen(&po->rx_ring.prb_bdqc);
+	else
+		has_room = packet_current_frame(po, &po->rx_ring,
+						TP_STATUS_KERNEL) != NULL;
+	spin_unlock(&sk->sk_receive_queue.lock);
+
+	return has_room;
+}
+
+/* starting at idx, find the first member other than skip with room for
+ * the packet; when every ring is full the packet stays with idx
+ */
+static unsigned int fanout_demux_rollover(struct packet_fanout *f,
+					  struct sk_buff *skb,
+					  unsigned int idx, unsigned int skip,
+					  unsigned int num)
+{
+	unsigned int i = idx;
+
+	do {
+		if (i != skip && packet_rcv_has_room(pkt_sk(f->arr[i]), skb))
+			return i;
+		if (++i == num)
+			i = 0;
+	} while (i != idx);
+
+	return idx;
 }
 
 static int packet_rcv_fanout(struct sk_buff *skb, struct net_device *dev,
@@ -1218,7 +1268,7 @@ static int packet_rcv_fanout(struct sk_buff *skb, struct net_device *dev,
 	struct packet_fanout *f = pt->af_packet_priv;
 	unsigned int num = f->num_members;
 	struct packet_sock *po;
-	struct sock *sk;
+	unsigned int idx;
 
 	if (!net_eq(dev_net(dev), read_pnet(&f->net)) ||
 	    !num) {
@@ -1235,17 +1285,24 @@ static int packet_rcv_fanout(struct sk_buff *skb, struct net_device *dev,
 				return 0;
 		}
 		skb_get_rxhash(skb);
-		sk = fanout_demux_hash(f, skb, num);
+		idx = fanout_demux_hash(f, skb, num);
 		break;
 	case PACKET_FANOUT_LB:
-		sk = fanout_demux_lb(f, skb, num);
+		idx = fanout_demux_lb(f, skb, num);
 		break;
 	case PACKET_FANOUT_CPU:
-		sk = fanout_demux_cpu(f, skb, num);
+		idx = fanout_demux_cpu(f, skb, num);
+		break;
+	case PACKET_FANOUT_ROLLOVER:
+		idx = fanout_demux_rollover(f, skb, 0, (unsigned int) -1, num);
 		break;
 	}
 
-	po = pkt_sk(sk);
+	po = pkt_sk(f->arr[idx]);
+	if (f->rollover && !packet_rcv_has_room(po, skb)) {
+		idx = fanout_demux_rollover(f, skb, idx, idx, num);
+		po = pkt_sk(f->arr[idx]);
+	}
 
 	return po->prot_hook.func(skb, dev, &po->prot_hook, orig_dev);
 }
@@ -1294,9 +1351,14 @@ static int fanout_add(struct sock *sk, u16 id, u16 type_flags)
 	struct packet_fanout *f, *match;
 	u8 type = type_flags & 0xff;
 	u8 defrag = (type_flags & PACKET_FANOUT_FLAG_DEFRAG) ? 1 : 0;
+	u8 rollover = (type_flags & PACKET_FANOUT_FLAG_ROLLOVER) ? 1 : 0;
 	int err;
 
 	switch (type) {
+	case PACKET_FANOUT_ROLLOVER:
+		if (rollover)
+			return -EINVAL;
+		/* fall through */
 	case PACKET_FANOUT_HASH:
 	case PACKET_FANOUT_LB:
 	case PACKET_FANOUT_CPU:
@@ -1321,7 +1383,8 @@ static int fanout_add(struct sock *sk, u16 id, u16 type_flags)
 		}
 	}
 	err = -EINVAL;
-	if (match && match->defrag != defrag)
+	if (match && (match->defrag != defrag ||
+		      match->rollover != rollover))
 		goto out;
 	if (!match) {
 		err = -ENOMEM;
@@ -1332,6 +1395,7 @@ static int fanout_add(struct sock *sk, u16 id, u16 type_flags)
 		match->id = id;
 		match->type = type;
 		match->defrag = defrag;
+		match->rollover = rollover;
 		atomic_set(&match->rr_cur, 0);
 		INIT_LIST_HEAD(&match->list);
 		spin_lock_init(&match->lock);
@@ -1967,6 +2031,7 @@ static int tpacket_fill_skb(struct packet_sock *po, struct sk_buff *skb,
 	union {
 		struct tpacket_hdr *h1;
 		struct tpacket2_hdr *h2;
+		struct tpacket3_hdr *h3;
 		void *raw;
 	} ph;
 	int to_write, offset, len, tp_len, nr_frags, len_max;
@@ -1987,6 +2052,14 @@ static int tpacket_fill_skb(struct packet_sock *po, struct sk_buff *skb,
 	case TPACKET_V2:
 		tp_len = ph.h2->tp_len;
 		break;
+	case TPACKET_V3:
+		/* frames are sent one by one, chaining is not supported */
+		if (unlikely(ph.h3->tp_next_offset != 0)) {
+			pr_err("variable sized slot not supported\n");
+			return -EINVAL;
+		}
+		tp_len = ph.h3->tp_len;
+		break;
 	default:
 		tp_len = ph.h1->tp_len;
 		break;
@@ -3605,10 +3678,15 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 	/* Added to avoid minimal code churn */
 	struct tpacket_req *req = &req_u->req;
 
-	/* Opening a Tx-ring is NOT supported in TPACKET_V3 */
-	if (!closing && tx_ring && (po->tp_version > TPACKET_V2)) {
-		WARN(1, "Tx-ring is not supported.\n");
-		goto out;
+	/* A TPACKET_V3 Tx-ring is made of fixed size frames, like V2:
+	 * the block retire timer and private area only apply to Rx
+	 */
+	if (!closing && tx_ring && po->tp_version == TPACKET_V3) {
+		struct tpacket_req3 *req3 = &req_u->req3;
+
+		if (req3->tp_retire_blk_tov || req3->tp_sizeof_priv ||
+		    req3->tp_feature_req_word)
+			goto out;
 	}
 
 	rb = tx_ring ? &po->tx_ring : &po->rx_ring;
@@ -3665,12 +3743,10 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 			goto out;
 		switch (po->tp_version) {
 		case TPACKET_V3:
-		/* Transmit path is not supported. We checked
-		 * it above but just being paranoid
-		 */
+			/* Block transmit is not supported yet */
 			if (!tx_ring)
 				init_prb_bdqc(po, rb, pg_vec, req_u, tx_ring);
-				break;
+			break;
 		default:
 			break;
 		}
@@ -0,0 +1,345 @@
+/*
+ * net/sched/cls_bpf.c	eBPF Packet Classifier.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Each filter runs a BPF_PROG_TYPE_SCHED_CLS program loaded with the bpf()
+ * system call.  The program returns 0 if the packet does not match, -1 to
+ * select the class configured with TCA_BPF_CLASSID, or the classid itself.
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/rtnetlink.h>
+#include <linux/skbuff.h>
+#include <linux/bpf.h>
+#include <net/netlink.h>
+#include <net/act_api.h>
+#include <net/pkt_cls.h>
+
+struct cls_bpf_head {
+	u32			hgenerator;
+	struct list_head	flist;
+};
+
+struct cls_bpf_filter {
+	u32			handle;
+	u32			prog_fd;	/* as given by the user, for dumps */
+	struct bpf_prog		*prog;
+	struct tcf_exts		exts;
+	struct tcf_result	res;
+	struct list_head	link;
+};
+
+static const struct tcf_ext_map cls_bpf_ext_map = {
+	.action = TCA_BPF_ACT,
+	.police = TCA_BPF_POLICE
+};
+
+static int cls_bpf_classify(struct sk_buff *skb, const struct tcf_proto *tp,
+			    struct tcf_result *res)
+{
+	struct cls_bpf_head *head = (struct cls_bpf_head *) tp->root;
+	struct cls_bpf_filter *f;
+	unsigned int filter_res;
+	int r;
+
+	list_for_each_entry(f, &head->flist, link) {
+		/* map helpers expect to run under rcu_read_lock() */
+		rcu_read_lock();
+		filter_res = BPF_PROG_RUN(f->prog, skb);
+		rcu_read_unlock();
+
+		if (filter_res == 0)
+			continue;
+
+		*res = f->res;
+		if (filter_res != -1U)
+			res->classid = filter_res;
+
+		r = tcf_exts_exec(skb, &f->exts, res);
+		if (r < 0)
+			continue;
+		return r;
+	}
+	return -1;
+}
+
+static unsigned long cls_bpf_get(struct tcf_proto *tp, u32 handle)
+{
+	struct cls_bpf_head *head = (struct cls_bpf_head *) tp->root;
+	struct cls_bpf_filter *f;
+
+	if (head == NULL)
+		return 0UL;
+
+	list_for_each_entry(f, &head->flist, link)
+		if (f->handle == handle)
+			return (unsigned long) f;
+
+	return 0UL;
+}
+
+static void cls_bpf_put(struct tcf_proto *tp, unsigned long f)
+{
+}
+
+static int cls_bpf_init(struct tcf_proto *tp)
+{
+	struct cls_bpf_head *head;
+
+	head = kzalloc(sizeof(*head), GFP_KERNEL);
+	if (head == NULL)
+		return -ENOBUFS;
+	INIT_LIST_HEAD(&head->flist);
+	tp->root = head;
+	return 0;
+}
+
+static void cls_bpf_delete_filter(struct tcf_proto *tp,
+				  struct cls_bpf_filter *f)
+{
+	tcf_unbind_filter(tp, &f->res);
+	tcf_exts_destroy(tp, &f->exts);
+	if (f->prog)
+		bpf_prog_put(f->prog);
+	kfree(f);
+}
+
+static void cls_bpf_destroy(struct tcf_proto *tp)
+{
+	struct cls_bpf_head *head = tp->root;
+	struct cls_bpf_filter *f, *n;
+
+	list_for_each_entry_safe(f, n, &head->flist, link) {
+		list_del(&f->link);
+		cls_bpf_delete_filter(tp, f);
+	}
+	kfree(head);
+}
+
+static int cls_bpf_delete(struct tcf_proto *tp, unsigned long arg)
+{
+	struct cls_bpf_head *head = (struct cls_bpf_head *) tp->root;
+	struct cls_bpf_filter *t, *f = (struct cls_bpf_filter *) arg;
+
+	list_for_each_entry(t, &head->flist, link)
+		if (t == f) {
+			tcf_tree_lock(tp);
+			list_del(&t->link);
+			tcf_tree_unlock(tp);
+			cls_bpf_delete_filter(tp, t);
+			return 0;
+		}
+
+	return -ENOENT;
+}
+
+static const struct nla_policy cls_bpf_policy[TCA_BPF_MAX + 1] = {
+	[TCA_BPF_CLASSID]	= { .type = NLA_U32 },
+	[TCA_BPF_FD]		= { .type = NLA_U32 },
+};
+
+static int cls_bpf_set_parms(struct tcf_proto *tp, struct cls_bpf_filter *f,
+			     unsigned long base, struct nlattr **tb,
+			     struct nlattr *est)
+{
+	struct bpf_prog *prog = NULL, *old_prog;
+	struct tcf_exts e;
+	u32 ufd = 0;
+	int err;
+
+	if (!f->prog && !tb[TCA_BPF_FD])
+		return -EINVAL;
+
+	err = tcf_exts_validate(tp, tb, est, &e, &cls_bpf_ext_map);
+	if (err < 0)
+		return err;
+
+	if (tb[TCA_BPF_FD]) {
+		ufd = nla_get_u32(tb[TCA_BPF_FD]);
+		prog = bpf_prog_get(ufd);
+		if (IS_ERR(prog)) {
+			err = PTR_ERR(prog);
+			goto errout;
+		}
+
+		if (prog->type != BPF_PROG_TYPE_SCHED_CLS) {
+			bpf_prog_put(prog);
+			err = -EINVAL;
+			goto errout;
+		}
+	}
+
+	if (tb[TCA_BPF_CLASSID]) {
+		f->res.classid = nla_get_u32(tb[TCA_BPF_CLASSID]);
+		tcf_bind_filter(tp, &f->res, base);
+	}
+
+	tcf_exts_change(tp, &f->exts, &e);
+
+	if (prog) {
+		tcf_tree_lock(tp);
+		old_prog = f->prog;
+		f->prog = prog;
+		f->prog_fd = ufd;
+		tcf_tree_unlock(tp);
+
+		if (old_prog)
+			bpf_prog_put(old_prog);
+	}
+
+	return 0;
+errout:
+	tcf_exts_destroy(tp, &e);
+	return err;
+}
+
+static int cls_bpf_change(struct tcf_proto *tp, unsigned long base, u32 handle,
+			  struct nlattr **tca, unsigned long *arg)
+{
+	struct cls_bpf_head *head = (struct cls_bpf_head *) tp->root;
+	struct cls_bpf_filter *f = (struct cls_bpf_filter *) *arg;
+	struct nlattr *tb[TCA_BPF_MAX + 1];
+	int err;
+
+	if (tca[TCA_OPTIONS] == NULL)
+		return -EINVAL;
+
+	err = nla_parse_nested(tb, TCA_BPF_MAX, tca[TCA_OPTIONS],
+			       cls_bpf_policy);
+	if (err < 0)
+		return err;
+
+	if (f != NULL) {
+		if (handle && f->handle != handle)
+			return -EINVAL;
+		return cls_bpf_set_parms(tp, f, base, tb, tca[TCA_RATE]);
+	}
+
+	err = -ENOBUFS;
+	f = kzalloc(sizeof(*f), GFP_KERNEL);
+	if (f == NULL)
+		goto errout;
+
+	err = -EINVAL;
+	if (handle)
+		f->handle = handle;
+	else {
+		unsigned int i = 0x80000000;
+		do {
+			if (++head->hgenerator == 0x7FFFFFFF)
+				head->hgenerator = 1;
+		} while (--i > 0 && cls_bpf_get(tp, head->hgenerator));
+
+		if (i <= 0) {
+			pr_err("Insufficient number of handles\n");
+			goto errout;
+		}
+
+		f->handle = head->hgenerator;
+	}
+
+	err = cls_bpf_set_parms(tp, f, base, tb, tca[TCA_RATE]);
+	if (err < 0)
+		goto errout;
+
+	tcf_tree_lock(tp);
+	list_add(&f->link, &head->flist);
+	tcf_tree_unlock(tp);
+	*arg = (unsigned long) f;
+
+	return 0;
+errout:
+	if (*arg == 0UL && f)
+		kfree(f);
+
+	return err;
+}
+
+static void cls_bpf_walk(struct tcf_proto *tp, struct tcf_walker *arg)
+{
+	struct cls_bpf_head *head = (struct cls_bpf_head *) tp->root;
+	struct cls_bpf_filter *f;
+
+	list_for_each_entry(f, &head->flist, link) {
+		if (arg->count < arg->skip)
+			goto skip;
+
+		if (arg->fn(tp, (unsigned long) f, arg) < 0) {
+			arg->stop = 1;
+			break;
+		}
+skip:
+		arg->count++;
+	}
+}
+
+static int cls_bpf_dump(struct tcf_proto *tp, unsigned long fh,
+			struct sk_buff *skb, struct tcmsg *t)
+{
+	struct cls_bpf_filter *f = (struct cls_bpf_filter *) fh;
+	struct nlattr *nest;
+
+	if (f == NULL)
+		return skb->len;
+
+	t->tcm_handle = f->handle;
+
+	nest = nla_nest_start(skb, TCA_OPTIONS);
+	if (nest == NULL)
+		goto nla_put_failure;
+
+	if (f->res.classid)
+		NLA_PUT_U32(skb, TCA_BPF_CLASSID, f->res.classid);
+
+	NLA_PUT_U32(skb, TCA_BPF_FD, f->prog_fd);
+
+	if (tcf_exts_dump(skb, &f->exts, &cls_bpf_ext_map) < 0)
+		goto nla_put_failure;
+
+	nla_nest_end(skb, nest);
+
+	if (tcf_exts_dump_stats(skb, &f->exts, &cls_bpf_ext_map) < 0)
+		goto nla_put_failure;
+
+	return skb->len;
+
+nla_put_failure:
+	nla_nest_cancel(skb, nest);
+	return -1;
+}
+
+static struct tcf_proto_ops cls_bpf_ops __read_mostly = {
+	.kind		=	"bpf",
+	.classify	=	cls_bpf_classify,
+	.init		=	cls_bpf_init,
+	.destroy	=	cls_bpf_destroy,
+	.get		=	cls_bpf_get,
+	.put		=	cls_bpf_put,
+	.change		=	cls_bpf_change,
+	.delete		=	cls_bpf_delete,
+	.walk		=	cls_bpf_walk,
+	.dump		=	cls_bpf_dump,
+	.owner		=	THIS_MODULE,
+};
+
+static int __init cls_bpf_init_mod(void)
+{
+	return register_tcf_proto_ops(&cls_bpf_ops);
+}
+
+static void __exit cls_bpf_exit_mod(void)
+{
+	unregister_tcf_proto_ops(&cls_bpf_ops);
+}
+
+module_init(cls_bpf_init_mod)
+module_exit(cls_bpf_exit_mod)
+MODULE_LICENSE("GPL");
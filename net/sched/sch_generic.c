@@ -39,39 +39,109 @@
  * - updates to tree and tree walking are only done under the rtnl mutex.
  */
 
+/*
+ * A batch is a list of packets for one tx queue linked through skb->next.
+ * A GSO packet can only be the last one of a batch, since its skb->next
+ * carries the segments dev_hard_start_xmit() has yet to send.
+ */
+static inline struct sk_buff *qdisc_batch_next(const struct sk_buff *skb)
+{
+	return skb_is_gso(skb) ? NULL : skb->next;
+}
+
 static inline int dev_requeue_skb(struct sk_buff *skb, struct Qdisc *q)
 {
-	skb_dst_force(skb);
+	struct sk_buff *nskb;
+
+	for (nskb = skb; nskb; nskb = qdisc_batch_next(nskb)) {
+		skb_dst_force(nskb);
+		q->q.qlen++;	/* it's still part of the queue */
+	}
 	q->gso_skb = skb;
 	q->qstats.requeues++;
-	q->q.qlen++;	/* it's still part of the queue */
 	__netif_schedule(q);
 
 	return 0;
 }
 
-static inline struct sk_buff *dequeue_skb(struct Qdisc *q)
+/*
+ * Bytes the driver can still take according to BQL.  Drivers that do not
+ * use BQL report nothing, so they never get batches.
+ */
+static inline int qdisc_avail_bulklimit(const struct netdev_queue *txq)
+{
+#ifdef CONFIG_BQL
+	return dql_avail(&txq->dql);
+#else
+	return 0;
+#endif
+}
+
+static void try_bulk_dequeue_skb(struct Qdisc *q, struct sk_buff *skb,
+				 const struct netdev_queue *txq,
+				 int *packets)
+{
+	int bytelimit = qdisc_avail_bulklimit(txq) - skb->len;
+
+	while (bytelimit > 0 && !skb_is_gso(skb)) {
+		struct sk_buff *nskb = q->dequeue(q);
+
+		if (!nskb)
+			break;
+
+		bytelimit -= nskb->len;
+		skb->next = nskb;
+		skb = nskb;
+		(*packets)++;
+	}
+}
+
+/*
+ * Returns the next batch.  *validate tells the caller whether it still has
+ * to run validate_xmit_skb_list() on it: a requeued batch already went
+ * through it before its first attempt.
+ */
+static inline struct sk_buff *dequeue_skb(struct Qdisc *q, bool *validate,
+					  int *packets)
 {
 	struct sk_buff *skb = q->gso_skb;
+	const struct netdev_queue *txq = q->dev_queue;
 
+	*packets = 1;
+	*validate = true;
 	if (unlikely(skb)) {
 		struct net_device *dev = qdisc_dev(q);
-		struct netdev_queue *txq;
+		struct sk_buff *nskb;
 
 		/* check the reason of requeuing without tx lock first */
 		txq = netdev_get_tx_queue(dev, skb_get_queue_mapping(skb));
 		if (!netif_xmit_frozen_or_stopped(txq)) {
 			q->gso_skb = NULL;
-			q->q.qlen--;
+			for (nskb = skb; nskb; nskb = qdisc_batch_next(nskb))
+				q->q.qlen--;
+			*validate = false;
 		} else
 			skb = NULL;
 	} else {
 		skb = q->dequeue(q);
+		if (skb && (q->flags & TCQ_F_ONETXQUEUE) &&
+		    !(qdisc_dev(q)->features & NETIF_F_LLTX))
+			try_bulk_dequeue_skb(q, skb, txq, packets);
 	}
 
 	return skb;
 }
 
+static void qdisc_batch_free(struct sk_buff *skb)
+{
+	while (skb) {
+		struct sk_buff *next = qdisc_batch_next(skb);
+
+		kfree_skb(skb);
+		skb = next;
+	}
+}
+
 static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 					   struct netdev_queue *dev_queue,
 					   struct Qdisc *q)
@@ -85,7 +155,7 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 		 * detect it by checking xmit owner and drop the packet when
 		 * deadloop is detected. Return OK to try the next skb.
 		 */
-		kfree_skb(skb);
+		qdisc_batch_free(skb);
 		if (net_ratelimit())
 			pr_warning("Dead loop on netdevice %s, fix it urgently!\n",
 				   dev_queue->dev->name);
@@ -103,9 +173,12 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 }
 
 /*
- * Transmit one skb, and handle the return status as required. Holding the
- * __QDISC_STATE_RUNNING bit guarantees that only one CPU can execute this
- * function.
+ * Transmit a batch of skbs, and handle the return status as required.
+ * Every packet but the last is sent with the xmit_more hint so the driver
+ * only has to notify the hardware once.  The batch is validated before the
+ * tx lock is taken, so no packet can be dropped after one carrying the hint
+ * went out and leave the doorbell unrung.  Holding the __QDISC_STATE_RUNNING
+ * bit guarantees that only one CPU can execute this function.
  *
  * Returns to the caller:
  *				0  - queue is empty or throttled.
@@ -113,23 +186,44 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
  */
 int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 		    struct net_device *dev, struct netdev_queue *txq,
-		    spinlock_t *root_lock)
+		    spinlock_t *root_lock, bool validate)
 {
 	int ret = NETDEV_TX_BUSY;
 
 	/* And release qdisc */
 	spin_unlock(root_lock);
 
+	if (validate) {
+		skb = validate_xmit_skb_list(skb, dev);
+		if (!skb) {
+			spin_lock(root_lock);
+			return qdisc_qlen(q);
+		}
+	}
+
 	HARD_TX_LOCK(dev, txq, smp_processor_id());
-	if (!netif_xmit_frozen_or_stopped(txq))
-		ret = dev_hard_start_xmit(skb, dev, txq);
+	while (skb && !netif_xmit_frozen_or_stopped(txq)) {
+		struct sk_buff *next = qdisc_batch_next(skb);
+
+		if (next)
+			skb->next = NULL;
+		ret = dev_hard_start_xmit(skb, dev, txq, next != NULL);
+		if (!dev_xmit_complete(ret)) {
+			if (next)
+				skb->next = next;
+			break;
+		}
+		skb = next;
+	}
+	if (skb && dev_xmit_complete(ret))
+		ret = NETDEV_TX_BUSY;	/* queue stopped within the batch */
 
 	HARD_TX_UNLOCK(dev, txq);
 
 	spin_lock(root_lock);
 
-	if (dev_xmit_complete(ret)) {
-		/* Driver sent out skb successfully or skb was consumed */
+	if (!skb) {
+		/* Driver sent out skbs successfully or skbs were consumed */
 		ret = qdisc_qlen(q);
 	} else if (ret == NETDEV_TX_LOCKED) {
 		/* Driver try lock failed */
@@ -168,15 +262,16 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
  *				>0 - queue is not empty.
  *
  */
-static inline int qdisc_restart(struct Qdisc *q)
+static inline int qdisc_restart(struct Qdisc *q, int *packets)
 {
 	struct netdev_queue *txq;
 	struct net_device *dev;
 	spinlock_t *root_lock;
 	struct sk_buff *skb;
+	bool validate;
 
 	/* Dequeue packet */
-	skb = dequeue_skb(q);
+	skb = dequeue_skb(q, &validate, packets);
 	if (unlikely(!skb))
 		return 0;
 	WARN_ON_ONCE(skb_dst_is_noref(skb));
@@ -184,20 +279,22 @@ static inline int qdisc_restart(struct Qdisc *q)
 	dev = qdisc_dev(q);
 	txq = netdev_get_tx_queue(dev, skb_get_queue_mapping(skb));
 
-	return sch_direct_xmit(skb, q, dev, txq, root_lock);
+	return sch_direct_xmit(skb, q, dev, txq, root_lock, validate);
 }
 
 void __qdisc_run(struct Qdisc *q)
 {
 	int quota = weight_p;
+	int packets;
 
-	while (qdisc_restart(q)) {
+	while (qdisc_restart(q, &packets)) {
 		/*
 		 * Ordered by possible occurrence: Postpone processing if
 		 * 1. we've exceeded packet quota
 		 * 2. another process needs the CPU;
 		 */
-		if (--quota <= 0 || need_resched()) {
+		quota -= packets;
+		if (quota <= 0 || need_resched()) {
 			__netif_schedule(q);
 			break;
 		}
@@ -576,6 +673,8 @@ struct Qdisc *qdisc_alloc(struct netdev_queue *dev_queue,
 	sch->enqueue = ops->enqueue;
 	sch->dequeue = ops->dequeue;
 	sch->dev_queue = dev_queue;
+	if (!netif_is_multiqueue(qdisc_dev(sch)))
+		sch->flags |= TCQ_F_ONETXQUEUE;
 	dev_hold(qdisc_dev(sch));
 	atomic_set(&sch->refcnt, 1);
 
@@ -613,7 +712,7 @@ void qdisc_reset(struct Qdisc *qdisc)
 		ops->reset(qdisc);
 
 	if (qdisc->gso_skb) {
-		kfree_skb(qdisc->gso_skb);
+		qdisc_batch_free(qdisc->gso_skb);
 		qdisc->gso_skb = NULL;
 		qdisc->q.qlen = 0;
 	}
@@ -649,7 +748,7 @@ void qdisc_destroy(struct Qdisc *qdisc)
 	module_put(ops->owner);
 	dev_put(qdisc_dev(qdisc));
 
-	kfree_skb(qdisc->gso_skb);
+	qdisc_batch_free(qdisc->gso_skb);
 	/*
 	 * gen_estimator est_timer() might access qdisc->q.lock,
 	 * wait a RCU grace period before freeing qdisc.
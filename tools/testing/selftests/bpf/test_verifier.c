@@ -0,0 +1,917 @@
+/*
+ * test_verifier:
+ *
+ * Loads small eBPF programs with the bpf() system call and checks that the
+ * verifier accepts or rejects each one, and that a rejection is reported
+ * with the expected message in the verifier log.  The cases cover
+ * malformed programs, uninitialized registers and stack, context, map
+ * value and packet bounds, division by zero and leaks of kernel pointers.
+ *
+ * Some accepted socket filters are also attached to a UDP socket with
+ * SO_ATTACH_BPF to check what they do at run time, e.g. that a division
+ * by a zero register ends the program with 0 and so drops the datagram.
+ * Whether the interpreter or the JIT runs them depends on
+ * net.core.bpf_jit_enable.
+ *
+ * Needs CAP_SYS_ADMIN.
+ *
+ * Usage: test_verifier [-v]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../../../../include/linux/bpf.h"
+
+#ifndef __NR_bpf
+# if defined(__x86_64__)
+#  define __NR_bpf 321
+# elif defined(__i386__)
+#  define __NR_bpf 357
+# else
+#  error __NR_bpf not defined
+# endif
+#endif
+
+/* include/asm-generic/socket.h of this tree */
+#undef SO_ATTACH_BPF
+#define SO_ATTACH_BPF	45
+
+#define BPF_ALU64_REG(OP, DST, SRC)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU64 | BPF_OP(OP) | BPF_X,	\
+		.dst_reg = DST, .src_reg = SRC })
+
+#define BPF_ALU32_REG(OP, DST, SRC)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU | BPF_OP(OP) | BPF_X,		\
+		.dst_reg = DST, .src_reg = SRC })
+
+#define BPF_ALU64_IMM(OP, DST, IMM)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU64 | BPF_OP(OP) | BPF_K,	\
+		.dst_reg = DST, .imm = IMM })
+
+#define BPF_ALU32_IMM(OP, DST, IMM)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU | BPF_OP(OP) | BPF_K,		\
+		.dst_reg = DST, .imm = IMM })
+
+#define BPF_MOV64_REG(DST, SRC)					\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU64 | BPF_MOV | BPF_X,		\
+		.dst_reg = DST, .src_reg = SRC })
+
+#define BPF_MOV32_REG(DST, SRC)					\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU | BPF_MOV | BPF_X,		\
+		.dst_reg = DST, .src_reg = SRC })
+
+#define BPF_MOV64_IMM(DST, IMM)					\
+	((struct bpf_insn) {					\
+		.code  = BPF_ALU64 | BPF_MOV | BPF_K,		\
+		.dst_reg = DST, .imm = IMM })
+
+/* two instructions, the second one only carries the upper half */
+#define BPF_LD_MAP_FD(DST, MAP_FD)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_LD | BPF_DW | BPF_IMM,		\
+		.dst_reg = DST, .src_reg = BPF_PSEUDO_MAP_FD,	\
+		.imm = MAP_FD }),				\
+	((struct bpf_insn) { .code = 0 })
+
+#define BPF_LD_ABS(SIZE, IMM)					\
+	((struct bpf_insn) {					\
+		.code  = BPF_LD | BPF_SIZE(SIZE) | BPF_ABS,	\
+		.imm = IMM })
+
+#define BPF_LDX_MEM(SIZE, DST, SRC, OFF)			\
+	((struct bpf_insn) {					\
+		.code  = BPF_LDX | BPF_SIZE(SIZE) | BPF_MEM,	\
+		.dst_reg = DST, .src_reg = SRC, .off = OFF })
+
+#define BPF_STX_MEM(SIZE, DST, SRC, OFF)			\
+	((struct bpf_insn) {					\
+		.code  = BPF_STX | BPF_SIZE(SIZE) | BPF_MEM,	\
+		.dst_reg = DST, .src_reg = SRC, .off = OFF })
+
+#define BPF_STX_XADD(SIZE, DST, SRC, OFF)			\
+	((struct bpf_insn) {					\
+		.code  = BPF_STX | BPF_SIZE(SIZE) | BPF_XADD,	\
+		.dst_reg = DST, .src_reg = SRC, .off = OFF })
+
+#define BPF_ST_MEM(SIZE, DST, OFF, IMM)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_ST | BPF_SIZE(SIZE) | BPF_MEM,	\
+		.dst_reg = DST, .off = OFF, .imm = IMM })
+
+#define BPF_JMP_REG(OP, DST, SRC, OFF)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_JMP | BPF_OP(OP) | BPF_X,		\
+		.dst_reg = DST, .src_reg = SRC, .off = OFF })
+
+#define BPF_JMP_IMM(OP, DST, IMM, OFF)				\
+	((struct bpf_insn) {					\
+		.code  = BPF_JMP | BPF_OP(OP) | BPF_K,		\
+		.dst_reg = DST, .off = OFF, .imm = IMM })
+
+#define BPF_RAW_INSN(CODE, DST, SRC, OFF, IMM)			\
+	((struct bpf_insn) {					\
+		.code  = CODE, .dst_reg = DST, .src_reg = SRC,	\
+		.off = OFF, .imm = IMM })
+
+#define BPF_CALL_FUNC(FUNC)					\
+	BPF_RAW_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, FUNC)
+
+#define BPF_EXIT_INSN()						\
+	((struct bpf_insn) { .code = BPF_JMP | BPF_EXIT })
+
+/* r2 = fp - 8, with a zeroed key there, and r1 = the test map */
+#define MAP_KEY_ON_STACK(MAP_INSN)				\
+	BPF_ST_MEM(BPF_DW, BPF_REG_10, -8, 0),			\
+	BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),			\
+	BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -8),			\
+	BPF_LD_MAP_FD(BPF_REG_1, 0)
+
+/* r2 = xdp_md->data, r3 = xdp_md->data_end, r4 = data + 8, r0 = XDP_PASS */
+#define PKT_PTRS						\
+	BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,		\
+		    offsetof(struct xdp_md, data)),		\
+	BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_1,		\
+		    offsetof(struct xdp_md, data_end)),		\
+	BPF_MOV64_IMM(BPF_REG_0, XDP_PASS),			\
+	BPF_MOV64_REG(BPF_REG_4, BPF_REG_2),			\
+	BPF_ALU64_IMM(BPF_ADD, BPF_REG_4, 8)
+
+#define MAX_INSNS	32
+#define MAX_FIXUPS	4
+
+enum { ACCEPT, REJECT };
+enum { RUN_NONE, RUN_DELIVERED, RUN_DROPPED };
+
+struct bpf_test {
+	const char	*descr;
+	struct bpf_insn	insns[MAX_INSNS];
+	int		fixup[MAX_FIXUPS];	/* insns that load the map fd */
+	const char	*errstr;
+	int		result;
+	enum bpf_prog_type prog_type;		/* socket filter if unset */
+	int		run;			/* socket filters only */
+};
+
+static struct bpf_test tests[] = {
+	/* malformed programs */
+	{
+		"unreachable instruction",
+		.insns = {
+			BPF_EXIT_INSN(),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "unreachable insn 1",
+		.result = REJECT,
+	},
+	{
+		"jump out of range",
+		.insns = {
+			BPF_JMP_IMM(BPF_JA, 0, 0, 1),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "jump out of range from insn 0 to 2",
+		.result = REJECT,
+	},
+	{
+		"loop",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_JMP_IMM(BPF_JA, 0, 0, -2),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "back-edge from insn 1 to 0",
+		.result = REJECT,
+	},
+	{
+		"unknown instruction class",
+		.insns = {
+			BPF_RAW_INSN(BPF_RET | BPF_K, 0, 0, 0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "unknown insn class 6",
+		.result = REJECT,
+	},
+	{
+		"ld_imm64 without its second half",
+		.insns = {
+			BPF_RAW_INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_0, 0, 0, 1),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid bpf_ld_imm64 insn",
+		.result = REJECT,
+	},
+	{
+		"call to an unknown function",
+		.insns = {
+			BPF_CALL_FUNC(1234),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid func 1234",
+		.result = REJECT,
+	},
+
+	/* registers and stack */
+	{
+		"R0 not set at exit",
+		.insns = {
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "R0 !read_ok",
+		.result = REJECT,
+	},
+	{
+		"read of an uninitialized register",
+		.insns = {
+			BPF_MOV64_REG(BPF_REG_0, BPF_REG_2),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "R2 !read_ok",
+		.result = REJECT,
+	},
+	{
+		"write to the frame pointer",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_10, 0),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "frame pointer is read only",
+		.result = REJECT,
+	},
+	{
+		"read of uninitialized stack",
+		.insns = {
+			BPF_LDX_MEM(BPF_DW, BPF_REG_0, BPF_REG_10, -8),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid read from stack off -8+0 size 8",
+		.result = REJECT,
+	},
+	{
+		"stack write above the frame",
+		.insns = {
+			BPF_ST_MEM(BPF_DW, BPF_REG_10, 8, 0),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid stack off=8 size=8",
+		.result = REJECT,
+	},
+	{
+		"misaligned stack write",
+		.insns = {
+			BPF_ST_MEM(BPF_DW, BPF_REG_10, -4, 0),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "misaligned access off -4 size 8",
+		.result = REJECT,
+	},
+	{
+		"stack write and read",
+		.insns = {
+			BPF_ST_MEM(BPF_DW, BPF_REG_10, -8, 1),
+			BPF_LDX_MEM(BPF_DW, BPF_REG_0, BPF_REG_10, -8),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+	},
+
+	/* context */
+	{
+		"context read",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_1,
+				    offsetof(struct __sk_buff, mark)),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+	},
+	{
+		"context read past the end",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_1,
+				    sizeof(struct __sk_buff)),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid bpf_context access off=84 size=4",
+		.result = REJECT,
+	},
+	{
+		"context read of fields rewritten into several insns",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_1,
+				    offsetof(struct __sk_buff, pkt_type)),
+			BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+				    offsetof(struct __sk_buff, vlan_present)),
+			BPF_ALU64_REG(BPF_ADD, BPF_REG_0, BPF_REG_2),
+			BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+				    offsetof(struct __sk_buff, vlan_tci)),
+			BPF_ALU64_REG(BPF_ADD, BPF_REG_0, BPF_REG_2),
+			BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+				    offsetof(struct __sk_buff, ifindex)),
+			BPF_ALU64_REG(BPF_ADD, BPF_REG_0, BPF_REG_2),
+			BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+				    offsetof(struct __sk_buff, cb[4])),
+			BPF_ALU64_REG(BPF_ADD, BPF_REG_0, BPF_REG_2),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+	},
+	{
+		"jump across a context read rewritten into several insns",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+				    offsetof(struct __sk_buff, len)),
+			BPF_MOV64_IMM(BPF_REG_0, 1),
+			BPF_JMP_IMM(BPF_JNE, BPF_REG_2, 0, 1),
+			BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_1,
+				    offsetof(struct __sk_buff, ifindex)),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+		.run = RUN_DELIVERED,
+	},
+	{
+		"context read of direct packet pointers",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_1,
+				    offsetof(struct __sk_buff, data)),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid bpf_context access off=76 size=4",
+		.result = REJECT,
+	},
+	{
+		"context write",
+		.insns = {
+			BPF_ST_MEM(BPF_W, BPF_REG_1,
+				   offsetof(struct __sk_buff, mark), 0),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid bpf_context access off=8 size=4",
+		.result = REJECT,
+	},
+	{
+		"LD_ABS with the context in R6",
+		.insns = {
+			BPF_MOV64_REG(BPF_REG_6, BPF_REG_1),
+			BPF_LD_ABS(BPF_B, 0),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+	},
+	{
+		"LD_ABS without the context in R6",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_6, 0),
+			BPF_LD_ABS(BPF_B, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "at the time of BPF_LD_ABS|IND R6 != pointer to skb",
+		.result = REJECT,
+	},
+	{
+		"LD_ABS in an XDP program",
+		.insns = {
+			BPF_MOV64_REG(BPF_REG_6, BPF_REG_1),
+			BPF_LD_ABS(BPF_B, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "BPF_LD_ABS|IND instructions not allowed for this program type",
+		.result = REJECT,
+		.prog_type = BPF_PROG_TYPE_XDP,
+	},
+
+	/* maps */
+	{
+		"map value access after the NULL check",
+		.insns = {
+			MAP_KEY_ON_STACK(),
+			BPF_CALL_FUNC(BPF_FUNC_map_lookup_elem),
+			BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 2),
+			BPF_ST_MEM(BPF_DW, BPF_REG_0, 0, 42),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.fixup = {3},
+		.result = ACCEPT,
+	},
+	{
+		"map value access without the NULL check",
+		.insns = {
+			MAP_KEY_ON_STACK(),
+			BPF_CALL_FUNC(BPF_FUNC_map_lookup_elem),
+			BPF_ST_MEM(BPF_DW, BPF_REG_0, 0, 42),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.fixup = {3},
+		.errstr = "R0 invalid mem access 'map_value_or_null'",
+		.result = REJECT,
+	},
+	{
+		"map value read past the end",
+		.insns = {
+			MAP_KEY_ON_STACK(),
+			BPF_CALL_FUNC(BPF_FUNC_map_lookup_elem),
+			BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 2),
+			BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_0, 8),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.fixup = {3},
+		.errstr = "invalid access to map value, value_size=8 off=8 size=8",
+		.result = REJECT,
+	},
+	{
+		"map key not initialized",
+		.insns = {
+			BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -8),
+			BPF_LD_MAP_FD(BPF_REG_1, 0),
+			BPF_CALL_FUNC(BPF_FUNC_map_lookup_elem),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.fixup = {2},
+		.errstr = "invalid indirect read from stack off -8+0 size 8",
+		.result = REJECT,
+	},
+
+	/* division by zero */
+	{
+		"division by a zero constant",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_0, 1),
+			BPF_ALU64_IMM(BPF_DIV, BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "div by zero",
+		.result = REJECT,
+	},
+	{
+		"32-bit modulo by a zero constant",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_0, 1),
+			BPF_ALU32_IMM(BPF_MOD, BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "div by zero",
+		.result = REJECT,
+	},
+	{
+		"shift by the register width",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_0, 1),
+			BPF_ALU64_IMM(BPF_LSH, BPF_REG_0, 64),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid shift 64",
+		.result = REJECT,
+	},
+	{
+		"division by a zero register returns 0",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_0, -1),
+			BPF_MOV64_IMM(BPF_REG_1, 0),
+			BPF_ALU64_REG(BPF_DIV, BPF_REG_0, BPF_REG_1),
+			BPF_MOV64_IMM(BPF_REG_0, -1),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+		.run = RUN_DROPPED,
+	},
+	{
+		"32-bit modulo by a zero register returns 0",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_0, -1),
+			BPF_MOV64_IMM(BPF_REG_1, 0),
+			BPF_ALU32_REG(BPF_MOD, BPF_REG_0, BPF_REG_1),
+			BPF_MOV64_IMM(BPF_REG_0, -1),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+		.run = RUN_DROPPED,
+	},
+	{
+		"division by a non-zero register",
+		.insns = {
+			BPF_MOV64_IMM(BPF_REG_0, -1),
+			BPF_MOV64_IMM(BPF_REG_1, 1),
+			BPF_ALU64_REG(BPF_DIV, BPF_REG_0, BPF_REG_1),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+		.run = RUN_DELIVERED,
+	},
+
+	/* packet access, XDP */
+	{
+		"packet read without a length check",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+				    offsetof(struct xdp_md, data)),
+			BPF_LDX_MEM(BPF_B, BPF_REG_0, BPF_REG_2, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid access to packet, off=0 size=1, R2 range=0",
+		.result = REJECT,
+		.prog_type = BPF_PROG_TYPE_XDP,
+	},
+	{
+		"packet read within the checked length",
+		.insns = {
+			PKT_PTRS,
+			BPF_JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, 1),
+			BPF_LDX_MEM(BPF_B, BPF_REG_0, BPF_REG_2, 7),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+		.prog_type = BPF_PROG_TYPE_XDP,
+	},
+	{
+		"packet read past the checked length",
+		.insns = {
+			PKT_PTRS,
+			BPF_JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, 1),
+			BPF_LDX_MEM(BPF_B, BPF_REG_0, BPF_REG_2, 8),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid access to packet, off=8 size=1, R2 range=8",
+		.result = REJECT,
+		.prog_type = BPF_PROG_TYPE_XDP,
+	},
+	{
+		"packet read where the length check failed",
+		.insns = {
+			PKT_PTRS,
+			BPF_JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, 1),
+			BPF_EXIT_INSN(),
+			BPF_LDX_MEM(BPF_B, BPF_REG_0, BPF_REG_2, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "invalid access to packet, off=0 size=1, R2 range=0",
+		.result = REJECT,
+		.prog_type = BPF_PROG_TYPE_XDP,
+	},
+	{
+		"packet read after a data_end >= data + len check",
+		.insns = {
+			PKT_PTRS,
+			BPF_JMP_REG(BPF_JGE, BPF_REG_3, BPF_REG_4, 1),
+			BPF_EXIT_INSN(),
+			BPF_LDX_MEM(BPF_B, BPF_REG_0, BPF_REG_2, 7),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+		.prog_type = BPF_PROG_TYPE_XDP,
+	},
+	{
+		"packet write within the checked length",
+		.insns = {
+			PKT_PTRS,
+			BPF_JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, 1),
+			BPF_ST_MEM(BPF_W, BPF_REG_2, 4, 0),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+		.prog_type = BPF_PROG_TYPE_XDP,
+	},
+	{
+		"packet pointer moved by a register",
+		.insns = {
+			PKT_PTRS,
+			BPF_ALU64_REG(BPF_ADD, BPF_REG_2, BPF_REG_0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "R2 pointer arithmetic prohibited",
+		.result = REJECT,
+		.prog_type = BPF_PROG_TYPE_XDP,
+	},
+
+	/* pointer leaks */
+	{
+		"leak pointer as return value",
+		.insns = {
+			BPF_MOV64_REG(BPF_REG_0, BPF_REG_10),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "R0 leaks addr as return value",
+		.result = REJECT,
+	},
+	{
+		"leak pointer into map value",
+		.insns = {
+			BPF_MOV64_REG(BPF_REG_6, BPF_REG_1),
+			MAP_KEY_ON_STACK(),
+			BPF_CALL_FUNC(BPF_FUNC_map_lookup_elem),
+			BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 1),
+			BPF_STX_MEM(BPF_DW, BPF_REG_0, BPF_REG_6, 0),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.fixup = {4},
+		.errstr = "R6 leaks addr into map",
+		.result = REJECT,
+	},
+	{
+		"leak pointer into packet",
+		.insns = {
+			PKT_PTRS,
+			BPF_JMP_REG(BPF_JGT, BPF_REG_4, BPF_REG_3, 1),
+			BPF_STX_MEM(BPF_DW, BPF_REG_2, BPF_REG_2, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "R2 leaks addr into packet",
+		.result = REJECT,
+		.prog_type = BPF_PROG_TYPE_XDP,
+	},
+	{
+		"leak pointer into helper argument",
+		.insns = {
+			BPF_ST_MEM(BPF_DW, BPF_REG_10, -8, 0),
+			BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+			BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -8),
+			BPF_MOV64_REG(BPF_REG_3, BPF_REG_2),
+			BPF_MOV64_REG(BPF_REG_4, BPF_REG_10),
+			BPF_LD_MAP_FD(BPF_REG_1, 0),
+			BPF_CALL_FUNC(BPF_FUNC_map_update_elem),
+			BPF_EXIT_INSN(),
+		},
+		.fixup = {5},
+		.errstr = "R4 leaks addr into helper function",
+		.result = REJECT,
+	},
+	{
+		"leak pointer through atomic add",
+		.insns = {
+			BPF_ST_MEM(BPF_DW, BPF_REG_10, -8, 0),
+			BPF_STX_XADD(BPF_DW, BPF_REG_10, BPF_REG_1, -8),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "R1 leaks addr into mem",
+		.result = REJECT,
+	},
+	{
+		"pointer arithmetic",
+		.insns = {
+			BPF_MOV64_REG(BPF_REG_0, BPF_REG_1),
+			BPF_ALU64_IMM(BPF_AND, BPF_REG_0, 0xff),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "R0 pointer arithmetic prohibited",
+		.result = REJECT,
+	},
+	{
+		"partial copy of pointer",
+		.insns = {
+			BPF_MOV32_REG(BPF_REG_0, BPF_REG_1),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "R1 partial copy of pointer",
+		.result = REJECT,
+	},
+	{
+		"pointer compared with a scalar",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+				    offsetof(struct __sk_buff, len)),
+			BPF_MOV64_IMM(BPF_REG_0, 0),
+			BPF_JMP_REG(BPF_JGT, BPF_REG_1, BPF_REG_2, 1),
+			BPF_MOV64_IMM(BPF_REG_0, 1),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "R1 pointer comparison prohibited",
+		.result = REJECT,
+	},
+	{
+		"spill and fill of the context",
+		.insns = {
+			BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_1, -8),
+			BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_10, -8),
+			BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_6,
+				    offsetof(struct __sk_buff, len)),
+			BPF_EXIT_INSN(),
+		},
+		.result = ACCEPT,
+	},
+	{
+		"leak pointer filled from the stack",
+		.insns = {
+			BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_1, -8),
+			BPF_LDX_MEM(BPF_DW, BPF_REG_0, BPF_REG_10, -8),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "R0 leaks addr as return value",
+		.result = REJECT,
+	},
+	{
+		"leak pointer on a path pruned against a scalar",
+		.insns = {
+			BPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_1,
+				    offsetof(struct __sk_buff, len)),
+			BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 2),
+			BPF_MOV64_REG(BPF_REG_2, BPF_REG_0),
+			BPF_JMP_IMM(BPF_JA, 0, 0, 1),
+			BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+			BPF_MOV64_REG(BPF_REG_0, BPF_REG_2),
+			BPF_EXIT_INSN(),
+		},
+		.errstr = "R0 leaks addr as return value",
+		.result = REJECT,
+	},
+};
+
+static int verbose_log;
+static char bpf_log_buf[65536];
+
+static __u64 ptr_to_u64(const void *ptr)
+{
+	return (__u64) (unsigned long) ptr;
+}
+
+static int create_map(void)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = BPF_MAP_TYPE_HASH;
+	attr.key_size = sizeof(long long);
+	attr.value_size = sizeof(long long);
+	attr.max_entries = 1024;
+	return syscall(__NR_bpf, BPF_MAP_CREATE, &attr, sizeof(attr));
+}
+
+static int load_prog(enum bpf_prog_type type, const struct bpf_insn *insns,
+		     int len)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = type;
+	attr.insns = ptr_to_u64(insns);
+	attr.insn_cnt = len;
+	attr.license = ptr_to_u64("GPL");
+	attr.log_buf = ptr_to_u64(bpf_log_buf);
+	attr.log_size = sizeof(bpf_log_buf);
+	attr.log_level = 1;
+	bpf_log_buf[0] = 0;
+	return syscall(__NR_bpf, BPF_PROG_LOAD, &attr, sizeof(attr));
+}
+
+/* number of instructions up to the last non-zero one */
+static int prog_len(const struct bpf_insn *insns)
+{
+	int len;
+
+	for (len = MAX_INSNS; len > 0; len--)
+		if (insns[len - 1].code || insns[len - 1].imm)
+			break;
+	return len;
+}
+
+/* Attach the program to a UDP socket and send it a datagram.  Returns 1 if
+ * the datagram was received, 0 if not, -1 on error.
+ */
+static int run_prog(int prog_fd)
+{
+	struct sockaddr_in addr;
+	socklen_t alen = sizeof(addr);
+	struct timeval tv = { .tv_sec = 0, .tv_usec = 200000 };
+	char c = 'x';
+	int rfd, sfd, ret = -1;
+
+	rfd = socket(AF_INET, SOCK_DGRAM, 0);
+	sfd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (rfd < 0 || sfd < 0)
+		goto out;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(rfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    getsockname(rfd, (struct sockaddr *)&addr, &alen) < 0)
+		goto out;
+	setsockopt(rfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	if (setsockopt(rfd, SOL_SOCKET, SO_ATTACH_BPF, &prog_fd,
+		       sizeof(prog_fd)) < 0) {
+		perror("SO_ATTACH_BPF");
+		goto out;
+	}
+
+	if (sendto(sfd, &c, 1, 0, (struct sockaddr *)&addr,
+		   sizeof(addr)) < 0)
+		goto out;
+	ret = recv(rfd, &c, 1, 0) == 1;
+out:
+	if (rfd >= 0)
+		close(rfd);
+	if (sfd >= 0)
+		close(sfd);
+	return ret;
+}
+
+static int do_test_single(struct bpf_test *test, int map_fd)
+{
+	enum bpf_prog_type type = test->prog_type ?: BPF_PROG_TYPE_SOCKET_FILTER;
+	int len = prog_len(test->insns);
+	int *fixup = test->fixup;
+	int prog_fd, ret;
+
+	for (; *fixup; fixup++)
+		test->insns[*fixup].imm = map_fd;
+
+	prog_fd = load_prog(type, test->insns, len);
+
+	if (test->result == ACCEPT) {
+		if (prog_fd < 0) {
+			printf("FAIL\n  failed to load prog '%s'\n",
+			       strerror(errno));
+			goto fail_log;
+		}
+	} else {
+		if (prog_fd >= 0) {
+			printf("FAIL\n  unexpected success to load\n");
+			goto fail_log;
+		}
+		if (strstr(bpf_log_buf, test->errstr) == NULL) {
+			printf("FAIL\n  unexpected error message: %s\n",
+			       bpf_log_buf[0] ? bpf_log_buf : strerror(errno));
+			goto fail_log;
+		}
+	}
+
+	if (test->run != RUN_NONE) {
+		ret = run_prog(prog_fd);
+		if (ret < 0 || ret != (test->run == RUN_DELIVERED)) {
+			printf("FAIL\n  datagram %s\n",
+			       ret < 0 ? "could not be sent" :
+			       ret ? "was delivered" : "was dropped");
+			goto fail;
+		}
+	}
+
+	printf("OK\n");
+	if (prog_fd >= 0)
+		close(prog_fd);
+	return 0;
+
+fail_log:
+	if (verbose_log)
+		printf("%s", bpf_log_buf);
+fail:
+	if (prog_fd >= 0)
+		close(prog_fd);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	int map_fd, i, errors = 0;
+
+	if (argc > 1 && strcmp(argv[1], "-v") == 0)
+		verbose_log = 1;
+
+	map_fd = create_map();
+	if (map_fd < 0) {
+		if (errno == ENOSYS || errno == EPERM) {
+			printf("[SKIP] test_verifier: %s\n", strerror(errno));
+			return 0;
+		}
+		printf("failed to create map '%s'\n", strerror(errno));
+		return 1;
+	}
+
+	for (i = 0; i < (int)(sizeof(tests) / sizeof(tests[0])); i++) {
+		printf("#%d %s ", i, tests[i].descr);
+		errors += do_test_single(&tests[i], map_fd);
+	}
+	close(map_fd);
+
+	if (errors) {
+		printf("[FAIL] %d of %d tests failed\n", errors, i);
+		return 1;
+	}
+	printf("[PASS] %d tests\n", i);
+	return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * fq_flows:
+ *
+ * Opens a large number of TCP flows over the loopback device and keeps all
+ * of them busy at once, then reports aggregate throughput and the spread of
+ * per-flow throughput.  It is meant to be run with a flow-aware qdisc (such
+ * as "fq") installed on the egress device, e.g.
+ *
+ *	tc qdisc replace dev lo root fq
+ *	./fq_flows -n 5000 -t 10
+ *
+ * A scheduler that is fair between flows shows a small max/min ratio; one
+ * that is not lets a few flows take most of the bandwidth.  With -r, the
+ * program exits with status 2 if any flow starved or the max/min ratio of
+ * per-flow throughput exceeds the given limit.
+ *
+ * Usage: fq_flows [-n flows] [-t seconds] [-p port] [-s write_size]
+ *		   [-r max_ratio]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_FLOWS	1000
+#define DEFAULT_SECS	5
+#define DEFAULT_PORT	45123
+#define DEFAULT_WSIZE	16384
+
+struct flow {
+	int		sfd;	/* sending side */
+	int		rfd;	/* receiving side */
+	unsigned long long bytes;
+};
+
+static char *buf;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void set_nonblock(int fd)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static void raise_nofile(int need)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl))
+		return;
+	if (rl.rlim_cur >= (rlim_t)need)
+		return;
+	rl.rlim_cur = need;
+	if (rl.rlim_max < rl.rlim_cur)
+		rl.rlim_max = rl.rlim_cur;
+	if (setrlimit(RLIMIT_NOFILE, &rl))
+		perror("setrlimit");
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+	int nflows = DEFAULT_FLOWS, secs = DEFAULT_SECS;
+	int port = DEFAULT_PORT, wsize = DEFAULT_WSIZE;
+	struct sockaddr_in addr;
+	struct epoll_event ev, *events;
+	unsigned long long total = 0, *sorted;
+	struct flow *flows;
+	double start, end, ratio, max_ratio = 0;
+	int lfd, efd, i, c, one = 1, ret = 0;
+
+	while ((c = getopt(argc, argv, "n:t:p:s:r:")) != -1) {
+		switch (c) {
+		case 'n':
+			nflows = atoi(optarg);
+			break;
+		case 't':
+			secs = atoi(optarg);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 's':
+			wsize = atoi(optarg);
+			break;
+		case 'r':
+			max_ratio = atof(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n flows] [-t seconds] "
+				"[-p port] [-s write_size] [-r max_ratio]\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+	if (nflows <= 0 || secs <= 0 || wsize <= 0 || max_ratio < 0) {
+		fprintf(stderr, "invalid arguments\n");
+		exit(1);
+	}
+
+	raise_nofile(2 * nflows + 16);
+
+	buf = malloc(wsize);
+	flows = calloc(nflows, sizeof(*flows));
+	events = calloc(2 * nflows, sizeof(*events));
+	sorted = calloc(nflows, sizeof(*sorted));
+	if (!buf || !flows || !events || !sorted) {
+		perror("malloc");
+		exit(1);
+	}
+	memset(buf, 0x5a, wsize);
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0) {
+		perror("socket");
+		exit(1);
+	}
+	setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(lfd, 1024)) {
+		perror("bind/listen");
+		exit(1);
+	}
+
+	efd = epoll_create(2 * nflows);
+	if (efd < 0) {
+		perror("epoll_create");
+		exit(1);
+	}
+
+	for (i = 0; i < nflows; i++) {
+		struct flow *f = &flows[i];
+
+		f->sfd = socket(AF_INET, SOCK_STREAM, 0);
+		if (f->sfd < 0 ||
+		    connect(f->sfd, (struct sockaddr *)&addr, sizeof(addr))) {
+			perror("connect");
+			exit(1);
+		}
+		f->rfd = accept(lfd, NULL, NULL);
+		if (f->rfd < 0) {
+			perror("accept");
+			exit(1);
+		}
+		set_nonblock(f->sfd);
+		set_nonblock(f->rfd);
+
+		/* even index: sender of flow i/2, odd index: receiver */
+		ev.events = EPOLLOUT;
+		ev.data.u32 = 2 * i;
+		epoll_ctl(efd, EPOLL_CTL_ADD, f->sfd, &ev);
+		ev.events = EPOLLIN;
+		ev.data.u32 = 2 * i + 1;
+		epoll_ctl(efd, EPOLL_CTL_ADD, f->rfd, &ev);
+	}
+
+	start = now();
+	end = start + secs;
+	while (now() < end) {
+		int n = epoll_wait(efd, events, 2 * nflows, 100);
+
+		for (i = 0; i < n; i++) {
+			unsigned int idx = events[i].data.u32;
+			struct flow *f = &flows[idx / 2];
+			ssize_t ret;
+
+			if (idx & 1) {
+				while ((ret = read(f->rfd, buf, wsize)) > 0)
+					f->bytes += ret;
+			} else {
+				ret = write(f->sfd, buf, wsize);
+				if (ret < 0 && errno != EAGAIN) {
+					perror("write");
+					exit(1);
+				}
+			}
+		}
+	}
+	end = now();
+
+	for (i = 0; i < nflows; i++) {
+		total += flows[i].bytes;
+		sorted[i] = flows[i].bytes;
+		close(flows[i].sfd);
+		close(flows[i].rfd);
+	}
+	close(lfd);
+	close(efd);
+
+	qsort(sorted, nflows, sizeof(*sorted), cmp_ull);
+
+	printf("flows: %d  duration: %.2f s\n", nflows, end - start);
+	printf("aggregate: %.2f Mbit/s\n", total * 8 / (end - start) / 1e6);
+	printf("per flow Mbit/s: min %.3f  median %.3f  max %.3f\n",
+	       sorted[0] * 8 / (end - start) / 1e6,
+	       sorted[nflows / 2] * 8 / (end - start) / 1e6,
+	       sorted[nflows - 1] * 8 / (end - start) / 1e6);
+	for (i = 0; i < nflows && !sorted[i]; i++)
+		;
+	if (i) {
+		printf("starved flows: %d\n", i);
+		if (max_ratio)
+			ret = 2;
+	} else {
+		ratio = (double)sorted[nflows - 1] / sorted[0];
+		printf("max/min ratio: %.2f\n", ratio);
+		if (max_ratio && ratio > max_ratio) {
+			printf("max/min ratio exceeds %.2f\n", max_ratio);
+			ret = 2;
+		}
+	}
+
+	free(sorted);
+	free(events);
+	free(flows);
+	free(buf);
+	return ret;
+}
@@ -0,0 +1,323 @@
+/*
+ * route_bench:
+ *
+ * Measures the cost of IPv4 FIB lookups against a large routing table.
+ * In a private network namespace it installs a number of random prefixes
+ * (by default 500000, roughly the size of a full Internet table) as
+ * blackhole routes, then sends UDP datagrams to random addresses covered
+ * by them.  Every send performs a full lookup in the FIB trie and fails
+ * without queueing anything, so the time per send is the lookup cost
+ * plus a fixed syscall overhead; run with -n 0 to see the latter.
+ *
+ * With -g the prefixes are unicast routes via an on-link gateway on the
+ * loopback device instead, and every send builds a real output route and
+ * transmits the datagram, which lo then drops as not for this host.  This
+ * is the path the per-nexthop output route cache serves; the time per
+ * send includes the transmit.
+ *
+ * Must be run as root.
+ *
+ * Usage: route_bench [-g] [-n prefixes] [-l lookups] [-s seed]
+ */
+
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#define DEFAULT_PREFIXES	500000
+#define DEFAULT_LOOKUPS		2000000
+#define NR_DADDRS		(1 << 20)
+#define BATCH_BYTES		(64 * 1024)
+#define GATEWAY			"192.0.2.1"	/* TEST-NET-1 */
+
+struct prefix {
+	unsigned int	addr;	/* host order */
+	unsigned char	len;
+};
+
+struct route_req {
+	struct nlmsghdr	nh;
+	struct rtmsg	rt;
+	struct rtattr	rta;
+	unsigned int	dst;
+	/* only sent with -g */
+	struct rtattr	gw_rta;
+	unsigned int	gw;
+	struct rtattr	oif_rta;
+	int		oif;
+};
+
+static int gateway_mode;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Roughly the prefix length mix of a global routing table. */
+static unsigned char random_plen(void)
+{
+	int r = rand() % 100;
+
+	if (r < 58)
+		return 24;
+	if (r < 66)
+		return 23;
+	if (r < 76)
+		return 22;
+	if (r < 84)
+		return 21;
+	if (r < 90)
+		return 20;
+	return 16 + rand() % 4;
+}
+
+static unsigned int random_addr(void)
+{
+	/* unicast space, 1.0.0.0 - 223.255.255.255 */
+	unsigned int a = ((unsigned int)rand() << 16) ^ (unsigned int)rand();
+
+	return (1 + a % 223) << 24 | (a & 0xffffff);
+}
+
+static int drain_errors(int fd)
+{
+	char buf[8192];
+	int errors = 0;
+	int len;
+
+	while ((len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+		struct nlmsghdr *nh = (struct nlmsghdr *)buf;
+
+		for (; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+			struct nlmsgerr *e = NLMSG_DATA(nh);
+
+			if (nh->nlmsg_type == NLMSG_ERROR && e->error)
+				errors++;
+		}
+	}
+	return errors;
+}
+
+static int install_routes(const struct prefix *p, int n)
+{
+	static char batch[BATCH_BYTES];
+	struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+	size_t used = 0;
+	int errors = 0;
+	int fd, i;
+
+	fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (fd < 0) {
+		perror("socket(NETLINK_ROUTE)");
+		return -1;
+	}
+
+	for (i = 0; i <= n; i++) {
+		struct route_req *req;
+
+		if (i == n || used + sizeof(*req) > sizeof(batch)) {
+			if (used && sendto(fd, batch, used, 0,
+					   (struct sockaddr *)&sa,
+					   sizeof(sa)) < 0) {
+				perror("sendto(NETLINK_ROUTE)");
+				close(fd);
+				return -1;
+			}
+			used = 0;
+			errors += drain_errors(fd);
+			if (i == n)
+				break;
+		}
+
+		req = (struct route_req *)(batch + used);
+		memset(req, 0, sizeof(*req));
+		req->nh.nlmsg_len = gateway_mode ? sizeof(*req) :
+				    offsetof(struct route_req, gw_rta);
+		req->nh.nlmsg_type = RTM_NEWROUTE;
+		req->nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_CREATE |
+				      NLM_F_REPLACE;
+		req->nh.nlmsg_seq = i;
+		req->rt.rtm_family = AF_INET;
+		req->rt.rtm_dst_len = p[i].len;
+		req->rt.rtm_table = RT_TABLE_MAIN;
+		req->rt.rtm_protocol = RTPROT_STATIC;
+		req->rt.rtm_scope = RT_SCOPE_UNIVERSE;
+		req->rt.rtm_type = RTN_BLACKHOLE;
+		req->rta.rta_type = RTA_DST;
+		req->rta.rta_len = RTA_LENGTH(sizeof(req->dst));
+		req->dst = htonl(p[i].addr);
+		if (gateway_mode) {
+			req->rt.rtm_type = RTN_UNICAST;
+			req->rt.rtm_flags = RTNH_F_ONLINK;
+			req->gw_rta.rta_type = RTA_GATEWAY;
+			req->gw_rta.rta_len = RTA_LENGTH(sizeof(req->gw));
+			req->gw = inet_addr(GATEWAY);
+			req->oif_rta.rta_type = RTA_OIF;
+			req->oif_rta.rta_len = RTA_LENGTH(sizeof(req->oif));
+			req->oif = if_nametoindex("lo");
+		}
+		used += NLMSG_ALIGN(req->nh.nlmsg_len);
+	}
+
+	/* give the last replies a moment to arrive */
+	usleep(100000);
+	errors += drain_errors(fd);
+	close(fd);
+	return errors;
+}
+
+static int loopback_up(void)
+{
+	struct ifreq ifr;
+	int fd, ret;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+	memset(&ifr, 0, sizeof(ifr));
+	strcpy(ifr.ifr_name, "lo");
+	ret = ioctl(fd, SIOCGIFFLAGS, &ifr);
+	if (!ret) {
+		ifr.ifr_flags |= IFF_UP;
+		ret = ioctl(fd, SIOCSIFFLAGS, &ifr);
+	}
+	close(fd);
+	return ret;
+}
+
+static void show_triestat(void)
+{
+	char line[256];
+	FILE *f;
+
+	f = fopen("/proc/net/fib_triestat", "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f))
+		if (strstr(line, "depth") || strstr(line, "Leaves") ||
+		    strstr(line, "Prefixes") || strstr(line, "Internal") ||
+		    strstr(line, "Main:"))
+			fputs(line, stdout);
+	fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	int nprefixes = DEFAULT_PREFIXES;
+	long lookups = DEFAULT_LOOKUPS;
+	unsigned int seed = 1;
+	struct sockaddr_in sin = { .sin_family = AF_INET, .sin_port = htons(9) };
+	struct prefix *p;
+	unsigned int *daddrs;
+	double start, elapsed;
+	long i, unexpected = 0;
+	int fd, opt, err;
+
+	while ((opt = getopt(argc, argv, "gn:l:s:")) != -1) {
+		switch (opt) {
+		case 'g':
+			gateway_mode = 1;
+			break;
+		case 'n':
+			nprefixes = atoi(optarg);
+			break;
+		case 'l':
+			lookups = atol(optarg);
+			break;
+		case 's':
+			seed = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-g] [-n prefixes] [-l lookups] [-s seed]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (nprefixes < 0 || lookups <= 0)
+		return 1;
+
+	if (unshare(CLONE_NEWNET)) {
+		perror("unshare(CLONE_NEWNET)");
+		return 1;
+	}
+	if (gateway_mode && loopback_up()) {
+		perror("bringing up lo");
+		return 1;
+	}
+
+	srand(seed);
+	p = calloc(nprefixes ? nprefixes : 1, sizeof(*p));
+	daddrs = calloc(NR_DADDRS, sizeof(*daddrs));
+	if (!p || !daddrs) {
+		perror("calloc");
+		return 1;
+	}
+
+	for (i = 0; i < nprefixes; i++) {
+		p[i].len = random_plen();
+		p[i].addr = random_addr() & (~0U << (32 - p[i].len));
+	}
+
+	start = now();
+	err = install_routes(p, nprefixes);
+	if (err < 0)
+		return 1;
+	printf("installed %d prefixes in %.2fs (%d errors)\n",
+	       nprefixes, now() - start, err);
+	show_triestat();
+
+	for (i = 0; i < NR_DADDRS; i++) {
+		if (nprefixes) {
+			const struct prefix *q = &p[rand() % nprefixes];
+			unsigned int host = random_addr();
+
+			daddrs[i] = htonl(q->addr |
+					  (host & ~(~0U << (32 - q->len))));
+		} else
+			daddrs[i] = htonl(random_addr());
+	}
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket(AF_INET)");
+		return 1;
+	}
+
+	start = now();
+	for (i = 0; i < lookups; i++) {
+		sin.sin_addr.s_addr = daddrs[i & (NR_DADDRS - 1)];
+		if ((sendto(fd, "", 0, 0, (struct sockaddr *)&sin,
+			    sizeof(sin)) == 0) != gateway_mode)
+			unexpected++;
+	}
+	elapsed = now() - start;
+
+	printf("%ld lookups in %.3fs: %.1f ns/lookup, %.2f Mlookups/s\n",
+	       lookups, elapsed, elapsed * 1e9 / lookups,
+	       lookups / elapsed / 1e6);
+	if (unexpected)
+		printf("%ld sends unexpectedly %s\n", unexpected,
+		       gateway_mode ? "failed" : "succeeded");
+
+	close(fd);
+	free(daddrs);
+	free(p);
+	return 0;
+}